@@ -0,0 +1,209 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "BenchmarkHarness.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace SurgeBox
+{
+
+namespace
+{
+
+// Repeats of a quick benchmark stop here however fast it is
+constexpr int MAX_REPEATS = 50;
+
+// Flagged when growth exceeds what was expected by this much
+constexpr double SUPERLINEAR_MARGIN = 0.5;
+
+struct Result
+{
+    int size{0};
+    int repeats{0};
+    BenchmarkRun best;
+
+    double nsPerOp() const { return best.ops > 0 ? best.seconds * 1e9 / best.ops : 0.0; }
+};
+
+// Least-squares slope of log(ns/op) against log(size)
+double fitGrowth(const std::vector<Result> &results)
+{
+    double n = 0.0, sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+    for (const auto &result : results)
+    {
+        if (result.size <= 0 || result.nsPerOp() <= 0.0)
+            continue;
+        double x = std::log(static_cast<double>(result.size));
+        double y = std::log(result.nsPerOp());
+        n += 1.0;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    double denominator = n * sxx - sx * sx;
+    return n >= 2.0 && denominator > 0.0 ? (n * sxy - sx * sy) / denominator : 0.0;
+}
+
+std::vector<int> parseSizes(const std::string &text)
+{
+    std::vector<int> sizes;
+    for (const auto &token : juce::StringArray::fromTokens(juce::String(text), ",", ""))
+    {
+        if (token.getIntValue() > 0)
+            sizes.push_back(token.getIntValue());
+    }
+    return sizes;
+}
+
+int usage(const char *tool)
+{
+    std::fprintf(stderr,
+                 "usage: %s [--sizes <n,n,...>] [--filter <name>] [--min-time <seconds>] "
+                 "[--repeats <n>] [-o <results.json>]\n",
+                 tool);
+    return 2;
+}
+
+} // namespace
+
+bool parseBenchmarkArgs(int argc, char **argv, const char *tool, BenchmarkOptions &options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage(tool);
+            return false;
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--sizes")
+            options.sizes = parseSizes(value);
+        else if (arg == "--filter")
+            options.filter = value;
+        else if (arg == "--min-time")
+            options.minSeconds = std::atof(value.c_str());
+        else if (arg == "--repeats")
+            options.minRepeats = std::atoi(value.c_str());
+        else if (arg == "-o")
+            options.output = juce::File::getCurrentWorkingDirectory().getChildFile(value);
+        else
+        {
+            usage(tool);
+            return false;
+        }
+    }
+
+    if (options.sizes.empty() || options.minRepeats < 1)
+    {
+        usage(tool);
+        return false;
+    }
+    return true;
+}
+
+int runBenchmarks(const char *suite, const std::vector<Benchmark> &benchmarks,
+                  const BenchmarkOptions &options)
+{
+    juce::Array<juce::var> list;
+    int flagged = 0;
+
+    for (const auto &benchmark : benchmarks)
+    {
+        if (!options.filter.empty() && benchmark.name.find(options.filter) == std::string::npos)
+            continue;
+
+        std::fprintf(stderr, "%s\n", benchmark.name.c_str());
+        std::vector<Result> results;
+        for (int size : benchmark.sizes.empty() ? options.sizes : benchmark.sizes)
+        {
+            Result result;
+            result.size = size;
+            double total = 0.0;
+            while (result.repeats < MAX_REPEATS &&
+                   (result.repeats < options.minRepeats || total < options.minSeconds))
+            {
+                auto run = benchmark.run(size);
+                total += run.seconds;
+                if (result.repeats++ == 0 || run.seconds < result.best.seconds)
+                    result.best = std::move(run);
+            }
+            results.push_back(result);
+
+            std::fprintf(stderr, "  %10d %-8s %14.1f ns/op %10.3f ms\n", size,
+                         benchmark.sizeName.c_str(), result.nsPerOp(),
+                         result.best.seconds * 1000.0);
+        }
+
+        double growth = fitGrowth(results);
+        bool superlinear = growth > benchmark.expectedGrowth + SUPERLINEAR_MARGIN;
+        flagged += superlinear ? 1 : 0;
+        std::fprintf(stderr, "  growth %.2f (expected %.2f)%s\n", growth,
+                     benchmark.expectedGrowth, superlinear ? "  SUPERLINEAR" : "");
+
+        juce::Array<juce::var> points;
+        for (const auto &result : results)
+        {
+            auto *point = new juce::DynamicObject();
+            point->setProperty("size", result.size);
+            point->setProperty("ops", result.best.ops);
+            point->setProperty("repeats", result.repeats);
+            point->setProperty("seconds", result.best.seconds);
+            point->setProperty("nsPerOp", result.nsPerOp());
+            if (result.best.bytes > 0 && result.best.seconds > 0.0)
+            {
+                point->setProperty("bytes", result.best.bytes);
+                point->setProperty("mbPerSecond", static_cast<double>(result.best.bytes) /
+                                                      (1024.0 * 1024.0) / result.best.seconds);
+            }
+            for (const auto &[name, value] : result.best.metrics)
+                point->setProperty(juce::Identifier(juce::String(name)), value);
+            points.add(juce::var(point));
+        }
+
+        auto *entry = new juce::DynamicObject();
+        entry->setProperty("name", juce::String(benchmark.name));
+        entry->setProperty("description", juce::String(benchmark.description));
+        entry->setProperty("sizeName", juce::String(benchmark.sizeName));
+        entry->setProperty("expectedGrowth", benchmark.expectedGrowth);
+        entry->setProperty("growth", growth);
+        entry->setProperty("superlinear", superlinear);
+        entry->setProperty("results", points);
+        list.add(juce::var(entry));
+    }
+
+    auto *root = new juce::DynamicObject();
+    root->setProperty("suite", juce::String(suite));
+    root->setProperty("version", 1);
+    root->setProperty("time", juce::Time::getCurrentTime().toISO8601(true));
+    root->setProperty("system", juce::SystemStats::getOperatingSystemName() + ", " +
+                                    juce::SystemStats::getCpuModel());
+    root->setProperty("superlinear", flagged);
+    root->setProperty("benchmarks", list);
+
+    auto json = juce::JSON::toString(juce::var(root));
+    if (options.output == juce::File())
+    {
+        std::printf("%s\n", json.toRawUTF8());
+        return 0;
+    }
+    if (!options.output.replaceWithText(json))
+    {
+        std::fprintf(stderr, "%s: can't write %s\n", suite,
+                     options.output.getFullPathName().toRawUTF8());
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace SurgeBox
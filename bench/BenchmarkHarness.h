@@ -0,0 +1,79 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SurgeBox
+{
+
+// One timed run of a benchmark at one size. The run does its own setup and
+// times only the work being measured.
+struct BenchmarkRun
+{
+    int ops{0};
+    double seconds{0.0};
+    juce::int64 bytes{0}; // Data processed, for throughput; 0 - none
+    std::vector<std::pair<std::string, double>> metrics;
+};
+
+struct Benchmark
+{
+    std::string name;
+    std::string description;
+    std::string sizeName{"notes"};
+    std::vector<int> sizes; // Empty - the suite's sizes
+
+    // How ns/op is expected to grow with size, as the slope of log(ns/op)
+    // against log(size): 0 for O(1) or O(log n) per op, 1 for O(n) per op
+    double expectedGrowth{0.0};
+
+    std::function<BenchmarkRun(int size)> run;
+};
+
+struct BenchmarkOptions
+{
+    std::vector<int> sizes{100, 1000, 10000, 100000};
+    std::string filter;  // Only benchmarks whose name contains this
+    juce::File output;   // JSON; default stdout
+    double minSeconds{0.2};
+    int minRepeats{3};
+};
+
+// Returns false after printing usage if the arguments don't parse
+bool parseBenchmarkArgs(int argc, char **argv, const char *tool, BenchmarkOptions &options);
+
+/**
+ * Runs each benchmark at each size, keeping the fastest of at least
+ * minRepeats runs (more for quick ones, up to minSeconds), prints a table to
+ * stderr and writes the results as JSON.
+ *
+ * Each benchmark's growth is fitted over its sizes. One that grows half an
+ * order or more faster than expected is flagged "superlinear" - an O(n) step
+ * hiding in a per-note path shows up as growth near 1 where 0 was expected.
+ * Returns the process exit code.
+ */
+int runBenchmarks(const char *suite, const std::vector<Benchmark> &benchmarks,
+                  const BenchmarkOptions &options);
+
+// Seconds taken by work
+template <typename Work> double timeSeconds(Work &&work)
+{
+    auto start = std::chrono::steady_clock::now();
+    work();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace SurgeBox
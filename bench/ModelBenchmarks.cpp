@@ -0,0 +1,461 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+// surgebox-bench-model - times pattern editing, undo and project I/O against
+// note count, and writes the scaling curves as JSON.
+//
+//   surgebox-bench-model [--sizes 100,1000,10000,100000] [--filter <name>] [-o <file>]
+
+#include "BenchmarkHarness.h"
+#include "GrooveboxProject.h"
+#include "PatternModel.h"
+#include "tinyxml/tinyxml.h"
+#include "sst/basic-blocks/mechanics/endian-ops.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+
+using namespace SurgeBox;
+
+namespace mech = sst::basic_blocks::mechanics;
+
+namespace
+{
+
+// Patterns this long hold 100k notes without most of them overlapping
+constexpr int BENCH_BARS = 64;
+
+// Single-note edits per run; their cost per op shouldn't depend on it
+constexpr int EDITS_PER_RUN = 1000;
+
+// Keep every step - trimming history isn't what's being measured
+constexpr int UNLIMITED_UNDO = std::numeric_limits<int>::max();
+
+std::vector<MIDINote> randomNotes(int count, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> step(0, BENCH_BARS * 16 - 1);
+    std::uniform_int_distribution<int> length(1, 8);
+    std::uniform_int_distribution<int> pitch(36, 96);
+    std::uniform_int_distribution<int> velocity(40, 127);
+
+    std::vector<MIDINote> notes;
+    notes.reserve(static_cast<size_t>(count));
+    for (int i = 0; i < count; ++i)
+        notes.emplace_back(step(rng) * 0.25, length(rng) * 0.25,
+                           static_cast<uint8_t>(pitch(rng)), static_cast<uint8_t>(velocity(rng)));
+    return notes;
+}
+
+void loadNotes(PatternModel &model, std::vector<MIDINote> notes)
+{
+    Pattern pattern;
+    pattern.bars = BENCH_BARS;
+    pattern.notes = std::move(notes);
+    model.loadFromPattern(pattern);
+}
+
+// Every note with its pitch changed by semitones
+std::vector<PatternModel::NoteEdit> transposed(const PatternModel &model, int semitones)
+{
+    std::vector<PatternModel::NoteEdit> edits(static_cast<size_t>(model.getNumNotes()));
+    for (int i = 0; i < model.getNumNotes(); ++i)
+    {
+        auto &edit = edits[static_cast<size_t>(i)];
+        edit.id = model.getNoteId(i);
+        model.getNoteAt(i, edit.startBeat, edit.duration, edit.pitch, edit.velocity);
+        edit.pitch = std::clamp(edit.pitch + semitones, 0, 127);
+    }
+    return edits;
+}
+
+// A project holding count notes, split over each voice's first slot so the
+// version 1 image holds them all
+void fillProject(GrooveboxProject &project, int count)
+{
+    project.reset();
+    auto notes = randomNotes(count, 7);
+    for (int v = 0; v < NUM_VOICES; ++v)
+    {
+        auto &pattern = project.voices[static_cast<size_t>(v)].patterns[0];
+        pattern.bars = BENCH_BARS;
+        for (size_t i = static_cast<size_t>(v); i < notes.size(); i += NUM_VOICES)
+            pattern.notes.push_back(notes[i]);
+        pattern.sortNotes();
+    }
+}
+
+// The same project as version 1 wrote it: one pattern per voice without a
+// slot, notes without IDs, no song, pattern slots or MIDI effects
+std::string toVersion1(const std::string &image)
+{
+    ProjectHeader header;
+    std::memcpy(&header, image.data(), sizeof(header));
+
+    TiXmlDocument doc;
+    doc.Parse(image.c_str() + sizeof(header));
+    TiXmlElement *root = doc.RootElement();
+    root->SetAttribute("version", 1);
+    if (TiXmlElement *song = root->FirstChildElement("song"))
+        root->RemoveChild(song);
+
+    for (TiXmlElement *voice = root->FirstChildElement("voice"); voice;
+         voice = voice->NextSiblingElement("voice"))
+    {
+        voice->RemoveAttribute("active_slot");
+        std::vector<TiXmlElement *> stale;
+        for (TiXmlElement *child = voice->FirstChildElement(); child;
+             child = child->NextSiblingElement())
+        {
+            int slot = 0;
+            std::string type = child->Value();
+            if (type == "midi_fx" ||
+                (type == "pattern" && child->QueryIntAttribute("slot", &slot) == TIXML_SUCCESS &&
+                 slot != 0))
+                stale.push_back(child);
+        }
+        for (TiXmlElement *child : stale)
+            voice->RemoveChild(child);
+
+        if (TiXmlElement *pattern = voice->FirstChildElement("pattern"))
+        {
+            pattern->RemoveAttribute("slot");
+            for (TiXmlElement *note = pattern->FirstChildElement("note"); note;
+                 note = note->NextSiblingElement("note"))
+                note->RemoveAttribute("id");
+        }
+    }
+
+    TiXmlPrinter printer;
+    printer.SetIndent("  ");
+    doc.Accept(&printer);
+    std::string xml = printer.Str();
+
+    header.version = mech::endian_write_int32LE(1);
+    header.xmlsize = mech::endian_write_int32LE(static_cast<uint32_t>(xml.size()));
+    std::string result(reinterpret_cast<const char *>(&header), sizeof(header));
+    return result + xml;
+}
+
+fs::path pathOf(const juce::TemporaryFile &file)
+{
+    return fs::path(file.getFile().getFullPathName().toStdString());
+}
+
+// ============================================================================
+// PatternModel
+// ============================================================================
+
+BenchmarkRun addOneByOne(int size)
+{
+    juce::UndoManager undo(UNLIMITED_UNDO);
+    PatternModel model(&undo);
+    auto notes = randomNotes(size, 1);
+
+    BenchmarkRun run;
+    run.ops = size;
+    run.seconds = timeSeconds([&] {
+        for (const auto &note : notes)
+        {
+            model.beginTransaction("Add Note");
+            model.addNote(note.startBeat, note.duration, note.pitch, note.velocity);
+        }
+    });
+    return run;
+}
+
+BenchmarkRun addBatch(int size)
+{
+    juce::UndoManager undo(UNLIMITED_UNDO);
+    PatternModel model(&undo);
+    std::vector<PatternModel::NoteEdit> edits;
+    for (const auto &note : randomNotes(size, 1))
+        edits.push_back({0, note.startBeat, note.duration, note.pitch, note.velocity});
+
+    BenchmarkRun run;
+    run.ops = size;
+    run.seconds = timeSeconds([&] { model.addNotes("Record", edits); });
+    return run;
+}
+
+BenchmarkRun moveOneByOne(int size)
+{
+    juce::UndoManager undo(UNLIMITED_UNDO);
+    PatternModel model(&undo);
+    loadNotes(model, randomNotes(size, 1));
+
+    std::mt19937 rng(2);
+    std::uniform_int_distribution<int> index(0, size - 1);
+    std::uniform_int_distribution<int> step(0, BENCH_BARS * 16 - 1);
+    std::uniform_int_distribution<int> pitch(36, 96);
+
+    BenchmarkRun run;
+    run.ops = EDITS_PER_RUN;
+    run.seconds = timeSeconds([&] {
+        for (int i = 0; i < EDITS_PER_RUN; ++i)
+        {
+            model.beginTransaction("Move Note");
+            model.moveNote(index(rng), step(rng) * 0.25, pitch(rng));
+        }
+    });
+    return run;
+}
+
+BenchmarkRun removeOneByOne(int size)
+{
+    juce::UndoManager undo(UNLIMITED_UNDO);
+    PatternModel model(&undo);
+    loadNotes(model, randomNotes(size, 1));
+    int count = std::min(size / 2, EDITS_PER_RUN);
+    std::mt19937 rng(3);
+
+    BenchmarkRun run;
+    run.ops = count;
+    run.seconds = timeSeconds([&] {
+        for (int i = 0; i < count; ++i)
+        {
+            model.beginTransaction("Delete Note");
+            model.removeNote(static_cast<int>(rng() % static_cast<uint32_t>(size - i)));
+        }
+    });
+    return run;
+}
+
+BenchmarkRun removeBatch(int size)
+{
+    juce::UndoManager undo(UNLIMITED_UNDO);
+    PatternModel model(&undo);
+    loadNotes(model, randomNotes(size, 1));
+    std::vector<uint32_t> ids;
+    for (int i = 0; i < size; i += 2)
+        ids.push_back(model.getNoteId(i));
+
+    BenchmarkRun run;
+    run.ops = static_cast<int>(ids.size());
+    run.seconds = timeSeconds([&] {
+        model.beginTransaction("Delete Notes");
+        model.removeNotes(ids);
+    });
+    return run;
+}
+
+BenchmarkRun editBatch(int size)
+{
+    juce::UndoManager undo(UNLIMITED_UNDO);
+    PatternModel model(&undo);
+    loadNotes(model, randomNotes(size, 1));
+    auto edits = transposed(model, 1);
+
+    BenchmarkRun run;
+    run.ops = size;
+    run.seconds = timeSeconds([&] { model.applyNoteEdits("Transpose", edits, {}); });
+    return run;
+}
+
+BenchmarkRun sortUnordered(int size)
+{
+    PatternModel model;
+    Pattern pattern;
+    pattern.bars = BENCH_BARS;
+    pattern.notes = randomNotes(size, 1);
+
+    // loadFromPattern appends in the pattern's order, then sorts once
+    BenchmarkRun run;
+    run.ops = size;
+    run.seconds = timeSeconds([&] { model.loadFromPattern(pattern); });
+    return run;
+}
+
+BenchmarkRun sortOrdered(int size)
+{
+    PatternModel model;
+    loadNotes(model, randomNotes(size, 1));
+
+    BenchmarkRun run;
+    run.ops = size;
+    run.seconds = timeSeconds([&] { model.sortNotes(); });
+    return run;
+}
+
+BenchmarkRun findContaining(int size)
+{
+    PatternModel model;
+    loadNotes(model, randomNotes(size, 1));
+
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<double> beat(0.0, BENCH_BARS * 4.0);
+    std::uniform_int_distribution<int> pitch(36, 96);
+    std::vector<std::pair<double, int>> queries;
+    for (int i = 0; i < EDITS_PER_RUN; ++i)
+        queries.emplace_back(beat(rng), pitch(rng));
+
+    int found = 0;
+    BenchmarkRun run;
+    run.ops = EDITS_PER_RUN;
+    run.seconds = timeSeconds([&] {
+        for (const auto &[queryBeat, queryPitch] : queries)
+            found += model.findNoteContaining(queryBeat, queryPitch) >= 0 ? 1 : 0;
+    });
+    run.metrics.emplace_back("hits", found);
+    return run;
+}
+
+// ============================================================================
+// Undo
+// ============================================================================
+
+BenchmarkRun undoBatch(int size)
+{
+    juce::UndoManager undo(UNLIMITED_UNDO);
+    PatternModel model(&undo);
+    loadNotes(model, randomNotes(size, 1));
+    model.applyNoteEdits("Transpose", transposed(model, 1), {});
+
+    double undoSeconds = timeSeconds([&] { undo.undo(); });
+    double redoSeconds = timeSeconds([&] { undo.redo(); });
+
+    BenchmarkRun run;
+    run.ops = size;
+    run.seconds = undoSeconds + redoSeconds;
+    run.metrics.emplace_back("undoMs", undoSeconds * 1000.0);
+    run.metrics.emplace_back("redoMs", redoSeconds * 1000.0);
+    return run;
+}
+
+BenchmarkRun undoManySteps(int size)
+{
+    // One transaction of a ValueTree action per note - the path edits take
+    // when they don't go through a gesture or a bulk edit
+    juce::UndoManager undo(UNLIMITED_UNDO);
+    PatternModel model(&undo);
+    loadNotes(model, randomNotes(size, 1));
+    model.beginTransaction("Set Velocity");
+    for (int i = 0; i < size; ++i)
+        model.setNoteVelocity(i, 100);
+
+    double undoSeconds = timeSeconds([&] { undo.undo(); });
+    double redoSeconds = timeSeconds([&] { undo.redo(); });
+
+    BenchmarkRun run;
+    run.ops = size;
+    run.seconds = undoSeconds + redoSeconds;
+    run.metrics.emplace_back("undoMs", undoSeconds * 1000.0);
+    run.metrics.emplace_back("redoMs", redoSeconds * 1000.0);
+    return run;
+}
+
+// ============================================================================
+// Project I/O
+// ============================================================================
+
+BenchmarkRun saveProject(int size)
+{
+    GrooveboxProject project;
+    fillProject(project, size);
+    juce::TemporaryFile file(".sbox");
+
+    BenchmarkRun run;
+    run.ops = size;
+    run.seconds = timeSeconds([&] { project.saveToFile(pathOf(file)); });
+    run.bytes = file.getFile().getSize();
+    return run;
+}
+
+BenchmarkRun loadProject(int size, bool version1)
+{
+    GrooveboxProject project;
+    fillProject(project, size);
+    std::string image;
+    project.saveToMemory(image);
+    if (version1)
+        image = toVersion1(image);
+
+    juce::TemporaryFile file(".sbox");
+    file.getFile().replaceWithData(image.data(), image.size());
+
+    GrooveboxProject loaded;
+    bool ok = false;
+    BenchmarkRun run;
+    run.ops = size;
+    run.seconds = timeSeconds([&] { ok = loaded.loadFromFile(pathOf(file)); });
+    run.bytes = static_cast<juce::int64>(image.size());
+    run.metrics.emplace_back("loaded", ok ? 1.0 : 0.0);
+    return run;
+}
+
+BenchmarkRun stateRoundTrip(int size)
+{
+    // What the host's getStateInformation/setStateInformation do, less the
+    // Surge patches: the project through a temporary file each way, then the
+    // models reloaded from it
+    GrooveboxProject project;
+    fillProject(project, size);
+    std::vector<std::unique_ptr<PatternModel>> models;
+    for (int i = 0; i < NUM_VOICES * NUM_PATTERN_SLOTS; ++i)
+        models.push_back(std::make_unique<PatternModel>());
+
+    juce::MemoryBlock state;
+    BenchmarkRun run;
+    run.ops = size;
+    run.seconds = timeSeconds([&] {
+        juce::TemporaryFile saved(".sbox");
+        project.saveToFile(pathOf(saved));
+        saved.getFile().loadFileAsData(state);
+
+        juce::TemporaryFile restored(".sbox");
+        restored.getFile().replaceWithData(state.getData(), state.getSize());
+        project.loadFromFile(pathOf(restored));
+        for (int i = 0; i < NUM_VOICES * NUM_PATTERN_SLOTS; ++i)
+            models[static_cast<size_t>(i)]->loadFromPattern(project.getPattern(i));
+    });
+    run.bytes = static_cast<juce::int64>(state.getSize());
+    return run;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    BenchmarkOptions options;
+    if (!parseBenchmarkArgs(argc, argv, "surgebox-bench-model", options))
+        return 2;
+
+    const std::vector<Benchmark> benchmarks = {
+        {"model.add", "addNote per note, one undo step each", "notes", {}, 0.0, addOneByOne},
+        {"model.addBatch", "addNotes, one undo step", "notes", {}, 0.0, addBatch},
+        {"model.move", "moveNote on random notes, one undo step each", "notes", {}, 0.0,
+         moveOneByOne},
+        {"model.remove", "removeNote on random notes, one undo step each", "notes", {}, 0.0,
+         removeOneByOne},
+        {"model.removeBatch", "removeNotes on every other note", "notes", {}, 0.0, removeBatch},
+        {"model.editBatch", "applyNoteEdits transposing every note", "notes", {}, 0.0,
+         editBatch},
+        {"model.sort", "loadFromPattern from notes out of order", "notes", {}, 0.0,
+         sortUnordered},
+        {"model.sortSorted", "sortNotes on notes already in order", "notes", {}, 0.0,
+         sortOrdered},
+        {"model.findNoteContaining", "findNoteContaining at random beats and pitches", "notes",
+         {}, 1.0, findContaining},
+        {"undo.batch", "undo and redo of a transpose of every note", "notes", {}, 0.0,
+         undoBatch},
+        {"undo.manySteps", "undo and redo of a transaction of one action per note", "notes", {},
+         0.0, undoManySteps},
+        {"project.save", "saveToFile, current format", "notes", {}, 0.0, saveProject},
+        {"project.load", "loadFromFile, current format", "notes", {}, 0.0,
+         [](int size) { return loadProject(size, false); }},
+        {"project.loadV1", "loadFromFile, version 1 format", "notes", {}, 0.0,
+         [](int size) { return loadProject(size, true); }},
+        {"state.roundTrip", "project state out and back in, models reloaded", "notes", {}, 0.0,
+         stateRoundTrip},
+    };
+
+    return runBenchmarks("model", benchmarks, options);
+}
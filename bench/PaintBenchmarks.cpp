@@ -0,0 +1,225 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+// surgebox-bench-paint - paints the piano roll offscreen with the software
+// renderer and times each frame, so rendering work can be measured without a
+// display.
+//
+//   surgebox-bench-paint [--sizes 100,1000,10000,100000] [--filter <name>] [-o <file>]
+
+#include "BenchmarkHarness.h"
+#include "gui/widgets/PianoRollWidget.h"
+
+#include <juce_gui_basics/juce_gui_basics.h>
+
+#include <algorithm>
+#include <array>
+#include <random>
+
+using namespace SurgeBox;
+
+namespace
+{
+
+constexpr int BENCH_BARS = 64;
+constexpr int FRAMES_PER_RUN = 30;
+
+// The piano roll as the editor lays it out: 87 key columns of 18 pixels, the
+// keys and a margin above and below the pattern, seen through a viewport
+constexpr int ROLL_WIDTH = 87 * 18;
+constexpr int ROLL_MARGIN = 30 + 10;
+constexpr int ROLL_KEYS = 30;
+constexpr int VIEW_HEIGHT = 400;
+
+// The editor repaints at 30 Hz while playing; 120 BPM moves the playhead this
+// far between frames
+constexpr double PLAYHEAD_STEP = 2.0 / 30.0;
+
+struct Scene
+{
+    int notes{10000};
+    double pixelsPerBeat{60.0};
+    int selected{0};
+    double playhead{0.0};   // First frame's beat, the view following it; negative - stopped
+    bool noteEdit{false};   // Repaint one note's bounds per frame, as an edit does
+};
+
+void loadRandomNotes(PatternModel &model, int count)
+{
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> step(0, BENCH_BARS * 16 - 1);
+    std::uniform_int_distribution<int> length(1, 8);
+    std::uniform_int_distribution<int> pitch(36, 96);
+    std::uniform_int_distribution<int> velocity(40, 127);
+
+    Pattern pattern;
+    pattern.bars = BENCH_BARS;
+    for (int i = 0; i < count; ++i)
+        pattern.notes.emplace_back(step(rng) * 0.25, length(rng) * 0.25,
+                                   static_cast<uint8_t>(pitch(rng)),
+                                   static_cast<uint8_t>(velocity(rng)));
+    model.loadFromPattern(pattern);
+}
+
+// What repaintNotes asks for when a note changes: its rectangle in the roll,
+// widened a pixel
+juce::Rectangle<int> noteBounds(const PatternModel &model, int index, double pixelsPerBeat)
+{
+    double startBeat, duration;
+    int pitch, velocity;
+    model.getNoteAt(index, startBeat, duration, pitch, velocity);
+    int x = (pitch - 21) * 18 + 1;
+    int y = ROLL_KEYS + static_cast<int>(startBeat * pixelsPerBeat);
+    int h = std::max(6, static_cast<int>(duration * pixelsPerBeat));
+    return juce::Rectangle<int>(x, y, 16, h).expanded(1);
+}
+
+// Pixels the frame wrote - it starts fully transparent - and pixels that
+// differ from the frame before
+void countPixels(const juce::Image &frame, const juce::Image &previous, juce::int64 &touched,
+                 juce::int64 &changed)
+{
+    juce::Image::BitmapData current(frame, juce::Image::BitmapData::readOnly);
+    juce::Image::BitmapData before(previous, juce::Image::BitmapData::readOnly);
+    for (int y = 0; y < current.height; ++y)
+    {
+        auto *a = reinterpret_cast<const juce::PixelARGB *>(current.getLinePointer(y));
+        auto *b = reinterpret_cast<const juce::PixelARGB *>(before.getLinePointer(y));
+        for (int x = 0; x < current.width; ++x)
+        {
+            touched += a[x].getAlpha() != 0 ? 1 : 0;
+            changed += a[x].getNativeARGB() != b[x].getNativeARGB() ? 1 : 0;
+        }
+    }
+}
+
+BenchmarkRun paintScene(const Scene &scene)
+{
+    PatternModel model;
+    loadRandomNotes(model, scene.notes);
+
+    PianoRollWidget roll;
+    roll.setPatternModel(&model);
+    roll.setPixelsPerBeat(scene.pixelsPerBeat);
+    double pixelsPerBeat = roll.getPixelsPerBeat();
+    roll.setSize(ROLL_WIDTH, static_cast<int>(BENCH_BARS * 4 * pixelsPerBeat) + ROLL_MARGIN);
+
+    // Spread through the pattern rather than bunched at its start
+    std::vector<uint32_t> selection;
+    for (int i = 0; i < scene.selected && i < model.getNumNotes(); ++i)
+        selection.push_back(model.getNoteId(
+            static_cast<int>(static_cast<juce::int64>(i) * model.getNumNotes() / scene.selected)));
+    roll.selectNotes(selection);
+
+    // The playhead a third of the way down the view
+    int scroll = 0;
+    if (scene.playhead >= 0.0)
+        scroll = std::clamp(ROLL_KEYS + static_cast<int>(scene.playhead * pixelsPerBeat) -
+                                VIEW_HEIGHT / 3,
+                            0, std::max(0, roll.getHeight() - VIEW_HEIGHT));
+
+    // Edits land on notes in view
+    int notesInView = 0;
+    while (notesInView < model.getNumNotes() &&
+           noteBounds(model, notesInView, pixelsPerBeat).getY() < VIEW_HEIGHT)
+        ++notesInView;
+
+    // Two frames, painted alternately so each can be compared with the last
+    std::array<juce::Image, 2> frames;
+    for (auto &frame : frames)
+        frame = juce::Image(juce::Image::ARGB, ROLL_WIDTH, VIEW_HEIGHT, true,
+                            juce::SoftwareImageType());
+
+    BenchmarkRun run;
+    run.ops = FRAMES_PER_RUN;
+    juce::int64 clipped = 0, touched = 0, changed = 0;
+    for (int f = 0; f < FRAMES_PER_RUN; ++f)
+    {
+        auto &frame = frames[static_cast<size_t>(f % 2)];
+        frame.clear(frame.getBounds());
+
+        juce::Rectangle<int> clip(0, scroll, ROLL_WIDTH, VIEW_HEIGHT);
+        if (scene.noteEdit && notesInView > 0)
+            clip = clip.getIntersection(noteBounds(model, f % notesInView, pixelsPerBeat));
+        roll.setPlayheadOverride(scene.playhead >= 0.0 ? scene.playhead + f * PLAYHEAD_STEP
+                                                       : -1.0);
+
+        run.seconds += timeSeconds([&] {
+            juce::Graphics g(frame);
+            g.setOrigin({0, -scroll});
+            g.reduceClipRegion(clip);
+            roll.paintEntireComponent(g, true);
+        });
+
+        // The first frame has nothing before it to differ from
+        juce::int64 frameChanged = 0;
+        clipped += clip.getWidth() * clip.getHeight();
+        countPixels(frame, frames[static_cast<size_t>((f + 1) % 2)], touched, frameChanged);
+        changed += f > 0 ? frameChanged : 0;
+    }
+
+    run.metrics.emplace_back("pixelsPerFrame", static_cast<double>(clipped) / FRAMES_PER_RUN);
+    run.metrics.emplace_back("touchedPerFrame", static_cast<double>(touched) / FRAMES_PER_RUN);
+    run.metrics.emplace_back("changedPerFrame",
+                             static_cast<double>(changed) / (FRAMES_PER_RUN - 1));
+    return run;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    BenchmarkOptions options;
+    if (!parseBenchmarkArgs(argc, argv, "surgebox-bench-paint", options))
+        return 2;
+
+    // Components and fonts without a window or a display
+    juce::ScopedJuceInitialiser_GUI initialiser;
+
+    // Frames visit every note however few are in view, so expect growth of 1
+    // against note count until that changes
+    const std::vector<Benchmark> benchmarks = {
+        {"paint.notes", "playback frames of a pattern this size", "notes", {}, 1.0,
+         [](int size) {
+             Scene scene;
+             scene.notes = size;
+             return paintScene(scene);
+         }},
+        {"paint.noteEdit", "one edited note's bounds repainted per frame", "notes", {}, 1.0,
+         [](int size) {
+             Scene scene;
+             scene.notes = size;
+             scene.playhead = -1.0;
+             scene.noteEdit = true;
+             return paintScene(scene);
+         }},
+        {"paint.zoom", "playback frames of 10k notes at this zoom", "pixelsPerBeat",
+         {15, 30, 60, 120}, 0.0,
+         [](int size) {
+             Scene scene;
+             scene.pixelsPerBeat = size;
+             return paintScene(scene);
+         }},
+        {"paint.selection", "playback frames of 10k notes with this many selected", "selected",
+         {10, 100, 1000, 10000}, 0.0,
+         [](int size) {
+             Scene scene;
+             scene.selected = size;
+             return paintScene(scene);
+         }},
+        {"paint.playhead", "playback frames of 10k notes from this beat", "playheadBeat",
+         {1, 16, 64, 240}, 0.0,
+         [](int size) {
+             Scene scene;
+             scene.playhead = size;
+             return paintScene(scene);
+         }},
+    };
+
+    return runBenchmarks("paint", benchmarks, options);
+}
@@ -0,0 +1,1178 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "EditJournal.h"
+#include "PatternModel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace SurgeBox
+{
+
+// ============================================================================
+// Record encoding
+//
+// File:   "SBJL" | u32 version | u64 generation | record*
+// Record: u32 bodySize | body | u32 fnv1a(body)
+// Body:   u8 type | u8 target | payload
+// Pattern records target one voice/slot pattern (voice * NUM_PATTERN_SLOTS +
+// slot); all others target a voice.
+// All integers little-endian. A torn or corrupt tail stops replay there.
+// ============================================================================
+
+namespace
+{
+
+constexpr uint32_t JOURNAL_VERSION = 11;
+constexpr char JOURNAL_MAGIC[4] = {'S', 'B', 'J', 'L'};
+
+enum class RecordType : uint8_t
+{
+    NoteAdded = 1,   // u32 index, note
+    NoteRemoved,     // u32 index
+    NoteProperty,    // u32 index, u8 property, f64 value
+    NoteMoved,       // u32 oldIndex, u32 newIndex
+    PatternProperty, // u8 property, f64 value
+    PatternBase,     // u32 bars, f64 swing, u32 count, note*
+    Mixer,           // u8 field, f64 value
+    Global,          // u8 field, f64 value
+    PatchBlob,       // u32 size, bytes
+    NotesSorted,     // (none) - whole pattern re-sorted by start
+    ActiveSlot,      // u8 slot
+    Song,            // u8 songMode, u32 count, count * (u32 bars, u8 slot + 1 per voice)
+    AutomationLane,  // u32 size, target, u32 count, count * (f64 beat, f64 value)
+    NoteLock,        // u32 noteId, u32 size, target, f64 value (NaN - removed)
+    Groove,          // u32 size, name, f64 stepBeats, u32 count, count * (f64 timing, f64 velocity)
+    MidiEffects,     // MAX_MIDI_EFFECTS * midi effect
+    PatternBatch     // u32 count, count * (u8 type, payload) - one bulk edit's pattern records
+};
+
+// Midi effect payload: u8 type, f64 rate, f64 gate, u8 arpMode, u8 octaves,
+// u8 numIntervals, MAX_CHORD_INTERVALS * u8 interval (two's complement)
+
+bool isPatternRecord(RecordType type)
+{
+    return type <= RecordType::PatternBase || type == RecordType::NotesSorted ||
+           type == RecordType::AutomationLane || type == RecordType::NoteLock ||
+           type == RecordType::PatternBatch;
+}
+
+// Note payload: f64 start, f64 duration, u8 pitch, u8 velocity, u32 noteId, u32 trig
+enum NoteProperty : uint8_t
+{
+    PropStart,
+    PropDuration,
+    PropPitch,
+    PropVelocity,
+    PropTrig
+};
+
+enum PatternPropertyId : uint8_t
+{
+    PropBars,
+    PropSwing
+};
+
+void putU8(std::string &b, uint8_t v) { b.push_back(static_cast<char>(v)); }
+
+void putU32(std::string &b, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        b.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void putU64(std::string &b, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i)
+        b.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void putF64(std::string &b, double d)
+{
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    putU64(b, u);
+}
+
+uint32_t fnv1a32(const char *data, size_t size)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+    {
+        h ^= static_cast<uint8_t>(data[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Builds one framed record in place: reserve the size slot, write the body, seal
+class RecordBuilder
+{
+  public:
+    RecordBuilder(RecordType type, int voice)
+    {
+        putU32(bytes, 0);
+        putU8(bytes, static_cast<uint8_t>(type));
+        putU8(bytes, static_cast<uint8_t>(voice));
+    }
+
+    std::string &seal()
+    {
+        auto bodySize = static_cast<uint32_t>(bytes.size() - 4);
+        for (int i = 0; i < 4; ++i)
+            bytes[i] = static_cast<char>((bodySize >> (8 * i)) & 0xff);
+        putU32(bytes, fnv1a32(bytes.data() + 4, bodySize));
+        return bytes;
+    }
+
+    std::string bytes;
+};
+
+void putNote(std::string &b, const juce::ValueTree &note)
+{
+    putF64(b, note.getProperty(IDs::startBeat));
+    putF64(b, note.getProperty(IDs::duration));
+    putU8(b, static_cast<uint8_t>(static_cast<int>(note.getProperty(IDs::pitch))));
+    putU8(b, static_cast<uint8_t>(static_cast<int>(note.getProperty(IDs::velocity))));
+    putU32(b, static_cast<uint32_t>(static_cast<juce::int64>(note.getProperty(IDs::noteId))));
+    putU32(b, static_cast<uint32_t>(static_cast<juce::int64>(note.getProperty(IDs::trig, 0))));
+}
+
+class Reader
+{
+  public:
+    Reader(const char *data, size_t size) : p_(data), end_(data + size) {}
+
+    bool ok() const { return ok_; }
+    size_t remaining() const { return static_cast<size_t>(end_ - p_); }
+    const char *position() const { return p_; }
+
+    uint8_t u8()
+    {
+        if (!need(1))
+            return 0;
+        return static_cast<uint8_t>(*p_++);
+    }
+
+    uint32_t u32()
+    {
+        if (!need(4))
+            return 0;
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i)
+            v |= static_cast<uint32_t>(static_cast<uint8_t>(*p_++)) << (8 * i);
+        return v;
+    }
+
+    uint64_t u64()
+    {
+        if (!need(8))
+            return 0;
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i)
+            v |= static_cast<uint64_t>(static_cast<uint8_t>(*p_++)) << (8 * i);
+        return v;
+    }
+
+    double f64()
+    {
+        uint64_t u = u64();
+        double d;
+        memcpy(&d, &u, sizeof(d));
+        return d;
+    }
+
+    const char *bytes(size_t n)
+    {
+        if (!need(n))
+            return nullptr;
+        auto *start = p_;
+        p_ += n;
+        return start;
+    }
+
+  private:
+    bool need(size_t n)
+    {
+        if (!ok_ || remaining() < n)
+        {
+            ok_ = false;
+            return false;
+        }
+        return true;
+    }
+
+    const char *p_;
+    const char *end_;
+    bool ok_{true};
+};
+
+juce::ValueTree readNote(Reader &r)
+{
+    juce::ValueTree note(IDs::Note);
+    note.setProperty(IDs::startBeat, r.f64(), nullptr);
+    note.setProperty(IDs::duration, r.f64(), nullptr);
+    note.setProperty(IDs::pitch, static_cast<int>(r.u8()), nullptr);
+    note.setProperty(IDs::velocity, static_cast<int>(r.u8()), nullptr);
+    note.setProperty(IDs::noteId, static_cast<juce::int64>(r.u32()), nullptr);
+    if (uint32_t trig = r.u32())
+        note.setProperty(IDs::trig, static_cast<juce::int64>(trig), nullptr);
+    return note;
+}
+
+void syncToDisk(std::FILE *f)
+{
+    std::fflush(f);
+#if defined(_WIN32)
+    _commit(_fileno(f));
+#else
+    fsync(fileno(f));
+#endif
+}
+
+fs::path snapshotPath(const fs::path &dir, uint64_t gen)
+{
+    return dir / ("snapshot-" + std::to_string(gen) + ".sbox");
+}
+
+fs::path journalPath(const fs::path &dir, uint64_t gen)
+{
+    return dir / ("journal-" + std::to_string(gen) + ".log");
+}
+
+// Parse "<prefix><number><suffix>" filenames; returns false on mismatch
+bool parseGeneration(const std::string &name, const std::string &prefix,
+                     const std::string &suffix, uint64_t &gen)
+{
+    if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+        return false;
+
+    auto digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+    if (digits.empty() || !std::all_of(digits.begin(), digits.end(),
+                                         [](char c) { return c >= '0' && c <= '9'; }))
+        return false;
+
+    gen = std::stoull(digits);
+    return true;
+}
+
+// Highest generation with a complete snapshot on disk, 0 if none
+uint64_t latestSnapshotGeneration(const fs::path &dir)
+{
+    uint64_t latest = 0;
+    std::error_code ec;
+    if (!fs::is_directory(dir, ec))
+        return 0;
+
+    for (const auto &entry : fs::directory_iterator(dir, ec))
+    {
+        uint64_t gen;
+        if (parseGeneration(entry.path().filename().string(), "snapshot-", ".sbox", gen))
+            latest = std::max(latest, gen);
+    }
+    return latest;
+}
+
+juce::Identifier notePropertyId(uint8_t prop)
+{
+    switch (prop)
+    {
+        case PropStart:
+            return IDs::startBeat;
+        case PropDuration:
+            return IDs::duration;
+        case PropPitch:
+            return IDs::pitch;
+        case PropTrig:
+            return IDs::trig;
+        default:
+            return IDs::velocity;
+    }
+}
+
+// Applies one note or pattern-property edit, standalone or from a batch;
+// false if the type is not one of those
+bool replayPatternEdit(RecordType type, Reader &rec, PatternModel &model)
+{
+    auto &tree = model.getValueTree();
+    switch (type)
+    {
+        case RecordType::NoteAdded:
+        {
+            int index = static_cast<int>(rec.u32());
+            auto note = readNote(rec);
+            tree.addChild(note, std::min(index, tree.getNumChildren()), nullptr);
+            break;
+        }
+        case RecordType::NoteRemoved:
+        {
+            int index = static_cast<int>(rec.u32());
+            if (index < tree.getNumChildren())
+                tree.removeChild(index, nullptr);
+            break;
+        }
+        case RecordType::NoteProperty:
+        {
+            int index = static_cast<int>(rec.u32());
+            uint8_t prop = rec.u8();
+            double value = rec.f64();
+            if (index < tree.getNumChildren())
+            {
+                if (prop == PropPitch || prop == PropVelocity)
+                    tree.getChild(index).setProperty(notePropertyId(prop),
+                                                     static_cast<int>(value), nullptr);
+                else if (prop == PropTrig)
+                    tree.getChild(index).setProperty(IDs::trig, static_cast<juce::int64>(value),
+                                                     nullptr);
+                else
+                    tree.getChild(index).setProperty(notePropertyId(prop), value, nullptr);
+            }
+            break;
+        }
+        case RecordType::NoteMoved:
+        {
+            int oldIndex = static_cast<int>(rec.u32());
+            int newIndex = static_cast<int>(rec.u32());
+            if (oldIndex < tree.getNumChildren() && newIndex < tree.getNumChildren())
+                tree.moveChild(oldIndex, newIndex, nullptr);
+            break;
+        }
+        case RecordType::NotesSorted:
+            model.sortNotes();
+            break;
+        case RecordType::PatternProperty:
+        {
+            uint8_t prop = rec.u8();
+            double value = rec.f64();
+            if (prop == PropBars)
+                tree.setProperty(IDs::bars, static_cast<int>(value), nullptr);
+            else if (prop == PropSwing)
+                tree.setProperty(IDs::swing, value, nullptr);
+            break;
+        }
+        default:
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+// ============================================================================
+// PatternTap
+// ============================================================================
+
+void EditJournal::PatternTap::valueTreePropertyChanged(juce::ValueTree &tree,
+                                                       const juce::Identifier &property)
+{
+    std::string payload;
+    if (tree.hasType(IDs::Pattern))
+    {
+        if (property == IDs::bars)
+            putU8(payload, PropBars);
+        else if (property == IDs::swing)
+            putU8(payload, PropSwing);
+        else
+            return;
+        putF64(payload, tree.getProperty(property));
+        write(static_cast<uint8_t>(RecordType::PatternProperty), payload);
+    }
+    else if (tree.hasType(IDs::Note))
+    {
+        uint8_t prop;
+        if (property == IDs::startBeat)
+            prop = PropStart;
+        else if (property == IDs::duration)
+            prop = PropDuration;
+        else if (property == IDs::pitch)
+            prop = PropPitch;
+        else if (property == IDs::velocity)
+            prop = PropVelocity;
+        else if (property == IDs::trig)
+            prop = PropTrig;
+        else
+            return;
+
+        auto *model = owner_.models_[static_cast<size_t>(pattern_)];
+        auto id = static_cast<uint32_t>(static_cast<juce::int64>(tree.getProperty(IDs::noteId)));
+        int index = model ? model->indexOfNote(id) : tree.getParent().indexOf(tree);
+
+        putU32(payload, static_cast<uint32_t>(index));
+        putU8(payload, prop);
+        putF64(payload, tree.getProperty(property));
+        write(static_cast<uint8_t>(RecordType::NoteProperty), payload);
+    }
+}
+
+void EditJournal::PatternTap::valueTreeChildAdded(juce::ValueTree &parent, juce::ValueTree &child)
+{
+    if (!child.hasType(IDs::Note))
+        return;
+
+    auto *model = owner_.models_[static_cast<size_t>(pattern_)];
+    int index = model ? model->indexOfAddedNote(child) : parent.indexOf(child);
+
+    std::string payload;
+    putU32(payload, static_cast<uint32_t>(index));
+    putNote(payload, child);
+    write(static_cast<uint8_t>(RecordType::NoteAdded), payload);
+}
+
+void EditJournal::PatternTap::valueTreeChildRemoved(juce::ValueTree & /*parent*/,
+                                                    juce::ValueTree &child, int index)
+{
+    if (!child.hasType(IDs::Note))
+        return;
+
+    std::string payload;
+    putU32(payload, static_cast<uint32_t>(index));
+    write(static_cast<uint8_t>(RecordType::NoteRemoved), payload);
+}
+
+void EditJournal::PatternTap::valueTreeChildOrderChanged(juce::ValueTree & /*parent*/,
+                                                         int oldIndex, int newIndex)
+{
+    // ValueTree::sort reports a reorder of every child as (0, 0)
+    if (oldIndex == newIndex)
+    {
+        write(static_cast<uint8_t>(RecordType::NotesSorted), {});
+        return;
+    }
+
+    std::string payload;
+    putU32(payload, static_cast<uint32_t>(oldIndex));
+    putU32(payload, static_cast<uint32_t>(newIndex));
+    write(static_cast<uint8_t>(RecordType::NoteMoved), payload);
+}
+
+void EditJournal::PatternTap::write(uint8_t type, const std::string &payload)
+{
+    // A transform sets several properties on every note it touches; buffer
+    // them so the whole edit costs one record and one trip through the lock
+    auto *model = owner_.models_[static_cast<size_t>(pattern_)];
+    if (model && model->isInBatch())
+    {
+        putU8(batch_, type);
+        batch_ += payload;
+        ++batchCount_;
+        return;
+    }
+
+    RecordBuilder rec(static_cast<RecordType>(type), pattern_);
+    rec.bytes += payload;
+    owner_.append(rec.seal());
+}
+
+void EditJournal::PatternTap::flush()
+{
+    if (batchCount_ == 0)
+        return;
+
+    RecordBuilder rec(RecordType::PatternBatch, pattern_);
+    putU32(rec.bytes, batchCount_);
+    rec.bytes += batch_;
+    owner_.append(rec.seal());
+
+    batch_.clear();
+    batchCount_ = 0;
+}
+
+// ============================================================================
+// EditJournal
+// ============================================================================
+
+EditJournal::EditJournal() = default;
+
+EditJournal::~EditJournal() { close(false); }
+
+bool EditJournal::open(const fs::path &directory, std::string snapshot,
+                       std::array<PatternModel *, NUM_PATTERNS> models)
+{
+    if (isOpen())
+        return true;
+
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    if (!fs::is_directory(directory, ec))
+        return false;
+
+    directory_ = directory;
+
+    // Never reuse a generation number - a previous session may still be recoverable
+    generation_ = latestSnapshotGeneration(directory_);
+    for (const auto &entry : fs::directory_iterator(directory_, ec))
+    {
+        uint64_t gen;
+        if (parseGeneration(entry.path().filename().string(), "journal-", ".log", gen))
+            generation_ = std::max(generation_, gen);
+    }
+
+    attach(models);
+
+    stopRequested_ = false;
+    enqueueCompaction(std::move(snapshot));
+    writer_ = std::thread([this]() { writerLoop(); });
+    return true;
+}
+
+void EditJournal::close(bool discard)
+{
+    if (!isOpen())
+        return;
+
+    detach();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopRequested_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+
+    if (journalFile_)
+    {
+        std::fclose(journalFile_);
+        journalFile_ = nullptr;
+    }
+
+    if (discard)
+        removeGenerationsBefore(generation_ + 1);
+
+    journalBytes_.store(0);
+}
+
+void EditJournal::attach(std::array<PatternModel *, NUM_PATTERNS> models)
+{
+    models_ = models;
+    taps_.clear();
+    for (int p = 0; p < NUM_PATTERNS; ++p)
+    {
+        taps_.push_back(std::make_unique<PatternTap>(*this, p));
+        if (models_[p])
+        {
+            auto *tap = taps_[p].get();
+            models_[p]->getValueTree().addListener(tap);
+            models_[p]->onBatchEnded = [tap] { tap->flush(); };
+        }
+    }
+}
+
+void EditJournal::detach()
+{
+    for (int p = 0; p < NUM_PATTERNS && p < static_cast<int>(taps_.size()); ++p)
+    {
+        if (models_[p])
+        {
+            taps_[p]->flush();
+            models_[p]->getValueTree().removeListener(taps_[p].get());
+            models_[p]->onBatchEnded = nullptr;
+        }
+    }
+    taps_.clear();
+    models_ = {};
+}
+
+void EditJournal::recordMixer(int voice, MixerField field, float value)
+{
+    if (!isOpen())
+        return;
+
+    RecordBuilder rec(RecordType::Mixer, voice);
+    putU8(rec.bytes, static_cast<uint8_t>(field));
+    putF64(rec.bytes, value);
+    append(rec.seal());
+}
+
+void EditJournal::recordGlobal(GlobalField field, double value)
+{
+    if (!isOpen())
+        return;
+
+    RecordBuilder rec(RecordType::Global, 0);
+    putU8(rec.bytes, static_cast<uint8_t>(field));
+    putF64(rec.bytes, value);
+    append(rec.seal());
+}
+
+void EditJournal::recordActiveSlot(int voice, int slot)
+{
+    if (!isOpen())
+        return;
+
+    RecordBuilder rec(RecordType::ActiveSlot, voice);
+    putU8(rec.bytes, static_cast<uint8_t>(slot));
+    append(rec.seal());
+}
+
+void EditJournal::recordSong(const std::vector<SongSection> &song, bool songMode)
+{
+    if (!isOpen())
+        return;
+
+    // Arrangements are small - each change stores the whole song
+    RecordBuilder rec(RecordType::Song, 0);
+    putU8(rec.bytes, songMode ? 1 : 0);
+    putU32(rec.bytes, static_cast<uint32_t>(song.size()));
+    for (const auto &section : song)
+    {
+        putU32(rec.bytes, static_cast<uint32_t>(section.bars));
+        for (int slot : section.slots)
+            putU8(rec.bytes, static_cast<uint8_t>(slot + 1));
+    }
+    append(rec.seal());
+}
+
+void EditJournal::recordAutomationLane(int pattern, const std::string &target,
+                                       const AutomationLane &lane)
+{
+    if (!isOpen())
+        return;
+
+    // The whole lane - no points means it was removed
+    RecordBuilder rec(RecordType::AutomationLane, pattern);
+    putU32(rec.bytes, static_cast<uint32_t>(target.size()));
+    rec.bytes.append(target);
+    putU32(rec.bytes, static_cast<uint32_t>(lane.points.size()));
+    for (const auto &point : lane.points)
+    {
+        putF64(rec.bytes, point.beat);
+        putF64(rec.bytes, point.value);
+    }
+    append(rec.seal());
+}
+
+void EditJournal::recordNoteLock(int pattern, uint32_t noteId, const std::string &target,
+                                 float value)
+{
+    if (!isOpen())
+        return;
+
+    RecordBuilder rec(RecordType::NoteLock, pattern);
+    putU32(rec.bytes, noteId);
+    putU32(rec.bytes, static_cast<uint32_t>(target.size()));
+    rec.bytes.append(target);
+    putF64(rec.bytes, value);
+    append(rec.seal());
+}
+
+void EditJournal::recordGroove(const GrooveTemplate &groove)
+{
+    if (!isOpen())
+        return;
+
+    RecordBuilder rec(RecordType::Groove, 0);
+    putU32(rec.bytes, static_cast<uint32_t>(groove.name.size()));
+    rec.bytes.append(groove.name);
+    putF64(rec.bytes, groove.stepBeats);
+    putU32(rec.bytes, static_cast<uint32_t>(groove.steps.size()));
+    for (const auto &step : groove.steps)
+    {
+        putF64(rec.bytes, step.timing);
+        putF64(rec.bytes, step.velocity);
+    }
+    append(rec.seal());
+}
+
+void EditJournal::recordMidiEffects(int voice, const MidiEffectChainSettings &settings)
+{
+    if (!isOpen())
+        return;
+
+    RecordBuilder rec(RecordType::MidiEffects, voice);
+    for (const auto &effect : settings)
+    {
+        putU8(rec.bytes, static_cast<uint8_t>(effect.type));
+        putF64(rec.bytes, effect.rate);
+        putF64(rec.bytes, effect.gate);
+        putU8(rec.bytes, static_cast<uint8_t>(effect.arpMode));
+        putU8(rec.bytes, static_cast<uint8_t>(effect.octaves));
+        putU8(rec.bytes, static_cast<uint8_t>(effect.numIntervals));
+        for (int8_t interval : effect.intervals)
+            putU8(rec.bytes, static_cast<uint8_t>(interval));
+    }
+    append(rec.seal());
+}
+
+void EditJournal::recordPatch(int voice, const void *data, size_t size)
+{
+    if (!isOpen() || !data)
+        return;
+
+    RecordBuilder rec(RecordType::PatchBlob, voice);
+    putU32(rec.bytes, static_cast<uint32_t>(size));
+    rec.bytes.append(static_cast<const char *>(data), size);
+    append(rec.seal());
+}
+
+void EditJournal::append(const std::string &record)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.empty() || queue_.back().isCompaction)
+            queue_.emplace_back();
+        queue_.back().records += record;
+    }
+    journalBytes_.fetch_add(record.size());
+    // The writer wakes on its own schedule; batching is the point
+}
+
+void EditJournal::compact(std::string snapshot)
+{
+    if (!isOpen())
+        return;
+
+    enqueueCompaction(std::move(snapshot));
+}
+
+void EditJournal::enqueueCompaction(std::string snapshot)
+{
+    PendingItem item;
+    item.isCompaction = true;
+    item.generation = ++generation_;
+    item.records = encodePatternBases();
+    item.snapshot = std::move(snapshot);
+
+    journalBytes_.store(item.records.size());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(item));
+}
+
+std::string EditJournal::encodePatternBases() const
+{
+    // Patterns are stored again in tree order so replay indices line up with the
+    // editor, independent of the sort order used by the .sbox snapshot
+    std::string bytes;
+    for (int p = 0; p < NUM_PATTERNS; ++p)
+    {
+        if (!models_[p])
+            continue;
+
+        const auto &tree = models_[p]->getValueTree();
+        RecordBuilder rec(RecordType::PatternBase, p);
+        putU32(rec.bytes, static_cast<uint32_t>(models_[p]->getBars()));
+        putF64(rec.bytes, models_[p]->getSwing());
+        putU32(rec.bytes, static_cast<uint32_t>(tree.getNumChildren()));
+        for (int i = 0; i < tree.getNumChildren(); ++i)
+            putNote(rec.bytes, tree.getChild(i));
+        bytes += rec.seal();
+    }
+    return bytes;
+}
+
+void EditJournal::writerLoop()
+{
+    for (;;)
+    {
+        std::vector<PendingItem> batch;
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait_for(lock, std::chrono::milliseconds(fsyncIntervalMs),
+                           [this]() { return stopRequested_; });
+            batch.swap(queue_);
+            stopping = stopRequested_;
+        }
+
+        bool dirty = false;
+        for (const auto &item : batch)
+        {
+            if (item.isCompaction)
+            {
+                writeGeneration(item);
+            }
+            else if (journalFile_ && !item.records.empty())
+            {
+                std::fwrite(item.records.data(), 1, item.records.size(), journalFile_);
+                dirty = true;
+            }
+        }
+
+        // One fsync per batch, however many edits it holds
+        if (dirty)
+            syncToDisk(journalFile_);
+
+        if (stopping)
+            break;
+    }
+}
+
+bool EditJournal::writeGeneration(const PendingItem &item)
+{
+    // 1. New journal generation, starting with the pattern bases. It is made
+    // durable first: until the snapshot below is renamed into place, recovery
+    // ignores it, and records keep going to the current journal.
+    auto newJournalPath = journalPath(directory_, item.generation);
+    std::FILE *journal = std::fopen(newJournalPath.string().c_str(), "wb");
+    if (!journal)
+        return false;
+
+    std::string header(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    putU32(header, JOURNAL_VERSION);
+    putU64(header, item.generation);
+    bool written = std::fwrite(header.data(), 1, header.size(), journal) == header.size() &&
+                   std::fwrite(item.records.data(), 1, item.records.size(), journal) ==
+                       item.records.size();
+    syncToDisk(journal);
+
+    // 2. Snapshot: write to a temp name, make it durable, then rename into place.
+    // The rename is what switches recovery over to the new generation.
+    auto finalPath = snapshotPath(directory_, item.generation);
+    auto tempPath = finalPath;
+    tempPath.replace_extension(".tmp");
+
+    std::error_code ec;
+    if (written)
+    {
+        std::FILE *snap = std::fopen(tempPath.string().c_str(), "wb");
+        written = snap && std::fwrite(item.snapshot.data(), 1, item.snapshot.size(), snap) ==
+                              item.snapshot.size();
+        if (snap)
+        {
+            syncToDisk(snap);
+            std::fclose(snap);
+        }
+        if (written)
+            fs::rename(tempPath, finalPath, ec);
+    }
+
+    if (!written || ec)
+    {
+        // Stay on the current generation - its snapshot and journal still hold
+        // everything, and later records keep going to it
+        std::fclose(journal);
+        fs::remove(newJournalPath, ec);
+        fs::remove(tempPath, ec);
+        return false;
+    }
+
+    if (journalFile_)
+        std::fclose(journalFile_);
+    journalFile_ = journal;
+
+    // 3. Older generations are now superseded
+    removeGenerationsBefore(item.generation);
+    return true;
+}
+
+void EditJournal::removeGenerationsBefore(uint64_t generation)
+{
+    std::error_code ec;
+    std::vector<fs::path> stale;
+    for (const auto &entry : fs::directory_iterator(directory_, ec))
+    {
+        auto name = entry.path().filename().string();
+        uint64_t gen;
+        if ((parseGeneration(name, "snapshot-", ".sbox", gen) ||
+             parseGeneration(name, "snapshot-", ".tmp", gen) ||
+             parseGeneration(name, "journal-", ".log", gen)) &&
+            gen < generation)
+        {
+            stale.push_back(entry.path());
+        }
+    }
+
+    for (const auto &path : stale)
+        fs::remove(path, ec);
+}
+
+// ============================================================================
+// Recovery
+// ============================================================================
+
+bool EditJournal::hasRecoverableSession(const fs::path &directory)
+{
+    return latestSnapshotGeneration(directory) > 0;
+}
+
+bool EditJournal::recover(const fs::path &directory, GrooveboxProject &project)
+{
+    uint64_t gen = latestSnapshotGeneration(directory);
+    if (gen == 0)
+        return false;
+
+    if (!project.loadFromFile(snapshotPath(directory, gen)))
+        return false;
+
+    std::ifstream file(journalPath(directory, gen), std::ios::binary | std::ios::ate);
+    if (!file)
+        return true; // No journal - the snapshot alone is complete
+
+    auto size = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+    std::string data(size, '\0');
+    file.read(data.data(), static_cast<std::streamsize>(size));
+
+    Reader header(data.data(), data.size());
+    auto *magic = header.bytes(sizeof(JOURNAL_MAGIC));
+    // Record layouts change between versions - a journal from another version
+    // can't be replayed, so only its snapshot is recovered
+    if (!magic || memcmp(magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+        header.u32() != JOURNAL_VERSION || header.u64() != gen)
+        return true;
+
+    // Replay pattern deltas onto scratch models, seeded from the snapshot
+    std::array<std::unique_ptr<PatternModel>, NUM_PATTERNS> models;
+    for (int p = 0; p < NUM_PATTERNS; ++p)
+    {
+        models[p] = std::make_unique<PatternModel>();
+        models[p]->loadFromPattern(project.getPattern(p));
+    }
+
+    Reader r(header.position(), header.remaining());
+    while (r.remaining() > 0)
+    {
+        uint32_t bodySize = r.u32();
+        const char *body = r.bytes(bodySize);
+        uint32_t checksum = r.u32();
+        if (!r.ok() || bodySize < 2 || fnv1a32(body, bodySize) != checksum)
+            break; // Torn write at the tail - everything before it is good
+
+        Reader rec(body, bodySize);
+        auto type = static_cast<RecordType>(rec.u8());
+        int target = rec.u8();
+
+        bool patternRecord = isPatternRecord(type);
+        if (target >= (patternRecord ? NUM_PATTERNS : NUM_VOICES))
+            continue;
+
+        auto &model = *models[patternRecord ? target : 0];
+        auto &tree = model.getValueTree();
+        auto &voiceState = project.voices[patternRecord ? target / NUM_PATTERN_SLOTS : target];
+
+        switch (type)
+        {
+            case RecordType::NoteAdded:
+            case RecordType::NoteRemoved:
+            case RecordType::NoteProperty:
+            case RecordType::NoteMoved:
+            case RecordType::NotesSorted:
+            case RecordType::PatternProperty:
+                replayPatternEdit(type, rec, model);
+                break;
+            case RecordType::PatternBatch:
+            {
+                uint32_t count = rec.u32();
+                for (uint32_t i = 0; i < count && rec.ok(); ++i)
+                {
+                    auto subType = static_cast<RecordType>(rec.u8());
+                    if (!replayPatternEdit(subType, rec, model))
+                        break; // Corrupt batch - its remaining bytes can't be framed
+                }
+                break;
+            }
+            case RecordType::ActiveSlot:
+                voiceState.activeSlot = std::min<int>(rec.u8(), NUM_PATTERN_SLOTS - 1);
+                break;
+            case RecordType::PatternBase:
+            {
+                tree.removeAllChildren(nullptr);
+                tree.setProperty(IDs::bars, static_cast<int>(rec.u32()), nullptr);
+                tree.setProperty(IDs::swing, rec.f64(), nullptr);
+                uint32_t count = rec.u32();
+                for (uint32_t i = 0; i < count && rec.ok(); ++i)
+                    tree.appendChild(readNote(rec), nullptr);
+                break;
+            }
+            case RecordType::Mixer:
+            {
+                auto field = static_cast<MixerField>(rec.u8());
+                auto value = static_cast<float>(rec.f64());
+                switch (field)
+                {
+                    case MixerField::Volume:
+                        voiceState.volume = value;
+                        break;
+                    case MixerField::Pan:
+                        voiceState.pan = value;
+                        break;
+                    case MixerField::SendA:
+                        voiceState.sendA = value;
+                        break;
+                    case MixerField::SendB:
+                        voiceState.sendB = value;
+                        break;
+                    case MixerField::Mute:
+                        voiceState.mute = value != 0.0f;
+                        break;
+                    case MixerField::Solo:
+                        voiceState.solo = value != 0.0f;
+                        break;
+                }
+                break;
+            }
+            case RecordType::Global:
+            {
+                auto field = static_cast<GlobalField>(rec.u8());
+                double value = rec.f64();
+                switch (field)
+                {
+                    case GlobalField::Tempo:
+                        project.tempo = value;
+                        break;
+                    case GlobalField::LoopBars:
+                        project.loopBars = static_cast<int>(value);
+                        break;
+                    case GlobalField::Swing:
+                        project.swing = value;
+                        break;
+                    case GlobalField::MasterVolume:
+                        project.masterVolume = static_cast<float>(value);
+                        break;
+                    case GlobalField::Seed:
+                        project.seed = static_cast<uint32_t>(value);
+                        break;
+                }
+                break;
+            }
+            case RecordType::PatchBlob:
+            {
+                uint32_t blobSize = rec.u32();
+                if (const char *blob = rec.bytes(blobSize))
+                    voiceState.patchData.assign(blob, blob + blobSize);
+                break;
+            }
+            case RecordType::AutomationLane:
+            {
+                uint32_t nameSize = rec.u32();
+                const char *name = rec.bytes(nameSize);
+                uint32_t count = rec.u32();
+                if (!name)
+                    break;
+
+                AutomationLane lane;
+                lane.target.assign(name, nameSize);
+                for (uint32_t i = 0; i < count && rec.ok(); ++i)
+                {
+                    double beat = rec.f64();
+                    double value = rec.f64();
+                    lane.points.push_back({beat, static_cast<float>(value)});
+                }
+                if (!rec.ok())
+                    break;
+
+                auto &lanes = project.getPattern(target).automation;
+                lanes.erase(std::remove_if(lanes.begin(), lanes.end(),
+                                           [&](const AutomationLane &l) {
+                                               return l.target == lane.target;
+                                           }),
+                            lanes.end());
+                if (!lane.points.empty())
+                    lanes.push_back(std::move(lane));
+                break;
+            }
+            case RecordType::NoteLock:
+            {
+                uint32_t noteId = rec.u32();
+                uint32_t nameSize = rec.u32();
+                const char *name = rec.bytes(nameSize);
+                double value = rec.f64();
+                if (name && rec.ok())
+                    project.getPattern(target).setLock(noteId, std::string(name, nameSize),
+                                                       static_cast<float>(value));
+                break;
+            }
+            case RecordType::Groove:
+            {
+                uint32_t nameSize = rec.u32();
+                const char *name = rec.bytes(nameSize);
+                double stepBeats = rec.f64();
+                uint32_t count = rec.u32();
+
+                GrooveTemplate groove;
+                if (name)
+                    groove.name.assign(name, nameSize);
+                groove.stepBeats = stepBeats;
+                for (uint32_t i = 0; i < count && rec.ok(); ++i)
+                {
+                    double timing = rec.f64();
+                    double velocity = rec.f64();
+                    groove.steps.push_back(
+                        {static_cast<float>(timing), static_cast<int>(velocity)});
+                }
+
+                groove.sanitise();
+                if (rec.ok())
+                    project.groove = std::move(groove);
+                break;
+            }
+            case RecordType::MidiEffects:
+            {
+                MidiEffectChainSettings settings;
+                for (auto &effect : settings)
+                {
+                    effect.type = static_cast<MidiEffectSettings::Type>(std::min<int>(
+                        rec.u8(), static_cast<int>(MidiEffectSettings::Type::NoteRepeat)));
+                    effect.rate = rec.f64();
+                    effect.gate = static_cast<float>(rec.f64());
+                    effect.arpMode = static_cast<MidiEffectSettings::ArpMode>(std::min<int>(
+                        rec.u8(), static_cast<int>(MidiEffectSettings::ArpMode::AsPlayed)));
+                    effect.octaves = std::clamp<int>(rec.u8(), 1, 4);
+                    effect.numIntervals = std::min<int>(rec.u8(), MAX_CHORD_INTERVALS);
+                    for (auto &interval : effect.intervals)
+                        interval = static_cast<int8_t>(rec.u8());
+                }
+
+                if (rec.ok())
+                    voiceState.midiEffects = settings;
+                break;
+            }
+            case RecordType::Song:
+            {
+                bool songMode = rec.u8() != 0;
+                uint32_t count = rec.u32();
+
+                std::vector<SongSection> song;
+                for (uint32_t i = 0; i < count && rec.ok(); ++i)
+                {
+                    SongSection section;
+                    section.bars = std::max(1, static_cast<int>(rec.u32()));
+                    for (auto &slot : section.slots)
+                        slot = std::min<int>(rec.u8(), NUM_PATTERN_SLOTS) - 1;
+                    song.push_back(section);
+                }
+
+                if (rec.ok())
+                {
+                    project.song = std::move(song);
+                    project.songMode = songMode;
+                }
+                break;
+            }
+        }
+    }
+
+    for (int p = 0; p < NUM_PATTERNS; ++p)
+        models[p]->saveToPattern(project.getPattern(p));
+
+    return true;
+}
+
+uint64_t EditJournal::fingerprint(const void *data, size_t size)
+{
+    auto *bytes = static_cast<const uint8_t *>(data);
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i)
+    {
+        h ^= bytes[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+} // namespace SurgeBox
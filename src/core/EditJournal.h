@@ -0,0 +1,169 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include "GrooveboxProject.h"
+#include <juce_data_structures/juce_data_structures.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace SurgeBox
+{
+
+class PatternModel;
+
+/**
+ * Append-only journal of compact edit records, used for crash-safe autosave.
+ *
+ * Edits are encoded on the message thread into small binary records (pattern
+ * deltas, mixer and global changes, patch blobs) and handed to a background
+ * writer which appends them to journal-<gen>.log and fsyncs in batches. Every
+ * so often the owner hands over a full project image which becomes
+ * snapshot-<gen>.sbox and starts a new journal generation. Recovery loads the
+ * newest snapshot and replays its journal on top.
+ *
+ * Pattern deltas mirror the ValueTree operations of each PatternModel (child
+ * added/removed/moved, property set) by child index, so replay reproduces the
+ * exact note order the editor had. The deltas of one bulk edit (a transform,
+ * an undo step) are appended together as a single batch record.
+ */
+class EditJournal
+{
+  public:
+    enum class MixerField : uint8_t
+    {
+        Volume,
+        Pan,
+        SendA,
+        SendB,
+        Mute,
+        Solo
+    };
+
+    enum class GlobalField : uint8_t
+    {
+        Tempo,
+        LoopBars,
+        Swing,
+        MasterVolume,
+        Seed
+    };
+
+    EditJournal();
+    ~EditJournal();
+
+    // Start a new journal generation in directory, seeded with a full project image.
+    // Older generations are removed once the new snapshot is durable.
+    // models holds every voice/slot pattern, indexed as in NUM_PATTERNS.
+    bool open(const fs::path &directory, std::string snapshot,
+              std::array<PatternModel *, NUM_PATTERNS> models);
+
+    // Flush and stop the writer. With discard, all journal files are deleted
+    // (a clean shutdown leaves nothing to recover).
+    void close(bool discard);
+    bool isOpen() const { return writer_.joinable(); }
+
+    // Edit records - constant cost, called from the message thread
+    void recordMixer(int voice, MixerField field, float value);
+    void recordGlobal(GlobalField field, double value);
+    void recordActiveSlot(int voice, int slot);
+    void recordSong(const std::vector<SongSection> &song, bool songMode);
+    void recordAutomationLane(int pattern, const std::string &target, const AutomationLane &lane);
+    void recordGroove(const GrooveTemplate &groove);
+    void recordNoteLock(int pattern, uint32_t noteId, const std::string &target, float value);
+    void recordMidiEffects(int voice, const MidiEffectChainSettings &settings);
+    void recordPatch(int voice, const void *data, size_t size);
+
+    // Compaction - owner polls needsCompaction() and supplies a project image
+    bool needsCompaction() const { return journalBytes_.load() >= compactionThresholdBytes; }
+    void compact(std::string snapshot);
+
+    // Recovery
+    static bool hasRecoverableSession(const fs::path &directory);
+    static bool recover(const fs::path &directory, GrooveboxProject &project);
+
+    // Cheap content fingerprint, used to detect patch changes worth journaling
+    static uint64_t fingerprint(const void *data, size_t size);
+
+    size_t compactionThresholdBytes{4 * 1024 * 1024};
+    int fsyncIntervalMs{250};
+
+  private:
+    // Listens to one voice/slot PatternModel tree and journals every change
+    class PatternTap : public juce::ValueTree::Listener
+    {
+      public:
+        PatternTap(EditJournal &owner, int pattern) : owner_(owner), pattern_(pattern) {}
+
+        void valueTreePropertyChanged(juce::ValueTree &tree,
+                                      const juce::Identifier &property) override;
+        void valueTreeChildAdded(juce::ValueTree &parent, juce::ValueTree &child) override;
+        void valueTreeChildRemoved(juce::ValueTree &parent, juce::ValueTree &child,
+                                   int index) override;
+        void valueTreeChildOrderChanged(juce::ValueTree &parent, int oldIndex,
+                                        int newIndex) override;
+
+        // Appends the records buffered during a batch as one PatternBatch record
+        void flush();
+
+      private:
+        // Appends a record now, or buffers it while the model is in a batch
+        void write(uint8_t type, const std::string &payload);
+
+        EditJournal &owner_;
+        int pattern_;
+        std::string batch_; // u8 type, payload per buffered record
+        uint32_t batchCount_{0};
+    };
+
+    struct PendingItem
+    {
+        bool isCompaction{false};
+        uint64_t generation{0};
+        std::string records;   // journal bytes (records, or pattern bases for compaction)
+        std::string snapshot;  // project image, compaction only
+    };
+
+    void append(const std::string &record);
+    void enqueueCompaction(std::string snapshot);
+    std::string encodePatternBases() const;
+    void attach(std::array<PatternModel *, NUM_PATTERNS> models);
+    void detach();
+
+    // Writer thread
+    void writerLoop();
+    bool writeGeneration(const PendingItem &item);
+    void removeGenerationsBefore(uint64_t generation);
+
+    fs::path directory_;
+    std::array<PatternModel *, NUM_PATTERNS> models_{};
+    std::vector<std::unique_ptr<PatternTap>> taps_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<PendingItem> queue_;
+    bool stopRequested_{false};
+    std::thread writer_;
+
+    uint64_t generation_{0};
+    std::atomic<size_t> journalBytes_{0};
+
+    // Writer-thread state
+    std::FILE *journalFile_{nullptr};
+};
+
+} // namespace SurgeBox
@@ -0,0 +1,324 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "FlightRecorder.h"
+#include "EditJournal.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace SurgeBox
+{
+
+namespace
+{
+
+juce::String hexBytes(const FlightRecorder::Event &event)
+{
+    juce::String text;
+    for (int i = 0; i < event.size; ++i)
+        text << (i > 0 ? " " : "")
+             << juce::String::toHexString(static_cast<int>(event.bytes[i])).paddedLeft('0', 2);
+    return text;
+}
+
+} // namespace
+
+FlightRecorder::FlightRecorder() = default;
+
+FlightRecorder::~FlightRecorder() { stop(); }
+
+void FlightRecorder::prepare(double sampleRate)
+{
+    ticksPerSample_ =
+        static_cast<double>(juce::Time::getHighResolutionTicksPerSecond()) / sampleRate;
+}
+
+void FlightRecorder::setDirectory(const fs::path &directory)
+{
+    stop();
+    if (directory.empty())
+        return;
+
+    directory_ = directory;
+    state_.store(RECORDING);
+    writer_ = std::thread([this] { writerLoop(); });
+}
+
+void FlightRecorder::stop()
+{
+    if (!writer_.joinable())
+        return;
+
+    {
+        const std::lock_guard<std::mutex> lock(imageMutex_);
+        state_.store(STOPPING);
+    }
+    state_.notify_one();
+    imageReady_.notify_one();
+    writer_.join();
+    state_.store(IDLE);
+    imageWanted_.store(false);
+    captured_ = false;
+    skippedCaptures_ = 0;
+}
+
+// ============================================================================
+// Audio thread
+// ============================================================================
+
+void FlightRecorder::beginBlock(int numSamples, double beat, double tempo, bool playing)
+{
+    int state = state_.load(std::memory_order_acquire);
+    if (state != RECORDING && state != TRIPPED)
+    {
+        lastState_ = state;
+        current_ = nullptr;
+        return;
+    }
+
+    // Back from a capture or a stop - the old blocks are written or stale
+    if (lastState_ != RECORDING && lastState_ != TRIPPED)
+    {
+        next_ = 0;
+        count_ = 0;
+        blockIndex_ = 0;
+    }
+    lastState_ = state;
+
+    current_ = &blocks_[static_cast<size_t>(next_)];
+    current_->index = blockIndex_++;
+    current_->numSamples = numSamples;
+    current_->beat = beat;
+    current_->tempo = tempo;
+    current_->playing = playing;
+    current_->voiceTicks.fill(0);
+    current_->voiceNotes.fill(0);
+    current_->numEvents = 0;
+    current_->droppedEvents = 0;
+}
+
+void FlightRecorder::addMidi(int voice, int frame, const uint8_t *data, int size)
+{
+    if (!current_ || size <= 0)
+        return;
+    if (current_->numEvents >= MAX_EVENTS)
+    {
+        ++current_->droppedEvents;
+        return;
+    }
+
+    // Sysex keeps its first bytes
+    auto &event = current_->events[static_cast<size_t>(current_->numEvents++)];
+    event.frame = frame;
+    event.voice = static_cast<int8_t>(voice);
+    event.size = static_cast<uint8_t>(std::min(size, 3));
+    std::copy(data, data + event.size, event.bytes.begin());
+}
+
+void FlightRecorder::addVoiceRender(int voice, juce::int64 ticks, int notes)
+{
+    if (!current_)
+        return;
+
+    // Quanta add up to the host block
+    current_->voiceTicks[static_cast<size_t>(voice)] += ticks;
+    auto &peak = current_->voiceNotes[static_cast<size_t>(voice)];
+    peak = std::max(peak, notes);
+}
+
+void FlightRecorder::endBlock(juce::int64 ticks, int qualityLevel)
+{
+    if (!current_)
+        return;
+
+    current_->ticks = ticks;
+    current_->qualityLevel = qualityLevel;
+    current_->missed = static_cast<double>(ticks) > current_->numSamples * ticksPerSample_;
+    bool missed = current_->missed;
+    current_ = nullptr;
+    next_ = (next_ + 1) % NUM_BLOCKS;
+    count_ = std::min(count_ + 1, NUM_BLOCKS);
+
+    int state = RECORDING;
+    if (missed && state_.compare_exchange_strong(state, TRIPPED))
+    {
+        missIndex_ = blockIndex_ - 1;
+        blocksAfterMiss_ = BLOCKS_AFTER_MISS;
+        return;
+    }
+
+    state = TRIPPED;
+    if (lastState_ == TRIPPED && --blocksAfterMiss_ <= 0 &&
+        state_.compare_exchange_strong(state, FROZEN, std::memory_order_release))
+    {
+        state_.notify_one();
+    }
+}
+
+// ============================================================================
+// Writer thread
+// ============================================================================
+
+void FlightRecorder::setProjectImage(std::string image)
+{
+    auto snapshot = std::make_shared<const std::string>(std::move(image));
+    {
+        const std::lock_guard<std::mutex> lock(imageMutex_);
+        projectImage_ = std::move(snapshot);
+        imageWanted_.store(false);
+    }
+    imageReady_.notify_one();
+}
+
+fs::path FlightRecorder::getLastCapture() const
+{
+    const std::lock_guard<std::mutex> lock(captureMutex_);
+    return lastCapture_;
+}
+
+void FlightRecorder::writerLoop()
+{
+    for (;;)
+    {
+        int state = state_.load(std::memory_order_acquire);
+        if (state == STOPPING)
+            return;
+        if (state != FROZEN)
+        {
+            state_.wait(state, std::memory_order_acquire);
+            continue;
+        }
+
+        // A machine that keeps missing would otherwise write a capture every
+        // few dozen blocks
+        auto now = juce::Time::getMillisecondCounter();
+        if (captured_ && now - lastCaptureMs_ < MIN_CAPTURE_INTERVAL_MS)
+        {
+            ++skippedCaptures_;
+        }
+        else
+        {
+            auto image = waitForProjectImage();
+            writeCapture(image.get());
+            removeOldCaptures();
+            captured_ = true;
+            lastCaptureMs_ = juce::Time::getMillisecondCounter();
+            skippedCaptures_ = 0;
+        }
+
+        state = FROZEN;
+        state_.compare_exchange_strong(state, RECORDING);
+    }
+}
+
+std::shared_ptr<const std::string> FlightRecorder::waitForProjectImage()
+{
+    // Taken only now, so edits cost nothing until a capture needs it
+    std::unique_lock<std::mutex> lock(imageMutex_);
+    projectImage_.reset();
+    imageWanted_.store(true);
+    imageReady_.wait_for(lock, std::chrono::milliseconds(IMAGE_WAIT_MS), [this] {
+        return projectImage_ != nullptr || state_.load() == STOPPING;
+    });
+    imageWanted_.store(false);
+    return std::move(projectImage_);
+}
+
+void FlightRecorder::writeCapture(const std::string *image)
+{
+    double msPerTick = 1000.0 / static_cast<double>(juce::Time::getHighResolutionTicksPerSecond());
+    juce::Array<juce::var> blocks;
+    for (int i = 0; i < count_; ++i)
+    {
+        const auto &block = blocks_[static_cast<size_t>((next_ - count_ + i + NUM_BLOCKS) %
+                                                        NUM_BLOCKS)];
+        auto *entry = new juce::DynamicObject();
+        entry->setProperty("index", static_cast<juce::int64>(block.index));
+        entry->setProperty("frames", block.numSamples);
+        entry->setProperty("beat", block.beat);
+        entry->setProperty("tempo", block.tempo);
+        entry->setProperty("playing", block.playing);
+        entry->setProperty("qualityLevel", block.qualityLevel);
+        entry->setProperty("renderMs", static_cast<double>(block.ticks) * msPerTick);
+        entry->setProperty("deadlineMs", block.numSamples * ticksPerSample_ * msPerTick);
+        entry->setProperty("missed", block.missed);
+
+        juce::Array<juce::var> voices;
+        for (int v = 0; v < NUM_VOICES; ++v)
+        {
+            auto *voice = new juce::DynamicObject();
+            voice->setProperty("renderMs",
+                               static_cast<double>(block.voiceTicks[static_cast<size_t>(v)]) *
+                                   msPerTick);
+            voice->setProperty("notes", block.voiceNotes[static_cast<size_t>(v)]);
+            voices.add(juce::var(voice));
+        }
+        entry->setProperty("voices", voices);
+
+        juce::Array<juce::var> midi;
+        for (int e = 0; e < block.numEvents; ++e)
+        {
+            const auto &event = block.events[static_cast<size_t>(e)];
+            auto *message = new juce::DynamicObject();
+            message->setProperty("voice", event.voice);
+            message->setProperty("frame", event.frame);
+            message->setProperty("bytes", hexBytes(event));
+            midi.add(juce::var(message));
+        }
+        entry->setProperty("midi", midi);
+        if (block.droppedEvents > 0)
+            entry->setProperty("droppedMidi", block.droppedEvents);
+        blocks.add(juce::var(entry));
+    }
+
+    auto *root = new juce::DynamicObject();
+    root->setProperty("version", 1);
+    root->setProperty("time", juce::Time::getCurrentTime().toISO8601(true));
+    root->setProperty("missedBlock", static_cast<juce::int64>(missIndex_));
+    if (skippedCaptures_ > 0)
+        root->setProperty("skippedCaptures", skippedCaptures_);
+    // Hashed here rather than on the message thread; a capture without one is
+    // still worth having
+    if (image)
+        root->setProperty("projectHash",
+                          juce::String::toHexString(static_cast<juce::int64>(
+                              EditJournal::fingerprint(image->data(), image->size()))));
+    root->setProperty("blocks", blocks);
+
+    // Written beside and renamed over, so a reader never sees half a capture
+    juce::File directory(directory_.string());
+    directory.createDirectory();
+    auto name = "xrun-" + juce::Time::getCurrentTime().formatted("%Y%m%d-%H%M%S") + "-" +
+                juce::String(captureCount_.load() + 1) + ".json";
+    auto capture = directory.getChildFile(name);
+    auto temporary = capture.getSiblingFile(name + ".tmp");
+    if (!temporary.replaceWithText(juce::JSON::toString(juce::var(root))) ||
+        !temporary.moveFileTo(capture))
+        return;
+
+    const std::lock_guard<std::mutex> lock(captureMutex_);
+    lastCapture_ = fs::path(capture.getFullPathName().toStdString());
+    captureCount_.fetch_add(1);
+}
+
+void FlightRecorder::removeOldCaptures()
+{
+    auto captures = juce::File(directory_.string())
+                        .findChildFiles(juce::File::findFiles, false, "xrun-*.json");
+    if (captures.size() <= MAX_CAPTURES)
+        return;
+
+    std::sort(captures.begin(), captures.end(), [](const juce::File &a, const juce::File &b) {
+        return a.getLastModificationTime() < b.getLastModificationTime();
+    });
+    for (int i = 0; i < captures.size() - MAX_CAPTURES; ++i)
+        captures.getReference(i).deleteFile();
+}
+
+} // namespace SurgeBox
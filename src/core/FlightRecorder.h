@@ -0,0 +1,153 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include "GrooveboxProject.h"
+#include <juce_core/juce_core.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace SurgeBox
+{
+
+/**
+ * Keeps the last NUM_BLOCKS host blocks - their MIDI, transport, and each
+ * voice's render time and sounding notes - so a block that misses its
+ * deadline can be looked at afterwards.
+ *
+ * A miss records BLOCKS_AFTER_MISS more blocks, then freezes the ring. A
+ * background thread asks the message thread for a project image, hashes it,
+ * writes the ring to xrun-<time>.json in the directory and starts recording
+ * again. Captures are at least MIN_CAPTURE_INTERVAL_MS apart - misses in
+ * between are only counted - and the directory keeps the newest MAX_CAPTURES.
+ * Nothing on the audio thread allocates, locks or writes files; a block with
+ * more than MAX_EVENTS MIDI events keeps the first of them.
+ *
+ * The audio thread brackets each host block with beginBlock() and endBlock();
+ * voices' renders may be added from the render workers in between.
+ */
+class FlightRecorder
+{
+  public:
+    static constexpr int NUM_BLOCKS = 64;
+    static constexpr int BLOCKS_AFTER_MISS = 8;
+    static constexpr int MAX_EVENTS = 256;
+    static constexpr juce::uint32 MIN_CAPTURE_INTERVAL_MS = 30000;
+    static constexpr int MAX_CAPTURES = 32;
+    static constexpr int IMAGE_WAIT_MS = 2000;
+
+    struct Event
+    {
+        int32_t frame{0};
+        int8_t voice{0};
+        uint8_t size{0};
+        std::array<uint8_t, 3> bytes{};
+    };
+
+    struct Block
+    {
+        uint64_t index{0}; // Host blocks since recording started
+        int numSamples{0};
+        double beat{0.0};
+        double tempo{0.0};
+        bool playing{false};
+        int qualityLevel{0};
+        juce::int64 ticks{0}; // The whole block's render time
+        bool missed{false};
+        std::array<juce::int64, NUM_VOICES> voiceTicks{};
+        std::array<int, NUM_VOICES> voiceNotes{};
+        std::array<Event, MAX_EVENTS> events{};
+        int numEvents{0};
+        int droppedEvents{0};
+    };
+
+    FlightRecorder();
+    ~FlightRecorder();
+
+    // Message thread - record, writing captures to directory; empty - stop.
+    // prepare() first.
+    void setDirectory(const fs::path &directory);
+    bool isEnabled() const { return state_.load() != IDLE; }
+    void prepare(double sampleRate);
+
+    // Audio thread
+    void beginBlock(int numSamples, double beat, double tempo, bool playing);
+    bool isRecording() const { return current_ != nullptr; }
+    void addMidi(int voice, int frame, const uint8_t *data, int size);
+    void endBlock(juce::int64 ticks, int qualityLevel);
+
+    // Audio thread or the render workers, one thread per voice in a block
+    void addVoiceRender(int voice, juce::int64 ticks, int notes);
+
+    // Message thread - a capture is waiting for the project as saved, to hash
+    // it. Answered with setProjectImage(); a capture that waits longer than
+    // IMAGE_WAIT_MS is written without a hash.
+    bool wantsProjectImage() const { return imageWanted_.load(); }
+    void setProjectImage(std::string image);
+
+    // Any thread - captures written, and the latest one's path
+    int getCaptureCount() const { return captureCount_.load(); }
+    fs::path getLastCapture() const;
+
+  private:
+    enum State
+    {
+        IDLE,
+        RECORDING,
+        TRIPPED, // Recording the blocks after a miss
+        FROZEN,  // Being written
+        STOPPING
+    };
+
+    void stop();
+    void writerLoop();
+    std::shared_ptr<const std::string> waitForProjectImage();
+    void writeCapture(const std::string *image);
+    void removeOldCaptures();
+
+    fs::path directory_;
+    std::thread writer_;
+    std::atomic<int> state_{IDLE};
+
+    // Audio thread - written before the release of FROZEN, read after it
+    std::array<Block, NUM_BLOCKS> blocks_{};
+    int next_{0};
+    int count_{0};
+    uint64_t blockIndex_{0};
+    uint64_t missIndex_{0};
+    int blocksAfterMiss_{0};
+    int lastState_{IDLE};
+    Block *current_{nullptr};
+    double ticksPerSample_{0.0};
+
+    std::mutex imageMutex_;
+    std::condition_variable imageReady_;
+    std::shared_ptr<const std::string> projectImage_;
+    std::atomic<bool> imageWanted_{false};
+
+    // Writer thread
+    juce::uint32 lastCaptureMs_{0};
+    bool captured_{false};
+    int skippedCaptures_{0}; // Misses not written since the last capture
+
+    mutable std::mutex captureMutex_;
+    fs::path lastCapture_;
+    std::atomic<int> captureCount_{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FlightRecorder)
+};
+
+} // namespace SurgeBox
@@ -14,10 +14,13 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <fstream>
 #include <iomanip>
+#include <limits>
 #include <sstream>
 
 namespace mech = sst::basic_blocks::mechanics;
@@ -43,6 +46,20 @@ void MIDINote::toXML(TiXmlElement *parent) const
     noteEl.SetDoubleAttribute("duration", duration);
     noteEl.SetAttribute("pitch", pitch);
     noteEl.SetAttribute("velocity", velocity);
+    if (id != 0)
+        noteEl.SetAttribute("id", static_cast<int>(id));
+
+    if (trig != 0)
+    {
+        auto condition = TrigCondition::unpack(trig);
+        noteEl.SetAttribute("probability", condition.probability);
+        noteEl.SetAttribute("condition", static_cast<int>(condition.type));
+        if (condition.type == TrigCondition::Type::Every)
+        {
+            noteEl.SetAttribute("condition_n", condition.n);
+            noteEl.SetAttribute("condition_m", condition.m);
+        }
+    }
     parent->InsertEndChild(noteEl);
 }
 
@@ -58,9 +75,55 @@ MIDINote MIDINote::fromXML(TiXmlElement *element)
     note.pitch = static_cast<uint8_t>(std::clamp(pitchInt, 0, 127));
     note.velocity = static_cast<uint8_t>(std::clamp(velInt, 1, 127));
 
+    int idInt = 0;
+    if (element->QueryIntAttribute("id", &idInt) == TIXML_SUCCESS && idInt > 0)
+        note.id = static_cast<uint32_t>(idInt);
+
+    TrigCondition condition;
+    int typeInt = 0;
+    element->QueryIntAttribute("probability", &condition.probability);
+    element->QueryIntAttribute("condition", &typeInt);
+    element->QueryIntAttribute("condition_n", &condition.n);
+    element->QueryIntAttribute("condition_m", &condition.m);
+    condition.type = static_cast<TrigCondition::Type>(
+        std::clamp(typeInt, 0, static_cast<int>(TrigCondition::Type::NotFirst)));
+    note.trig = condition.pack();
+
     return note;
 }
 
+// ============================================================================
+// TrigCondition
+// ============================================================================
+
+// Bits 0-6: 100 - probability, 7-9: type, 10-15: n - 1, 16-21: m - 1. Fields a
+// type doesn't use are zero, so equal conditions pack equal.
+uint32_t TrigCondition::pack() const
+{
+    auto bits = static_cast<uint32_t>(100 - std::clamp(probability, 0, 100));
+    bits |= static_cast<uint32_t>(type) << 7;
+    if (type == Type::Every)
+    {
+        int every = std::clamp(m, 1, 64);
+        bits |= static_cast<uint32_t>(std::clamp(n, 1, every) - 1) << 10;
+        bits |= static_cast<uint32_t>(every - 1) << 16;
+    }
+    return bits;
+}
+
+TrigCondition TrigCondition::unpack(uint32_t bits)
+{
+    TrigCondition condition;
+    condition.probability = 100 - static_cast<int>(std::min(bits & 127, 100u));
+    condition.type = static_cast<Type>(std::min((bits >> 7) & 7, 3u));
+    if (condition.type == Type::Every)
+    {
+        condition.n = static_cast<int>((bits >> 10) & 63) + 1;
+        condition.m = static_cast<int>((bits >> 16) & 63) + 1;
+    }
+    return condition;
+}
+
 // ============================================================================
 // Pattern
 // ============================================================================
@@ -129,14 +192,84 @@ std::vector<const MIDINote *> Pattern::getNotesStartingInRange(double startBeat,
     return result;
 }
 
-void Pattern::toXML(TiXmlElement *parent) const
+AutomationLane *Pattern::findLane(const std::string &target)
+{
+    for (auto &lane : automation)
+    {
+        if (lane.target == target)
+            return &lane;
+    }
+    return nullptr;
+}
+
+void Pattern::setLock(uint32_t noteId, const std::string &target, float value)
+{
+    auto byNote = [](const ParameterLock &l, uint32_t id) { return l.noteId < id; };
+    auto first = std::lower_bound(locks.begin(), locks.end(), noteId, byNote);
+    auto it = std::find_if(first, locks.end(), [&](const ParameterLock &l) {
+        return l.noteId != noteId || l.target == target;
+    });
+
+    bool exists = it != locks.end() && it->noteId == noteId;
+    if (std::isnan(value))
+    {
+        if (exists)
+            locks.erase(it);
+    }
+    else if (exists)
+    {
+        it->value = std::clamp(value, 0.0f, 1.0f);
+    }
+    else
+    {
+        locks.insert(it, {noteId, target, std::clamp(value, 0.0f, 1.0f)});
+    }
+}
+
+float Pattern::getLock(uint32_t noteId, const std::string &target) const
+{
+    auto byNote = [](const ParameterLock &l, uint32_t id) { return l.noteId < id; };
+    for (auto it = std::lower_bound(locks.begin(), locks.end(), noteId, byNote);
+         it != locks.end() && it->noteId == noteId; ++it)
+    {
+        if (it->target == target)
+            return it->value;
+    }
+    return std::numeric_limits<float>::quiet_NaN();
+}
+
+size_t Pattern::memoryBytes() const
+{
+    size_t bytes = notes.capacity() * sizeof(MIDINote) +
+                   automation.capacity() * sizeof(AutomationLane) +
+                   locks.capacity() * sizeof(ParameterLock);
+    for (const auto &lane : automation)
+        bytes += lane.target.capacity() + lane.points.capacity() * sizeof(AutomationPoint);
+    for (const auto &lock : locks)
+        bytes += lock.target.capacity();
+    return bytes;
+}
+
+void Pattern::toXML(TiXmlElement *parent, int slot) const
 {
     TiXmlElement patternEl("pattern");
+    patternEl.SetAttribute("slot", slot);
     patternEl.SetAttribute("bars", bars);
     patternEl.SetDoubleAttribute("swing", swing);
 
     for (const auto &note : notes)
         note.toXML(&patternEl);
+    for (const auto &lane : automation)
+        lane.toXML(&patternEl);
+
+    for (const auto &lock : locks)
+    {
+        TiXmlElement lockEl("lock");
+        lockEl.SetAttribute("note", static_cast<int>(lock.noteId));
+        lockEl.SetAttribute("target", lock.target.c_str());
+        lockEl.SetDoubleAttribute("value", lock.value);
+        patternEl.InsertEndChild(lockEl);
+    }
 
     parent->InsertEndChild(patternEl);
 }
@@ -153,6 +286,220 @@ void Pattern::fromXML(TiXmlElement *element)
         notes.push_back(MIDINote::fromXML(noteEl));
     }
     sortNotes();
+
+    automation.clear();
+    for (TiXmlElement *laneEl = element->FirstChildElement("automation"); laneEl;
+         laneEl = laneEl->NextSiblingElement("automation"))
+    {
+        AutomationLane lane;
+        lane.fromXML(laneEl);
+        if (!lane.target.empty() && !lane.points.empty())
+            automation.push_back(std::move(lane));
+    }
+
+    locks.clear();
+    for (TiXmlElement *lockEl = element->FirstChildElement("lock"); lockEl;
+         lockEl = lockEl->NextSiblingElement("lock"))
+    {
+        int noteId = 0;
+        double value = 0.0;
+        const char *target = lockEl->Attribute("target");
+        lockEl->QueryIntAttribute("note", &noteId);
+        lockEl->QueryDoubleAttribute("value", &value);
+        if (target && noteId > 0)
+            setLock(static_cast<uint32_t>(noteId), target, static_cast<float>(value));
+    }
+}
+
+// ============================================================================
+// AutomationLane
+// ============================================================================
+
+void AutomationLane::toXML(TiXmlElement *parent) const
+{
+    TiXmlElement laneEl("automation");
+    laneEl.SetAttribute("target", target.c_str());
+
+    for (const auto &point : points)
+    {
+        TiXmlElement pointEl("point");
+        pointEl.SetDoubleAttribute("beat", point.beat);
+        pointEl.SetDoubleAttribute("value", point.value);
+        laneEl.InsertEndChild(pointEl);
+    }
+
+    parent->InsertEndChild(laneEl);
+}
+
+void AutomationLane::fromXML(TiXmlElement *element)
+{
+    if (const char *attr = element->Attribute("target"))
+        target = attr;
+
+    points.clear();
+    for (TiXmlElement *pointEl = element->FirstChildElement("point"); pointEl;
+         pointEl = pointEl->NextSiblingElement("point"))
+    {
+        AutomationPoint point;
+        double value = 0.0;
+        pointEl->QueryDoubleAttribute("beat", &point.beat);
+        pointEl->QueryDoubleAttribute("value", &value);
+        point.value = static_cast<float>(std::clamp(value, 0.0, 1.0));
+        points.push_back(point);
+    }
+
+    std::stable_sort(points.begin(), points.end(),
+                     [](const AutomationPoint &a, const AutomationPoint &b) {
+                         return a.beat < b.beat;
+                     });
+}
+
+// ============================================================================
+// SongSection
+// ============================================================================
+
+void SongSection::toXML(TiXmlElement *parent) const
+{
+    TiXmlElement sectionEl("section");
+    sectionEl.SetAttribute("bars", bars);
+
+    for (int v = 0; v < NUM_VOICES; v++)
+    {
+        TiXmlElement voiceEl("voice");
+        voiceEl.SetAttribute("index", v);
+        voiceEl.SetAttribute("slot", slots[v]);
+        sectionEl.InsertEndChild(voiceEl);
+    }
+
+    parent->InsertEndChild(sectionEl);
+}
+
+void SongSection::fromXML(TiXmlElement *element)
+{
+    element->QueryIntAttribute("bars", &bars);
+    bars = std::max(bars, 1);
+
+    for (TiXmlElement *voiceEl = element->FirstChildElement("voice"); voiceEl;
+         voiceEl = voiceEl->NextSiblingElement("voice"))
+    {
+        int index = 0, slot = 0;
+        voiceEl->QueryIntAttribute("index", &index);
+        voiceEl->QueryIntAttribute("slot", &slot);
+        if (index >= 0 && index < NUM_VOICES)
+            slots[index] = std::clamp(slot, -1, NUM_PATTERN_SLOTS - 1);
+    }
+}
+
+// ============================================================================
+// GrooveTemplate
+// ============================================================================
+
+void GrooveTemplate::toXML(TiXmlElement *parent) const
+{
+    TiXmlElement grooveEl("groove");
+    grooveEl.SetAttribute("name", name.c_str());
+    grooveEl.SetDoubleAttribute("step_beats", stepBeats);
+
+    for (const auto &step : steps)
+    {
+        TiXmlElement stepEl("step");
+        stepEl.SetDoubleAttribute("timing", step.timing);
+        stepEl.SetAttribute("velocity", step.velocity);
+        grooveEl.InsertEndChild(stepEl);
+    }
+
+    parent->InsertEndChild(grooveEl);
+}
+
+void GrooveTemplate::fromXML(TiXmlElement *element)
+{
+    const char *nameAttr = element->Attribute("name");
+    name = nameAttr ? nameAttr : "";
+    element->QueryDoubleAttribute("step_beats", &stepBeats);
+
+    steps.clear();
+    for (TiXmlElement *stepEl = element->FirstChildElement("step"); stepEl;
+         stepEl = stepEl->NextSiblingElement("step"))
+    {
+        double timing = 0.0;
+        int velocity = 0;
+        stepEl->QueryDoubleAttribute("timing", &timing);
+        stepEl->QueryIntAttribute("velocity", &velocity);
+        steps.push_back({static_cast<float>(timing), velocity});
+    }
+    sanitise();
+}
+
+void GrooveTemplate::sanitise()
+{
+    // Also catches NaN
+    if (!(stepBeats > 0.0) || !std::isfinite(stepBeats))
+        stepBeats = 0.25;
+    for (auto &step : steps)
+    {
+        step.timing = std::isfinite(step.timing) ? std::clamp(step.timing, -1.0f, 1.0f) : 0.0f;
+        step.velocity = std::clamp(step.velocity, -127, 127);
+    }
+}
+
+// ============================================================================
+// MidiEffectSettings
+// ============================================================================
+
+void MidiEffectSettings::toXML(TiXmlElement *parent, int index) const
+{
+    TiXmlElement fxEl("midi_fx");
+    fxEl.SetAttribute("slot", index);
+    fxEl.SetAttribute("type", static_cast<int>(type));
+    fxEl.SetDoubleAttribute("rate", rate);
+    fxEl.SetDoubleAttribute("gate", gate);
+    fxEl.SetAttribute("mode", static_cast<int>(arpMode));
+    fxEl.SetAttribute("octaves", octaves);
+
+    std::string list;
+    for (int i = 0; i < numIntervals; ++i)
+        list += (i > 0 ? "," : "") + std::to_string(intervals[static_cast<size_t>(i)]);
+    fxEl.SetAttribute("intervals", list.c_str());
+
+    parent->InsertEndChild(fxEl);
+}
+
+void MidiEffectSettings::fromXML(TiXmlElement *element)
+{
+    int typeVal = 0;
+    element->QueryIntAttribute("type", &typeVal);
+    type = static_cast<Type>(std::clamp(typeVal, 0, static_cast<int>(Type::NoteRepeat)));
+
+    element->QueryDoubleAttribute("rate", &rate);
+    if (rate <= 0.0)
+        rate = 0.25;
+
+    double gateVal = gate;
+    element->QueryDoubleAttribute("gate", &gateVal);
+    gate = static_cast<float>(std::clamp(gateVal, 0.05, 1.0));
+
+    int modeVal = 0;
+    element->QueryIntAttribute("mode", &modeVal);
+    arpMode = static_cast<ArpMode>(std::clamp(modeVal, 0, static_cast<int>(ArpMode::AsPlayed)));
+
+    element->QueryIntAttribute("octaves", &octaves);
+    octaves = std::clamp(octaves, 1, 4);
+
+    numIntervals = 0;
+    if (const char *list = element->Attribute("intervals"))
+    {
+        char *end = nullptr;
+        for (const char *p = list; *p && numIntervals < MAX_CHORD_INTERVALS; p = end)
+        {
+            long interval = std::strtol(p, &end, 10);
+            if (end == p)
+                break;
+            intervals[static_cast<size_t>(numIntervals++)] =
+                static_cast<int8_t>(std::clamp(interval, -48L, 48L));
+            if (*end == ',')
+                ++end;
+        }
+    }
 }
 
 // ============================================================================
@@ -212,6 +559,7 @@ void VoiceState::toXML(TiXmlElement *parent, int index) const
     TiXmlElement voiceEl("voice");
     voiceEl.SetAttribute("index", index);
     voiceEl.SetAttribute("name", name.c_str());
+    voiceEl.SetAttribute("active_slot", activeSlot);
 
     // Mixer
     TiXmlElement mixerEl("mixer");
@@ -243,7 +591,16 @@ void VoiceState::toXML(TiXmlElement *parent, int index) const
         voiceEl.InsertEndChild(patchEl);
     }
 
-    pattern.toXML(&voiceEl);
+    for (int slot = 0; slot < NUM_PATTERN_SLOTS; ++slot)
+        patterns[static_cast<size_t>(slot)].toXML(&voiceEl, slot);
+
+    for (int slot = 0; slot < MAX_MIDI_EFFECTS; ++slot)
+    {
+        const auto &effect = midiEffects[static_cast<size_t>(slot)];
+        if (effect.type != MidiEffectSettings::Type::Off)
+            effect.toXML(&voiceEl, slot);
+    }
+
     parent->InsertEndChild(voiceEl);
 }
 
@@ -252,6 +609,10 @@ void VoiceState::fromXML(TiXmlElement *element, int /*index*/)
     if (const char *nameAttr = element->Attribute("name"))
         name = nameAttr;
 
+    int slotAttr = 0;
+    if (element->QueryIntAttribute("active_slot", &slotAttr) == TIXML_SUCCESS)
+        activeSlot = std::clamp(slotAttr, 0, NUM_PATTERN_SLOTS - 1);
+
     if (TiXmlElement *mixerEl = element->FirstChildElement("mixer"))
     {
         double val;
@@ -291,8 +652,24 @@ void VoiceState::fromXML(TiXmlElement *element, int /*index*/)
         }
     }
 
-    if (TiXmlElement *patternEl = element->FirstChildElement("pattern"))
-        pattern.fromXML(patternEl);
+    // Version 1 files hold a single pattern without a slot attribute
+    for (TiXmlElement *patternEl = element->FirstChildElement("pattern"); patternEl;
+         patternEl = patternEl->NextSiblingElement("pattern"))
+    {
+        int slot = 0;
+        patternEl->QueryIntAttribute("slot", &slot);
+        if (slot >= 0 && slot < NUM_PATTERN_SLOTS)
+            patterns[static_cast<size_t>(slot)].fromXML(patternEl);
+    }
+
+    for (TiXmlElement *fxEl = element->FirstChildElement("midi_fx"); fxEl;
+         fxEl = fxEl->NextSiblingElement("midi_fx"))
+    {
+        int slot = 0;
+        fxEl->QueryIntAttribute("slot", &slot);
+        if (slot >= 0 && slot < MAX_MIDI_EFFECTS)
+            midiEffects[static_cast<size_t>(slot)].fromXML(fxEl);
+    }
 }
 
 void VoiceState::captureFromSynth(SurgeSynthesizer *synth)
@@ -333,18 +710,24 @@ void GrooveboxProject::reset()
     tempo = 120.0;
     loopBars = 4;
     swing = 0.0;
+    groove = GrooveTemplate();
+    seed = 0;
     masterVolume = 0.8f;
 
     for (int i = 0; i < NUM_VOICES; i++)
     {
         voices[i] = VoiceState();
         voices[i].name = fmt::format("Voice {}", i + 1);
-        voices[i].pattern.bars = loopBars;
+        for (auto &pattern : voices[i].patterns)
+            pattern.bars = loopBars;
     }
 
     for (int i = 0; i < NUM_GLOBAL_FX; i++)
         globalFX[i] = GlobalFXSlot();
 
+    song.clear();
+    songMode = false;
+
     projectName = "Untitled";
     author.clear();
     comment.clear();
@@ -357,7 +740,7 @@ int GrooveboxProject::getMaxPatternBars() const
 {
     int maxBars = 1;
     for (const auto &voice : voices)
-        maxBars = std::max(maxBars, voice.pattern.bars);
+        maxBars = std::max(maxBars, voice.pattern().bars);
     return maxBars;
 }
 
@@ -386,6 +769,9 @@ void GrooveboxProject::toXML(TiXmlDocument &doc)
     globalEl.SetAttribute("loop_bars", loopBars);
     globalEl.SetDoubleAttribute("swing", swing);
     globalEl.SetDoubleAttribute("master_volume", masterVolume);
+    globalEl.SetAttribute("seed", std::to_string(seed).c_str());
+    if (!groove.empty())
+        groove.toXML(&globalEl);
 
     TiXmlElement globalFXEl("global_fx");
     for (int i = 0; i < NUM_GLOBAL_FX; i++)
@@ -397,6 +783,13 @@ void GrooveboxProject::toXML(TiXmlDocument &doc)
     for (int i = 0; i < NUM_VOICES; i++)
         voices[i].toXML(&root, i);
 
+    // Song arrangement
+    TiXmlElement songEl("song");
+    songEl.SetAttribute("mode", songMode ? 1 : 0);
+    for (const auto &section : song)
+        section.toXML(&songEl);
+    root.InsertEndChild(songEl);
+
     // Metadata
     TiXmlElement metaEl("meta");
     metaEl.SetAttribute("name", projectName.c_str());
@@ -439,6 +832,13 @@ void GrooveboxProject::fromXML(TiXmlDocument &doc)
         globalEl->QueryIntAttribute("loop_bars", &loopBars);
         globalEl->QueryDoubleAttribute("swing", &swing);
 
+        const char *seedAttr = globalEl->Attribute("seed");
+        seed = seedAttr ? static_cast<uint32_t>(std::strtoul(seedAttr, nullptr, 10)) : 0;
+
+        groove = GrooveTemplate();
+        if (TiXmlElement *grooveEl = globalEl->FirstChildElement("groove"))
+            groove.fromXML(grooveEl);
+
         double mv;
         if (globalEl->QueryDoubleAttribute("master_volume", &mv) == TIXML_SUCCESS)
             masterVolume = static_cast<float>(mv);
@@ -465,6 +865,22 @@ void GrooveboxProject::fromXML(TiXmlDocument &doc)
             voices[index].fromXML(voiceEl, index);
     }
 
+    if (TiXmlElement *songEl = root->FirstChildElement("song"))
+    {
+        int modeInt = 0;
+        songEl->QueryIntAttribute("mode", &modeInt);
+        songMode = (modeInt != 0);
+
+        song.clear();
+        for (TiXmlElement *sectionEl = songEl->FirstChildElement("section"); sectionEl;
+             sectionEl = sectionEl->NextSiblingElement("section"))
+        {
+            SongSection section;
+            section.fromXML(sectionEl);
+            song.push_back(section);
+        }
+    }
+
     if (TiXmlElement *metaEl = root->FirstChildElement("meta"))
     {
         if (const char *attr = metaEl->Attribute("name"))
@@ -495,7 +911,7 @@ void GrooveboxProject::fromXML(TiXmlDocument &doc)
     }
 }
 
-bool GrooveboxProject::saveToFile(const fs::path &path)
+bool GrooveboxProject::saveToMemory(std::string &data)
 {
     modifiedDate_ = getCurrentTimestamp();
 
@@ -513,24 +929,20 @@ bool GrooveboxProject::saveToFile(const fs::path &path)
     header.xmlsize = mech::endian_write_int32LE(static_cast<uint32_t>(xmlStr.size()));
     header.numVoices = mech::endian_write_int32LE(NUM_VOICES);
 
-    std::ofstream file(path, std::ios::binary);
-    if (!file)
-        return false;
-
-    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
-    file.write(xmlStr.data(), xmlStr.size());
-
-    return file.good();
+    data.clear();
+    data.reserve(sizeof(header) + xmlStr.size());
+    data.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    data.append(xmlStr);
+    return true;
 }
 
-bool GrooveboxProject::loadFromFile(const fs::path &path)
+bool GrooveboxProject::loadFromMemory(const void *data, size_t size)
 {
-    std::ifstream file(path, std::ios::binary);
-    if (!file)
+    if (!data || size < sizeof(ProjectHeader))
         return false;
 
     ProjectHeader header;
-    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    memcpy(&header, data, sizeof(header));
 
     if (memcmp(header.tag, "SBOX", 4) != 0)
         return false;
@@ -540,13 +952,11 @@ bool GrooveboxProject::loadFromFile(const fs::path &path)
         return false;
 
     uint32_t xmlsize = mech::endian_read_int32LE(header.xmlsize);
-
-    std::string xmlStr(xmlsize, '\0');
-    file.read(xmlStr.data(), xmlsize);
-
-    if (!file)
+    if (xmlsize > size - sizeof(header))
         return false;
 
+    std::string xmlStr(static_cast<const char *>(data) + sizeof(header), xmlsize);
+
     TiXmlDocument doc;
     doc.Parse(xmlStr.c_str());
 
@@ -559,4 +969,37 @@ bool GrooveboxProject::loadFromFile(const fs::path &path)
     return true;
 }
 
+bool GrooveboxProject::saveToFile(const fs::path &path)
+{
+    std::string data;
+    if (!saveToMemory(data))
+        return false;
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+
+    return file.good();
+}
+
+bool GrooveboxProject::loadFromFile(const fs::path &path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+
+    auto size = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+
+    std::string data(size, '\0');
+    file.read(data.data(), static_cast<std::streamsize>(size));
+
+    if (!file)
+        return false;
+
+    return loadFromMemory(data.data(), data.size());
+}
+
 } // namespace SurgeBox
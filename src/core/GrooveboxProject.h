@@ -27,6 +27,10 @@ namespace SurgeBox
 static constexpr int NUM_VOICES = 4;
 static constexpr int NUM_GLOBAL_FX = 4;
 static constexpr int FX_PARAMS_PER_SLOT = 12;
+static constexpr int NUM_PATTERN_SLOTS = 16;
+
+// Every voice/slot pattern, indexed voice * NUM_PATTERN_SLOTS + slot
+static constexpr int NUM_PATTERNS = NUM_VOICES * NUM_PATTERN_SLOTS;
 
 // ============================================================================
 // File Format
@@ -43,7 +47,59 @@ struct ProjectHeader
 };
 #pragma pack(pop)
 
-static constexpr uint32_t PROJECT_FORMAT_VERSION = 1;
+static constexpr uint32_t PROJECT_FORMAT_VERSION = 4;
+
+// ============================================================================
+// Trig Conditions
+// ============================================================================
+
+// Whether a note plays on a pass of its pattern: the condition must hold, then
+// the probability is rolled. Both depend only on the pass index (counted from
+// when play started) and the project seed, so a pass always plays the same.
+// Notes carry it packed into 32 bits - 0 always plays.
+struct TrigCondition
+{
+    enum class Type : uint8_t
+    {
+        Always,
+        Every,   // Pass n of every m
+        Fill,    // Only while fill is on
+        NotFirst // Every pass but the first
+    };
+
+    Type type{Type::Always};
+    int probability{100}; // Percent
+    int n{1};             // Every - 1..m
+    int m{2};             // Every - 1..64
+
+    uint32_t pack() const;
+    static TrigCondition unpack(uint32_t bits);
+
+    // Whether a note with packed trig bits plays on pass - a handful of integer ops
+    static bool passes(uint32_t bits, uint32_t pass, uint32_t seed, uint32_t noteKey, bool fill)
+    {
+        if (bits == 0)
+            return true;
+
+        uint32_t type = (bits >> 7) & 7;
+        uint32_t n = (bits >> 10) & 63;
+        uint32_t m = ((bits >> 16) & 63) + 1;
+        bool condition = (type == static_cast<uint32_t>(Type::Always)) |
+                         ((type == static_cast<uint32_t>(Type::Every)) & (pass % m == n)) |
+                         ((type == static_cast<uint32_t>(Type::Fill)) & fill) |
+                         ((type == static_cast<uint32_t>(Type::NotFirst)) & (pass != 0));
+
+        // Counter-based roll: a hash of (seed, note, pass), scaled to 0..99
+        uint32_t h = seed ^ (noteKey * 0x9e3779b9u) ^ (pass * 0x85ebca6bu);
+        h ^= h >> 16;
+        h *= 0x7feb352du;
+        h ^= h >> 15;
+        h *= 0x846ca68bu;
+        h ^= h >> 16;
+        auto roll = static_cast<uint32_t>((static_cast<uint64_t>(h) * 100) >> 32);
+        return condition & (roll < 100 - (bits & 127));
+    }
+};
 
 // ============================================================================
 // MIDI Note
@@ -55,6 +111,8 @@ struct MIDINote
     double duration{1.0};
     uint8_t pitch{60};
     uint8_t velocity{100};
+    uint32_t id{0};   // Stable note ID from PatternModel, 0 if unassigned
+    uint32_t trig{0}; // TrigCondition::pack()
 
     MIDINote() = default;
     MIDINote(double start, double dur, uint8_t p, uint8_t vel)
@@ -69,6 +127,41 @@ struct MIDINote
     static MIDINote fromXML(TiXmlElement *element);
 };
 
+// ============================================================================
+// Automation
+// ============================================================================
+
+// Mixer automation targets; anything else names a Surge parameter
+static constexpr const char *AUTOMATION_MIXER_VOLUME = "mixer/volume";
+static constexpr const char *AUTOMATION_MIXER_PAN = "mixer/pan";
+
+struct AutomationPoint
+{
+    double beat{0.0};
+    float value{0.0f}; // Normalized 0..1
+};
+
+// Breakpoints for one target, interpolated linearly. The target is a Surge
+// parameter storage name ("a_filter1_cutoff") or a mixer field ("mixer/volume").
+struct AutomationLane
+{
+    std::string target;
+    std::vector<AutomationPoint> points; // Sorted by beat
+
+    void toXML(TiXmlElement *parent) const;
+    void fromXML(TiXmlElement *element);
+};
+
+// A parameter override carried by one note (a "p-lock"): set just before the
+// note starts, restored when it ends. Patterns keep these in a side table keyed
+// by note ID, so plain notes carry nothing.
+struct ParameterLock
+{
+    uint32_t noteId{0};
+    std::string target; // Surge parameter storage name
+    float value{0.0f};  // Normalized 0..1
+};
+
 // ============================================================================
 // Pattern
 // ============================================================================
@@ -76,8 +169,10 @@ struct MIDINote
 struct Pattern
 {
     std::vector<MIDINote> notes;
+    std::vector<AutomationLane> automation;
+    std::vector<ParameterLock> locks; // Sorted by note ID
     int bars{4};
-    double swing{0.0};
+    double swing{0.0}; // 0..1, see GrooveTemplate - 0 follows the project swing
 
     double lengthInBeats() const { return bars * 4.0; }
 
@@ -91,10 +186,112 @@ struct Pattern
     std::vector<MIDINote *> getNotesInRange(double startBeat, double endBeat);
     std::vector<const MIDINote *> getNotesStartingInRange(double startBeat, double endBeat) const;
 
+    // Lane for target, or nullptr
+    AutomationLane *findLane(const std::string &target);
+
+    // Set, or with a NaN value remove, the lock of a note on target
+    void setLock(uint32_t noteId, const std::string &target, float value);
+
+    // The lock of a note on target, or NaN without one
+    float getLock(uint32_t noteId, const std::string &target) const;
+
+    // Heap held by the notes, lanes and locks
+    size_t memoryBytes() const;
+
+    void toXML(TiXmlElement *parent, int slot) const;
+    void fromXML(TiXmlElement *element);
+};
+
+// ============================================================================
+// Song Section
+// ============================================================================
+
+// One step of the song arrangement: each voice loops one of its pattern slots
+// for the length of the section. A slot of -1 leaves the voice silent.
+struct SongSection
+{
+    int bars{4};
+    std::array<int, NUM_VOICES> slots{};
+
     void toXML(TiXmlElement *parent) const;
     void fromXML(TiXmlElement *element);
 };
 
+// ============================================================================
+// Groove
+// ============================================================================
+
+// A timing feel applied to notes when patterns are compiled for playback.
+// Steps repeat every steps.size() * stepBeats; a note takes the offsets of the
+// step nearest its start. Swing (0..1) is applied first: it delays the
+// off-beat of every pair of 16ths by up to half a 16th, 0.67 being triplet feel.
+struct GrooveStep
+{
+    float timing{0.0f}; // Fraction of stepBeats, negative is early
+    int velocity{0};    // Added to the note's velocity
+};
+
+struct GrooveTemplate
+{
+    std::string name;
+    double stepBeats{0.25};
+    std::vector<GrooveStep> steps;
+
+    bool empty() const { return steps.empty(); }
+
+    // Brings a step length that isn't positive back to a 16th and clamps the
+    // offsets, as fromXML does
+    void sanitise();
+
+    void toXML(TiXmlElement *parent) const;
+    void fromXML(TiXmlElement *element);
+};
+
+// ============================================================================
+// MIDI Effects
+// ============================================================================
+
+static constexpr int MAX_MIDI_EFFECTS = 4;
+static constexpr int MAX_CHORD_INTERVALS = 4;
+
+// One stage of a voice's MIDI effect chain, which reworks the sequencer's notes
+// before they reach Surge. Plain data, so the audio thread can take a whole
+// chain by copy.
+struct MidiEffectSettings
+{
+    enum class Type : uint8_t
+    {
+        Off,
+        Arpeggiator, // Steps through the held notes
+        Chord,       // Adds intervals above each note
+        NoteRepeat   // Retriggers held notes every step
+    };
+
+    enum class ArpMode : uint8_t
+    {
+        Up,
+        Down,
+        UpDown,
+        AsPlayed
+    };
+
+    Type type{Type::Off};
+    double rate{0.25}; // Arpeggiator and note repeat step, in beats
+    float gate{0.5f};  // Fraction of the step each generated note sounds
+    ArpMode arpMode{ArpMode::Up};
+    int octaves{1}; // Arpeggiator range, 1..4
+
+    // Chord - semitones above the played note
+    std::array<int8_t, MAX_CHORD_INTERVALS> intervals{};
+    int numIntervals{0};
+
+    void toXML(TiXmlElement *parent, int index) const;
+    void fromXML(TiXmlElement *element);
+};
+
+// Stages run in order; Off stages are skipped
+using MidiEffectChainSettings = std::array<MidiEffectSettings, MAX_MIDI_EFFECTS>;
+
 // ============================================================================
 // Global FX Slot
 // ============================================================================
@@ -119,7 +316,14 @@ struct VoiceState
 {
     std::string name;
     std::vector<char> patchData;
-    Pattern pattern;
+
+    // Pattern bank - activeSlot is the one being edited, and played once a
+    // queued switch has landed
+    std::array<Pattern, NUM_PATTERN_SLOTS> patterns;
+    int activeSlot{0};
+
+    Pattern &pattern() { return patterns[static_cast<size_t>(activeSlot)]; }
+    const Pattern &pattern() const { return patterns[static_cast<size_t>(activeSlot)]; }
 
     float volume{1.0f};
     float pan{0.0f};
@@ -128,6 +332,8 @@ struct VoiceState
     bool mute{false};
     bool solo{false};
 
+    MidiEffectChainSettings midiEffects;
+
     VoiceState();
 
     void toXML(TiXmlElement *parent, int index) const;
@@ -147,11 +353,17 @@ class GrooveboxProject
     double tempo{120.0};
     int loopBars{4};
     double swing{0.0};
+    GrooveTemplate groove; // Empty - no groove
+    uint32_t seed{0};      // Trig probability rolls
     float masterVolume{0.8f};
 
     std::array<VoiceState, NUM_VOICES> voices;
     std::array<GlobalFXSlot, NUM_GLOBAL_FX> globalFX;
 
+    // Song mode plays the arrangement instead of each voice's selected slot
+    std::vector<SongSection> song;
+    bool songMode{false};
+
     std::string projectName{"Untitled"};
     std::string author;
     std::string comment;
@@ -161,10 +373,21 @@ class GrooveboxProject
 
     bool saveToFile(const fs::path &path);
     bool loadFromFile(const fs::path &path);
+
+    // Serialize to / parse from an in-memory .sbox image (header + XML)
+    bool saveToMemory(std::string &data);
+    bool loadFromMemory(const void *data, size_t size);
     void reset();
 
     int getMaxPatternBars() const;
 
+    // Pattern by voice/slot index (see NUM_PATTERNS)
+    Pattern &getPattern(int index)
+    {
+        return voices[static_cast<size_t>(index / NUM_PATTERN_SLOTS)]
+            .patterns[static_cast<size_t>(index % NUM_PATTERN_SLOTS)];
+    }
+
   private:
     void toXML(TiXmlDocument &doc);
     void fromXML(TiXmlDocument &doc);
@@ -0,0 +1,129 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "MemoryReport.h"
+#include <juce_core/juce_core.h>
+
+#include <cstdio>
+
+#if defined(__linux__)
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+namespace SurgeBox
+{
+
+namespace
+{
+
+juce::String formatBytes(int64_t bytes)
+{
+    if (bytes >= 1024 * 1024)
+        return juce::String(static_cast<double>(bytes) / (1024.0 * 1024.0), 1) + " MB";
+    if (bytes >= 1024)
+        return juce::String(static_cast<double>(bytes) / 1024.0, 1) + " KB";
+    return juce::String(bytes) + " B";
+}
+
+} // namespace
+
+void MemoryReport::add(std::string group, std::string name, int64_t bytes, bool estimated)
+{
+    entries.push_back({std::move(group), std::move(name), bytes, estimated});
+}
+
+int64_t MemoryReport::getTotal() const
+{
+    int64_t total = 0;
+    for (const auto &entry : entries)
+        total += entry.bytes;
+    return total;
+}
+
+int64_t MemoryReport::getGroupTotal(const std::string &group) const
+{
+    int64_t total = 0;
+    for (const auto &entry : entries)
+    {
+        if (entry.group == group)
+            total += entry.bytes;
+    }
+    return total;
+}
+
+std::string MemoryReport::toText() const
+{
+    juce::String text;
+    juce::String group;
+    for (const auto &entry : entries)
+    {
+        if (group != juce::String(entry.group))
+        {
+            group = entry.group;
+            text << (text.isEmpty() ? "" : "\n") << group << "  "
+                 << formatBytes(getGroupTotal(entry.group)) << "\n";
+        }
+        text << "    " << juce::String(entry.name).paddedRight(' ', 32)
+             << formatBytes(entry.bytes).paddedLeft(' ', 10) << (entry.estimated ? "  ~" : "")
+             << "\n";
+    }
+
+    text << "\nAccounted for  " << formatBytes(getTotal()) << "\n";
+    if (residentBytes > 0)
+        text << "Process resident  " << formatBytes(residentBytes) << "\n";
+    text << "(~ estimated)\n";
+    return text.toStdString();
+}
+
+std::string MemoryReport::toJson() const
+{
+    juce::Array<juce::var> list;
+    for (const auto &entry : entries)
+    {
+        auto *item = new juce::DynamicObject();
+        item->setProperty("group", juce::String(entry.group));
+        item->setProperty("name", juce::String(entry.name));
+        item->setProperty("bytes", static_cast<juce::int64>(entry.bytes));
+        item->setProperty("estimated", entry.estimated);
+        list.add(juce::var(item));
+    }
+
+    auto *root = new juce::DynamicObject();
+    root->setProperty("totalBytes", static_cast<juce::int64>(getTotal()));
+    root->setProperty("residentBytes", static_cast<juce::int64>(residentBytes));
+    root->setProperty("entries", list);
+    return juce::JSON::toString(juce::var(root)).toStdString();
+}
+
+int64_t MemoryReport::currentResidentBytes()
+{
+#if defined(__linux__)
+    // The second field of statm is resident pages
+    long long size = 0;
+    long long resident = 0;
+    FILE *statm = std::fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0;
+    int fields = std::fscanf(statm, "%lld %lld", &size, &resident);
+    std::fclose(statm);
+    return fields == 2 ? static_cast<int64_t>(resident) * sysconf(_SC_PAGESIZE) : 0;
+#elif defined(__APPLE__)
+    mach_task_basic_info info{};
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info),
+                  &count) != KERN_SUCCESS)
+        return 0;
+    return static_cast<int64_t>(info.resident_size);
+#else
+    return 0;
+#endif
+}
+
+} // namespace SurgeBox
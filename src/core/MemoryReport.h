@@ -0,0 +1,54 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace SurgeBox
+{
+
+struct MemoryEntry
+{
+    std::string group; // "Surge", "Patterns", "Undo", "Project", "Engine" or "Editor"
+    std::string name;
+    int64_t bytes{0};
+    bool estimated{false}; // Otherwise counted exactly or measured
+};
+
+/**
+ * Where a SurgeBox instance's memory goes.
+ *
+ * Containers SurgeBox owns are counted by their capacity, and undo steps by
+ * the sizes they report to the UndoManager. Surge instances and editors are
+ * estimated as the growth in resident memory while they were created, which
+ * counts whatever other threads allocated at the time too: the figures are
+ * only valid when nothing else was being constructed concurrently. Surge's
+ * static tables, shared by every instance in the process, are reported on
+ * their own line. ValueTrees are estimated from their node counts.
+ */
+struct MemoryReport
+{
+    std::vector<MemoryEntry> entries;
+    int64_t residentBytes{0}; // The whole process when the report was taken, 0 - unknown
+
+    void add(std::string group, std::string name, int64_t bytes, bool estimated = false);
+    int64_t getTotal() const;
+    int64_t getGroupTotal(const std::string &group) const;
+
+    // A table for people, and JSON for tools
+    std::string toText() const;
+    std::string toJson() const;
+
+    // This process's resident memory, 0 where it can't be read
+    static int64_t currentResidentBytes();
+};
+
+} // namespace SurgeBox
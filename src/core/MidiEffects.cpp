@@ -0,0 +1,445 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "MidiEffects.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace SurgeBox
+{
+
+namespace
+{
+
+// Shortest step accepted, in beats - a 1/256 note
+constexpr double MIN_RATE = 1.0 / 64.0;
+
+// Input notes this close after a step still make it - the sequencer rounds its
+// sample offsets on its own
+constexpr int INPUT_TOLERANCE_SAMPLES = 2;
+
+// Call fn(sample) for each multiple of rate the block crosses on the loop, with
+// the sample offsets worked out as the sequencer places its notes. The grid
+// restarts at the loop point, so steps stay on the bar.
+template <typename Fn>
+void forEachStep(const MidiEffectChain::BlockTiming &timing, double rate, Fn &&fn)
+{
+    double endBeat = timing.startBeat + timing.numSamples * timing.beatsPerSample;
+
+    // Steps in [from, to), the same products deciding both ends so that
+    // consecutive blocks never both take (or both skip) a boundary
+    auto walk = [&](double from, double to, int baseSample) {
+        double k = std::ceil(from / rate);
+        while (k > 0.0 && (k - 1.0) * rate >= from)
+            k -= 1.0;
+        while (k * rate < from)
+            k += 1.0;
+
+        for (; k * rate < to; k += 1.0)
+        {
+            int sample = baseSample + static_cast<int>((k * rate - from) / timing.beatsPerSample);
+            fn(std::clamp(sample, 0, timing.numSamples - 1));
+        }
+    };
+
+    if (endBeat >= timing.loopEnd)
+    {
+        walk(timing.startBeat, timing.loopEnd, 0);
+        int loopSample =
+            static_cast<int>((timing.loopEnd - timing.startBeat) / timing.beatsPerSample);
+        walk(0.0, endBeat - timing.loopEnd, loopSample);
+    }
+    else
+    {
+        walk(timing.startBeat, endBeat, 0);
+    }
+}
+
+void addNote(juce::MidiBuffer &buffer, uint8_t pitch, uint8_t velocity, int sampleOffset)
+{
+    const juce::uint8 data[3] = {static_cast<juce::uint8>(velocity > 0 ? 0x90 : 0x80), pitch,
+                                 velocity};
+    buffer.addEvent(data, 3, sampleOffset);
+}
+
+} // namespace
+
+// ============================================================================
+// EventList
+// ============================================================================
+
+void MidiEffectChain::EventList::push(const NoteEvent &event)
+{
+    if (size_ < MAX_EVENTS)
+        events_[static_cast<size_t>(size_++)] = event;
+}
+
+void MidiEffectChain::EventList::sort()
+{
+    // Mostly in order already - insertion sort, stable
+    auto before = [](const NoteEvent &a, const NoteEvent &b) {
+        if (a.sampleOffset != b.sampleOffset)
+            return a.sampleOffset < b.sampleOffset;
+        return a.velocity == 0 && b.velocity > 0;
+    };
+
+    for (int i = 1; i < size_; ++i)
+    {
+        NoteEvent event = events_[static_cast<size_t>(i)];
+        int j = i;
+        for (; j > 0 && before(event, events_[static_cast<size_t>(j - 1)]); --j)
+            events_[static_cast<size_t>(j)] = events_[static_cast<size_t>(j - 1)];
+        events_[static_cast<size_t>(j)] = event;
+    }
+}
+
+// ============================================================================
+// MidiEffectChain
+// ============================================================================
+
+MidiEffectChain::MidiEffectChain() { scratch_.ensureSize(MIDI_BUFFER_BYTES); }
+
+void MidiEffectChain::setSettings(const MidiEffectChainSettings &settings)
+{
+    slots_[static_cast<size_t>(back_)] = settings;
+    back_ = middle_.exchange(back_ | SLOT_NEW) & SLOT_INDEX;
+}
+
+void MidiEffectChain::process(juce::MidiBuffer &buffer, const BlockTiming &timing)
+{
+    bool changed = (middle_.load() & SLOT_NEW) != 0;
+
+    // Bypassed - only keep track of what is held and sounding
+    if (!changed && numStages_ == 0)
+    {
+        for (const auto metadata : buffer)
+        {
+            if (metadata.numBytes < 3)
+                continue;
+            uint8_t status = metadata.data[0] & 0xf0;
+            uint8_t pitch = metadata.data[1] & 0x7f;
+            bool on = status == 0x90 && metadata.data[2] > 0;
+            if (on || status == 0x80 || status == 0x90)
+            {
+                inputHeld_[pitch] = on ? metadata.data[2] : 0;
+                if (sounding_[pitch] != on)
+                    numSounding_ += on ? 1 : -1;
+                sounding_[pitch] = on;
+            }
+        }
+        return;
+    }
+
+    EventList *in = &events_[0];
+    EventList *out = &events_[1];
+    in->clear();
+
+    if (changed)
+    {
+        adoptSettings();
+
+        // The new chain starts from the notes held at its input
+        for (int pitch = 0; pitch < 128; ++pitch)
+        {
+            if (inputHeld_[static_cast<size_t>(pitch)] > 0)
+                in->push({0, static_cast<uint8_t>(pitch), inputHeld_[static_cast<size_t>(pitch)]});
+        }
+    }
+
+    // Notes go through the stages, anything else straight on
+    for (const auto metadata : buffer)
+    {
+        uint8_t status = metadata.numBytes >= 3 ? metadata.data[0] & 0xf0 : 0;
+        if (status != 0x80 && status != 0x90)
+        {
+            scratch_.addEvent(metadata.data, metadata.numBytes, metadata.samplePosition);
+            continue;
+        }
+
+        uint8_t pitch = metadata.data[1] & 0x7f;
+        uint8_t velocity = status == 0x90 ? metadata.data[2] & 0x7f : 0;
+        inputHeld_[pitch] = velocity;
+        in->push({metadata.samplePosition, pitch, velocity});
+    }
+    in->sort();
+
+    for (int s = 0; s < numStages_; ++s)
+    {
+        auto &stage = stages_[static_cast<size_t>(s)];
+        out->clear();
+        if (stage.settings.type == MidiEffectSettings::Type::Chord)
+            processChord(stage, *in, *out);
+        else
+            processStepped(stage, *in, *out, timing);
+        out->sort();
+        std::swap(in, out);
+    }
+
+    for (int i = 0; i < in->size(); ++i)
+    {
+        const auto &event = (*in)[i];
+        bool on = event.velocity > 0;
+        if (sounding_[event.pitch] != on)
+            numSounding_ += on ? 1 : -1;
+        sounding_[event.pitch] = on;
+        addNote(scratch_, event.pitch, event.velocity, event.sampleOffset);
+    }
+
+    buffer.swapWith(scratch_);
+    scratch_.clear();
+}
+
+void MidiEffectChain::flush(juce::MidiBuffer &buffer)
+{
+    if (numSounding_ == 0 && numStages_ == 0)
+        return;
+
+    for (int pitch = 0; pitch < 128; ++pitch)
+    {
+        if (sounding_[static_cast<size_t>(pitch)])
+            addNote(buffer, static_cast<uint8_t>(pitch), 0, 0);
+    }
+    sounding_.fill(false);
+    numSounding_ = 0;
+    inputHeld_.fill(0);
+    resetStages();
+}
+
+void MidiEffectChain::adoptSettings()
+{
+    front_ = middle_.exchange(front_) & SLOT_INDEX;
+    const auto &settings = slots_[static_cast<size_t>(front_)];
+
+    // Release whatever the old chain left sounding
+    for (int pitch = 0; pitch < 128; ++pitch)
+    {
+        if (sounding_[static_cast<size_t>(pitch)])
+            addNote(scratch_, static_cast<uint8_t>(pitch), 0, 0);
+    }
+    sounding_.fill(false);
+    numSounding_ = 0;
+
+    numStages_ = 0;
+    for (const auto &effect : settings)
+    {
+        if (effect.type == MidiEffectSettings::Type::Off)
+            continue;
+
+        auto &stage = stages_[static_cast<size_t>(numStages_++)];
+        stage.settings = effect;
+        stage.settings.rate = std::max(effect.rate, MIN_RATE);
+        stage.settings.gate = std::clamp(effect.gate, 0.05f, 1.0f);
+        stage.settings.octaves = std::clamp(effect.octaves, 1, 4);
+        stage.settings.numIntervals = std::clamp(effect.numIntervals, 0, MAX_CHORD_INTERVALS);
+    }
+    resetStages();
+}
+
+void MidiEffectChain::resetStages()
+{
+    for (auto &stage : stages_)
+    {
+        stage.numHeld = 0;
+        stage.step = 0;
+        stage.numPending = 0;
+        stage.chordCount.fill(0);
+    }
+}
+
+void MidiEffectChain::processChord(Stage &stage, const EventList &in, EventList &out)
+{
+    for (int i = 0; i < in.size(); ++i)
+    {
+        const auto &event = in[i];
+        auto &notes = stage.chordNotes[event.pitch];
+        auto &count = stage.chordCount[event.pitch];
+
+        // A note-off, or a retrigger, releases the chord struck before
+        for (int n = 0; n < count; ++n)
+            out.push({event.sampleOffset, notes[static_cast<size_t>(n)], 0});
+        count = 0;
+
+        if (event.velocity == 0)
+            continue;
+
+        auto add = [&](int pitch) {
+            if (pitch < 0 || pitch > 127)
+                return;
+            auto p = static_cast<uint8_t>(pitch);
+            if (std::find(notes.begin(), notes.begin() + count, p) != notes.begin() + count)
+                return;
+            notes[count++] = p;
+            out.push({event.sampleOffset, p, event.velocity});
+        };
+
+        add(event.pitch);
+        for (int n = 0; n < stage.settings.numIntervals; ++n)
+            add(event.pitch + stage.settings.intervals[static_cast<size_t>(n)]);
+    }
+}
+
+void MidiEffectChain::processStepped(Stage &stage, const EventList &in, EventList &out,
+                                     const BlockTiming &timing)
+{
+    const auto &settings = stage.settings;
+    bool arpeggiate = settings.type == MidiEffectSettings::Type::Arpeggiator;
+    int gateSamples = std::max(
+        1, static_cast<int>(settings.rate * settings.gate / timing.beatsPerSample));
+
+    auto handle = [&](const NoteEvent &event) {
+        auto begin = stage.held.begin();
+        auto end = begin + stage.numHeld;
+        auto found = std::find_if(begin, end, [&](const HeldNote &h) {
+            return h.pitch == event.pitch;
+        });
+
+        if (event.velocity == 0)
+        {
+            if (found != end)
+            {
+                std::move(found + 1, end, found);
+                --stage.numHeld;
+            }
+            if (stage.numHeld == 0)
+                stage.step = 0;
+            return;
+        }
+
+        if (found == end)
+        {
+            if (stage.numHeld == MAX_HELD)
+                return;
+            found = end;
+            ++stage.numHeld;
+        }
+        *found = {event.pitch, event.velocity, -1};
+
+        // Note repeat strikes at once, then on every step while held
+        if (!arpeggiate)
+        {
+            found->startSample = event.sampleOffset;
+            schedule(stage, out, event.sampleOffset, event.pitch, event.velocity, gateSamples);
+        }
+    };
+
+    // Input notes up to a step's sample are taken before it fires
+    int next = 0;
+    auto takeInputs = [&](int sample) {
+        for (; next < in.size() && in[next].sampleOffset <= sample; ++next)
+            handle(in[next]);
+    };
+
+    forEachStep(timing, settings.rate, [&](int sample) {
+        takeInputs(sample + INPUT_TOLERANCE_SAMPLES);
+        if (arpeggiate)
+            fireArpeggio(stage, sample, gateSamples, out);
+        else
+            fireRepeats(stage, sample, gateSamples, out);
+    });
+    takeInputs(INT_MAX - INPUT_TOLERANCE_SAMPLES);
+
+    // Release what ends this block; the rest counts down into the next
+    int kept = 0;
+    for (int i = 0; i < stage.numPending; ++i)
+    {
+        auto pending = stage.pending[static_cast<size_t>(i)];
+        if (pending.sampleOffset < timing.numSamples)
+        {
+            out.push({pending.sampleOffset, pending.pitch, 0});
+            continue;
+        }
+        pending.sampleOffset -= timing.numSamples;
+        stage.pending[static_cast<size_t>(kept++)] = pending;
+    }
+    stage.numPending = kept;
+
+    for (int h = 0; h < stage.numHeld; ++h)
+        stage.held[static_cast<size_t>(h)].startSample = -1;
+}
+
+void MidiEffectChain::fireArpeggio(Stage &stage, int sample, int gateSamples, EventList &out)
+{
+    int numHeld = stage.numHeld;
+    if (numHeld == 0)
+        return;
+
+    const auto &settings = stage.settings;
+    std::array<HeldNote, MAX_HELD> order;
+    std::copy(stage.held.begin(), stage.held.begin() + numHeld, order.begin());
+    if (settings.arpMode != MidiEffectSettings::ArpMode::AsPlayed)
+    {
+        std::sort(order.begin(), order.begin() + numHeld,
+                  [](const HeldNote &a, const HeldNote &b) { return a.pitch < b.pitch; });
+    }
+
+    int length = numHeld * settings.octaves;
+    int index = 0;
+    switch (settings.arpMode)
+    {
+        case MidiEffectSettings::ArpMode::Up:
+        case MidiEffectSettings::ArpMode::AsPlayed:
+            index = stage.step % length;
+            break;
+        case MidiEffectSettings::ArpMode::Down:
+            index = length - 1 - stage.step % length;
+            break;
+        case MidiEffectSettings::ArpMode::UpDown:
+        {
+            // Ends aren't repeated: 0 1 2 1 0 1 2 ...
+            int cycle = length > 1 ? 2 * length - 2 : 1;
+            int position = stage.step % cycle;
+            index = position < length ? position : cycle - position;
+            break;
+        }
+    }
+    ++stage.step;
+
+    const auto &note = order[static_cast<size_t>(index % numHeld)];
+    int pitch = note.pitch + 12 * (index / numHeld);
+    if (pitch <= 127)
+        schedule(stage, out, sample, static_cast<uint8_t>(pitch), note.velocity, gateSamples);
+}
+
+void MidiEffectChain::fireRepeats(Stage &stage, int sample, int gateSamples, EventList &out)
+{
+    for (int h = 0; h < stage.numHeld; ++h)
+    {
+        const auto &note = stage.held[static_cast<size_t>(h)];
+        if (note.startSample != sample)
+            schedule(stage, out, sample, note.pitch, note.velocity, gateSamples);
+    }
+}
+
+void MidiEffectChain::schedule(Stage &stage, EventList &out, int sample, uint8_t pitch,
+                               uint8_t velocity, int gateSamples)
+{
+    // A pitch still sounding is cut where it is struck again
+    int kept = 0;
+    for (int i = 0; i < stage.numPending; ++i)
+    {
+        const auto &pending = stage.pending[static_cast<size_t>(i)];
+        if (pending.pitch == pitch)
+        {
+            out.push({std::min(pending.sampleOffset, sample), pitch, 0});
+            continue;
+        }
+        stage.pending[static_cast<size_t>(kept++)] = pending;
+    }
+    stage.numPending = kept;
+
+    // Without room to schedule its release the note isn't played
+    if (stage.numPending == MAX_PENDING)
+        return;
+
+    out.push({sample, pitch, velocity});
+    stage.pending[static_cast<size_t>(stage.numPending++)] = {sample + gateSamples, pitch};
+}
+
+} // namespace SurgeBox
@@ -0,0 +1,151 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include "GrooveboxProject.h"
+#include <juce_audio_basics/juce_audio_basics.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace SurgeBox
+{
+
+/**
+ * A voice's MIDI effect chain - arpeggiator, chord and note repeat stages run
+ * on the sequencer's notes between the sequencer and Surge.
+ *
+ * Runs on the audio thread with fixed-capacity state only: notes past a
+ * capacity are dropped, never allocated for. Generated notes are scheduled on
+ * the sequencer's beat grid at sample accuracy; note-offs that fall in a later
+ * block are carried over as sample countdowns.
+ *
+ * Settings come from the message thread through a triple buffer. A new chain
+ * releases everything the old one left sounding and is fed the notes still
+ * held at its input.
+ */
+class MidiEffectChain
+{
+  public:
+    // Where the block falls on the sequencer's loop
+    struct BlockTiming
+    {
+        double startBeat{0.0};
+        double loopEnd{4.0};
+        double beatsPerSample{0.0};
+        int numSamples{0};
+    };
+
+    MidiEffectChain();
+
+    // Message thread
+    void setSettings(const MidiEffectChainSettings &settings);
+
+    // Audio thread - rework the note events of buffer in place
+    void process(juce::MidiBuffer &buffer, const BlockTiming &timing);
+
+    // Audio thread - the transport stopped: release every note the chain is
+    // sounding and forget held notes
+    void flush(juce::MidiBuffer &buffer);
+
+    // Audio thread - whether any stage is on
+    bool isActive() const { return numStages_ > 0; }
+
+  private:
+    static constexpr int MAX_EVENTS = 256;
+    static constexpr int MAX_HELD = 16;
+    static constexpr int MAX_PENDING = 64;
+    static constexpr int MIDI_BUFFER_BYTES = 4096;
+
+    struct NoteEvent
+    {
+        int sampleOffset{0};
+        uint8_t pitch{0};
+        uint8_t velocity{0}; // 0 - note-off
+    };
+
+    class EventList
+    {
+      public:
+        void clear() { size_ = 0; }
+        void push(const NoteEvent &event);
+        void sort(); // By sample; note-offs before note-ons at the same sample
+        int size() const { return size_; }
+        const NoteEvent &operator[](int i) const { return events_[static_cast<size_t>(i)]; }
+
+      private:
+        std::array<NoteEvent, MAX_EVENTS> events_{};
+        int size_{0};
+    };
+
+    struct HeldNote
+    {
+        uint8_t pitch{0};
+        uint8_t velocity{0};
+        int startSample{-1}; // Note repeat - struck this block, at this sample
+    };
+
+    struct PendingOff
+    {
+        int sampleOffset{0}; // From the start of the current block
+        uint8_t pitch{0};
+    };
+
+    struct Stage
+    {
+        MidiEffectSettings settings;
+
+        // Arpeggiator and note repeat - held input notes in the order played,
+        // the arpeggio position, and generated notes not yet released
+        std::array<HeldNote, MAX_HELD> held{};
+        int numHeld{0};
+        int step{0};
+        std::array<PendingOff, MAX_PENDING> pending{};
+        int numPending{0};
+
+        // Chord - notes sounding for each input pitch
+        std::array<std::array<uint8_t, MAX_CHORD_INTERVALS + 1>, 128> chordNotes{};
+        std::array<uint8_t, 128> chordCount{};
+    };
+
+    void adoptSettings();
+    void resetStages();
+
+    void processChord(Stage &stage, const EventList &in, EventList &out);
+    void processStepped(Stage &stage, const EventList &in, EventList &out,
+                        const BlockTiming &timing);
+    void fireArpeggio(Stage &stage, int sample, int gateSamples, EventList &out);
+    void fireRepeats(Stage &stage, int sample, int gateSamples, EventList &out);
+    static void schedule(Stage &stage, EventList &out, int sample, uint8_t pitch,
+                         uint8_t velocity, int gateSamples);
+
+    // Message thread -> audio thread triple buffer. The writer fills its back
+    // slot and swaps it into the middle; the reader swaps the middle out when
+    // it is marked new.
+    static constexpr int SLOT_INDEX = 3;
+    static constexpr int SLOT_NEW = 4;
+    std::array<MidiEffectChainSettings, 3> slots_{};
+    std::atomic<int> middle_{1};
+    int back_{0};  // Message thread
+    int front_{2}; // Audio thread
+
+    // Audio thread
+    std::array<Stage, MAX_MIDI_EFFECTS> stages_{};
+    int numStages_{0};
+    EventList events_[2];
+    std::array<uint8_t, 128> inputHeld_{}; // Velocity of each note held at the input
+    std::array<bool, 128> sounding_{};     // Notes the chain has sent on and not released
+    int numSounding_{0};
+    juce::MidiBuffer scratch_;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MidiEffectChain)
+};
+
+} // namespace SurgeBox
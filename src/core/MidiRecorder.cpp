@@ -0,0 +1,173 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "MidiRecorder.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace SurgeBox
+{
+
+MidiRecorder::MidiRecorder()
+    : captureBuffer_(static_cast<size_t>(CAPTURE_CAPACITY)),
+      keyboardBuffer_(static_cast<size_t>(KEYBOARD_CAPACITY))
+{
+}
+
+void MidiRecorder::setArmed(bool armed)
+{
+    armed_.store(armed);
+    if (!armed)
+        reset();
+}
+
+void MidiRecorder::pushKeyboardNote(uint8_t pitch, uint8_t velocity)
+{
+    if (!armed_.load())
+        return;
+
+    int start1, size1, start2, size2;
+    keyboardFifo_.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 > 0)
+        keyboardBuffer_[static_cast<size_t>(start1)] = {pitch, velocity};
+    else if (size2 > 0)
+        keyboardBuffer_[static_cast<size_t>(start2)] = {pitch, velocity};
+    keyboardFifo_.finishedWrite(size1 + size2);
+}
+
+void MidiRecorder::push(const Event &event)
+{
+    // A full FIFO drops the note - the audio thread never waits for the reader
+    int start1, size1, start2, size2;
+    captureFifo_.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 > 0)
+        captureBuffer_[static_cast<size_t>(start1)] = event;
+    else if (size2 > 0)
+        captureBuffer_[static_cast<size_t>(start2)] = event;
+    captureFifo_.finishedWrite(size1 + size2);
+}
+
+void MidiRecorder::update(const std::array<PatternModel *, NUM_VOICES> &models,
+                          double playheadBeat, bool playing)
+{
+    // Keys still down when the transport stops never get their note-off recorded
+    if (!playing)
+    {
+        commitAll(models);
+        return;
+    }
+
+    drain(models);
+
+    for (int v = 0; v < NUM_VOICES; ++v)
+    {
+        auto *model = models[static_cast<size_t>(v)];
+        if (!model)
+            continue;
+
+        // The pass ends when the playhead wraps this voice's pattern
+        double length = model->lengthInBeats();
+        double local = length > 0.0 ? std::fmod(playheadBeat, length) : 0.0;
+        bool wrapped = local < lastLocalBeat_[static_cast<size_t>(v)];
+        lastLocalBeat_[static_cast<size_t>(v)] = local;
+
+        if (wrapped)
+            commit(v, *model);
+    }
+}
+
+void MidiRecorder::commitAll(const std::array<PatternModel *, NUM_VOICES> &models)
+{
+    drain(models);
+    for (int v = 0; v < NUM_VOICES; ++v)
+    {
+        if (auto *model = models[static_cast<size_t>(v)])
+            commit(v, *model);
+    }
+    reset();
+}
+
+void MidiRecorder::drain(const std::array<PatternModel *, NUM_VOICES> &models)
+{
+    int start1, size1, start2, size2;
+    captureFifo_.prepareToRead(captureFifo_.getNumReady(), start1, size1, start2, size2);
+
+    auto handle = [&](const Event &event) {
+        auto *model = models[static_cast<size_t>(event.voice)];
+        if (!model || event.pitch > 127)
+            return;
+
+        double length = model->lengthInBeats();
+        if (length <= 0.0)
+            return;
+
+        auto &held = held_[static_cast<size_t>(event.voice)][event.pitch];
+        if (event.velocity > 0)
+        {
+            // Retriggering a held key ends the previous note there
+            finishNote(event.voice, event.pitch, event.elapsedBeats, length);
+            held = {true, std::fmod(event.beat, length), event.elapsedBeats, event.velocity};
+        }
+        else
+        {
+            finishNote(event.voice, event.pitch, event.elapsedBeats, length);
+        }
+    };
+
+    for (int i = 0; i < size1; ++i)
+        handle(captureBuffer_[static_cast<size_t>(start1 + i)]);
+    for (int i = 0; i < size2; ++i)
+        handle(captureBuffer_[static_cast<size_t>(start2 + i)]);
+    captureFifo_.finishedRead(size1 + size2);
+}
+
+void MidiRecorder::finishNote(int voice, uint8_t pitch, double elapsedBeats, double patternLength)
+{
+    auto &held = held_[static_cast<size_t>(voice)][pitch];
+    if (!held.held)
+        return;
+    held.held = false;
+
+    double start = held.startBeat;
+    if (quantizeGrid_ > 0.0)
+    {
+        start = std::round(start / quantizeGrid_) * quantizeGrid_;
+        if (start >= patternLength)
+            start -= patternLength;
+    }
+
+    // A note held across the loop point is cut at the pattern end
+    double duration = std::min(elapsedBeats - held.elapsedBeats, patternLength - start);
+    finished_[static_cast<size_t>(voice)].push_back(
+        {0, start, duration, pitch, static_cast<int>(held.velocity)});
+}
+
+void MidiRecorder::commit(int voice, PatternModel &model)
+{
+    auto &notes = finished_[static_cast<size_t>(voice)];
+    if (notes.empty())
+        return;
+
+    model.addNotes("Record Notes", notes);
+    notes.clear();
+}
+
+void MidiRecorder::reset()
+{
+    for (auto &voiceHeld : held_)
+    {
+        for (auto &held : voiceHeld)
+            held.held = false;
+    }
+    for (auto &notes : finished_)
+        notes.clear();
+    lastLocalBeat_.fill(0.0);
+}
+
+} // namespace SurgeBox
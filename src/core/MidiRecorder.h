@@ -0,0 +1,125 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include "GrooveboxProject.h"
+#include "PatternModel.h"
+#include <juce_core/juce_core.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace SurgeBox
+{
+
+/**
+ * Live overdub recording into the voices' patterns.
+ *
+ * The audio thread stamps each incoming note with the sequencer's position and
+ * pushes it into a fixed-size lock-free FIFO - no allocation, no locks, and
+ * notes that don't fit are dropped rather than waited for. The message thread
+ * drains it, pairs note-ons with their note-offs, quantizes, and commits what
+ * each voice played during a loop pass as one undo step.
+ *
+ * Notes from the on-screen keyboard reach the audio thread through a second
+ * FIFO and are stamped at the start of the block that plays them.
+ */
+class MidiRecorder
+{
+  public:
+    struct Event
+    {
+        double beat{0.0};         // Sequencer loop position
+        double elapsedBeats{0.0}; // Beats played since the transport started - never wraps
+        int voice{0};
+        uint8_t pitch{0};
+        uint8_t velocity{0}; // 0 - note-off
+    };
+
+    MidiRecorder();
+
+    // Message thread
+    void setArmed(bool armed);
+    bool isArmed() const { return armed_.load(); }
+    void setQuantize(double grid) { quantizeGrid_ = grid; } // Beats, 0 - off
+    double getQuantize() const { return quantizeGrid_; }
+
+    // A note played on the on-screen keyboard (velocity 0 - released)
+    void pushKeyboardNote(uint8_t pitch, uint8_t velocity);
+
+    // Pair up what was captured and commit each voice's pass once the playhead
+    // has wrapped its pattern, or everything when the transport stops.
+    // models are the patterns being recorded into, by voice.
+    void update(const std::array<PatternModel *, NUM_VOICES> &models, double playheadBeat,
+                bool playing);
+
+    // Commit every voice's pass as it stands, wrapped or not, and forget held
+    // keys - before disarming mid-loop
+    void commitAll(const std::array<PatternModel *, NUM_VOICES> &models);
+
+    // Audio thread
+    void push(const Event &event);
+
+    // Call fn(pitch, velocity) for each keyboard note queued since the last call
+    template <typename Fn> void takeKeyboardNotes(Fn &&fn);
+
+  private:
+    void drain(const std::array<PatternModel *, NUM_VOICES> &models);
+    void finishNote(int voice, uint8_t pitch, double elapsedBeats, double patternLength);
+    void commit(int voice, PatternModel &model);
+    void reset();
+
+    static constexpr int CAPTURE_CAPACITY = 4096;
+    static constexpr int KEYBOARD_CAPACITY = 256;
+
+    std::atomic<bool> armed_{false};
+    double quantizeGrid_{0.0};
+
+    juce::AbstractFifo captureFifo_{CAPTURE_CAPACITY};
+    std::vector<Event> captureBuffer_;
+
+    struct KeyboardNote
+    {
+        uint8_t pitch{0};
+        uint8_t velocity{0};
+    };
+    juce::AbstractFifo keyboardFifo_{KEYBOARD_CAPACITY};
+    std::vector<KeyboardNote> keyboardBuffer_;
+
+    // Message thread - notes still held, and notes finished this pass
+    struct HeldNote
+    {
+        bool held{false};
+        double startBeat{0.0}; // Pattern-local
+        double elapsedBeats{0.0};
+        uint8_t velocity{0};
+    };
+    std::array<std::array<HeldNote, 128>, NUM_VOICES> held_{};
+    std::array<std::vector<PatternModel::NoteEdit>, NUM_VOICES> finished_;
+    std::array<double, NUM_VOICES> lastLocalBeat_{};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MidiRecorder)
+};
+
+template <typename Fn> void MidiRecorder::takeKeyboardNotes(Fn &&fn)
+{
+    int start1, size1, start2, size2;
+    keyboardFifo_.prepareToRead(keyboardFifo_.getNumReady(), start1, size1, start2, size2);
+    for (int i = 0; i < size1; ++i)
+        fn(keyboardBuffer_[static_cast<size_t>(start1 + i)].pitch,
+           keyboardBuffer_[static_cast<size_t>(start1 + i)].velocity);
+    for (int i = 0; i < size2; ++i)
+        fn(keyboardBuffer_[static_cast<size_t>(start2 + i)].pitch,
+           keyboardBuffer_[static_cast<size_t>(start2 + i)].velocity);
+    keyboardFifo_.finishedRead(size1 + size2);
+}
+
+} // namespace SurgeBox
@@ -0,0 +1,430 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "NoteTransforms.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace SurgeBox
+{
+
+namespace
+{
+
+// Two notes closer than this are treated as touching, not overlapping
+constexpr double OVERLAP_EPSILON = 1.0e-9;
+
+// Counter-based hash (splitmix64) - the same seed and note always get the same
+// offset, so humanize is repeatable and needs no generator state between notes
+inline uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Uniform in [-1, 1)
+inline double bipolar(uint64_t bits) { return static_cast<double>(bits >> 11) * 0x1.0p-52 - 1.0; }
+
+} // namespace
+
+// ============================================================================
+// NoteBuffer
+// ============================================================================
+
+void NoteBuffer::clear()
+{
+    ids.clear();
+    start.clear();
+    duration.clear();
+    pitch.clear();
+    velocity.clear();
+}
+
+void NoteBuffer::reserve(size_t n)
+{
+    ids.reserve(n);
+    start.reserve(n);
+    duration.reserve(n);
+    pitch.reserve(n);
+    velocity.reserve(n);
+}
+
+void NoteBuffer::push(uint32_t id, double startBeat, double length, int notePitch, int noteVelocity)
+{
+    ids.push_back(id);
+    start.push_back(startBeat);
+    duration.push_back(length);
+    pitch.push_back(notePitch);
+    velocity.push_back(noteVelocity);
+}
+
+// ============================================================================
+// NoteTransform
+// ============================================================================
+
+NoteTransform NoteTransform::transpose(int semitones)
+{
+    return {Type::Transpose, static_cast<double>(semitones), 0.0, 0};
+}
+
+NoteTransform NoteTransform::quantize(double grid, double strength)
+{
+    return {Type::Quantize, grid, std::clamp(strength, 0.0, 1.0), 0};
+}
+
+NoteTransform NoteTransform::humanize(double timing, int velocity, uint32_t seed)
+{
+    return {Type::Humanize, timing, static_cast<double>(velocity), seed};
+}
+
+NoteTransform NoteTransform::scaleVelocity(double factor, int offset)
+{
+    return {Type::ScaleVelocity, factor, static_cast<double>(offset), 0};
+}
+
+NoteTransform NoteTransform::reverse() { return {Type::Reverse, 0.0, 0.0, 0}; }
+
+NoteTransform NoteTransform::stretch(double factor) { return {Type::Stretch, factor, 0.0, 0}; }
+
+NoteTransform NoteTransform::legato() { return {Type::Legato, 0.0, 0.0, 0}; }
+
+// ============================================================================
+// NoteTransformer
+// ============================================================================
+
+bool NoteTransformer::apply(PatternModel &model, const std::vector<uint32_t> &noteIds,
+                            const std::vector<NoteTransform> &pipeline, const juce::String &name)
+{
+    if (noteIds.empty() || pipeline.empty())
+        return false;
+
+    // Selected notes by index, in pattern (start) order and without duplicates
+    selectedIndices_.clear();
+    for (uint32_t id : noteIds)
+    {
+        int index = model.indexOfNote(id);
+        if (index >= 0)
+            selectedIndices_.push_back(index);
+    }
+    std::sort(selectedIndices_.begin(), selectedIndices_.end());
+    selectedIndices_.erase(std::unique(selectedIndices_.begin(), selectedIndices_.end()),
+                           selectedIndices_.end());
+    if (selectedIndices_.empty())
+        return false;
+
+    double start, duration;
+    int pitch, velocity;
+
+    selected_.clear();
+    selected_.reserve(selectedIndices_.size());
+    for (int index : selectedIndices_)
+    {
+        model.getNoteAt(index, start, duration, pitch, velocity);
+        selected_.push(model.getNoteId(index), start, duration, pitch, velocity);
+    }
+
+    run(selected_, pipeline, model.lengthInBeats());
+
+    // Only unselected notes within the transformed selection's span and pitch
+    // range can collide with it
+    double spanStart = selected_.start[0];
+    double spanEnd = selected_.start[0] + selected_.duration[0];
+    int lowPitch = selected_.pitch[0];
+    int highPitch = selected_.pitch[0];
+    for (size_t i = 1; i < selected_.size(); ++i)
+    {
+        spanStart = std::min(spanStart, selected_.start[i]);
+        spanEnd = std::max(spanEnd, selected_.start[i] + selected_.duration[i]);
+        lowPitch = std::min(lowPitch, selected_.pitch[i]);
+        highPitch = std::max(highPitch, selected_.pitch[i]);
+    }
+
+    // Notes are sorted by start - none from the first starting at the span's end on
+    auto startAt = [&](int i) {
+        model.getNoteAt(i, start, duration, pitch, velocity);
+        return start;
+    };
+    int lo = 0, hi = model.getNumNotes();
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (startAt(mid) < spanEnd)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    others_.clear();
+    auto nextSelected = selectedIndices_.begin();
+    for (int i = 0; i < lo; ++i)
+    {
+        if (nextSelected != selectedIndices_.end() && *nextSelected == i)
+        {
+            ++nextSelected;
+            continue;
+        }
+
+        model.getNoteAt(i, start, duration, pitch, velocity);
+        if (start + duration > spanStart && pitch >= lowPitch && pitch <= highPitch)
+            others_.push(model.getNoteId(i), start, duration, pitch, velocity);
+    }
+
+    resolveOverlaps();
+
+    size_t numSelected = selected_.size();
+    std::vector<PatternModel::NoteEdit> edits;
+    std::vector<uint32_t> removedIds;
+    edits.reserve(numSelected);
+
+    for (size_t i = 0; i < numSelected; ++i)
+    {
+        if (removed_[i])
+            removedIds.push_back(selected_.ids[i]);
+        else
+            edits.push_back({selected_.ids[i], selected_.start[i], selected_.duration[i],
+                             selected_.pitch[i], selected_.velocity[i]});
+    }
+    for (size_t i = 0; i < others_.size(); ++i)
+    {
+        if (removed_[numSelected + i])
+            removedIds.push_back(others_.ids[i]);
+    }
+
+    return model.applyNoteEdits(name, edits, removedIds);
+}
+
+void NoteTransformer::run(NoteBuffer &notes, const std::vector<NoteTransform> &pipeline,
+                          double lengthInBeats)
+{
+    for (const auto &step : pipeline)
+        runStep(notes, step);
+
+    // Keep every note inside the pattern and within MIDI range
+    const size_t n = notes.size();
+    const double lastStart = std::max(0.0, lengthInBeats - PatternModel::MIN_NOTE_DURATION);
+    double *start = notes.start.data();
+    double *duration = notes.duration.data();
+    int *pitch = notes.pitch.data();
+    int *velocity = notes.velocity.data();
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        start[i] = std::clamp(start[i], 0.0, lastStart);
+        duration[i] = std::max(duration[i], PatternModel::MIN_NOTE_DURATION);
+        pitch[i] = std::clamp(pitch[i], 0, 127);
+        velocity[i] = std::clamp(velocity[i], 1, 127);
+    }
+}
+
+void NoteTransformer::runStep(NoteBuffer &notes, const NoteTransform &step)
+{
+    const size_t n = notes.size();
+    if (n == 0)
+        return;
+
+    const uint32_t *ids = notes.ids.data();
+    double *start = notes.start.data();
+    double *duration = notes.duration.data();
+    int *pitch = notes.pitch.data();
+    int *velocity = notes.velocity.data();
+
+    switch (step.type)
+    {
+        case NoteTransform::Type::Transpose:
+        {
+            const int semitones = static_cast<int>(step.amount);
+            for (size_t i = 0; i < n; ++i)
+                pitch[i] += semitones;
+            break;
+        }
+        case NoteTransform::Type::Quantize:
+        {
+            if (step.amount <= 0.0)
+                break;
+            const double grid = step.amount;
+            const double strength = step.strength;
+            for (size_t i = 0; i < n; ++i)
+                start[i] += (std::round(start[i] / grid) * grid - start[i]) * strength;
+            break;
+        }
+        case NoteTransform::Type::Humanize:
+        {
+            const uint64_t seed = static_cast<uint64_t>(step.seed) << 32;
+            const double timing = step.amount;
+            const double range = step.strength;
+            for (size_t i = 0; i < n; ++i)
+            {
+                uint64_t bits = mix(seed | ids[i]);
+                start[i] += bipolar(bits) * timing;
+                velocity[i] += static_cast<int>(std::lround(bipolar(mix(bits)) * range));
+            }
+            break;
+        }
+        case NoteTransform::Type::ScaleVelocity:
+        {
+            const double factor = step.amount;
+            const double offset = step.strength;
+            for (size_t i = 0; i < n; ++i)
+                velocity[i] = static_cast<int>(std::lround(velocity[i] * factor + offset));
+            break;
+        }
+        case NoteTransform::Type::Reverse:
+        {
+            double first = start[0];
+            double last = start[0] + duration[0];
+            for (size_t i = 1; i < n; ++i)
+            {
+                first = std::min(first, start[i]);
+                last = std::max(last, start[i] + duration[i]);
+            }
+
+            // A note ending at the span's end now starts at its beginning
+            const double mirror = first + last;
+            for (size_t i = 0; i < n; ++i)
+                start[i] = mirror - (start[i] + duration[i]);
+            break;
+        }
+        case NoteTransform::Type::Stretch:
+        {
+            if (step.amount <= 0.0)
+                break;
+            const double anchor = *std::min_element(start, start + n);
+            const double factor = step.amount;
+            for (size_t i = 0; i < n; ++i)
+            {
+                start[i] = anchor + (start[i] - anchor) * factor;
+                duration[i] *= factor;
+            }
+            break;
+        }
+        case NoteTransform::Type::Legato:
+        {
+            // order_ is free until resolveOverlaps
+            auto &order = order_;
+            order.resize(n);
+            std::iota(order.begin(), order.end(), 0u);
+            std::sort(order.begin(), order.end(),
+                      [start](uint32_t a, uint32_t b) { return start[a] < start[b]; });
+
+            // Walk back to front; chords share a start and extend to the same next one
+            double nextStart = -1.0;
+            size_t k = n;
+            while (k > 0)
+            {
+                size_t groupEnd = k;
+                double groupStart = start[order[k - 1]];
+                while (k > 0 && start[order[k - 1]] == groupStart)
+                    --k;
+
+                if (nextStart > groupStart)
+                {
+                    for (size_t j = k; j < groupEnd; ++j)
+                        duration[order[j]] = nextStart - groupStart;
+                }
+                nextStart = groupStart;
+            }
+            break;
+        }
+    }
+}
+
+void NoteTransformer::resolveOverlaps()
+{
+    // Selected notes occupy [0, numSelected) of the combined index space
+    const uint32_t numSelected = static_cast<uint32_t>(selected_.size());
+    const uint32_t total = numSelected + static_cast<uint32_t>(others_.size());
+
+    auto pitchOf = [this, numSelected](uint32_t i) {
+        return i < numSelected ? selected_.pitch[i] : others_.pitch[i - numSelected];
+    };
+    auto startOf = [this, numSelected](uint32_t i) {
+        return i < numSelected ? selected_.start[i] : others_.start[i - numSelected];
+    };
+    auto durationOf = [this, numSelected](uint32_t i) -> double & {
+        return i < numSelected ? selected_.duration[i] : others_.duration[i - numSelected];
+    };
+
+    order_.resize(total);
+    std::iota(order_.begin(), order_.end(), 0u);
+    std::sort(order_.begin(), order_.end(), [&](uint32_t a, uint32_t b) {
+        int pa = pitchOf(a), pb = pitchOf(b);
+        if (pa != pb)
+            return pa < pb;
+        double sa = startOf(a), sb = startOf(b);
+        if (sa != sb)
+            return sa < sb;
+        return a < b;
+    });
+
+    removed_.assign(total, 0);
+
+    // Notes kept so far on the current pitch, in start order
+    auto &kept = kept_;
+    kept.clear();
+    int currentPitch = -1;
+
+    for (uint32_t index : order_)
+    {
+        if (pitchOf(index) != currentPitch)
+        {
+            currentPitch = pitchOf(index);
+            kept.clear();
+        }
+
+        const bool isSelected = index < numSelected;
+        const double start = startOf(index);
+        bool keep = true;
+
+        while (!kept.empty())
+        {
+            uint32_t prev = kept.back();
+            if (startOf(prev) + durationOf(prev) <= start + OVERLAP_EPSILON)
+                break;
+
+            const bool prevSelected = prev < numSelected;
+            if (prevSelected && isSelected)
+            {
+                // Trim the earlier one; if nothing playable is left, drop it
+                double trimmed = start - startOf(prev);
+                if (trimmed >= PatternModel::MIN_NOTE_DURATION)
+                {
+                    durationOf(prev) = trimmed;
+                    break;
+                }
+                removed_[prev] = 1;
+                kept.pop_back();
+            }
+            else if (prevSelected)
+            {
+                keep = false;
+                break;
+            }
+            else if (isSelected)
+            {
+                removed_[prev] = 1;
+                kept.pop_back();
+            }
+            else
+            {
+                // Overlaps between untouched notes were there before - leave them
+                break;
+            }
+        }
+
+        if (keep)
+            kept.push_back(index);
+        else
+            removed_[index] = 1;
+    }
+}
+
+} // namespace SurgeBox
@@ -0,0 +1,104 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include "PatternModel.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace SurgeBox
+{
+
+/**
+ * A selection of notes laid out as parallel arrays, so each transform is a
+ * plain loop over doubles and ints that the compiler can vectorize.
+ */
+struct NoteBuffer
+{
+    std::vector<uint32_t> ids;
+    std::vector<double> start;
+    std::vector<double> duration;
+    std::vector<int> pitch;
+    std::vector<int> velocity;
+
+    size_t size() const { return ids.size(); }
+    void clear();
+    void reserve(size_t n);
+    void push(uint32_t id, double startBeat, double length, int notePitch, int noteVelocity);
+};
+
+/**
+ * One step of a transform pipeline. Build them with the named constructors.
+ */
+struct NoteTransform
+{
+    enum class Type
+    {
+        Transpose,     // amount = semitones
+        Quantize,      // amount = grid (beats), strength = 0..1
+        Humanize,      // amount = max timing offset (beats), strength = max velocity offset
+        ScaleVelocity, // amount = factor, strength = offset
+        Reverse,       // mirror within the selection's span
+        Stretch,       // amount = factor, anchored at the selection's first start
+        Legato         // extend each note to the next later start in the selection
+    };
+
+    Type type{Type::Transpose};
+    double amount{0.0};
+    double strength{0.0};
+    uint32_t seed{0};
+
+    static NoteTransform transpose(int semitones);
+    static NoteTransform quantize(double grid, double strength = 1.0);
+    static NoteTransform humanize(double timing, int velocity, uint32_t seed);
+    static NoteTransform scaleVelocity(double factor, int offset = 0);
+    static NoteTransform reverse();
+    static NoteTransform stretch(double factor);
+    static NoteTransform legato();
+};
+
+/**
+ * Runs transform pipelines over selections of a PatternModel.
+ *
+ * The selected notes are copied into a NoteBuffer and every transform runs as
+ * one pass over it. Then a sweep sorted by pitch resolves overlaps, over the
+ * selection and just the unselected notes within its span and pitch range:
+ * where two selected notes collide the earlier is trimmed, and any unselected
+ * note a selected one lands on is removed (as drawing over it does). The result
+ * is committed through PatternModel::applyNoteEdits as one undo step and one
+ * auto-sync.
+ */
+class NoteTransformer
+{
+  public:
+    // Apply pipeline to the notes with the given IDs. Returns false if nothing
+    // changed (no undo step is recorded then).
+    bool apply(PatternModel &model, const std::vector<uint32_t> &noteIds,
+               const std::vector<NoteTransform> &pipeline, const juce::String &name);
+
+    // The pure part, exposed for reuse: run pipeline over notes in place, then
+    // clamp them into [0, lengthInBeats)
+    void run(NoteBuffer &notes, const std::vector<NoteTransform> &pipeline,
+             double lengthInBeats);
+
+  private:
+    void runStep(NoteBuffer &notes, const NoteTransform &step);
+    void resolveOverlaps();
+
+    // Scratch buffers, kept between calls to avoid reallocating for big selections
+    NoteBuffer selected_;
+    NoteBuffer others_;
+    std::vector<int> selectedIndices_;
+    std::vector<uint32_t> order_;
+    std::vector<uint32_t> kept_;
+    std::vector<uint8_t> removed_;
+};
+
+} // namespace SurgeBox
@@ -0,0 +1,505 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "PatternBank.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace SurgeBox
+{
+
+namespace
+{
+
+constexpr double BEATS_PER_BAR = 4.0;
+
+// Positions this close to a boundary count as on it
+constexpr double BOUNDARY_EPSILON = 1.0e-9;
+
+// Notes starting just before a range still belong to it - matches the tolerance
+// Pattern::getNotesStartingInRange always used at beat boundaries
+constexpr double START_EPSILON = 0.0001;
+
+// Swing moves the middle of each pair of steps later by up to half a step. The
+// pair is stretched piecewise-linearly around it, so notes off the grid keep
+// their order.
+double applySwing(double beat, double swing)
+{
+    constexpr double STEP = 0.25;
+    constexpr double PAIR = 2.0 * STEP;
+
+    double pairStart = std::floor(beat / PAIR) * PAIR;
+    double t = beat - pairStart;
+    double middle = STEP * (1.0 + 0.5 * swing);
+    if (t < STEP)
+        return pairStart + t * (middle / STEP);
+    return pairStart + middle + (t - STEP) * ((PAIR - middle) / STEP);
+}
+
+std::optional<int> resolveTarget(const std::string &target,
+                                 const CompiledPattern::ParameterIndex *parameters)
+{
+    if (target == AUTOMATION_MIXER_VOLUME)
+        return CompiledPattern::TARGET_MIXER_VOLUME;
+    if (target == AUTOMATION_MIXER_PAN)
+        return CompiledPattern::TARGET_MIXER_PAN;
+
+    if (parameters)
+    {
+        auto it = parameters->find(target);
+        if (it != parameters->end())
+            return it->second;
+    }
+    return std::nullopt;
+}
+
+} // namespace
+
+// ============================================================================
+// CompiledPattern
+// ============================================================================
+
+std::unique_ptr<CompiledPattern> CompiledPattern::compile(const Pattern &pattern, int voice)
+{
+    return compile(pattern, voice, Context{});
+}
+
+std::unique_ptr<CompiledPattern> CompiledPattern::compile(const Pattern &pattern, int voice,
+                                                          const Context &context)
+{
+    const ParameterIndex *parameters = context.parameters;
+
+    auto compiled = std::make_unique<CompiledPattern>();
+    compiled->lengthBeats = pattern.lengthInBeats();
+    compiled->notes.reserve(pattern.notes.size());
+
+    auto voiceIndex = static_cast<uint8_t>(voice);
+    for (const auto &note : pattern.notes)
+        compiled->notes.push_back({note.startBeat, note.duration, note.pitch, note.velocity,
+                                   voiceIndex, 0, note.id, note.trig});
+
+    double swing = std::clamp(pattern.swing > 0.0 ? pattern.swing : context.swing, 0.0, 1.0);
+    const GrooveTemplate *groove =
+        context.groove && !context.groove->empty() ? context.groove : nullptr;
+    if ((swing > 0.0 || groove) && compiled->lengthBeats > 0.0)
+    {
+        for (auto &note : compiled->notes)
+        {
+            double start = swing > 0.0 ? applySwing(note.startBeat, swing) : note.startBeat;
+            int velocity = note.velocity;
+            if (groove)
+            {
+                auto step = static_cast<int64_t>(std::llround(note.startBeat / groove->stepBeats));
+                auto numSteps = static_cast<int64_t>(groove->steps.size());
+                // Notes before the loop start round to negative steps
+                auto index = ((step % numSteps) + numSteps) % numSteps;
+                const auto &offsets = groove->steps[static_cast<size_t>(index)];
+                start += offsets.timing * groove->stepBeats;
+                velocity += offsets.velocity;
+            }
+
+            // Notes pushed past either end of the loop wrap around to the other
+            note.startBeat = std::fmod(start, compiled->lengthBeats);
+            if (note.startBeat < 0.0)
+                note.startBeat += compiled->lengthBeats;
+            note.velocity = static_cast<uint8_t>(std::clamp(velocity, 1, 127));
+        }
+    }
+
+    if (!pattern.locks.empty() && parameters)
+    {
+        std::unordered_map<uint32_t, uint32_t> indexOf;
+        for (size_t i = 0; i < pattern.notes.size(); ++i)
+            indexOf.emplace(pattern.notes[i].id, static_cast<uint32_t>(i));
+
+        // Locks of deleted notes stay in the pattern (undo brings the note back)
+        // but aren't compiled
+        for (const auto &lock : pattern.locks)
+        {
+            auto note = indexOf.find(lock.noteId);
+            auto parameter = parameters->find(lock.target);
+            if (note == indexOf.end() || parameter == parameters->end())
+                continue;
+
+            auto &owner = compiled->notes[note->second];
+            if (owner.numLocks == std::numeric_limits<uint8_t>::max())
+                continue;
+            ++owner.numLocks;
+            compiled->locks.push_back({note->second, parameter->second, lock.value});
+        }
+    }
+
+    for (const auto &lane : pattern.automation)
+    {
+        if (lane.points.empty())
+            continue;
+
+        auto target = resolveTarget(lane.target, parameters);
+        if (!target)
+            continue;
+
+        Lane compiledLane;
+        compiledLane.target = *target;
+
+        compiledLane.beats.reserve(lane.points.size());
+        compiledLane.values.reserve(lane.points.size());
+        for (const auto &point : lane.points)
+        {
+            compiledLane.beats.push_back(point.beat);
+            compiledLane.values.push_back(point.value);
+        }
+        compiled->lanes.push_back(std::move(compiledLane));
+    }
+
+    if (!compiled->lanes.empty())
+        compiled->laneSpans.push_back({0.0, compiled->lengthBeats, compiled->lengthBeats,
+                                       voiceIndex, 0,
+                                       static_cast<uint32_t>(compiled->lanes.size())});
+
+    compiled->finalize();
+    return compiled;
+}
+
+float CompiledPattern::Lane::valueAt(double beat) const
+{
+    // Hold the first and last values outside the breakpoints
+    auto next = std::upper_bound(beats.begin(), beats.end(), beat);
+    if (next == beats.begin())
+        return values.front();
+    if (next == beats.end())
+        return values.back();
+
+    auto i = static_cast<size_t>(next - beats.begin());
+    double span = beats[i] - beats[i - 1];
+    double t = span > 0.0 ? (beat - beats[i - 1]) / span : 1.0;
+    return values[i - 1] + static_cast<float>(t) * (values[i] - values[i - 1]);
+}
+
+std::pair<const CompiledPattern::Lock *, const CompiledPattern::Lock *>
+CompiledPattern::locksOf(size_t noteIndex) const
+{
+    if (notes[noteIndex].numLocks == 0)
+        return {nullptr, nullptr};
+
+    auto first = std::lower_bound(
+        locks.begin(), locks.end(), noteIndex,
+        [](const Lock &lock, size_t index) { return lock.note < index; });
+    const Lock *begin = locks.data() + (first - locks.begin());
+    return {begin, begin + notes[noteIndex].numLocks};
+}
+
+void CompiledPattern::finalize()
+{
+    auto byStart = [](const Note &a, const Note &b) { return a.startBeat < b.startBeat; };
+    if (locks.empty())
+    {
+        std::stable_sort(notes.begin(), notes.end(), byStart);
+    }
+    else
+    {
+        // Sort through a permutation so the locks can follow their notes
+        std::vector<uint32_t> order(notes.size());
+        std::iota(order.begin(), order.end(), 0u);
+        std::stable_sort(order.begin(), order.end(),
+                         [&](uint32_t a, uint32_t b) { return byStart(notes[a], notes[b]); });
+
+        std::vector<uint32_t> position(notes.size());
+        std::vector<Note> sorted;
+        sorted.reserve(notes.size());
+        for (size_t k = 0; k < order.size(); ++k)
+        {
+            position[order[k]] = static_cast<uint32_t>(k);
+            sorted.push_back(notes[order[k]]);
+        }
+        notes.swap(sorted);
+
+        for (auto &lock : locks)
+            lock.note = position[lock.note];
+        std::stable_sort(locks.begin(), locks.end(),
+                         [](const Lock &a, const Lock &b) { return a.note < b.note; });
+    }
+
+    // Count the bar lines each note sounds across, then fill the lists in one
+    // pass (CSR layout - two flat arrays instead of a vector per bar)
+    size_t numBars = static_cast<size_t>(std::ceil(lengthBeats / BEATS_PER_BAR)) + 1;
+    chaseOffsets_.assign(numBars + 1, 0);
+
+    auto forEachBarLine = [&](const Note &note, auto &&fn) {
+        size_t bar = static_cast<size_t>(std::floor(note.startBeat / BEATS_PER_BAR)) + 1;
+        for (; bar < numBars && bar * BEATS_PER_BAR < note.endBeat() - BOUNDARY_EPSILON; ++bar)
+            fn(bar);
+    };
+
+    for (const auto &note : notes)
+        forEachBarLine(note, [&](size_t bar) { ++chaseOffsets_[bar + 1]; });
+    for (size_t bar = 0; bar < numBars; ++bar)
+        chaseOffsets_[bar + 1] += chaseOffsets_[bar];
+
+    chaseNotes_.resize(chaseOffsets_[numBars]);
+    std::vector<uint32_t> fill(chaseOffsets_.begin(), chaseOffsets_.end() - 1);
+    for (size_t i = 0; i < notes.size(); ++i)
+    {
+        auto index = static_cast<uint32_t>(i);
+        forEachBarLine(notes[i], [&](size_t bar) { chaseNotes_[fill[bar]++] = index; });
+    }
+}
+
+std::pair<size_t, size_t> CompiledPattern::notesStartingIn(double startBeat, double endBeat) const
+{
+    auto byStart = [](const Note &note, double beat) { return note.startBeat < beat; };
+    auto first = std::lower_bound(notes.begin(), notes.end(), startBeat - START_EPSILON, byStart);
+    auto last = std::lower_bound(first, notes.end(), endBeat, byStart);
+    return {static_cast<size_t>(first - notes.begin()), static_cast<size_t>(last - notes.begin())};
+}
+
+// ============================================================================
+// PatternBank
+// ============================================================================
+
+PatternBank::PatternBank()
+{
+    Pattern empty;
+    for (auto &voiceSlots : slots_)
+    {
+        for (auto &slot : voiceSlots)
+            slot.store(CompiledPattern::compile(empty).release());
+    }
+    song_.store(compileSong({}).release());
+
+    for (int v = 0; v < NUM_VOICES; ++v)
+    {
+        playingSlot_[v].store(0);
+        queuedSlot_[v].store(-1);
+    }
+
+    worker_ = std::thread([this] { workerLoop(); });
+}
+
+PatternBank::~PatternBank()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopRequested_ = true;
+    }
+    wake_.notify_one();
+    worker_.join();
+
+    for (auto &voiceSlots : slots_)
+    {
+        for (auto &slot : voiceSlots)
+            delete slot.exchange(nullptr);
+    }
+    delete song_.exchange(nullptr);
+}
+
+void PatternBank::submit(int voice, int slot, const Pattern &pattern)
+{
+    if (voice < 0 || voice >= NUM_VOICES || slot < 0 || slot >= NUM_PATTERN_SLOTS)
+        return;
+
+    {
+        // Only the latest state of a slot matters - a newer edit replaces a queued one
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_[static_cast<size_t>(voice * NUM_PATTERN_SLOTS + slot)] = pattern;
+        havePending_ = true;
+    }
+    wake_.notify_one();
+}
+
+void PatternBank::submitSong(const std::vector<SongSection> &song)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pendingSong_ = song;
+        havePending_ = true;
+    }
+    wake_.notify_one();
+}
+
+void PatternBank::setParameterNames(const std::vector<std::string> &names)
+{
+    CompiledPattern::ParameterIndex parameters;
+    for (size_t i = 0; i < names.size(); ++i)
+        parameters.emplace(names[i], static_cast<int>(i));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pendingParameters_ = std::move(parameters);
+        havePending_ = true;
+    }
+    wake_.notify_one();
+}
+
+void PatternBank::setGroove(double swing, const GrooveTemplate &groove)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pendingGroove_.emplace(swing, groove);
+        pendingGroove_->second.sanitise();
+        havePending_ = true;
+    }
+    wake_.notify_one();
+}
+
+void PatternBank::queueSlot(int voice, int slot)
+{
+    if (voice < 0 || voice >= NUM_VOICES || slot < 0 || slot >= NUM_PATTERN_SLOTS)
+        return;
+
+    // Re-selecting the playing slot cancels a pending switch
+    queuedSlot_[voice].store(slot == playingSlot_[voice].load() ? -1 : slot);
+}
+
+void PatternBank::setPlayingSlot(int voice, int slot)
+{
+    if (voice < 0 || voice >= NUM_VOICES || slot < 0 || slot >= NUM_PATTERN_SLOTS)
+        return;
+
+    queuedSlot_[voice].store(-1);
+    playingSlot_[voice].store(slot);
+}
+
+void PatternBank::waitUntilIdle()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return !havePending_ && !compiling_; });
+}
+
+double PatternBank::switchBoundary(int voice, double fromBeat) const
+{
+    double period = switchMode_.load() == SwitchMode::NextBar ? BEATS_PER_BAR
+                                                              : playing(voice).lengthBeats;
+    if (period <= 0.0)
+        return fromBeat;
+
+    double phase = std::fmod(fromBeat, period);
+    if (phase < BOUNDARY_EPSILON || period - phase < BOUNDARY_EPSILON)
+        return fromBeat;
+    return fromBeat + (period - phase);
+}
+
+void PatternBank::applyQueuedSwitch(int voice)
+{
+    int slot = queuedSlot_[voice].exchange(-1);
+    if (slot >= 0)
+        playingSlot_[voice].store(slot);
+}
+
+void PatternBank::publish(int index, std::unique_ptr<CompiledPattern> compiled)
+{
+    auto &slot = slots_[static_cast<size_t>(index / NUM_PATTERN_SLOTS)]
+                       [static_cast<size_t>(index % NUM_PATTERN_SLOTS)];
+    const CompiledPattern *old = slot.exchange(compiled.release());
+    retired_.push_back({std::unique_ptr<const CompiledPattern>(old), blocksRead_.load()});
+}
+
+void PatternBank::publishSong(std::unique_ptr<CompiledPattern> compiled)
+{
+    const CompiledPattern *old = song_.exchange(compiled.release());
+    retired_.push_back({std::unique_ptr<const CompiledPattern>(old), blocksRead_.load()});
+}
+
+std::unique_ptr<CompiledPattern>
+PatternBank::compileSong(const std::vector<SongSection> &song) const
+{
+    // Only the worker (and the constructor) replace slots, so they can be read freely
+    auto slotOf = [this](int voice, int slot) -> const CompiledPattern & {
+        return *slots_[static_cast<size_t>(voice)][static_cast<size_t>(slot)].load();
+    };
+    return CompiledPattern::compileSong(song, slotOf);
+}
+
+void PatternBank::reclaim()
+{
+    // Read the block count before checking for a running block: a block that
+    // starts after this point already sees the new patterns
+    uint64_t blocksRead = blocksRead_.load();
+    bool readerIdle = !readerActive_.load();
+
+    retired_.erase(std::remove_if(retired_.begin(), retired_.end(),
+                                  [&](const Retired &r) {
+                                      return readerIdle || blocksRead > r.retiredAtBlock;
+                                  }),
+                   retired_.end());
+}
+
+void PatternBank::workerLoop()
+{
+    std::vector<std::pair<int, Pattern>> jobs;
+    bool songChanged = false;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (retired_.empty())
+                wake_.wait(lock, [this] { return stopRequested_ || havePending_; });
+            else
+                wake_.wait_for(lock, std::chrono::milliseconds(RECLAIM_INTERVAL_MS),
+                               [this] { return stopRequested_ || havePending_; });
+
+            if (stopRequested_)
+                return;
+
+            for (size_t i = 0; i < pending_.size(); ++i)
+            {
+                if (pending_[i])
+                {
+                    jobs.emplace_back(static_cast<int>(i), std::move(*pending_[i]));
+                    pending_[i].reset();
+                }
+            }
+            if (pendingParameters_)
+            {
+                parameters_ = std::move(*pendingParameters_);
+                pendingParameters_.reset();
+            }
+            if (pendingGroove_)
+            {
+                swing_ = pendingGroove_->first;
+                groove_ = std::move(pendingGroove_->second);
+                pendingGroove_.reset();
+            }
+            if (pendingSong_)
+            {
+                sections_ = std::move(*pendingSong_);
+                pendingSong_.reset();
+                songChanged = true;
+            }
+            havePending_ = false;
+            compiling_ = !jobs.empty() || songChanged;
+        }
+
+        CompiledPattern::Context context{&parameters_, swing_, &groove_};
+        for (auto &[index, pattern] : jobs)
+        {
+            int voice = index / NUM_PATTERN_SLOTS;
+            publish(index, CompiledPattern::compile(pattern, voice, context));
+        }
+
+        // The song holds copies of its slots' notes and lanes, so any slot edit
+        // rebuilds it
+        if (songChanged || (!jobs.empty() && !sections_.empty()))
+            publishSong(compileSong(sections_));
+        jobs.clear();
+        songChanged = false;
+
+        reclaim();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            compiling_ = false;
+        }
+        idle_.notify_all();
+    }
+}
+
+} // namespace SurgeBox
@@ -0,0 +1,409 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include "GrooveboxProject.h"
+#include <juce_core/juce_core.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace SurgeBox
+{
+
+/**
+ * Notes compiled for playback: a flat list sorted by start, so the sequencer
+ * finds the notes of a block with a binary search and never allocates. Used for
+ * single pattern slots and for the whole song arrangement.
+ *
+ * The chase index lists, for each bar line, the notes that started earlier and
+ * are still sounding across it. The notes sounding at any position are that
+ * bar's list plus the notes starting between the bar line and the position -
+ * found without scanning everything before it.
+ *
+ * Automation lanes are compiled with their targets already resolved to Surge
+ * parameter indices (or mixer fields), so applying them needs no lookups. So are
+ * p-locks, which live in a side table sorted by note index: a note without any
+ * costs nothing beyond its (otherwise padding) lock count. Swing and groove are
+ * baked into the note starts and velocities, so playback never applies them.
+ * Trig conditions stay packed in the notes and are tested as they play.
+ */
+struct CompiledPattern
+{
+    // Surge parameter storage name -> parameter index
+    using ParameterIndex = std::unordered_map<std::string, int>;
+
+    struct Note
+    {
+        double startBeat{0.0};
+        double duration{0.0};
+        uint8_t pitch{0};
+        uint8_t velocity{0};
+        uint8_t voice{0};
+        uint8_t numLocks{0};
+        uint32_t id{0};
+        uint32_t trig{0}; // TrigCondition::pack()
+
+        // Song - which pass of its slot within the section the note is on, of
+        // how many. Slot notes leave both 0: their pass follows the playhead.
+        uint16_t pass{0};
+        uint16_t passCount{0};
+
+        double endBeat() const { return startBeat + duration; }
+    };
+
+    // Set parameter to value while note notes[note] sounds
+    struct Lock
+    {
+        uint32_t note{0};
+        int parameter{0};
+        float value{0.0f};
+    };
+
+    // Lane targets from zero up are Surge parameter indices
+    static constexpr int TARGET_MIXER_VOLUME = -1;
+    static constexpr int TARGET_MIXER_PAN = -2;
+
+    struct Lane
+    {
+        int target{0};
+        std::vector<double> beats;
+        std::vector<float> values;
+
+        float valueAt(double beat) const;
+    };
+
+    // Where lanes [firstLane, lastLane) drive a voice: from startBeat to endBeat,
+    // looping every loopBeats. A slot has one span; the song one per section and voice.
+    struct LaneSpan
+    {
+        double startBeat{0.0};
+        double endBeat{0.0};
+        double loopBeats{0.0};
+        uint8_t voice{0};
+        uint32_t firstLane{0};
+        uint32_t lastLane{0};
+    };
+
+    double lengthBeats{16.0};
+    std::vector<Note> notes;
+    std::vector<Lane> lanes;
+    std::vector<LaneSpan> laneSpans; // Sorted by startBeat
+    std::vector<Lock> locks;         // Sorted by note
+
+    // Locks [first, last) of notes[noteIndex]
+    std::pair<const Lock *, const Lock *> locksOf(size_t noteIndex) const;
+
+    // What a pattern is compiled against besides its own contents
+    struct Context
+    {
+        const ParameterIndex *parameters{nullptr};
+        double swing{0.0}; // Project swing, for patterns without their own
+        const GrooveTemplate *groove{nullptr};
+    };
+
+    // Lanes and locks whose target isn't in context.parameters (or, for lanes, a
+    // known mixer field) are dropped
+    static std::unique_ptr<CompiledPattern> compile(const Pattern &pattern, int voice,
+                                                    const Context &context);
+    static std::unique_ptr<CompiledPattern> compile(const Pattern &pattern, int voice = 0);
+
+    // The arrangement laid out end to end, each voice looping its slot through a
+    // section. slotOf(voice, slot) returns the compiled slot.
+    template <typename SlotLookup>
+    static std::unique_ptr<CompiledPattern> compileSong(const std::vector<SongSection> &song,
+                                                        SlotLookup &&slotOf);
+
+    // Index range [first, last) of the notes starting in [startBeat, endBeat)
+    std::pair<size_t, size_t> notesStartingIn(double startBeat, double endBeat) const;
+
+    // Call fn(note) for each note that started before beat and is still sounding
+    // at it - the notes to chase when playback starts at beat
+    template <typename Fn> void forEachNoteSoundingAt(double beat, Fn &&fn) const;
+
+    // Call fn(lane, value) for each lane driving voice at beat
+    template <typename Fn> void forEachLaneValue(int voice, double beat, Fn &&fn) const;
+
+  private:
+    void finalize(); // Sort by start, renumber the locks and build the chase index
+
+    // Notes sounding across bar line b: chaseNotes_[chaseOffsets_[b], chaseOffsets_[b + 1])
+    std::vector<uint32_t> chaseOffsets_;
+    std::vector<uint32_t> chaseNotes_;
+};
+
+/**
+ * Compiled pattern slots for every voice, and which slot each voice plays.
+ *
+ * Edited slots are handed over as Pattern copies and compiled on a worker
+ * thread, which publishes each result with a single pointer swap. The audio
+ * thread reads slots inside a ReadScope; a replaced pattern is freed only once
+ * no block that could have seen it is still running.
+ *
+ * Switching slots while playing is queued and lands on the audio thread at the
+ * next bar or pattern end, at the cost of an atomic index exchange.
+ */
+class PatternBank
+{
+  public:
+    enum class SwitchMode
+    {
+        NextBar,
+        PatternEnd
+    };
+
+    PatternBank();
+    ~PatternBank();
+
+    // Message thread
+    void submit(int voice, int slot, const Pattern &pattern);
+    void submitSong(const std::vector<SongSection> &song);
+
+    // Surge parameter storage names by index, for resolving automation targets.
+    // Patterns compiled before this is set play without their Surge lanes.
+    void setParameterNames(const std::vector<std::string> &names);
+
+    // Project swing and groove for patterns compiled from now on - resubmit the
+    // patterns to apply them to what is already compiled
+    void setGroove(double swing, const GrooveTemplate &groove);
+    void queueSlot(int voice, int slot);
+    void setPlayingSlot(int voice, int slot); // Immediately (stopped, project load)
+    int getPlayingSlot(int voice) const { return playingSlot_[voice].load(); }
+    int getQueuedSlot(int voice) const { return queuedSlot_[voice].load(); }
+    void setSwitchMode(SwitchMode mode) { switchMode_.store(mode); }
+    SwitchMode getSwitchMode() const { return switchMode_.load(); }
+
+    // Block until every submitted pattern has been published (offline use)
+    void waitUntilIdle();
+
+    // Audio thread - hold a ReadScope while using compiled patterns
+    class ReadScope
+    {
+      public:
+        explicit ReadScope(PatternBank &bank) : bank_(bank) { bank_.readerActive_.store(true); }
+        ~ReadScope()
+        {
+            bank_.blocksRead_.fetch_add(1);
+            bank_.readerActive_.store(false);
+        }
+
+      private:
+        PatternBank &bank_;
+    };
+
+    const CompiledPattern &playing(int voice) const
+    {
+        return *slots_[voice][static_cast<size_t>(playingSlot_[voice].load())].load();
+    }
+
+    // The compiled arrangement - lengthBeats is 0 when the song is empty
+    const CompiledPattern &song() const { return *song_.load(); }
+
+    bool hasQueuedSwitch(int voice) const { return queuedSlot_[voice].load() >= 0; }
+
+    // First beat at or after fromBeat where a queued switch may land
+    double switchBoundary(int voice, double fromBeat) const;
+
+    // Land the queued switch, if any
+    void applyQueuedSwitch(int voice);
+
+  private:
+    struct Retired
+    {
+        std::unique_ptr<const CompiledPattern> pattern;
+        uint64_t retiredAtBlock{0};
+    };
+
+    void workerLoop();
+    void publish(int index, std::unique_ptr<CompiledPattern> compiled);
+    void publishSong(std::unique_ptr<CompiledPattern> compiled);
+    std::unique_ptr<CompiledPattern> compileSong(const std::vector<SongSection> &song) const;
+    void reclaim();
+
+    static constexpr size_t NUM_SLOTS_TOTAL = NUM_VOICES * NUM_PATTERN_SLOTS;
+
+    std::array<std::array<std::atomic<const CompiledPattern *>, NUM_PATTERN_SLOTS>, NUM_VOICES>
+        slots_;
+    std::atomic<const CompiledPattern *> song_{nullptr};
+    std::array<std::atomic<int>, NUM_VOICES> playingSlot_;
+    std::array<std::atomic<int>, NUM_VOICES> queuedSlot_;
+    std::atomic<SwitchMode> switchMode_{SwitchMode::PatternEnd};
+
+    // Reader epoch - a pattern retired at block n is unreachable once the reader
+    // has finished block n, or immediately if no block is running
+    std::atomic<uint64_t> blocksRead_{0};
+    std::atomic<bool> readerActive_{false};
+
+    // Worker
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::array<std::optional<Pattern>, NUM_SLOTS_TOTAL> pending_;
+    std::optional<std::vector<SongSection>> pendingSong_;
+    std::optional<CompiledPattern::ParameterIndex> pendingParameters_;
+    std::optional<std::pair<double, GrooveTemplate>> pendingGroove_;
+    bool havePending_{false};
+    bool compiling_{false};
+    bool stopRequested_{false};
+    std::vector<Retired> retired_;               // Worker thread only
+    std::vector<SongSection> sections_;          // Worker thread only - the song being played
+    CompiledPattern::ParameterIndex parameters_; // Worker thread only
+    double swing_{0.0};                          // Worker thread only
+    GrooveTemplate groove_;                      // Worker thread only
+    std::thread worker_;
+
+    static constexpr int RECLAIM_INTERVAL_MS = 50;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PatternBank)
+};
+
+// ============================================================================
+// CompiledPattern templates
+// ============================================================================
+
+template <typename SlotLookup>
+std::unique_ptr<CompiledPattern> CompiledPattern::compileSong(const std::vector<SongSection> &song,
+                                                              SlotLookup &&slotOf)
+{
+    auto compiled = std::make_unique<CompiledPattern>();
+    compiled->lengthBeats = 0.0;
+
+    for (const auto &section : song)
+    {
+        double sectionStart = compiled->lengthBeats;
+        double sectionLength = section.bars * 4.0;
+        compiled->lengthBeats += sectionLength;
+
+        for (int v = 0; v < NUM_VOICES; ++v)
+        {
+            int slot = section.slots[static_cast<size_t>(v)];
+            if (slot < 0 || slot >= NUM_PATTERN_SLOTS)
+                continue;
+
+            const CompiledPattern &pattern = slotOf(v, slot);
+            if (pattern.lengthBeats <= 0.0)
+                continue;
+
+            // Loop the slot through the section; notes are cut at its end so
+            // nothing hangs over into the next section
+            auto passCount = static_cast<uint16_t>(std::ceil(sectionLength / pattern.lengthBeats));
+            uint16_t pass = 0;
+            for (double loop = 0.0; loop < sectionLength; loop += pattern.lengthBeats, ++pass)
+            {
+                for (const auto &note : pattern.notes)
+                {
+                    double start = loop + note.startBeat;
+                    if (start >= sectionLength)
+                        break;
+
+                    Note placed = note;
+                    placed.startBeat = sectionStart + start;
+                    placed.duration = std::min(note.duration, sectionLength - start);
+                    placed.voice = static_cast<uint8_t>(v);
+                    placed.pass = pass;
+                    placed.passCount = passCount;
+
+                    if (note.numLocks > 0)
+                    {
+                        auto index = static_cast<uint32_t>(compiled->notes.size());
+                        auto [lock, lastLock] =
+                            pattern.locksOf(static_cast<size_t>(&note - pattern.notes.data()));
+                        for (; lock != lastLock; ++lock)
+                            compiled->locks.push_back({index, lock->parameter, lock->value});
+                    }
+                    compiled->notes.push_back(placed);
+                }
+            }
+
+            if (!pattern.lanes.empty())
+            {
+                auto firstLane = static_cast<uint32_t>(compiled->lanes.size());
+                compiled->lanes.insert(compiled->lanes.end(), pattern.lanes.begin(),
+                                       pattern.lanes.end());
+                compiled->laneSpans.push_back({sectionStart, sectionStart + sectionLength,
+                                               pattern.lengthBeats, static_cast<uint8_t>(v),
+                                               firstLane,
+                                               static_cast<uint32_t>(compiled->lanes.size())});
+            }
+        }
+    }
+
+    compiled->finalize();
+    return compiled;
+}
+
+template <typename Fn> void CompiledPattern::forEachNoteSoundingAt(double beat, Fn &&fn) const
+{
+    // Notes starting within START_EPSILON of beat are triggered as playback
+    // starts, so they aren't chased
+    static constexpr double START_EPSILON = 0.0001;
+
+    if (notes.empty() || beat <= 0.0 || beat >= lengthBeats)
+        return;
+
+    size_t bar = static_cast<size_t>(beat / 4.0);
+    if (bar + 1 >= chaseOffsets_.size())
+        return;
+
+    for (uint32_t i = chaseOffsets_[bar]; i < chaseOffsets_[bar + 1]; ++i)
+    {
+        const auto &note = notes[chaseNotes_[i]];
+        if (note.endBeat() > beat)
+            fn(note);
+    }
+
+    auto [first, last] = notesStartingIn(bar * 4.0, beat - START_EPSILON);
+    for (size_t i = first; i < last; ++i)
+    {
+        // notesStartingIn reaches back by its own tolerance - skip anything before the bar
+        const auto &note = notes[i];
+        if (note.startBeat >= bar * 4.0 && note.endBeat() > beat)
+            fn(note);
+    }
+}
+
+template <typename Fn>
+void CompiledPattern::forEachLaneValue(int voice, double beat, Fn &&fn) const
+{
+    if (laneSpans.empty())
+        return;
+
+    // Spans starting together (one section) sit side by side - find the last
+    // start at or before beat, then look at that group
+    auto it = std::upper_bound(laneSpans.begin(), laneSpans.end(), beat,
+                               [](double b, const LaneSpan &span) { return b < span.startBeat; });
+    if (it == laneSpans.begin())
+        return;
+
+    double groupStart = std::prev(it)->startBeat;
+    for (auto span = std::prev(it);; --span)
+    {
+        if (span->voice == voice && beat < span->endBeat && span->loopBeats > 0.0)
+        {
+            double local = std::fmod(beat - span->startBeat, span->loopBeats);
+            for (uint32_t i = span->firstLane; i < span->lastLane; ++i)
+                fn(lanes[i], lanes[i].valueAt(local));
+        }
+        if (span == laneSpans.begin() || std::prev(span)->startBeat != groupStart)
+            break;
+    }
+}
+
+} // namespace SurgeBox
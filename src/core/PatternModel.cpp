@@ -8,10 +8,188 @@
 
 #include "PatternModel.h"
 #include <algorithm>
+#include <unordered_set>
+#include <utility>
 
 namespace SurgeBox
 {
 
+// ============================================================================
+// DeltaAction
+// ============================================================================
+
+/**
+ * Undo record for every note edit - a gesture, a bulk edit or a single call:
+ * the before/after values of each touched note. The note trees themselves are
+ * retained so removed notes can be re-inserted.
+ */
+class PatternModel::DeltaAction : public juce::UndoableAction
+{
+  public:
+    DeltaAction(PatternModel &model, std::vector<NoteDelta> deltas)
+        : model_(model), deltas_(std::move(deltas)), undoBytes_(model.undoBytes_)
+    {
+        undoBytes_->fetch_add(bytes());
+    }
+
+    ~DeltaAction() override { undoBytes_->fetch_sub(bytes()); }
+
+    bool perform() override
+    {
+        // The gesture already applied its edits live; only redo re-applies them
+        if (std::exchange(firstPerform_, false))
+            return true;
+        apply(true);
+        return true;
+    }
+
+    bool undo() override
+    {
+        apply(false);
+        return true;
+    }
+
+    // Units are bytes, matching the budget SurgeBoxEngine gives the UndoManager
+    int getSizeInUnits() override { return static_cast<int>(bytes()); }
+
+    // Repeated single edits of one note (a velocity drag without a gesture)
+    // fold into one, as ValueTree's own property actions would
+    juce::UndoableAction *createCoalescedAction(juce::UndoableAction *nextAction) override
+    {
+        auto *next = dynamic_cast<DeltaAction *>(nextAction);
+        if (!next || deltas_.size() != 1 || next->deltas_.size() != 1)
+            return nullptr;
+
+        const auto &first = deltas_.front();
+        const auto &second = next->deltas_.front();
+        if (first.note != second.note || !first.existsAfter || !second.existedBefore)
+            return nullptr;
+
+        auto *merged = new DeltaAction(model_, {{first.note, first.existedBefore,
+                                                 second.existsAfter, first.before,
+                                                 second.after}});
+        merged->firstPerform_ = false;
+        return merged;
+    }
+
+  private:
+    size_t bytes() const
+    {
+        return sizeof(*this) + deltas_.size() * (sizeof(NoteDelta) + NOTE_TREE_BYTES);
+    }
+
+    // Above this many notes, one re-sort beats repositioning each note
+    static constexpr size_t BULK_THRESHOLD = 64;
+
+    void apply(bool toAfter)
+    {
+        model_.beginBatch();
+        if (deltas_.size() > BULK_THRESHOLD)
+            applyBulk(toAfter);
+        else
+            applyEach(toAfter);
+        model_.endBatch();
+    }
+
+    void applyEach(bool toAfter)
+    {
+        auto &tree = model_.tree_;
+        for (auto &d : deltas_)
+        {
+            bool shouldExist = toAfter ? d.existsAfter : d.existedBefore;
+            bool exists = d.note.getParent() == tree;
+
+            if (!shouldExist)
+            {
+                if (exists)
+                    tree.removeChild(d.note, nullptr);
+                continue;
+            }
+
+            writeNote(d.note, toAfter ? d.after : d.before);
+            if (exists)
+                model_.repositionNote(d.note);
+            else
+                model_.insertSorted(d.note);
+        }
+    }
+
+    void applyBulk(bool toAfter)
+    {
+        auto &tree = model_.tree_;
+
+        // Removals first, by slot and back to front, while the slot map is valid
+        std::vector<int> removeSlots;
+        for (auto &d : deltas_)
+        {
+            bool shouldExist = toAfter ? d.existsAfter : d.existedBefore;
+            if (!shouldExist && d.note.getParent() == tree)
+                removeSlots.push_back(model_.indexOfNote(noteIdOf(d.note)));
+        }
+        std::sort(removeSlots.rbegin(), removeSlots.rend());
+        for (int index : removeSlots)
+            tree.removeChild(index, nullptr);
+
+        for (auto &d : deltas_)
+        {
+            if (!(toAfter ? d.existsAfter : d.existedBefore))
+                continue;
+
+            bool exists = d.note.getParent() == tree;
+            writeNote(d.note, toAfter ? d.after : d.before);
+            if (!exists)
+                tree.appendChild(d.note, nullptr);
+        }
+
+        model_.sortNotes();
+    }
+
+    PatternModel &model_;
+    std::vector<NoteDelta> deltas_;
+    std::shared_ptr<std::atomic<size_t>> undoBytes_;
+    bool firstPerform_{true};
+};
+
+// ============================================================================
+// PropertyAction
+// ============================================================================
+
+// Undo record for a pattern property (bars, swing)
+class PatternModel::PropertyAction : public juce::UndoableAction
+{
+  public:
+    PropertyAction(juce::ValueTree tree, const juce::Identifier &property, juce::var after)
+        : tree_(std::move(tree)), property_(property), before_(tree_.getProperty(property)),
+          after_(std::move(after))
+    {
+    }
+
+    bool perform() override
+    {
+        tree_.setProperty(property_, after_, nullptr);
+        return true;
+    }
+
+    bool undo() override
+    {
+        tree_.setProperty(property_, before_, nullptr);
+        return true;
+    }
+
+    // Both values are numbers, held inside the vars
+    int getSizeInUnits() override { return static_cast<int>(sizeof(*this)); }
+
+  private:
+    juce::ValueTree tree_;
+    juce::Identifier property_;
+    juce::var before_;
+    juce::var after_;
+};
+
+// ============================================================================
+// PatternModel
+// ============================================================================
+
 PatternModel::PatternModel() : tree_(IDs::Pattern)
 {
     tree_.setProperty(IDs::bars, 4, nullptr);
@@ -31,16 +209,27 @@ PatternModel::~PatternModel() { tree_.removeListener(this); }
 
 int PatternModel::getBars() const { return tree_.getProperty(IDs::bars, 4); }
 
-void PatternModel::setBars(int bars) { tree_.setProperty(IDs::bars, bars, undoManager_); }
+void PatternModel::setBars(int bars) { setPatternProperty(IDs::bars, bars); }
 
 double PatternModel::getSwing() const { return tree_.getProperty(IDs::swing, 0.0); }
 
-void PatternModel::setSwing(double swing) { tree_.setProperty(IDs::swing, swing, undoManager_); }
+void PatternModel::setSwing(double swing) { setPatternProperty(IDs::swing, swing); }
+
+void PatternModel::setPatternProperty(const juce::Identifier &property, const juce::var &value)
+{
+    if (tree_.getProperty(property) == value)
+        return;
+    if (undoManager_)
+        undoManager_->perform(new PropertyAction(tree_, property, value));
+    else
+        tree_.setProperty(property, value, nullptr);
+}
 
 juce::ValueTree PatternModel::createNoteTree(double startBeat, double duration, int pitch,
-                                              int velocity)
+                                              int velocity, uint32_t noteId)
 {
     juce::ValueTree note(IDs::Note);
+    note.setProperty(IDs::noteId, static_cast<juce::int64>(noteId), nullptr);
     note.setProperty(IDs::startBeat, startBeat, nullptr);
     note.setProperty(IDs::duration, duration, nullptr);
     note.setProperty(IDs::pitch, pitch, nullptr);
@@ -48,23 +237,102 @@ juce::ValueTree PatternModel::createNoteTree(double startBeat, double duration,
     return note;
 }
 
-void PatternModel::addNote(double startBeat, double duration, int pitch, int velocity)
+uint32_t PatternModel::noteIdOf(const juce::ValueTree &note)
 {
-    auto note = createNoteTree(startBeat, duration, pitch, velocity);
-    tree_.appendChild(note, undoManager_);
-    sortNotes();
+    return static_cast<uint32_t>(static_cast<juce::int64>(note.getProperty(IDs::noteId)));
+}
+
+PatternModel::NoteValues PatternModel::readNote(const juce::ValueTree &note)
+{
+    NoteValues values;
+    values.startBeat = note.getProperty(IDs::startBeat);
+    values.duration = note.getProperty(IDs::duration);
+    values.pitch = note.getProperty(IDs::pitch);
+    values.velocity = note.getProperty(IDs::velocity);
+    values.trig =
+        static_cast<uint32_t>(static_cast<juce::int64>(note.getProperty(IDs::trig, 0)));
+    return values;
+}
+
+void PatternModel::writeNote(juce::ValueTree &note, const NoteValues &values)
+{
+    note.setProperty(IDs::startBeat, values.startBeat, nullptr);
+    note.setProperty(IDs::duration, values.duration, nullptr);
+    note.setProperty(IDs::pitch, values.pitch, nullptr);
+    note.setProperty(IDs::velocity, values.velocity, nullptr);
+    if (values.trig != 0 || note.hasProperty(IDs::trig))
+        note.setProperty(IDs::trig, static_cast<juce::int64>(values.trig), nullptr);
+}
+
+void PatternModel::touchNote(const juce::ValueTree &note, bool isNew)
+{
+    if (!gestureActive_)
+        return;
+
+    // Gestures touch a handful of notes, so a linear scan is cheaper than hashing trees
+    for (const auto &d : gestureDeltas_)
+    {
+        if (d.note == note)
+            return;
+    }
+
+    NoteDelta delta;
+    delta.note = note;
+    delta.existedBefore = !isNew;
+    if (!isNew)
+        delta.before = readNote(note);
+    gestureDeltas_.push_back(std::move(delta));
+}
+
+uint32_t PatternModel::addNote(double startBeat, double duration, int pitch, int velocity)
+{
+    bool own = beginEdit();
+    uint32_t id = nextNoteId_++;
+    auto note = createNoteTree(startBeat, duration, pitch, velocity, id);
+    touchNote(note, true);
+    insertHint_ = sortedInsertIndex(startBeat);
+    tree_.addChild(note, insertHint_, nullptr);
+    endEdit(own);
+    return id;
 }
 
 void PatternModel::removeNote(int index)
 {
     if (index >= 0 && index < tree_.getNumChildren())
     {
-        tree_.removeChild(index, undoManager_);
+        bool own = beginEdit();
+        touchNote(tree_.getChild(index), false);
+        tree_.removeChild(index, nullptr);
+        endEdit(own);
     }
 }
 
+void PatternModel::removeNotes(const std::vector<uint32_t> &noteIds)
+{
+    // Resolve all slots up front, then remove back to front so they stay valid
+    std::vector<int> indices;
+    indices.reserve(noteIds.size());
+    for (auto id : noteIds)
+    {
+        int index = indexOfNote(id);
+        if (index >= 0)
+            indices.push_back(index);
+    }
+    std::sort(indices.rbegin(), indices.rend());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+    beginBatch();
+    std::vector<NoteDelta> removed;
+    for (int index : indices)
+        removeChildAt(index, removed);
+    endBatch();
+    recordDeltas(std::move(removed));
+}
+
 void PatternModel::removeNoteAt(double beat, int pitch, double tolerance)
 {
+    beginBatch();
+    std::vector<NoteDelta> removed;
     for (int i = tree_.getNumChildren() - 1; i >= 0; --i)
     {
         auto note = tree_.getChild(i);
@@ -72,20 +340,23 @@ void PatternModel::removeNoteAt(double beat, int pitch, double tolerance)
         int notePitch = note.getProperty(IDs::pitch);
 
         if (notePitch == pitch && std::abs(noteStart - beat) < tolerance)
-        {
-            tree_.removeChild(i, undoManager_);
-        }
+            removeChildAt(i, removed);
     }
+    endBatch();
+    recordDeltas(std::move(removed));
 }
 
 void PatternModel::moveNote(int index, double newStartBeat, int newPitch)
 {
     if (index >= 0 && index < tree_.getNumChildren())
     {
+        bool own = beginEdit();
         auto note = tree_.getChild(index);
-        note.setProperty(IDs::startBeat, newStartBeat, undoManager_);
-        note.setProperty(IDs::pitch, newPitch, undoManager_);
-        sortNotes();
+        touchNote(note, false);
+        note.setProperty(IDs::startBeat, newStartBeat, nullptr);
+        note.setProperty(IDs::pitch, newPitch, nullptr);
+        repositionNote(note);
+        endEdit(own);
     }
 }
 
@@ -93,8 +364,11 @@ void PatternModel::resizeNote(int index, double newDuration)
 {
     if (index >= 0 && index < tree_.getNumChildren())
     {
+        bool own = beginEdit();
         auto note = tree_.getChild(index);
-        note.setProperty(IDs::duration, std::max(0.0625, newDuration), undoManager_);
+        touchNote(note, false);
+        note.setProperty(IDs::duration, std::max(MIN_NOTE_DURATION, newDuration), nullptr);
+        endEdit(own);
     }
 }
 
@@ -102,28 +376,240 @@ void PatternModel::setNoteVelocity(int index, int velocity)
 {
     if (index >= 0 && index < tree_.getNumChildren())
     {
+        bool own = beginEdit();
         auto note = tree_.getChild(index);
-        note.setProperty(IDs::velocity, std::clamp(velocity, 1, 127), undoManager_);
+        touchNote(note, false);
+        note.setProperty(IDs::velocity, std::clamp(velocity, 1, 127), nullptr);
+        endEdit(own);
     }
 }
 
-void PatternModel::clear()
+void PatternModel::setNoteCondition(int index, const TrigCondition &condition)
 {
-    // Remove all notes
-    while (tree_.getNumChildren() > 0)
+    if (index >= 0 && index < tree_.getNumChildren())
     {
-        tree_.removeChild(0, undoManager_);
+        bool own = beginEdit();
+        auto note = tree_.getChild(index);
+        touchNote(note, false);
+        note.setProperty(IDs::trig, static_cast<juce::int64>(condition.pack()), nullptr);
+        endEdit(own);
     }
 }
 
+void PatternModel::clear()
+{
+    // Remove all notes, back to front
+    beginBatch();
+    std::vector<NoteDelta> removed;
+    for (int i = tree_.getNumChildren() - 1; i >= 0; --i)
+        removeChildAt(i, removed);
+    endBatch();
+    recordDeltas(std::move(removed));
+}
+
 void PatternModel::beginTransaction(const juce::String &name)
 {
     if (undoManager_)
         undoManager_->beginNewTransaction(name);
 }
 
+void PatternModel::beginGesture(const juce::String &name)
+{
+    if (gestureActive_)
+        endGesture();
+
+    gestureActive_ = true;
+    gestureName_ = name;
+    gestureDeltas_.clear();
+}
+
+void PatternModel::endGesture()
+{
+    if (!gestureActive_)
+        return;
+
+    auto deltas = takeGestureDeltas();
+    if (syncPending_)
+        syncPattern();
+    if (deltas.empty() || !undoManager_)
+        return;
+
+    undoManager_->beginNewTransaction(gestureName_);
+    undoManager_->perform(new DeltaAction(*this, std::move(deltas)));
+}
+
+bool PatternModel::beginEdit()
+{
+    beginBatch();
+    if (gestureActive_ || !undoManager_)
+        return false;
+
+    gestureActive_ = true;
+    implicitGesture_ = true;
+    gestureDeltas_.clear();
+    return true;
+}
+
+void PatternModel::endEdit(bool own)
+{
+    endBatch();
+    if (own)
+    {
+        implicitGesture_ = false;
+        recordDeltas(takeGestureDeltas());
+    }
+}
+
+void PatternModel::removeChildAt(int index, std::vector<NoteDelta> &removed)
+{
+    // Many notes at once - collected directly rather than through touchNote's
+    // scan of what a gesture has touched
+    auto note = tree_.getChild(index);
+    if (gestureActive_)
+        touchNote(note, false);
+    else if (undoManager_)
+        removed.push_back({note, true, false, readNote(note), {}});
+    tree_.removeChild(index, nullptr);
+}
+
+void PatternModel::recordDeltas(std::vector<NoteDelta> deltas)
+{
+    // Into the caller's transaction, as a ValueTree edit would be
+    if (!deltas.empty() && undoManager_)
+        undoManager_->perform(new DeltaAction(*this, std::move(deltas)));
+}
+
+std::vector<PatternModel::NoteDelta> PatternModel::takeGestureDeltas()
+{
+    gestureActive_ = false;
+
+    // Resolve final state and drop notes the gesture left as it found them
+    std::vector<NoteDelta> deltas;
+    deltas.reserve(gestureDeltas_.size());
+    for (auto &d : gestureDeltas_)
+    {
+        d.existsAfter = d.note.getParent() == tree_;
+        if (d.existsAfter)
+            d.after = readNote(d.note);
+
+        if (!d.existedBefore && !d.existsAfter)
+            continue;
+        if (d.existedBefore && d.existsAfter && d.before == d.after)
+            continue;
+        deltas.push_back(std::move(d));
+    }
+    gestureDeltas_.clear();
+    return deltas;
+}
+
+std::vector<uint32_t> PatternModel::addNotes(const juce::String &name,
+                                             const std::vector<NoteEdit> &notes)
+{
+    if (gestureActive_)
+        endGesture();
+
+    std::vector<uint32_t> ids;
+    std::vector<NoteDelta> deltas;
+    ids.reserve(notes.size());
+    deltas.reserve(notes.size());
+
+    beginBatch();
+    for (const auto &edit : notes)
+    {
+        NoteValues values{edit.startBeat, std::max(MIN_NOTE_DURATION, edit.duration),
+                          std::clamp(edit.pitch, 0, 127), std::clamp(edit.velocity, 1, 127)};
+        uint32_t id = nextNoteId_++;
+        auto note = createNoteTree(values.startBeat, values.duration, values.pitch,
+                                   values.velocity, id);
+        tree_.appendChild(note, nullptr);
+        deltas.push_back({note, false, true, {}, values});
+        ids.push_back(id);
+    }
+    sortNotes();
+    endBatch();
+
+    if (undoManager_ && !deltas.empty())
+    {
+        undoManager_->beginNewTransaction(name);
+        undoManager_->perform(new DeltaAction(*this, std::move(deltas)));
+    }
+    return ids;
+}
+
+bool PatternModel::applyNoteEdits(const juce::String &name, const std::vector<NoteEdit> &edits,
+                                  const std::vector<uint32_t> &removedIds)
+{
+    if (gestureActive_)
+        endGesture();
+
+    std::vector<NoteDelta> deltas;
+    deltas.reserve(edits.size() + removedIds.size());
+
+    // Resolve removals up front - property writes don't move slots, so they stay
+    // valid until the removal pass
+    std::vector<int> removeSlots;
+    removeSlots.reserve(removedIds.size());
+    for (auto id : removedIds)
+    {
+        int index = indexOfNote(id);
+        if (index >= 0)
+            removeSlots.push_back(index);
+    }
+    std::sort(removeSlots.rbegin(), removeSlots.rend());
+    removeSlots.erase(std::unique(removeSlots.begin(), removeSlots.end()), removeSlots.end());
+
+    beginBatch();
+
+    for (const auto &edit : edits)
+    {
+        int index = indexOfNote(edit.id);
+        if (index < 0)
+            continue;
+
+        auto note = tree_.getChild(index);
+        auto before = readNote(note);
+        NoteValues after{edit.startBeat, std::max(MIN_NOTE_DURATION, edit.duration),
+                         std::clamp(edit.pitch, 0, 127), std::clamp(edit.velocity, 1, 127),
+                         before.trig};
+        if (before == after)
+            continue;
+
+        writeNote(note, after);
+        deltas.push_back({note, true, true, before, after});
+    }
+
+    for (int index : removeSlots)
+    {
+        auto note = tree_.getChild(index);
+        deltas.push_back({note, true, false, readNote(note), {}});
+        tree_.removeChild(index, nullptr);
+    }
+
+    sortNotes();
+    endBatch();
+
+    if (deltas.empty())
+        return false;
+
+    if (undoManager_)
+    {
+        undoManager_->beginNewTransaction(name);
+        undoManager_->perform(new DeltaAction(*this, std::move(deltas)));
+    }
+    return true;
+}
+
 int PatternModel::getNumNotes() const { return tree_.getNumChildren(); }
 
+size_t PatternModel::estimateBytes() const
+{
+    auto notes = static_cast<size_t>(tree_.getNumChildren());
+    return sizeof(*this) + notes * NOTE_TREE_BYTES +
+           slotById_.bucket_count() * sizeof(void *) +
+           slotById_.size() * (sizeof(std::pair<uint32_t, int>) + 2 * sizeof(void *)) +
+           gestureDeltas_.capacity() * sizeof(NoteDelta);
+}
+
 bool PatternModel::getNoteAt(int index, double &startBeat, double &duration, int &pitch,
                               int &velocity) const
 {
@@ -138,6 +624,15 @@ bool PatternModel::getNoteAt(int index, double &startBeat, double &duration, int
     return true;
 }
 
+TrigCondition PatternModel::getNoteCondition(int index) const
+{
+    if (index < 0 || index >= tree_.getNumChildren())
+        return {};
+
+    auto bits = static_cast<juce::int64>(tree_.getChild(index).getProperty(IDs::trig, 0));
+    return TrigCondition::unpack(static_cast<uint32_t>(bits));
+}
+
 int PatternModel::findNoteAt(double beat, int pitch, double tolerance) const
 {
     for (int i = 0; i < tree_.getNumChildren(); ++i)
@@ -152,6 +647,43 @@ int PatternModel::findNoteAt(double beat, int pitch, double tolerance) const
     return -1;
 }
 
+uint32_t PatternModel::getNoteId(int index) const
+{
+    if (index < 0 || index >= tree_.getNumChildren())
+        return 0;
+    return noteIdOf(tree_.getChild(index));
+}
+
+int PatternModel::indexOfNote(uint32_t noteId) const
+{
+    if (slotsDirty_)
+        rebuildSlots();
+
+    auto it = slotById_.find(noteId);
+    return it != slotById_.end() ? it->second : -1;
+}
+
+int PatternModel::indexOfAddedNote(const juce::ValueTree &note) const
+{
+    // Undo re-adding a removed note lands wherever it was, so fall back to a
+    // search for that
+    int last = tree_.getNumChildren() - 1;
+    if (tree_.getChild(last) == note)
+        return last;
+    if (tree_.getChild(insertHint_) == note)
+        return insertHint_;
+    return tree_.indexOf(note);
+}
+
+void PatternModel::rebuildSlots() const
+{
+    slotById_.clear();
+    slotById_.reserve(static_cast<size_t>(tree_.getNumChildren()));
+    for (int i = 0; i < tree_.getNumChildren(); ++i)
+        slotById_[getNoteId(i)] = i;
+    slotsDirty_ = false;
+}
+
 int PatternModel::findNoteContaining(double beat, int pitch, double tolerance) const
 {
     for (int i = 0; i < tree_.getNumChildren(); ++i)
@@ -195,6 +727,10 @@ PatternModel::getNotesStartingInRange(double startBeat, double endBeat) const
 
 void PatternModel::loadFromPattern(const Pattern &pattern)
 {
+    // One sync at the end - pattern may be our own auto-sync target, which a
+    // per-change sync would overwrite before it has been read
+    beginBatch();
+
     // Clear existing notes without undo
     while (tree_.getNumChildren() > 0)
         tree_.removeChild(0, nullptr);
@@ -202,12 +738,30 @@ void PatternModel::loadFromPattern(const Pattern &pattern)
     tree_.setProperty(IDs::bars, pattern.bars, nullptr);
     tree_.setProperty(IDs::swing, pattern.swing, nullptr);
 
+    // Keep saved IDs where they are unique; older projects get fresh ones
+    std::unordered_set<uint32_t> used;
+    for (const auto &note : pattern.notes)
+    {
+        if (note.id != 0)
+            nextNoteId_ = std::max(nextNoteId_, note.id + 1);
+    }
+
     for (const auto &note : pattern.notes)
     {
+        uint32_t id = note.id;
+        if (id == 0 || !used.insert(id).second)
+            id = nextNoteId_++;
+
         auto noteTree =
-            createNoteTree(note.startBeat, note.duration, note.pitch, note.velocity);
+            createNoteTree(note.startBeat, note.duration, note.pitch, note.velocity, id);
+        if (note.trig != 0)
+            noteTree.setProperty(IDs::trig, static_cast<juce::int64>(note.trig), nullptr);
         tree_.appendChild(noteTree, nullptr);
     }
+
+    // Edits rely on the tree being in start order
+    sortNotes();
+    endBatch();
 }
 
 void PatternModel::saveToPattern(Pattern &pattern) const
@@ -225,6 +779,9 @@ void PatternModel::saveToPattern(Pattern &pattern) const
         midiNote.pitch = static_cast<uint8_t>(static_cast<int>(note.getProperty(IDs::pitch)));
         midiNote.velocity =
             static_cast<uint8_t>(static_cast<int>(note.getProperty(IDs::velocity)));
+        midiNote.id = getNoteId(i);
+        midiNote.trig =
+            static_cast<uint32_t>(static_cast<juce::int64>(note.getProperty(IDs::trig, 0)));
         pattern.notes.push_back(midiNote);
     }
     pattern.sortNotes();
@@ -232,70 +789,182 @@ void PatternModel::saveToPattern(Pattern &pattern) const
 
 void PatternModel::sortNotes()
 {
-    // Collect notes with their start beats
-    std::vector<std::pair<double, juce::ValueTree>> notesWithBeats;
-    for (int i = 0; i < tree_.getNumChildren(); ++i)
+    // Stable, so notes sharing a start keep their relative order. One reorder of
+    // the child array rather than a moveChild per note.
+    struct StartOrder
     {
-        auto note = tree_.getChild(i);
-        double start = note.getProperty(IDs::startBeat);
-        notesWithBeats.emplace_back(start, note);
-    }
+        static int compareElements(const juce::ValueTree &a, const juce::ValueTree &b)
+        {
+            double startA = a.getProperty(IDs::startBeat);
+            double startB = b.getProperty(IDs::startBeat);
+            return startA < startB ? -1 : (startB < startA ? 1 : 0);
+        }
+    };
 
-    // Sort by start beat
-    std::sort(notesWithBeats.begin(), notesWithBeats.end(),
-              [](const auto &a, const auto &b) { return a.first < b.first; });
+    auto startOf = [this](int i) -> double {
+        return tree_.getChild(i).getProperty(IDs::startBeat);
+    };
+    bool sorted = true;
+    for (int i = 1; i < tree_.getNumChildren() && sorted; ++i)
+        sorted = startOf(i - 1) <= startOf(i);
 
-    // Check if already sorted
-    bool needsSort = false;
-    for (int i = 0; i < static_cast<int>(notesWithBeats.size()); ++i)
+    if (!sorted)
     {
-        if (tree_.getChild(i) != notesWithBeats[i].second)
-        {
-            needsSort = true;
-            break;
-        }
+        StartOrder comparator;
+        tree_.sort(comparator, nullptr, true);
     }
+}
 
-    if (needsSort)
+int PatternModel::sortedInsertIndex(double startBeat, int skipIndex) const
+{
+    // Upper bound on start beat - notes are kept sorted by every edit path. With
+    // skipIndex, that child is treated as already removed.
+    int lo = 0, hi = tree_.getNumChildren() - (skipIndex >= 0 ? 1 : 0);
+    while (lo < hi)
     {
-        // Reorder without creating undo entries for the sort itself
-        for (int i = 0; i < static_cast<int>(notesWithBeats.size()); ++i)
-        {
-            tree_.moveChild(tree_.indexOf(notesWithBeats[i].second), i, nullptr);
-        }
+        int mid = (lo + hi) / 2;
+        int child = (skipIndex >= 0 && mid >= skipIndex) ? mid + 1 : mid;
+        if (static_cast<double>(tree_.getChild(child).getProperty(IDs::startBeat)) <= startBeat)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
+    return lo;
 }
 
-void PatternModel::valueTreeChildAdded(juce::ValueTree & /*parent*/, juce::ValueTree & /*child*/)
+void PatternModel::insertSorted(const juce::ValueTree &note)
 {
-    // Auto-sync to legacy pattern for sequencer playback
-    if (autoSyncPattern_)
-        saveToPattern(*autoSyncPattern_);
+    insertHint_ = sortedInsertIndex(note.getProperty(IDs::startBeat));
+    tree_.addChild(note, insertHint_, nullptr);
+}
 
-    if (onPatternChanged)
-        onPatternChanged();
+void PatternModel::repositionNote(const juce::ValueTree &note)
+{
+    int index = indexOfNote(noteIdOf(note));
+    if (index < 0)
+        return;
+
+    double start = note.getProperty(IDs::startBeat);
+    auto startOf = [this](int i) -> double { return tree_.getChild(i).getProperty(IDs::startBeat); };
+
+    // Already in order relative to its neighbours?
+    bool afterPrev = index == 0 || startOf(index - 1) <= start;
+    bool beforeNext = index == tree_.getNumChildren() - 1 || start <= startOf(index + 1);
+    if (afterPrev && beforeNext)
+        return;
+
+    tree_.moveChild(index, sortedInsertIndex(start, index), nullptr);
 }
 
-void PatternModel::valueTreeChildRemoved(juce::ValueTree & /*parent*/, juce::ValueTree & /*child*/,
-                                          int /*index*/)
+void PatternModel::endBatch()
 {
-    // Auto-sync to legacy pattern for sequencer playback
-    if (autoSyncPattern_)
-        saveToPattern(*autoSyncPattern_);
+    if (--batchDepth_ > 0)
+        return;
+
+    if (onBatchEnded)
+        onBatchEnded();
+
+    if (batchDirty_)
+    {
+        batchDirty_ = false;
+        notifyChanged();
+    }
+}
+
+void PatternModel::notifyChanged()
+{
+    if (batchDepth_ > 0)
+    {
+        batchDirty_ = true;
+        return;
+    }
+
+    // Auto-sync to legacy pattern for sequencer playback. A gesture re-sorts
+    // and recompiles once at its end rather than on every mouse event.
+    if (gestureActive_ && !implicitGesture_)
+        syncPending_ = true;
+    else
+        syncPattern();
+
+    // Swap out first - a callback may edit the pattern again
+    NoteChanges changes;
+    std::swap(changes, pendingChanges_);
 
     if (onPatternChanged)
         onPatternChanged();
+
+    if (onNotesChanged && !changes.empty())
+        onNotesChanged(changes);
+}
+
+void PatternModel::syncPattern()
+{
+    syncPending_ = false;
+    if (!autoSyncPattern_)
+        return;
+
+    saveToPattern(*autoSyncPattern_);
+    if (onSynced)
+        onSynced();
+}
+
+void PatternModel::valueTreeChildAdded(juce::ValueTree &parent, juce::ValueTree &child)
+{
+    // Appending leaves every other slot where it was
+    int last = parent.getNumChildren() - 1;
+    if (!slotsDirty_ && parent.getChild(last) == child)
+        slotById_[noteIdOf(child)] = last;
+    else
+        slotsDirty_ = true;
+    pendingChanges_.added.push_back(noteIdOf(child));
+    notifyChanged();
+}
+
+void PatternModel::valueTreeChildRemoved(juce::ValueTree &parent, juce::ValueTree &child,
+                                          int index)
+{
+    // Removing the last note leaves every other slot where it was
+    if (!slotsDirty_ && index == parent.getNumChildren())
+        slotById_.erase(noteIdOf(child));
+    else
+        slotsDirty_ = true;
+    pendingChanges_.removed.push_back(noteIdOf(child));
+    notifyChanged();
 }
 
-void PatternModel::valueTreePropertyChanged(juce::ValueTree & /*tree*/,
+void PatternModel::valueTreePropertyChanged(juce::ValueTree &tree,
                                              const juce::Identifier & /*property*/)
 {
-    // Auto-sync to legacy pattern for sequencer playback
-    if (autoSyncPattern_)
-        saveToPattern(*autoSyncPattern_);
+    if (tree == tree_)
+    {
+        pendingChanges_.patternChanged = true;
+    }
+    else
+    {
+        // A drag sets several properties of the same note in a row
+        auto id = noteIdOf(tree);
+        auto &modified = pendingChanges_.modified;
+        if (modified.empty() || modified.back() != id)
+            modified.push_back(id);
+    }
+    notifyChanged();
+}
 
-    if (onPatternChanged)
-        onPatternChanged();
+void PatternModel::valueTreeChildOrderChanged(juce::ValueTree &parent, int oldIndex, int newIndex)
+{
+    // Re-sorting moves slots but not content; the property change that caused it
+    // has already been reported.
+    //
+    // A moved note only shifts the notes between its old and new slots. A sort
+    // reports every child as (0, 0) and needs the whole map again.
+    if (slotsDirty_ || oldIndex == newIndex)
+    {
+        slotsDirty_ = true;
+        return;
+    }
+
+    for (int i = std::min(oldIndex, newIndex); i <= std::max(oldIndex, newIndex); ++i)
+        slotById_[noteIdOf(parent.getChild(i))] = i;
 }
 
 } // namespace SurgeBox
@@ -10,6 +10,9 @@
 
 #include <juce_data_structures/juce_data_structures.h>
 #include "GrooveboxProject.h"
+#include <atomic>
+#include <memory>
+#include <unordered_map>
 
 namespace SurgeBox
 {
@@ -25,15 +28,49 @@ inline const juce::Identifier startBeat{"startBeat"};
 inline const juce::Identifier duration{"duration"};
 inline const juce::Identifier pitch{"pitch"};
 inline const juce::Identifier velocity{"velocity"};
+inline const juce::Identifier noteId{"noteId"};
+inline const juce::Identifier trig{"trig"}; // TrigCondition::pack(), absent - always plays
 } // namespace IDs
 
 /**
  * PatternModel wraps pattern data in a ValueTree for automatic undo/redo support.
  * All note operations go through the UndoManager when provided.
+ *
+ * Every note carries a stable 32-bit ID (never 0) that survives sorting, undo
+ * and save/load, so selections and side tables can refer to notes while their
+ * child indices shift.
  */
 class PatternModel : public juce::ValueTree::Listener
 {
   public:
+    // IDs of the notes touched since the last notification. Edits made inside a
+    // batch (gesture undo, bulk edits) are reported together.
+    struct NoteChanges
+    {
+        std::vector<uint32_t> added;
+        std::vector<uint32_t> removed;
+        std::vector<uint32_t> modified;
+        bool patternChanged{false}; // bars/swing
+
+        bool empty() const
+        {
+            return added.empty() && removed.empty() && modified.empty() && !patternChanged;
+        }
+    };
+
+    // One note's complete state, for bulk edits
+    struct NoteEdit
+    {
+        uint32_t id{0};
+        double startBeat{0.0};
+        double duration{0.0};
+        int pitch{0};
+        int velocity{0};
+    };
+
+    // Shortest note an edit may leave behind
+    static constexpr double MIN_NOTE_DURATION = 0.0625;
+
     PatternModel();
     explicit PatternModel(juce::UndoManager *undoManager);
     ~PatternModel() override;
@@ -50,23 +87,54 @@ class PatternModel : public juce::ValueTree::Listener
     double lengthInBeats() const { return getBars() * 4.0; }
 
     // Note operations (all undoable when UndoManager is set)
-    void addNote(double startBeat, double duration, int pitch, int velocity);
+    uint32_t addNote(double startBeat, double duration, int pitch, int velocity);
     void removeNote(int index);
+    void removeNotes(const std::vector<uint32_t> &noteIds);
     void removeNoteAt(double beat, int pitch, double tolerance = 0.01);
     void moveNote(int index, double newStartBeat, int newPitch);
     void resizeNote(int index, double newDuration);
     void setNoteVelocity(int index, int velocity);
+    void setNoteCondition(int index, const TrigCondition &condition);
     void clear();
 
     // Batch operations (grouped as single undo)
     void beginTransaction(const juce::String &name);
 
+    // Continuous gestures (drag-drawing, moving, resizing). Edits made between
+    // beginGesture and endGesture bypass the UndoManager and are committed as one
+    // delta transaction holding only the notes the gesture touched, so undo/redo
+    // costs O(changed notes) however many mouse events the gesture took. The
+    // auto-sync pattern (and so playback) catches up once, at endGesture.
+    void beginGesture(const juce::String &name);
+    void endGesture();
+    bool isInGesture() const { return gestureActive_; }
+
+    // Bulk edits (transforms over a selection). Writes new values for existing
+    // notes and removes others as one undo step with one re-sort and one change
+    // notification, so the cost is O(n log n) however many notes change. A note
+    // listed in removedIds must not also be edited. Returns false if nothing changed.
+    bool applyNoteEdits(const juce::String &name, const std::vector<NoteEdit> &edits,
+                        const std::vector<uint32_t> &removedIds);
+
+    // Add notes as one undo step with one re-sort and one change notification
+    // (live recording). NoteEdit::id is ignored; returns the new notes' IDs.
+    std::vector<uint32_t> addNotes(const juce::String &name, const std::vector<NoteEdit> &notes);
+
     // Query
     int getNumNotes() const;
     bool getNoteAt(int index, double &startBeat, double &duration, int &pitch, int &velocity) const;
+    TrigCondition getNoteCondition(int index) const;
     int findNoteAt(double beat, int pitch, double tolerance = 0.01) const;
     int findNoteContaining(double beat, int pitch, double tolerance = 0.01) const;
 
+    // Stable IDs - indexOfNote is O(1) between structural edits
+    uint32_t getNoteId(int index) const;
+    int indexOfNote(uint32_t noteId) const;
+
+    // Slot of a note just added - O(1) for appends and the model's own sorted
+    // inserts, so listeners needn't search the pattern for it
+    int indexOfAddedNote(const juce::ValueTree &note) const;
+
     // For sequencer playback - get notes starting in range
     std::vector<std::tuple<double, double, int, int>> getNotesStartingInRange(double startBeat,
                                                                                double endBeat) const;
@@ -78,12 +146,29 @@ class PatternModel : public juce::ValueTree::Listener
     // Set a pattern to auto-sync on every change (for sequencer playback)
     void setAutoSyncPattern(Pattern *pattern) { autoSyncPattern_ = pattern; }
 
+    // Restore start order after edits made directly on the tree (journal replay)
+    void sortNotes();
+
+    // Estimated heap use of the notes, and the exact size of this model's
+    // undo steps held by the UndoManager
+    size_t estimateBytes() const;
+    size_t getUndoBytes() const { return undoBytes_->load(); }
+
     // Direct ValueTree access (for listeners)
     juce::ValueTree &getValueTree() { return tree_; }
     const juce::ValueTree &getValueTree() const { return tree_; }
 
-    // Listener callback for UI updates
+    // Listener callbacks for UI updates
     std::function<void()> onPatternChanged;
+    std::function<void(const NoteChanges &)> onNotesChanged;
+
+    // Called after the auto-sync pattern has been rewritten (engine hook)
+    std::function<void()> onSynced;
+
+    // True while a bulk edit (transform, undo step, load) is being applied;
+    // onBatchEnded fires as the outermost one finishes (journal hook)
+    bool isInBatch() const { return batchDepth_ > 0; }
+    std::function<void()> onBatchEnded;
 
   protected:
     // ValueTree::Listener
@@ -91,18 +176,89 @@ class PatternModel : public juce::ValueTree::Listener
     void valueTreeChildRemoved(juce::ValueTree &parent, juce::ValueTree &child,
                                int index) override;
     void valueTreePropertyChanged(juce::ValueTree &tree, const juce::Identifier &property) override;
+    void valueTreeChildOrderChanged(juce::ValueTree &parent, int oldIndex, int newIndex) override;
 
   private:
+    struct NoteValues
+    {
+        double startBeat{0.0};
+        double duration{0.0};
+        int pitch{0};
+        int velocity{0};
+        uint32_t trig{0}; // Packed TrigCondition
+
+        bool operator==(const NoteValues &other) const = default;
+    };
+
+    // One note's before/after state within a gesture
+    struct NoteDelta
+    {
+        juce::ValueTree note;
+        bool existedBefore{false};
+        bool existsAfter{false};
+        NoteValues before;
+        NoteValues after;
+    };
+
+    class DeltaAction;
+    class PropertyAction;
+
+    // Rough heap footprint of a note ValueTree and its properties
+    static constexpr size_t NOTE_TREE_BYTES = 256;
+
+    // Shared with this model's undo steps, which may outlive it
+    std::shared_ptr<std::atomic<size_t>> undoBytes_{std::make_shared<std::atomic<size_t>>(0)};
+
     juce::ValueTree tree_;
     juce::UndoManager *undoManager_{nullptr};
     Pattern *autoSyncPattern_{nullptr};
 
+    // Gesture state
+    bool gestureActive_{false};
+    bool implicitGesture_{false}; // One edit's own, from beginEdit
+    bool syncPending_{false};     // Auto-sync deferred to the gesture's end
+    juce::String gestureName_;
+    std::vector<NoteDelta> gestureDeltas_;
+
+    // While > 0, change notifications are folded into one at the end
+    int batchDepth_{0};
+    bool batchDirty_{false};
+    NoteChanges pendingChanges_;
+
+    // Note IDs
+    uint32_t nextNoteId_{1};
+    mutable std::unordered_map<uint32_t, int> slotById_;
+    mutable bool slotsDirty_{true};
+    int insertHint_{-1}; // Slot of the last sorted insert
+    void rebuildSlots() const;
+
     // Helper to create a note ValueTree
     static juce::ValueTree createNoteTree(double startBeat, double duration, int pitch,
-                                          int velocity);
+                                          int velocity, uint32_t noteId);
+    static uint32_t noteIdOf(const juce::ValueTree &note);
+    static NoteValues readNote(const juce::ValueTree &note);
+    static void writeNote(juce::ValueTree &note, const NoteValues &values);
 
-    // Sort notes by start beat
-    void sortNotes();
+    // Every edit is undone through a DeltaAction, sized in bytes for the undo
+    // budget. A single edit outside a gesture is recorded as a gesture of its
+    // own into the current transaction; beginEdit returns whether it started one.
+    // Each edit is also a batch, so setting several properties syncs once.
+    bool beginEdit();
+    void endEdit(bool own);
+    void touchNote(const juce::ValueTree &note, bool isNew);
+    void removeChildAt(int index, std::vector<NoteDelta> &removed);
+    void recordDeltas(std::vector<NoteDelta> deltas);
+    std::vector<NoteDelta> takeGestureDeltas();
+    void setPatternProperty(const juce::Identifier &property, const juce::var &value);
+
+    int sortedInsertIndex(double startBeat, int skipIndex = -1) const;
+    void insertSorted(const juce::ValueTree &note);
+    void repositionNote(const juce::ValueTree &note);
+
+    void beginBatch() { ++batchDepth_; }
+    void endBatch();
+    void notifyChanged();
+    void syncPattern();
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PatternModel)
 };
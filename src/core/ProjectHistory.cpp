@@ -0,0 +1,519 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "ProjectHistory.h"
+#include "EditJournal.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace SurgeBox
+{
+
+// ============================================================================
+// PatchDelta
+// ============================================================================
+
+PatchDelta PatchDelta::between(const std::string &from, const std::string &to)
+{
+    PatchDelta delta;
+
+    size_t prefix = 0;
+    size_t maxPrefix = std::min(from.size(), to.size());
+    while (prefix < maxPrefix && from[prefix] == to[prefix])
+        ++prefix;
+
+    if (prefix == from.size() && prefix == to.size())
+        return delta;
+
+    size_t suffix = 0;
+    size_t maxSuffix = maxPrefix - prefix;
+    while (suffix < maxSuffix && from[from.size() - 1 - suffix] == to[to.size() - 1 - suffix])
+        ++suffix;
+
+    size_t fromEnd = from.size() - suffix;
+    size_t toEnd = to.size() - suffix;
+
+    if (fromEnd - prefix != toEnd - prefix)
+    {
+        delta.hunks.push_back({static_cast<uint32_t>(prefix), from.substr(prefix, fromEnd - prefix),
+                               to.substr(prefix, toEnd - prefix)});
+        return delta;
+    }
+
+    // Same length in between: keep only the differing runs. Runs separated by a
+    // short stretch of equal bytes are merged, since each hunk has its own overhead.
+    static constexpr size_t MERGE_GAP = 16;
+
+    size_t pos = prefix;
+    while (pos < fromEnd)
+    {
+        size_t start = pos;
+        size_t end = pos + 1;
+        size_t scan = end;
+        while (scan < fromEnd && scan - end < MERGE_GAP)
+        {
+            if (from[scan] != to[scan])
+                end = scan + 1;
+            ++scan;
+        }
+
+        delta.hunks.push_back({static_cast<uint32_t>(start), from.substr(start, end - start),
+                               to.substr(start, end - start)});
+
+        pos = end;
+        while (pos < fromEnd && from[pos] == to[pos])
+            ++pos;
+    }
+
+    return delta;
+}
+
+bool PatchDelta::apply(std::string &blob, bool forward) const
+{
+    // Validate everything first so a mismatch leaves blob untouched
+    for (const auto &hunk : hunks)
+    {
+        const auto &expected = forward ? hunk.before : hunk.after;
+        if (hunk.offset + expected.size() > blob.size() ||
+            blob.compare(hunk.offset, expected.size(), expected) != 0)
+            return false;
+    }
+
+    // Multiple hunks only occur when both sides have equal length, so offsets hold
+    for (const auto &hunk : hunks)
+    {
+        const auto &expected = forward ? hunk.before : hunk.after;
+        const auto &replacement = forward ? hunk.after : hunk.before;
+        blob.replace(hunk.offset, expected.size(), replacement);
+    }
+    return true;
+}
+
+size_t PatchDelta::sizeInBytes() const
+{
+    size_t bytes = sizeof(*this);
+    for (const auto &hunk : hunks)
+        bytes += sizeof(Hunk) + hunk.before.size() + hunk.after.size();
+    return bytes;
+}
+
+// ============================================================================
+// Undo actions
+// ============================================================================
+
+/**
+ * A mixer or global value change. Consecutive changes of the same key coalesce,
+ * so a slider drag undoes in one step.
+ */
+class ProjectHistory::ValueAction : public juce::UndoableAction
+{
+  public:
+    ValueAction(uint32_t key, double before, double after, std::function<void(double)> setter,
+                juce::uint32 timeMs)
+        : key_(key), before_(before), after_(after), setter_(std::move(setter)), timeMs_(timeMs)
+    {
+    }
+
+    bool perform() override
+    {
+        setter_(after_);
+        return true;
+    }
+
+    bool undo() override
+    {
+        setter_(before_);
+        return true;
+    }
+
+    int getSizeInUnits() override { return static_cast<int>(sizeof(*this)); }
+
+    juce::UndoableAction *createCoalescedAction(juce::UndoableAction *nextAction) override
+    {
+        auto *next = dynamic_cast<ValueAction *>(nextAction);
+        if (!next || !canAbsorb(next->key_, next->timeMs_))
+            return nullptr;
+        return new ValueAction(key_, before_, next->after_, setter_, next->timeMs_);
+    }
+
+    // Whether a change of key at timeMs continues this one
+    bool canAbsorb(uint32_t key, juce::uint32 timeMs) const
+    {
+        return key == key_ && timeMs - timeMs_ < VALUE_COALESCE_MS;
+    }
+
+  private:
+    uint32_t key_;
+    double before_;
+    double after_;
+    std::function<void(double)> setter_;
+    juce::uint32 timeMs_;
+};
+
+/**
+ * Automation lanes replaced together - an edit, or every lane an automation take
+ * wrote to. Undo restores them in reverse.
+ */
+class ProjectHistory::LaneAction : public juce::UndoableAction
+{
+  public:
+    LaneAction(std::vector<LaneEdit> edits, LaneSetter setter)
+        : edits_(std::move(edits)), setter_(std::move(setter))
+    {
+    }
+
+    bool perform() override
+    {
+        for (const auto &edit : edits_)
+            setter_(edit.voice, edit.slot, edit.after);
+        return true;
+    }
+
+    bool undo() override
+    {
+        for (auto it = edits_.rbegin(); it != edits_.rend(); ++it)
+            setter_(it->voice, it->slot, it->before);
+        return true;
+    }
+
+    int getSizeInUnits() override
+    {
+        size_t bytes = sizeof(*this);
+        for (const auto &edit : edits_)
+            bytes += sizeof(LaneEdit) +
+                     (edit.before.points.size() + edit.after.points.size()) *
+                         sizeof(AutomationPoint);
+        return static_cast<int>(bytes);
+    }
+
+  private:
+    std::vector<LaneEdit> edits_;
+    LaneSetter setter_;
+};
+
+/**
+ * A p-lock edit. Consecutive edits of the same lock coalesce, so dragging a
+ * locked value undoes in one step.
+ */
+class ProjectHistory::LockAction : public juce::UndoableAction
+{
+  public:
+    LockAction(LockEdit edit, LockSetter setter, juce::uint32 timeMs)
+        : edit_(std::move(edit)), setter_(std::move(setter)), timeMs_(timeMs)
+    {
+    }
+
+    bool perform() override
+    {
+        setter_(edit_, edit_.after);
+        return true;
+    }
+
+    bool undo() override
+    {
+        setter_(edit_, edit_.before);
+        return true;
+    }
+
+    int getSizeInUnits() override
+    {
+        return static_cast<int>(sizeof(*this) + edit_.target.size());
+    }
+
+    juce::UndoableAction *createCoalescedAction(juce::UndoableAction *nextAction) override
+    {
+        auto *next = dynamic_cast<LockAction *>(nextAction);
+        if (!next || !canAbsorb(next->edit_, next->timeMs_))
+            return nullptr;
+
+        auto edit = edit_;
+        edit.after = next->edit_.after;
+        return new LockAction(std::move(edit), setter_, next->timeMs_);
+    }
+
+    // Whether an edit at timeMs continues this one
+    bool canAbsorb(const LockEdit &edit, juce::uint32 timeMs) const
+    {
+        return edit.voice == edit_.voice && edit.slot == edit_.slot &&
+               edit.noteId == edit_.noteId && edit.target == edit_.target &&
+               timeMs - timeMs_ < VALUE_COALESCE_MS;
+    }
+
+  private:
+    LockEdit edit_;
+    LockSetter setter_;
+    juce::uint32 timeMs_;
+};
+
+/**
+ * A settled patch change of one voice, stored as a delta against the previous
+ * baseline. Undo/redo are handed to the worker thread.
+ */
+class ProjectHistory::PatchAction : public juce::UndoableAction
+{
+  public:
+    PatchAction(ProjectHistory &owner, int voice, std::shared_ptr<const PatchDelta> delta)
+        : owner_(owner), voice_(voice), delta_(std::move(delta))
+    {
+    }
+
+    bool perform() override
+    {
+        // The change already happened in Surge; only redo needs to re-apply it
+        if (std::exchange(firstPerform_, false))
+            return true;
+        owner_.submitPatchJob({voice_, delta_, true});
+        return true;
+    }
+
+    bool undo() override
+    {
+        owner_.submitPatchJob({voice_, delta_, false});
+        return true;
+    }
+
+    int getSizeInUnits() override
+    {
+        return static_cast<int>(sizeof(*this) + delta_->sizeInBytes());
+    }
+
+  private:
+    ProjectHistory &owner_;
+    int voice_;
+    std::shared_ptr<const PatchDelta> delta_;
+    bool firstPerform_{true};
+};
+
+// ============================================================================
+// ProjectHistory
+// ============================================================================
+
+ProjectHistory::ProjectHistory(juce::UndoManager &undoManager) : undoManager_(undoManager)
+{
+    worker_ = std::thread([this] { workerLoop(); });
+}
+
+ProjectHistory::~ProjectHistory()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex_);
+        stopRequested_ = true;
+    }
+    wake_.notify_one();
+    worker_.join();
+}
+
+void ProjectHistory::recordValue(uint32_t key, const juce::String &name, double before,
+                                 double after, std::function<void(double)> setter)
+{
+    if (before == after)
+        return;
+
+    auto now = juce::Time::getMillisecondCounter();
+
+    // Keep coalescing only while the current transaction ends with this same value
+    juce::Array<const juce::UndoableAction *> current;
+    undoManager_.getActionsInCurrentTransaction(current);
+    auto *last = current.isEmpty() ? nullptr : dynamic_cast<const ValueAction *>(current.getLast());
+    if (!last || !last->canAbsorb(key, now))
+        undoManager_.beginNewTransaction(name);
+
+    undoManager_.perform(new ValueAction(key, before, after, std::move(setter), now));
+}
+
+void ProjectHistory::recordLanes(const juce::String &name, std::vector<LaneEdit> edits,
+                                 LaneSetter setter)
+{
+    if (edits.empty())
+        return;
+
+    undoManager_.beginNewTransaction(name);
+    undoManager_.perform(new LaneAction(std::move(edits), std::move(setter)));
+}
+
+void ProjectHistory::recordLock(const juce::String &name, LockEdit edit, LockSetter setter)
+{
+    // NaN on both sides is no lock before or after
+    if (edit.before == edit.after || (std::isnan(edit.before) && std::isnan(edit.after)))
+        return;
+
+    auto now = juce::Time::getMillisecondCounter();
+
+    juce::Array<const juce::UndoableAction *> current;
+    undoManager_.getActionsInCurrentTransaction(current);
+    auto *last = current.isEmpty() ? nullptr : dynamic_cast<const LockAction *>(current.getLast());
+    if (!last || !last->canAbsorb(edit, now))
+        undoManager_.beginNewTransaction(name);
+
+    undoManager_.perform(new LockAction(std::move(edit), std::move(setter), now));
+}
+
+void ProjectHistory::setPatchLoader(PatchLoader loader)
+{
+    std::lock_guard<std::mutex> lock(loaderMutex_);
+    loader_ = std::move(loader);
+}
+
+bool ProjectHistory::pollPatch(int voice, const void *data, size_t size, bool flush)
+{
+    if (voice < 0 || voice >= NUM_VOICES || !data || size == 0)
+        return false;
+
+    auto fp = EditJournal::fingerprint(data, size);
+    std::shared_ptr<const PatchDelta> delta;
+
+    {
+        std::lock_guard<std::mutex> lock(patchMutex_);
+        auto &track = patches_[voice];
+
+        if (track.adoptNextPoll)
+        {
+            if (track.reloadedAtMs != 0 &&
+                juce::Time::getMillisecondCounter() - track.reloadedAtMs < RELOAD_SETTLE_MS)
+                return false;
+
+            bool report = track.reportAdoption;
+            if (track.adoptBase)
+                track.base.assign(static_cast<const char *>(data), size);
+            track.baseFingerprint = fp;
+            track.pendingFingerprint = fp;
+            track.adoptNextPoll = false;
+            track.adoptBase = false;
+            track.reportAdoption = false;
+            track.reloadedAtMs = 0;
+            return report;
+        }
+
+        if (fp == track.baseFingerprint)
+        {
+            track.pendingFingerprint = fp;
+            return false;
+        }
+
+        // Still moving - wait for it to settle unless asked to flush
+        if (!flush && fp != track.pendingFingerprint)
+        {
+            track.pendingFingerprint = fp;
+            return false;
+        }
+
+        std::string blob(static_cast<const char *>(data), size);
+        delta = std::make_shared<const PatchDelta>(PatchDelta::between(track.base, blob));
+        track.baseFingerprint = fp;
+        track.pendingFingerprint = fp;
+
+        // Back where the history already is - an undone patch swapped in late
+        if (delta->hunks.empty())
+            return false;
+        track.base = std::move(blob);
+    }
+
+    undoManager_.beginNewTransaction("Patch Edit");
+    undoManager_.perform(new PatchAction(*this, voice, std::move(delta)));
+    return true;
+}
+
+void ProjectHistory::rebasePatch(int voice)
+{
+    if (voice < 0 || voice >= NUM_VOICES)
+        return;
+
+    std::lock_guard<std::mutex> lock(patchMutex_);
+    auto &track = patches_[voice];
+    track.adoptNextPoll = true;
+    track.adoptBase = true;
+    track.reportAdoption = false;
+    track.reloadedAtMs = 0;
+}
+
+void ProjectHistory::followPatch(int voice)
+{
+    if (voice < 0 || voice >= NUM_VOICES)
+        return;
+
+    std::lock_guard<std::mutex> lock(patchMutex_);
+    patches_[voice].adoptNextPoll = true;
+}
+
+size_t ProjectHistory::getPatchBaselineBytes(int voice)
+{
+    if (voice < 0 || voice >= NUM_VOICES)
+        return 0;
+
+    std::lock_guard<std::mutex> lock(patchMutex_);
+    return patches_[voice].base.capacity();
+}
+
+void ProjectHistory::submitPatchJob(PatchJob job)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex_);
+        jobs_.push_back(std::move(job));
+    }
+    wake_.notify_one();
+}
+
+void ProjectHistory::workerLoop()
+{
+    std::vector<PatchJob> jobs;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(jobMutex_);
+            wake_.wait(lock, [this] { return stopRequested_ || !jobs_.empty(); });
+            if (stopRequested_)
+                return;
+            jobs.swap(jobs_);
+        }
+
+        // Apply every queued step, then load only the final state of each voice,
+        // so holding down undo doesn't queue a patch load per step
+        std::array<bool, NUM_VOICES> changed{};
+        std::array<std::string, NUM_VOICES> blobs;
+        {
+            std::lock_guard<std::mutex> lock(patchMutex_);
+            for (const auto &job : jobs)
+            {
+                auto &track = patches_[job.voice];
+                if (job.delta->apply(track.base, job.forward))
+                    changed[job.voice] = true;
+                else
+                    jassertfalse; // Only recorded steps move the baseline
+            }
+
+            auto now = juce::Time::getMillisecondCounter();
+            for (int v = 0; v < NUM_VOICES; ++v)
+            {
+                if (!changed[v])
+                    continue;
+
+                auto &track = patches_[v];
+                track.baseFingerprint =
+                    EditJournal::fingerprint(track.base.data(), track.base.size());
+                track.pendingFingerprint = track.baseFingerprint;
+                track.adoptNextPoll = true;
+                track.reportAdoption = true;
+                track.reloadedAtMs = std::max<juce::uint32>(now, 1);
+                blobs[v] = track.base;
+            }
+        }
+        jobs.clear();
+
+        std::lock_guard<std::mutex> lock(loaderMutex_);
+        for (int v = 0; v < NUM_VOICES; ++v)
+        {
+            if (changed[v] && loader_)
+                loader_(v, blobs[v]);
+        }
+    }
+}
+
+} // namespace SurgeBox
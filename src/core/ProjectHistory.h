@@ -0,0 +1,183 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include "GrooveboxProject.h"
+#include <juce_data_structures/juce_data_structures.h>
+
+#include <array>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace SurgeBox
+{
+
+/**
+ * Binary delta between two snapshots of a serialized patch.
+ *
+ * A parameter tweak rewrites a handful of bytes in a blob of tens of kilobytes,
+ * so only the differing hunks are kept. Blobs of equal length are split into
+ * separate hunks; otherwise one hunk spans everything between the common prefix
+ * and suffix.
+ */
+struct PatchDelta
+{
+    struct Hunk
+    {
+        uint32_t offset{0};
+        std::string before;
+        std::string after;
+    };
+
+    std::vector<Hunk> hunks;
+
+    static PatchDelta between(const std::string &from, const std::string &to);
+
+    // Rewrite blob to the other side of the delta. Returns false (leaving blob
+    // untouched) if blob doesn't hold the bytes the delta expects.
+    bool apply(std::string &blob, bool forward) const;
+
+    size_t sizeInBytes() const;
+};
+
+/**
+ * Project-wide undo for state outside the pattern ValueTrees: mixer strips,
+ * global settings and the Surge patch of each voice. Everything is recorded as
+ * UndoableActions in the engine's shared UndoManager, so pattern edits and these
+ * share one timeline and one memory budget.
+ *
+ * Surge has no patch-changed hook, so the owner polls each synth's raw state and
+ * feeds it to pollPatch(). A change is recorded once the patch has settled (two
+ * identical polls), which folds a knob drag into one step. Undo/redo hand the
+ * delta to a worker thread that rebuilds the full blob and passes it to the patch
+ * loader, which queues it for Surge to swap in at its next block.
+ *
+ * Each voice's baseline is the state its undo steps lead to, and only recorded
+ * steps and undo/redo move it. Changes that aren't edits - automation, or
+ * whatever Surge reports while it swaps in an undone patch - are followed by
+ * fingerprint alone, and fold into the next recorded step, so every delta
+ * always applies to the baseline it is undone from.
+ */
+class ProjectHistory
+{
+  public:
+    // Called on the worker thread with a rebuilt patch to load into a voice
+    using PatchLoader = std::function<void(int voice, const std::string &blob)>;
+
+    explicit ProjectHistory(juce::UndoManager &undoManager);
+    ~ProjectHistory();
+
+    // Apply a mixer/global value change through setter and record it. Repeated
+    // changes of the same key (e.g. a slider drag) coalesce into one step.
+    void recordValue(uint32_t key, const juce::String &name, double before, double after,
+                     std::function<void(double)> setter);
+
+    // A replaced automation lane of a pattern slot. A lane without points is one
+    // that doesn't exist.
+    struct LaneEdit
+    {
+        int voice{0};
+        int slot{0};
+        AutomationLane before;
+        AutomationLane after;
+    };
+    using LaneSetter = std::function<void(int voice, int slot, const AutomationLane &lane)>;
+
+    // Apply lane edits through setter and record them as one step
+    void recordLanes(const juce::String &name, std::vector<LaneEdit> edits, LaneSetter setter);
+
+    // A p-lock of one note set (or, with NaN, removed)
+    struct LockEdit
+    {
+        int voice{0};
+        int slot{0};
+        uint32_t noteId{0};
+        std::string target;
+        float before{0.0f};
+        float after{0.0f};
+    };
+    using LockSetter = std::function<void(const LockEdit &edit, float value)>;
+
+    // Apply a lock edit through setter and record it. Repeated edits of the same
+    // lock coalesce into one step, like values.
+    void recordLock(const juce::String &name, LockEdit edit, LockSetter setter);
+
+    void setPatchLoader(PatchLoader loader);
+
+    // Feed a freshly polled patch. With flush, an unsettled change is recorded
+    // immediately (before an undo). Returns true when the stored baseline moved to
+    // a state the caller hasn't seen recorded yet (for journaling).
+    bool pollPatch(int voice, const void *data, size_t size, bool flush);
+
+    // The patch was replaced outside the history (project load): adopt the next
+    // poll as the new baseline without recording a step
+    void rebasePatch(int voice);
+
+    // The patch moved without an edit (automation playback): don't record the
+    // next poll as a step, but keep undoing towards the recorded states
+    void followPatch(int voice);
+
+    // Bytes held by a voice's patch baseline
+    size_t getPatchBaselineBytes(int voice);
+
+  private:
+    class ValueAction;
+    class LaneAction;
+    class LockAction;
+    class PatchAction;
+
+    struct PatchTrack
+    {
+        std::string base;            // Where the undo history is
+        uint64_t baseFingerprint{0}; // Of the state last seen in Surge
+        uint64_t pendingFingerprint{0};
+        bool adoptNextPoll{true};
+        bool adoptBase{true}; // The adopted poll becomes the baseline too
+        bool reportAdoption{false};
+        juce::uint32 reloadedAtMs{0};
+    };
+
+    struct PatchJob
+    {
+        int voice{0};
+        std::shared_ptr<const PatchDelta> delta;
+        bool forward{true};
+    };
+
+    void submitPatchJob(PatchJob job);
+    void workerLoop();
+
+    juce::UndoManager &undoManager_;
+
+    // Patch baselines - shared between message thread polls and the worker
+    std::mutex patchMutex_;
+    std::array<PatchTrack, NUM_VOICES> patches_;
+
+    std::mutex loaderMutex_;
+    PatchLoader loader_;
+
+    std::mutex jobMutex_;
+    std::condition_variable wake_;
+    std::vector<PatchJob> jobs_;
+    bool stopRequested_{false};
+    std::thread worker_;
+
+    // Give Surge time to swap in a queued patch before the next poll adopts it
+    static constexpr juce::uint32 RELOAD_SETTLE_MS = 250;
+    static constexpr juce::uint32 VALUE_COALESCE_MS = 1000;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ProjectHistory)
+};
+
+} // namespace SurgeBox
@@ -0,0 +1,129 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "QualityController.h"
+#include "VoiceGovernor.h"
+
+#include <algorithm>
+
+namespace SurgeBox
+{
+
+QualityController::QualityController() : logBuffer_(static_cast<size_t>(LOG_CAPACITY))
+{
+    // Fewer voices, then stop quiet tails, then thin out the stacks
+    setLevels({{},
+               {0.75f, 0, 0.0f},
+               {0.75f, 0, 0.01f},
+               {0.5f, 12, 0.05f},
+               {0.25f, 6, 0.1f}});
+}
+
+void QualityController::setLevels(const std::vector<QualityLevel> &levels)
+{
+    int count = std::clamp(static_cast<int>(levels.size()), 1, MAX_LEVELS);
+    for (int i = 0; i < count; ++i)
+    {
+        // Level 0 stays full quality whatever it is given
+        QualityLevel level = i == 0 ? QualityLevel{} : levels[static_cast<size_t>(i)];
+        auto &slot = levels_[static_cast<size_t>(i)];
+        slot.voiceBudgetScale.store(std::clamp(level.voiceBudgetScale, 0.0f, 1.0f));
+        slot.instanceVoiceCap.store(std::max(0, level.instanceVoiceCap));
+        slot.tailFloor.store(std::max(0.0f, level.tailFloor));
+    }
+    numLevels_.store(count);
+}
+
+void QualityController::setThresholds(float stepDownLoad, float stepUpLoad)
+{
+    stepDownLoad = std::max(0.0f, stepDownLoad);
+    stepDownLoad_.store(stepDownLoad);
+    stepUpLoad_.store(std::clamp(stepUpLoad, 0.0f, stepDownLoad));
+}
+
+void QualityController::prepare(double sampleRate)
+{
+    sampleRate_ = sampleRate;
+    samplePosition_ = 0;
+    cooldownSamples_ = 0;
+    calmSamples_ = 0;
+    if (level_ != 0)
+        step(0, 0.0f);
+}
+
+void QualityController::update(float blockLoad, int numSamples)
+{
+    samplePosition_ += numSamples;
+    cooldownSamples_ = std::max<juce::int64>(0, cooldownSamples_ - numSamples);
+
+    // Levels removed while in use, or all of them while disabled
+    int numLevels = enabled_.load() ? numLevels_.load() : 1;
+    if (level_ >= numLevels)
+        step(numLevels - 1, blockLoad);
+
+    if (blockLoad > stepDownLoad_.load())
+    {
+        calmSamples_ = 0;
+        if (cooldownSamples_ == 0 && level_ + 1 < numLevels)
+        {
+            step(level_ + 1, blockLoad);
+            cooldownSamples_ = static_cast<juce::int64>(COOLDOWN_SECONDS * sampleRate_);
+        }
+    }
+    else if (blockLoad < stepUpLoad_.load())
+    {
+        calmSamples_ += numSamples;
+        if (level_ > 0 && calmSamples_ >= static_cast<juce::int64>(holdSeconds_.load() *
+                                                                    sampleRate_))
+        {
+            step(level_ - 1, blockLoad);
+            calmSamples_ = 0;
+        }
+    }
+    else
+    {
+        calmSamples_ = 0;
+    }
+}
+
+void QualityController::apply(VoiceGovernor &governor) const
+{
+    const auto &level = levels_[static_cast<size_t>(level_)];
+    governor.setLimits(level.voiceBudgetScale.load(), level.instanceVoiceCap.load(),
+                       level.tailFloor.load());
+}
+
+void QualityController::step(int to, float load)
+{
+    Transition transition{samplePosition_, level_, to, load};
+    level_ = to;
+    currentLevel_.store(to);
+    numTransitions_.fetch_add(1);
+
+    // A full log drops the entry - the audio thread never waits for the reader
+    int start1, size1, start2, size2;
+    logFifo_.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 > 0)
+        logBuffer_[static_cast<size_t>(start1)] = transition;
+    else if (size2 > 0)
+        logBuffer_[static_cast<size_t>(start2)] = transition;
+    logFifo_.finishedWrite(size1 + size2);
+}
+
+void QualityController::readTransitions(std::vector<Transition> &out)
+{
+    int start1, size1, start2, size2;
+    logFifo_.prepareToRead(logFifo_.getNumReady(), start1, size1, start2, size2);
+    for (int i = 0; i < size1; ++i)
+        out.push_back(logBuffer_[static_cast<size_t>(start1 + i)]);
+    for (int i = 0; i < size2; ++i)
+        out.push_back(logBuffer_[static_cast<size_t>(start2 + i)]);
+    logFifo_.finishedRead(size1 + size2);
+}
+
+} // namespace SurgeBox
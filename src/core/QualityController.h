@@ -0,0 +1,123 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <vector>
+
+namespace SurgeBox
+{
+
+class VoiceGovernor;
+
+// One step of degraded quality, applied through the voice governor
+struct QualityLevel
+{
+    float voiceBudgetScale{1.0f}; // Of the governor's voice budget
+    int instanceVoiceCap{0};      // Surge voices per instance, 0 - no cap
+    float tailFloor{0.0f};        // Released voices under this level are stopped
+};
+
+/**
+ * Trades fidelity for headroom when blocks get close to their deadline.
+ *
+ * After each block the controller looks at the block's render time as a
+ * fraction of its duration. Above the step-down load it moves one level down
+ * at once, then waits a short cooldown so the next measurement reflects the
+ * change. It moves back up one level only after the load has stayed under the
+ * step-up load for the hold time - the gap between the two loads and the hold
+ * keep it from oscillating.
+ *
+ * Level 0 is full quality. Levels and thresholds are set from the message
+ * thread; update() runs on the audio thread and logs each transition to a
+ * FIFO the message thread reads.
+ */
+class QualityController
+{
+  public:
+    static constexpr int MAX_LEVELS = 8;
+
+    struct Transition
+    {
+        juce::int64 samplePosition{0}; // Samples rendered since prepare()
+        int from{0};
+        int to{0};
+        float load{0.0f}; // Block load that caused it
+    };
+
+    QualityController();
+
+    // Message thread - level 0 is always full quality; levels beyond it
+    // degrade further each
+    void setLevels(const std::vector<QualityLevel> &levels);
+    int getNumLevels() const { return numLevels_.load(); }
+    void setThresholds(float stepDownLoad, float stepUpLoad);
+    void setHoldSeconds(double seconds) { holdSeconds_.store(std::max(0.0, seconds)); }
+
+    // Message thread - disabled stays at full quality however loaded the
+    // blocks are, so output doesn't depend on the machine (offline renders)
+    void setEnabled(bool enabled) { enabled_.store(enabled); }
+    bool isEnabled() const { return enabled_.load(); }
+
+    // Audio thread
+    void prepare(double sampleRate);
+    void update(float blockLoad, int numSamples);
+    void apply(VoiceGovernor &governor) const;
+
+    // Any thread
+    int getLevel() const { return currentLevel_.load(); }
+    uint32_t getNumTransitions() const { return numTransitions_.load(); }
+
+    // Message thread - transitions logged since the last call, oldest first.
+    // Transitions that found the log full are counted but not logged.
+    void readTransitions(std::vector<Transition> &out);
+
+  private:
+    static constexpr int LOG_CAPACITY = 64;
+    static constexpr double COOLDOWN_SECONDS = 0.05;
+
+    struct AtomicLevel
+    {
+        std::atomic<float> voiceBudgetScale{1.0f};
+        std::atomic<int> instanceVoiceCap{0};
+        std::atomic<float> tailFloor{0.0f};
+    };
+
+    void step(int to, float load);
+
+    // Message thread -> audio thread. A level's fields may briefly mix old and
+    // new values while it is rewritten; any mix is a valid level.
+    std::array<AtomicLevel, MAX_LEVELS> levels_;
+    std::atomic<int> numLevels_{1};
+    std::atomic<float> stepDownLoad_{0.85f};
+    std::atomic<float> stepUpLoad_{0.5f};
+    std::atomic<double> holdSeconds_{2.0};
+    std::atomic<bool> enabled_{true};
+
+    // Audio thread
+    double sampleRate_{44100.0};
+    juce::int64 samplePosition_{0};
+    int level_{0};
+    juce::int64 cooldownSamples_{0};
+    juce::int64 calmSamples_{0};
+
+    // Telemetry
+    std::atomic<int> currentLevel_{0};
+    std::atomic<uint32_t> numTransitions_{0};
+    juce::AbstractFifo logFifo_{LOG_CAPACITY};
+    std::vector<Transition> logBuffer_;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(QualityController)
+};
+
+} // namespace SurgeBox
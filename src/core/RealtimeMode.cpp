@@ -0,0 +1,177 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "RealtimeMode.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace SurgeBox
+{
+
+#if defined(__linux__)
+
+namespace
+{
+
+std::string limitText(int resource, const char *unit, rlim_t scale)
+{
+    rlimit limit{};
+    if (getrlimit(resource, &limit) != 0)
+        return "unknown";
+    if (limit.rlim_cur == RLIM_INFINITY)
+        return "unlimited";
+    return std::to_string(limit.rlim_cur / scale) + unit;
+}
+
+size_t pageSize()
+{
+    static const auto size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+} // namespace
+
+bool RealtimeMode::isSupported() { return true; }
+
+bool RealtimeMode::promoteCurrentThread(int priority, int cpu, std::string &reason)
+{
+    bool ok = true;
+
+    sched_param param{};
+    param.sched_priority = std::clamp(priority, sched_get_priority_min(SCHED_FIFO),
+                                      sched_get_priority_max(SCHED_FIFO));
+    int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (error != 0)
+    {
+        reason = "SCHED_FIFO priority " + std::to_string(param.sched_priority) + ": " +
+                 std::strerror(error) + " (RLIMIT_RTPRIO is " +
+                 limitText(RLIMIT_RTPRIO, "", 1) +
+                 "; add the user to the audio group or grant CAP_SYS_NICE)";
+        ok = false;
+    }
+
+    if (cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (error != 0)
+        {
+            reason += std::string(ok ? "" : "; ") + "CPU " + std::to_string(cpu) + ": " +
+                      std::strerror(error);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void RealtimeMode::demoteCurrentThread()
+{
+    sched_param param{};
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+    // The main thread keeps the cores the process was started with
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (sched_getaffinity(getpid(), sizeof(cpus), &cpus) == 0)
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+bool RealtimeMode::lockMemory(std::string &reason)
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+        return true;
+
+    reason = std::string("mlockall: ") + std::strerror(errno) + " (RLIMIT_MEMLOCK is " +
+             limitText(RLIMIT_MEMLOCK, " KB", 1024) + "; raise memlock in limits.conf)";
+    return false;
+}
+
+void RealtimeMode::unlockMemory() { munlockall(); }
+
+void RealtimeMode::prefault(void *data, size_t size)
+{
+    if (!data || size == 0)
+        return;
+
+    // A write, so the page is private to us - a read could map the zero page
+    auto *bytes = static_cast<volatile char *>(data);
+    for (size_t offset = 0; offset < size; offset += pageSize())
+        bytes[offset] = bytes[offset];
+    bytes[size - 1] = bytes[size - 1];
+}
+
+void RealtimeMode::touch(const void *data, size_t size)
+{
+    if (!data || size == 0)
+        return;
+
+    auto *bytes = static_cast<const volatile char *>(data);
+    for (size_t offset = 0; offset < size; offset += pageSize())
+        (void)bytes[offset];
+    (void)bytes[size - 1];
+}
+
+void RealtimeMode::prefaultStack()
+{
+    volatile char stack[STACK_PREFAULT_BYTES];
+    for (size_t offset = 0; offset < STACK_PREFAULT_BYTES; offset += pageSize())
+        stack[offset] = 0;
+    (void)stack;
+}
+
+#else
+
+bool RealtimeMode::isSupported() { return false; }
+
+bool RealtimeMode::promoteCurrentThread(int, int, std::string &reason)
+{
+    reason = "Real-time scheduling is only available on Linux";
+    return false;
+}
+
+void RealtimeMode::demoteCurrentThread() {}
+
+bool RealtimeMode::lockMemory(std::string &reason)
+{
+    reason = "Memory locking is only available on Linux";
+    return false;
+}
+
+void RealtimeMode::unlockMemory() {}
+
+void RealtimeMode::prefault(void *data, size_t size)
+{
+    auto *bytes = static_cast<volatile char *>(data);
+    for (size_t offset = 0; bytes && offset < size; offset += 4096)
+        bytes[offset] = bytes[offset];
+}
+
+void RealtimeMode::touch(const void *data, size_t size)
+{
+    auto *bytes = static_cast<const volatile char *>(data);
+    for (size_t offset = 0; bytes && offset < size; offset += 4096)
+        (void)bytes[offset];
+}
+
+void RealtimeMode::prefaultStack() {}
+
+#endif
+
+} // namespace SurgeBox
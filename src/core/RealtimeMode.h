@@ -0,0 +1,77 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace SurgeBox
+{
+
+struct RealtimeSettings
+{
+    bool enabled{false};
+    int audioPriority{70};  // SCHED_FIFO, 1 to 99
+    int workerPriority{65};
+    int audioCpu{-1};       // -1 - any core
+    int firstWorkerCpu{-1}; // Render worker n runs on firstWorkerCpu + n; -1 - any core
+    bool lockMemory{true};
+};
+
+struct RealtimeStatus
+{
+    bool memoryLocked{false};
+    bool audioPromoted{false}; // Decided at the audio thread's next block
+    bool audioPending{false};
+    int workers{0};
+    int workersPromoted{0};
+    std::string reason; // Why any step fell back, empty if none did
+};
+
+/**
+ * The pieces of Linux real-time operation: SCHED_FIFO and core affinity for a
+ * thread, mlockall for the process, and pre-faulting memory so the first
+ * blocks don't page-fault.
+ *
+ * Each step can fail for lack of privileges - RLIMIT_RTPRIO, RLIMIT_MEMLOCK or
+ * CAP_SYS_NICE - and then returns false with a reason naming the limit to
+ * raise; the caller carries on without it. Elsewhere the steps do nothing but
+ * say they are unsupported.
+ */
+class RealtimeMode
+{
+  public:
+    static bool isSupported();
+
+    // SCHED_FIFO at priority for the calling thread, pinned to cpu if it is 0
+    // or more. Returns false with reason if either failed.
+    static bool promoteCurrentThread(int priority, int cpu, std::string &reason);
+
+    // Back to normal scheduling, on any core the process may use
+    static void demoteCurrentThread();
+
+    // Lock every current and future page of the process in memory
+    static bool lockMemory(std::string &reason);
+    static void unlockMemory();
+
+    // Touch each page of [data, data + size), writing back what is there.
+    // Nothing else may use the memory meanwhile.
+    static void prefault(void *data, size_t size);
+
+    // Read each page - safe on memory other threads write. Faults in pages that
+    // have been written before, such as all of a constructed object.
+    static void touch(const void *data, size_t size);
+
+    // Fault in the top STACK_PREFAULT_BYTES of the calling thread's stack
+    static void prefaultStack();
+
+    static constexpr size_t STACK_PREFAULT_BYTES = 256 * 1024;
+};
+
+} // namespace SurgeBox
@@ -0,0 +1,401 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "RemoteVoice.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <utility>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+extern char **environ;
+#endif
+
+namespace SurgeBox
+{
+
+using VoiceHost::Event;
+using VoiceHost::EventType;
+
+namespace
+{
+
+constexpr int HOST_START_TIMEOUT_MS = 5000;
+constexpr int HOST_STOP_TIMEOUT_MS = 1000;
+
+} // namespace
+
+RemoteVoice::RemoteVoice() = default;
+
+RemoteVoice::~RemoteVoice() { stop(); }
+
+bool RemoteVoice::start(const fs::path &hostExecutable, double sampleRate, int cpu)
+{
+    stop();
+    error_.clear();
+
+#if defined(__linux__)
+    static std::atomic<int> segmentCounter{0};
+    std::string name = "/surgebox-" + std::to_string(getpid()) + "-" +
+                       std::to_string(segmentCounter.fetch_add(1));
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        error_ = "Could not create shared memory " + name + ": " + std::strerror(errno);
+        return false;
+    }
+
+    void *memory = MAP_FAILED;
+    if (ftruncate(fd, sizeof(VoiceHost::Shared)) == 0)
+        memory = mmap(nullptr, sizeof(VoiceHost::Shared), PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        error_ = std::string("Could not map shared memory: ") + std::strerror(errno);
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    auto *shared = new (memory) VoiceHost::Shared();
+    shared->sampleRate = sampleRate;
+
+    auto cleanUp = [&] {
+        munmap(memory, sizeof(VoiceHost::Shared));
+        shm_unlink(name.c_str());
+    };
+
+    std::string path = hostExecutable.string();
+    std::string cpuArgument = std::to_string(cpu);
+    char *argv[] = {path.data(),
+                    const_cast<char *>("--shm"),
+                    name.data(),
+                    const_cast<char *>("--cpu"),
+                    cpuArgument.data(),
+                    nullptr};
+
+    pid_t pid = -1;
+    int spawnError = posix_spawn(&pid, path.c_str(), nullptr, nullptr, argv, environ);
+    if (spawnError != 0)
+    {
+        error_ = "Could not start " + path + ": " + std::strerror(spawnError);
+        cleanUp();
+        return false;
+    }
+
+    // The host builds its Surge instance before it reports ready
+    auto startedMs = juce::Time::getMillisecondCounter();
+    while (shared->hostReady.load() == 0)
+    {
+        int status = 0;
+        if (waitpid(pid, &status, WNOHANG) == pid)
+        {
+            error_ = "Voice host exited during startup";
+            cleanUp();
+            return false;
+        }
+        if (juce::Time::getMillisecondCounter() - startedMs > HOST_START_TIMEOUT_MS)
+        {
+            error_ = "Voice host did not start in time";
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            cleanUp();
+            return false;
+        }
+        VoiceHost::futexWait(shared->hostReady, 0, 100000000);
+    }
+
+    const juce::SpinLock::ScopedLockType lock(sharedLock_);
+    shared_ = shared;
+    shmName_ = name;
+    pid_ = pid;
+    requestSerial_ = 0;
+    awaiting_ = false;
+    posted_ = false;
+    numPending_ = 0;
+    running_.store(true);
+    return true;
+#else
+    juce::ignoreUnused(hostExecutable, sampleRate, cpu);
+    error_ = "Out-of-process voices are only available on Linux";
+    return false;
+#endif
+}
+
+void RemoteVoice::stop()
+{
+#if defined(__linux__)
+    VoiceHost::Shared *shared = nullptr;
+    {
+        const juce::SpinLock::ScopedLockType lock(sharedLock_);
+        running_.store(false);
+        shared = std::exchange(shared_, nullptr);
+    }
+    if (!shared)
+        return;
+
+    shared->shutdown.store(1);
+    VoiceHost::futexWake(shared->request);
+
+    if (pid_ > 0)
+    {
+        int status = 0;
+        auto stoppingMs = juce::Time::getMillisecondCounter();
+        while (waitpid(pid_, &status, WNOHANG) == 0)
+        {
+            if (juce::Time::getMillisecondCounter() - stoppingMs > HOST_STOP_TIMEOUT_MS)
+            {
+                kill(pid_, SIGKILL);
+                waitpid(pid_, &status, 0);
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        pid_ = -1;
+    }
+
+    munmap(shared, sizeof(VoiceHost::Shared));
+    shm_unlink(shmName_.c_str());
+    shmName_.clear();
+#endif
+}
+
+bool RemoteVoice::checkExited()
+{
+#if defined(__linux__)
+    if (pid_ <= 0)
+        return false;
+
+    int status = 0;
+    if (waitpid(pid_, &status, WNOHANG) != pid_)
+        return false;
+
+    {
+        const juce::SpinLock::ScopedLockType lock(sharedLock_);
+        running_.store(false);
+    }
+    pid_ = -1;
+    error_ = WIFSIGNALED(status)
+                 ? "Voice host killed by signal " + std::to_string(WTERMSIG(status))
+                 : "Voice host exited with status " + std::to_string(WEXITSTATUS(status));
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool RemoteVoice::sendPatch(const void *data, size_t size)
+{
+    if (!running_.load() || !shared_ || size > VoiceHost::MAX_PATCH_BYTES)
+        return false;
+
+    // The host has not taken the previous patch yet
+    uint32_t serial = shared_->patchSerial.load();
+    if (shared_->patchLoaded.load() != serial)
+        return false;
+
+    std::memcpy(shared_->patch, data, size);
+    shared_->patchSize = static_cast<uint32_t>(size);
+    shared_->patchSerial.store(serial + 1);
+    return true;
+}
+
+bool RemoteVoice::sendParameter(int parameter, float value)
+{
+    if (!running_.load() || !shared_)
+        return false;
+
+    Event event;
+    event.type = EventType::Parameter;
+    event.parameter = parameter;
+    event.value = value;
+    return shared_->control.push(event);
+}
+
+// ============================================================================
+// Audio thread
+// ============================================================================
+
+void RemoteVoice::beginBlock(int numSamples, double tempo, double ppqPos)
+{
+    // The engine splits longer blocks; past the shared buffer the rest plays
+    // silence rather than stale audio
+    jassert(numSamples <= VoiceHost::MAX_BLOCK_SAMPLES);
+    numSamples_ = numSamples;
+    tempo_ = tempo;
+    ppqPos_ = ppqPos;
+    numBlock_ = 0;
+}
+
+void RemoteVoice::addEvent(const Event &event)
+{
+    // Past capacity the event is dropped - the audio thread never allocates
+    if (numBlock_ < VoiceHost::MAX_BLOCK_EVENTS)
+        block_[static_cast<size_t>(numBlock_++)] = event;
+}
+
+void RemoteVoice::addNote(int sampleOffset, int channel, int pitch, int velocity)
+{
+    Event event;
+    event.sampleOffset = sampleOffset;
+    event.type = velocity > 0 ? EventType::NoteOn : EventType::NoteOff;
+    event.channel = static_cast<uint8_t>(channel);
+    event.pitch = static_cast<uint8_t>(pitch);
+    event.velocity = static_cast<uint8_t>(velocity);
+    addEvent(event);
+}
+
+void RemoteVoice::addPitchBend(int sampleOffset, int channel, float value)
+{
+    Event event;
+    event.sampleOffset = sampleOffset;
+    event.type = EventType::PitchBend;
+    event.channel = static_cast<uint8_t>(channel);
+    event.value = value;
+    addEvent(event);
+}
+
+void RemoteVoice::addController(int sampleOffset, int channel, int controller, int value)
+{
+    Event event;
+    event.sampleOffset = sampleOffset;
+    event.type = EventType::Controller;
+    event.channel = static_cast<uint8_t>(channel);
+    event.pitch = static_cast<uint8_t>(controller);
+    event.velocity = static_cast<uint8_t>(value);
+    addEvent(event);
+}
+
+void RemoteVoice::addParameter(int sampleOffset, int parameter, float value)
+{
+    Event event;
+    event.sampleOffset = sampleOffset;
+    event.type = EventType::Parameter;
+    event.parameter = parameter;
+    event.value = value;
+    addEvent(event);
+}
+
+void RemoteVoice::addAllNotesOff()
+{
+    Event event;
+    event.type = EventType::AllNotesOff;
+    addEvent(event);
+}
+
+void RemoteVoice::post()
+{
+    posted_ = false;
+
+#if defined(__linux__)
+    const juce::SpinLock::ScopedTryLockType lock(sharedLock_);
+    if (!lock.isLocked() || !running_.load())
+        return;
+
+    if (awaiting_ && shared_->response.load() == requestSerial_)
+        awaiting_ = false;
+
+    // Still busy with a late block - keep the events for the next one
+    if (awaiting_)
+    {
+        for (int i = 0; i < numBlock_ && numPending_ < VoiceHost::MAX_BLOCK_EVENTS; ++i)
+        {
+            auto event = block_[static_cast<size_t>(i)];
+            event.sampleOffset = 0;
+            pending_[static_cast<size_t>(numPending_++)] = event;
+        }
+        return;
+    }
+
+    int count = 0;
+    for (int i = 0; i < numPending_; ++i)
+        shared_->events[count++] = pending_[static_cast<size_t>(i)];
+    for (int i = 0; i < numBlock_ && count < VoiceHost::MAX_BLOCK_EVENTS; ++i)
+        shared_->events[count++] = block_[static_cast<size_t>(i)];
+    numPending_ = 0;
+
+    shared_->numEvents = count;
+    shared_->numSamples = std::min(numSamples_, VoiceHost::MAX_BLOCK_SAMPLES);
+    shared_->tempo = tempo_;
+    shared_->ppqPos = ppqPos_;
+    shared_->postedNanos = VoiceHost::monotonicNanos();
+
+    shared_->request.store(++requestSerial_);
+    VoiceHost::futexWake(shared_->request);
+    awaiting_ = true;
+    posted_ = true;
+#endif
+}
+
+bool RemoteVoice::finish(float *left, float *right, juce::int64 deadlineTicks)
+{
+    auto silence = [&] {
+        std::fill(left, left + numSamples_, 0.0f);
+        std::fill(right, right + numSamples_, 0.0f);
+        lateBlocks_.fetch_add(1);
+        return false;
+    };
+
+    if (!posted_)
+        return silence();
+    posted_ = false;
+
+#if defined(__linux__)
+    const juce::SpinLock::ScopedTryLockType lock(sharedLock_);
+    if (!lock.isLocked() || !running_.load())
+        return silence();
+
+    bool waited = false;
+    for (uint32_t seen = shared_->response.load(); seen != requestSerial_;
+         seen = shared_->response.load())
+    {
+        auto now = juce::Time::getHighResolutionTicks();
+        if (now >= deadlineTicks)
+            return silence();
+
+        auto remaining = juce::Time::highResolutionTicksToSeconds(deadlineTicks - now);
+        VoiceHost::futexWait(shared_->response, seen, static_cast<int64_t>(remaining * 1e9));
+        waited = true;
+    }
+    awaiting_ = false;
+    uint64_t seenNanos = VoiceHost::monotonicNanos();
+
+    int rendered = std::min(numSamples_, VoiceHost::MAX_BLOCK_SAMPLES);
+    std::copy(shared_->audio[0], shared_->audio[0] + rendered, left);
+    std::copy(shared_->audio[1], shared_->audio[1] + rendered, right);
+    std::fill(left + rendered, left + numSamples_, 0.0f);
+    std::fill(right + rendered, right + numSamples_, 0.0f);
+
+    // Waking the host, plus waking us again if we were already waiting -
+    // otherwise the answer sat ready and costs nothing
+    uint64_t wake = shared_->receivedNanos - shared_->postedNanos;
+    uint64_t back = waited && seenNanos > shared_->doneNanos ? seenNanos - shared_->doneNanos : 0;
+    double overhead = static_cast<double>(wake + back) * 1e-9;
+    lastOverhead_.store(overhead);
+    if (overhead > maxOverhead_.load())
+        maxOverhead_.store(overhead);
+    lastRender_.store(static_cast<double>(shared_->doneNanos - shared_->receivedNanos) * 1e-9);
+    activeVoices_.store(shared_->activeVoices);
+    return true;
+#else
+    juce::ignoreUnused(deadlineTicks);
+    return silence();
+#endif
+}
+
+} // namespace SurgeBox
@@ -0,0 +1,121 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include "VoiceHostProtocol.h"
+#include "filesystem/import.h"
+#include <juce_core/juce_core.h>
+
+#include <array>
+#include <atomic>
+#include <string>
+
+namespace SurgeBox
+{
+
+/**
+ * A voice rendered by a surgebox-voice-host child process (Linux only).
+ *
+ * The child owns its own Surge instance, so a patch that crashes or hogs a
+ * core takes down or slows only that process; it can be pinned to a core of
+ * its own. Audio, MIDI and parameter changes travel through a shared-memory
+ * segment (see VoiceHostProtocol.h) with futex wakeups per block.
+ *
+ * The audio thread posts a block with beginBlock()/add...()/post() and
+ * collects it with finish(), giving other work the time in between. A block
+ * that misses its deadline plays silence. Blocks posted while the host is
+ * still busy with a late one carry their events into the next block it takes,
+ * so no note-off is lost. Everything else runs on the message thread,
+ * including restarting a host that died.
+ */
+class RemoteVoice
+{
+  public:
+    RemoteVoice();
+    ~RemoteVoice();
+
+    // Message thread - cpu < 0 leaves the host unpinned. Returns false, with
+    // getError() saying why, if the host could not be started.
+    bool start(const fs::path &hostExecutable, double sampleRate, int cpu);
+    void stop();
+    bool isRunning() const { return running_.load(); }
+    const std::string &getError() const { return error_; }
+
+    // Message thread - reap a host that exited; true if it did since the
+    // last call
+    bool checkExited();
+
+    // Message thread
+    bool sendPatch(const void *data, size_t size);
+    bool sendParameter(int parameter, float value);
+
+    // Audio thread
+    void beginBlock(int numSamples, double tempo, double ppqPos);
+    void addNote(int sampleOffset, int channel, int pitch, int velocity); // Velocity 0 - off
+    void addPitchBend(int sampleOffset, int channel, float value);
+    void addController(int sampleOffset, int channel, int controller, int value);
+    void addParameter(int sampleOffset, int parameter, float value);
+    void addAllNotesOff();
+    void post();
+
+    // Audio thread - wait for the posted block until deadlineTicks (a
+    // juce::Time high-resolution tick count) and copy it out. Writes silence
+    // and returns false if it is late or nothing was posted.
+    bool finish(float *left, float *right, juce::int64 deadlineTicks);
+
+    // Any thread - the last block's round trip minus the host's render time,
+    // the worst since start, the host's render time, and blocks that missed
+    // their deadline
+    double getLastOverheadSeconds() const { return lastOverhead_.load(); }
+    double getMaxOverheadSeconds() const { return maxOverhead_.load(); }
+    double getLastRenderSeconds() const { return lastRender_.load(); }
+    int getActiveVoices() const { return activeVoices_.load(); }
+    uint32_t getLateBlocks() const { return lateBlocks_.load(); }
+    uint32_t getRestarts() const { return restarts_.load(); }
+    void countRestart() { restarts_.fetch_add(1); }
+
+  private:
+    void addEvent(const VoiceHost::Event &event);
+
+    VoiceHost::Shared *shared_{nullptr};
+    std::string shmName_;
+    int pid_{-1};
+    std::string error_;
+    std::atomic<bool> running_{false};
+
+    // Held by the audio thread while it uses shared_ - start() and stop()
+    // take it, so the audio thread skips the voice meanwhile
+    juce::SpinLock sharedLock_;
+
+    // Audio thread
+    int numSamples_{0};
+    double tempo_{120.0};
+    double ppqPos_{0.0};
+    bool posted_{false};
+    bool awaiting_{false}; // A posted block has not been answered yet
+    uint32_t requestSerial_{0};
+
+    // Events of blocks that could not be posted, replayed at the next one
+    std::array<VoiceHost::Event, VoiceHost::MAX_BLOCK_EVENTS> pending_{};
+    int numPending_{0};
+    std::array<VoiceHost::Event, VoiceHost::MAX_BLOCK_EVENTS> block_{};
+    int numBlock_{0};
+
+    // Telemetry
+    std::atomic<double> lastOverhead_{0.0};
+    std::atomic<double> maxOverhead_{0.0};
+    std::atomic<double> lastRender_{0.0};
+    std::atomic<int> activeVoices_{0};
+    std::atomic<uint32_t> lateBlocks_{0};
+    std::atomic<uint32_t> restarts_{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RemoteVoice)
+};
+
+} // namespace SurgeBox
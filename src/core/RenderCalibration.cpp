@@ -0,0 +1,220 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "RenderCalibration.h"
+#include "VoiceRenderScheduler.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <thread>
+
+namespace SurgeBox
+{
+
+namespace
+{
+
+// Uneven like real patches - one heavy pad, one light hat
+constexpr std::array<double, NUM_VOICES> VOICE_SHARES{0.4, 0.3, 0.2, 0.1};
+
+// Finest last; 0 - the whole block
+constexpr std::array<int, 4> QUANTA{0, 128, 64, 32};
+
+// A saw through a one-pole filter and a soft clip per note
+struct SyntheticVoice
+{
+    std::vector<float> output;
+    std::vector<float> phases;
+    std::vector<float> states;
+
+    explicit SyntheticVoice(int numNotes, int blockSize)
+        : output(static_cast<size_t>(blockSize)), phases(static_cast<size_t>(numNotes)),
+          states(static_cast<size_t>(numNotes))
+    {
+    }
+
+    void render(int numSamples)
+    {
+        std::fill(output.begin(), output.begin() + numSamples, 0.0f);
+        for (size_t n = 0; n < phases.size(); ++n)
+        {
+            float phase = phases[n];
+            float state = states[n];
+            float increment = 0.001f + 0.0001f * static_cast<float>(n);
+            for (int i = 0; i < numSamples; ++i)
+            {
+                phase += increment;
+                if (phase >= 1.0f)
+                    phase -= 1.0f;
+                state += 0.1f * (2.0f * phase - 1.0f - state);
+                output[static_cast<size_t>(i)] += state / (1.0f + std::abs(state));
+            }
+            phases[n] = phase;
+            states[n] = state;
+        }
+    }
+};
+
+int numCores()
+{
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+} // namespace
+
+RenderCalibration::Result RenderCalibration::run(double sampleRate, int blockSize,
+                                                 const std::atomic<bool> *cancel)
+{
+    Result result;
+    blockSize = std::max(1, blockSize);
+    result.sampleRate = sampleRate;
+    result.blockSize = blockSize;
+    result.blockSeconds = blockSize / sampleRate;
+
+    // Size the load from one voice's cost per note, best of a few runs
+    constexpr int PROBE_NOTES = 64;
+    SyntheticVoice probe(PROBE_NOTES, blockSize);
+    double probeSeconds = 1.0;
+    for (int i = 0; i < 8; ++i)
+    {
+        auto start = juce::Time::getHighResolutionTicks();
+        probe.render(blockSize);
+        probeSeconds = std::min(probeSeconds, juce::Time::highResolutionTicksToSeconds(
+                                                  juce::Time::getHighResolutionTicks() - start));
+    }
+    double perNote = std::max(1e-9, probeSeconds / PROBE_NOTES);
+    double totalNotes = LOAD_FRACTION * result.blockSeconds / perNote;
+
+    std::vector<SyntheticVoice> voices;
+    std::array<double, NUM_VOICES> costs{};
+    for (int v = 0; v < NUM_VOICES; ++v)
+    {
+        int notes = std::max(1, static_cast<int>(totalNotes * VOICE_SHARES[v]));
+        voices.emplace_back(notes, blockSize);
+        costs[v] = notes;
+    }
+
+    int quantumLength = 0;
+    VoiceRenderScheduler scheduler(
+        [&](int voice) { voices[static_cast<size_t>(voice)].render(quantumLength); });
+
+    int maxWorkers = std::min(VoiceRenderScheduler::MAX_WORKERS, numCores() - 1);
+    std::vector<double> blockSeconds(static_cast<size_t>(MEASURED_BLOCKS));
+    for (int workers = 0; workers <= maxWorkers; ++workers)
+    {
+        scheduler.setWorkers(workers);
+        for (int quantum : QUANTA)
+        {
+            if (quantum >= blockSize)
+                continue;
+            if (cancel && cancel->load())
+            {
+                scheduler.setWorkers(0);
+                return result;
+            }
+
+            Measurement measurement;
+            measurement.settings = {workers, quantum};
+            double totalSeconds = 0.0;
+
+            for (int block = 0; block < WARMUP_BLOCKS + MEASURED_BLOCKS; ++block)
+            {
+                auto start = juce::Time::getHighResolutionTicks();
+                int step = quantum > 0 ? quantum : blockSize;
+                for (int offset = 0; offset < blockSize; offset += step)
+                {
+                    quantumLength = std::min(step, blockSize - offset);
+                    scheduler.render(costs);
+                }
+                double seconds = juce::Time::highResolutionTicksToSeconds(
+                    juce::Time::getHighResolutionTicks() - start);
+
+                if (block < WARMUP_BLOCKS)
+                    continue;
+                totalSeconds += seconds;
+                blockSeconds[static_cast<size_t>(block - WARMUP_BLOCKS)] = seconds;
+            }
+
+            // A high percentile rather than the longest block - one preemption
+            // shouldn't decide the configuration
+            auto slow = blockSeconds.begin() +
+                        static_cast<std::ptrdiff_t>(SLOW_PERCENTILE * (MEASURED_BLOCKS - 1));
+            std::nth_element(blockSeconds.begin(), slow, blockSeconds.end());
+            measurement.slowBlockSeconds = *slow;
+            measurement.throughput =
+                MEASURED_BLOCKS * result.blockSeconds / std::max(1e-9, totalSeconds);
+            result.measurements.push_back(measurement);
+        }
+    }
+    scheduler.setWorkers(0);
+
+    // QUANTA runs coarse to fine, so the last within tolerance at the fewest
+    // workers is the finest
+    double bestSlow = result.measurements.front().slowBlockSeconds;
+    for (const auto &measurement : result.measurements)
+        bestSlow = std::min(bestSlow, measurement.slowBlockSeconds);
+
+    bool found = false;
+    for (const auto &measurement : result.measurements)
+    {
+        if (measurement.slowBlockSeconds > bestSlow * TOLERANCE)
+            continue;
+        if (found && measurement.settings.renderThreads > result.chosen.renderThreads)
+            break;
+        result.chosen = measurement.settings;
+        found = true;
+    }
+    result.complete = true;
+    return result;
+}
+
+juce::String RenderCalibration::keyFor(double sampleRate, int blockSize)
+{
+    return "renderCalibration_" + juce::String(juce::roundToInt(sampleRate)) + "_" +
+           juce::String(std::max(1, blockSize));
+}
+
+bool RenderCalibration::load(juce::PropertiesFile &settings, double sampleRate, int blockSize,
+                             RenderSettings &out)
+{
+    // The choice depends on the deadline it was measured against: "cores threads quantum"
+    auto fields = juce::StringArray::fromTokens(
+        settings.getValue(keyFor(sampleRate, blockSize)), " ", "");
+    if (fields.size() != 3 || fields[0].getIntValue() != numCores())
+        return false;
+
+    out.renderThreads = fields[1].getIntValue();
+    out.renderQuantum = fields[2].getIntValue();
+    return true;
+}
+
+void RenderCalibration::save(juce::PropertiesFile &settings, const Result &result)
+{
+    if (!result.complete)
+        return;
+
+    settings.setValue(keyFor(result.sampleRate, result.blockSize),
+                      juce::String(numCores()) + " " +
+                          juce::String(result.chosen.renderThreads) + " " +
+                          juce::String(result.chosen.renderQuantum));
+
+    for (const auto &measurement : result.measurements)
+    {
+        if (measurement.settings.renderThreads == result.chosen.renderThreads &&
+            measurement.settings.renderQuantum == result.chosen.renderQuantum)
+        {
+            settings.setValue("calibrationThroughput", measurement.throughput);
+            settings.setValue("calibrationSlowLoad",
+                              measurement.slowBlockSeconds / result.blockSeconds);
+        }
+    }
+    settings.saveIfNeeded();
+}
+
+} // namespace SurgeBox
@@ -0,0 +1,80 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include <juce_data_structures/juce_data_structures.h>
+
+#include <atomic>
+#include <vector>
+
+namespace SurgeBox
+{
+
+// How the engine renders - chosen by calibration, or set by hand
+struct RenderSettings
+{
+    int renderThreads{0}; // Workers beside the audio thread
+    int renderQuantum{0}; // Samples per engine pass, 0 - the host's whole block
+};
+
+/**
+ * Picks render settings for this machine by measurement.
+ *
+ * run() renders a synthetic four-voice load - oscillator and filter kernels,
+ * unevenly weighted like real patches - through the voice render scheduler
+ * with each worker count and render quantum. The load is sized to take about
+ * 60% of the block's duration on the audio thread alone. For every
+ * configuration it measures throughput and the 95th percentile block time over
+ * MEASURED_BLOCKS blocks; the winner has the lowest such time, preferring fewer
+ * workers and then a finer quantum among configurations within 10% of it.
+ *
+ * run() takes a few seconds and loads every core it tests, so run it off the
+ * audio and prepare paths; it gives up early, with complete false, once cancel
+ * is set. Results are kept in a PropertiesFile, one per sample rate and block
+ * size; load() reports false when none is stored for them, or the machine's
+ * core count changed since.
+ */
+class RenderCalibration
+{
+  public:
+    struct Measurement
+    {
+        RenderSettings settings;
+        double throughput{0.0};        // Seconds of audio rendered per second
+        double slowBlockSeconds{0.0};  // 95th percentile block time
+    };
+
+    struct Result
+    {
+        RenderSettings chosen;
+        double sampleRate{0.0};
+        int blockSize{0};
+        double blockSeconds{0.0}; // The deadline the load was measured against
+        std::vector<Measurement> measurements;
+        bool complete{false};
+    };
+
+    static Result run(double sampleRate, int blockSize,
+                      const std::atomic<bool> *cancel = nullptr);
+
+    static bool load(juce::PropertiesFile &settings, double sampleRate, int blockSize,
+                     RenderSettings &out);
+    static void save(juce::PropertiesFile &settings, const Result &result);
+
+  private:
+    static constexpr double LOAD_FRACTION = 0.6;
+    static constexpr double TOLERANCE = 1.1;
+    static constexpr int WARMUP_BLOCKS = 2;
+    static constexpr int MEASURED_BLOCKS = 64;
+    static constexpr double SLOW_PERCENTILE = 0.95;
+
+    static juce::String keyFor(double sampleRate, int blockSize);
+};
+
+} // namespace SurgeBox
@@ -7,29 +7,99 @@
  */
 
 #include "SurgeBoxEngine.h"
-#include "SurgeSynthProcessor.h"
 #include "globals.h"
 
 #include <juce_audio_basics/juce_audio_basics.h>
+
+#if !defined(SURGEBOX_HEADLESS)
+#include "SurgeSynthProcessor.h"
 #include <juce_audio_processors/juce_audio_processors.h>
+#endif
 
 #include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <limits>
+#include <string_view>
+#include <utility>
 
 namespace SurgeBox
 {
 
+namespace
+{
+
+// MIDI to a Surge instance, as the plugin routes it
+void playMidi(SurgeSynthesizer &synth, const juce::MidiMessage &msg)
+{
+    int channel = msg.getChannel() - 1;
+    if (msg.isNoteOn())
+        synth.playNote(channel, msg.getNoteNumber(), msg.getVelocity(), 0, -1);
+    else if (msg.isNoteOff())
+        synth.releaseNote(channel, msg.getNoteNumber(), msg.getVelocity());
+    else if (msg.isAllNotesOff() || msg.isAllSoundOff())
+        synth.allNotesOff();
+    else if (msg.isPitchWheel())
+        synth.pitchBend(channel, msg.getPitchWheelValue() - 8192);
+    else if (msg.isController())
+        synth.channelController(channel, msg.getControllerNumber(), msg.getControllerValue());
+}
+
+} // namespace
+
 // ============================================================================
 // SequencerEngine
 // ============================================================================
 
-SequencerEngine::SequencerEngine() = default;
+SequencerEngine::SequencerEngine()
+{
+    heldLocks_.reserve(MAX_HELD_LOCKS);
+    parameterEvents_.reserve(MAX_PARAMETER_EVENTS);
+}
 
 void SequencerEngine::setProject(GrooveboxProject *project) { project_ = project; }
 
 void SequencerEngine::setSynths(std::array<SurgeSynthesizer *, NUM_VOICES> synths)
 {
     synths_ = synths;
+
+    // Every instance has the same parameter layout - resolve the IDs once
+    parameterIds_.clear();
+    auto first = std::find_if(synths_.begin(), synths_.end(), [](auto *s) { return s; });
+    if (first != synths_.end())
+    {
+        for (auto *param : (*first)->storage.getPatch().param_ptr)
+            parameterIds_.push_back((*first)->idForParameter(param));
+    }
+
+    for (auto &values : automatedValues_)
+    {
+        values = std::vector<std::atomic<float>>(parameterIds_.size());
+        for (auto &value : values)
+            value.store(std::numeric_limits<float>::quiet_NaN());
+    }
+}
+
+float SequencerEngine::getAutomatedValue(int voice, int parameter) const
+{
+    const auto &values = automatedValues_[voice];
+    if (parameter < 0 || parameter >= static_cast<int>(values.size()))
+        return std::numeric_limits<float>::quiet_NaN();
+    return values[static_cast<size_t>(parameter)].load();
+}
+
+void SequencerEngine::applyParameterEvent(const ParameterEvent &event)
+{
+    auto *synth = synths_[event.voice];
+    if (!synth || event.parameter >= static_cast<int>(parameterIds_.size()))
+        return;
+
+    auto parameter = static_cast<size_t>(event.parameter);
+    synth->setParameter01(parameterIds_[parameter], event.value, false, false);
+
+    // Counted with automation: the recorder skips it and the undo history rebases
+    automatedValues_[event.voice][parameter].store(event.value);
+    automationApplied_[event.voice].store(true);
 }
 
 void SequencerEngine::play()
@@ -38,24 +108,21 @@ void SequencerEngine::play()
     if (playing_.load())
         return;
 
-    // Start from current position (which should be 0 after stop/rewind)
+    // Start from current position (which should be 0 after stop/rewind),
+    // chasing any notes that are already sounding there
+    seekTarget_.store(currentBeat_.load());
+    seekPending_.store(true);
+    restartCycles_.store(true);
     playing_.store(true);
 }
 
 void SequencerEngine::stop()
 {
+    // The audio thread owns the active notes and held locks - it releases
+    // them and rewinds when it picks up the stop
     playing_.store(false);
-
-    // Release all active notes
-    for (const auto &active : activeNotes_)
-    {
-        if (synths_[active.voiceIndex])
-            synths_[active.voiceIndex]->releaseNote(0, active.pitch, 0);
-    }
-    activeNotes_.clear();
-
-    // Reset to beginning when stopped
     currentBeat_.store(0.0);
+    stopPending_.store(true);
 }
 
 void SequencerEngine::setPlaying(bool playing)
@@ -68,32 +135,44 @@ void SequencerEngine::setPlaying(bool playing)
 
 void SequencerEngine::setPositionBeats(double beat)
 {
-    // Release all active notes when jumping
-    for (const auto &active : activeNotes_)
-    {
-        if (synths_[active.voiceIndex])
-            synths_[active.voiceIndex]->releaseNote(0, active.pitch, 0);
-    }
-    activeNotes_.clear();
+    // The audio thread owns the active notes - it releases and chases them when
+    // it picks up the seek
+    seekTarget_.store(beat);
     currentBeat_.store(beat);
+    seekPending_.store(true);
+}
+
+bool SequencerEngine::isSongActive() const
+{
+    return project_->songMode && bank_->song().lengthBeats > 0.0;
 }
 
 double SequencerEngine::getLoopEndBeat() const
 {
-    if (!project_)
+    if (!bank_)
         return 4.0;
 
-    // Loop length is the maximum of all pattern lengths
+    if (isSongActive())
+        return bank_->song().lengthBeats;
+
+    // Loop length is the maximum of all playing pattern lengths
     double maxLength = 4.0;
-    for (const auto &voice : project_->voices)
-    {
-        double patternLength = voice.pattern.bars * 4.0;
-        if (patternLength > maxLength)
-            maxLength = patternLength;
-    }
+    for (int v = 0; v < NUM_VOICES; ++v)
+        maxLength = std::max(maxLength, bank_->playing(v).lengthBeats);
     return maxLength;
 }
 
+double SequencerEngine::getBlockBeat(int sampleOffset) const
+{
+    double beat = blockStartBeat_ + sampleOffset * beatsPerSample_;
+    return beat >= blockLoopEnd_ ? beat - blockLoopEnd_ : beat;
+}
+
+double SequencerEngine::getBlockElapsedBeats(int sampleOffset) const
+{
+    return blockElapsedBeats_ + sampleOffset * beatsPerSample_;
+}
+
 std::vector<uint8_t> SequencerEngine::getPlayingNotes(int voiceIndex) const
 {
     std::vector<uint8_t> notes;
@@ -108,8 +187,38 @@ std::vector<uint8_t> SequencerEngine::getPlayingNotes(int voiceIndex) const
 void SequencerEngine::process(int numSamples, double sampleRate,
                               std::array<juce::MidiBuffer *, NUM_VOICES> midiBuffers)
 {
-    if (!playing_.load() || !project_)
+    // Mixer automation only holds while the sequencer runs
+    automatedVolume_.fill(std::numeric_limits<float>::quiet_NaN());
+    automatedPan_.fill(std::numeric_limits<float>::quiet_NaN());
+    parameterEvents_.clear();
+
+    if (stopPending_.exchange(false))
+    {
+        for (const auto &active : activeNotes_)
+        {
+            if (auto *buffer = midiBuffers[active.voiceIndex])
+                buffer->addEvent(juce::MidiMessage::noteOff(1, active.pitch), 0);
+        }
+        activeNotes_.clear();
+        releaseAllLocks(0);
+
+        // Back to the start, unless a seek has been made since
+        if (!seekPending_.load())
+            currentBeat_.store(0.0);
+    }
+
+    if (!playing_.load() || !project_ || !bank_)
+    {
+        // What the effect chains still sound is released once stopped
+        for (int v = 0; v < NUM_VOICES; ++v)
+        {
+            if (midiBuffers[v])
+                midiEffects_[v].flush(*midiBuffers[v]);
+        }
         return;
+    }
+
+    PatternBank::ReadScope readScope(*bank_);
 
     sampleRate_ = sampleRate;
     numSamplesInBlock_ = numSamples;
@@ -119,9 +228,46 @@ void SequencerEngine::process(int numSamples, double sampleRate,
     double beatsThisBlock = beatsPerSample_ * numSamples;
 
     double startBeat = currentBeat_.load();
+    double loopEnd = getLoopEndBeat();
+    blockLoopEnd_ = loopEnd;
+
+    if (restartCycles_.exchange(false))
+        loopCycle_ = 0;
+
+    bool seeking = seekPending_.exchange(false);
+    if (seeking)
+    {
+        for (const auto &active : activeNotes_)
+        {
+            if (auto *buffer = midiBuffers[active.voiceIndex])
+                buffer->addEvent(juce::MidiMessage::noteOff(1, active.pitch), 0);
+        }
+        activeNotes_.clear();
+        releaseAllLocks(0);
+        startBeat = std::max(0.0, seekTarget_.load());
+    }
+
+    // The loop can shrink under the playhead when a slot switch lands
+    if (startBeat >= loopEnd)
+    {
+        double wrapped = std::fmod(startBeat, loopEnd);
+        for (auto &active : activeNotes_)
+            active.endBeat -= startBeat - wrapped;
+        for (auto &held : heldLocks_)
+            held.endBeat -= startBeat - wrapped;
+        startBeat = wrapped;
+        ++loopCycle_;
+    }
+
+    if (seeking)
+        chaseNotesAt(startBeat, midiBuffers);
+
+    applyAutomation(startBeat);
+
     blockStartBeat_ = startBeat;
+    blockElapsedBeats_ = elapsedBeats_;
+    elapsedBeats_ += beatsThisBlock;
     double endBeat = startBeat + beatsThisBlock;
-    double loopEnd = getLoopEndBeat();
 
     if (endBeat >= loopEnd)
     {
@@ -137,6 +283,9 @@ void SequencerEngine::process(int numSamples, double sampleRate,
         double remainder = endBeat - loopEnd;
         for (auto &active : activeNotes_)
             active.endBeat -= loopEnd;
+        for (auto &held : heldLocks_)
+            held.endBeat -= loopEnd;
+        ++loopCycle_;
 
         triggerNotesInRange(0.0, remainder, numSamples, midiBuffers, loopSampleOffset);
         releaseNotesEndingInRange(0.0, remainder, numSamples, midiBuffers, loopSampleOffset);
@@ -148,93 +297,258 @@ void SequencerEngine::process(int numSamples, double sampleRate,
         releaseNotesEndingInRange(startBeat, endBeat, numSamples, midiBuffers, 0);
         currentBeat_.store(endBeat);
     }
+
+    // MIDI effects rework each voice's notes before they reach Surge
+    MidiEffectChain::BlockTiming timing{startBeat, loopEnd, beatsPerSample_, numSamples};
+    for (int v = 0; v < NUM_VOICES; ++v)
+    {
+        if (midiBuffers[v])
+            midiEffects_[v].process(*midiBuffers[v], timing);
+    }
 }
 
 void SequencerEngine::triggerNotesInRange(double startBeat, double endBeat, int numSamples,
                                           std::array<juce::MidiBuffer *, NUM_VOICES> midiBuffers,
                                           int baseSampleOffset)
 {
-    if (!project_)
+    if (!project_ || !bank_)
         return;
 
-    // Check for solo
-    bool anySolo = false;
-    for (const auto &v : project_->voices)
+    auto audibleVoices = getAudibleVoices();
+
+    if (isSongActive())
     {
-        if (v.solo)
-        {
-            anySolo = true;
-            break;
-        }
+        triggerSongNotes(startBeat, endBeat, numSamples, midiBuffers, baseSampleOffset,
+                         audibleVoices);
+        return;
     }
 
-    double blockLength = endBeat - startBeat;
-
     for (int v = 0; v < NUM_VOICES; v++)
     {
         if (!midiBuffers[v])
             continue;
 
-        const auto &voice = project_->voices[v];
+        bool audible = audibleVoices[v];
 
-        if (anySolo && !voice.solo)
+        // A queued slot switch lands at its boundary - muted voices switch too
+        double boundary = bank_->hasQueuedSwitch(v) ? bank_->switchBoundary(v, startBeat) : endBeat;
+        if (boundary < endBeat)
+        {
+            if (audible)
+                triggerVoiceNotes(v, startBeat, boundary, startBeat, numSamples, *midiBuffers[v],
+                                  baseSampleOffset);
+            bank_->applyQueuedSwitch(v);
+            if (audible)
+                triggerVoiceNotes(v, boundary, endBeat, startBeat, numSamples, *midiBuffers[v],
+                                  baseSampleOffset);
+        }
+        else if (audible)
+        {
+            triggerVoiceNotes(v, startBeat, endBeat, startBeat, numSamples, *midiBuffers[v],
+                              baseSampleOffset);
+        }
+    }
+}
+
+void SequencerEngine::triggerSongNotes(double startBeat, double endBeat, int numSamples,
+                                       std::array<juce::MidiBuffer *, NUM_VOICES> midiBuffers,
+                                       int baseSampleOffset,
+                                       const std::array<bool, NUM_VOICES> &audible)
+{
+    // Song notes sit on the song timeline, across all voices
+    const auto &song = bank_->song();
+    auto [first, last] = song.notesStartingIn(startBeat, endBeat);
+    for (size_t i = first; i < last; ++i)
+    {
+        const auto &note = song.notes[i];
+        if (!audible[note.voice] || !midiBuffers[note.voice])
             continue;
-        if (!anySolo && voice.mute)
+        if (!trigPasses(note, loopCycle_ * note.passCount + note.pass))
             continue;
 
-        double patternLength = voice.pattern.bars * 4.0;
-        if (patternLength <= 0)
+        double noteOffsetBeats = note.startBeat - startBeat;
+        int samplePos = baseSampleOffset + static_cast<int>(noteOffsetBeats / beatsPerSample_);
+        samplePos = std::clamp(samplePos, 0, numSamples - 1);
+        if (note.numLocks > 0)
+            lockNote(note.voice, song, i, samplePos, note.endBeat());
+        midiBuffers[note.voice]->addEvent(
+            juce::MidiMessage::noteOn(1, note.pitch, note.velocity), samplePos);
+        activeNotes_.push_back({note.voice, note.pitch, note.endBeat()});
+    }
+}
+
+void SequencerEngine::chaseNotesAt(double beat,
+                                   std::array<juce::MidiBuffer *, NUM_VOICES> midiBuffers)
+{
+    auto audible = getAudibleVoices();
+
+    auto chase = [&](int voice, const CompiledPattern &source, const CompiledPattern::Note &note,
+                     double endBeat) {
+        if (note.numLocks > 0)
+            lockNote(voice, source, static_cast<size_t>(&note - source.notes.data()), 0, endBeat);
+        midiBuffers[voice]->addEvent(juce::MidiMessage::noteOn(1, note.pitch, note.velocity), 0);
+        activeNotes_.push_back({voice, note.pitch, endBeat});
+    };
+
+    if (isSongActive())
+    {
+        const auto &song = bank_->song();
+        song.forEachNoteSoundingAt(beat, [&](const CompiledPattern::Note &note) {
+            if (audible[note.voice] && midiBuffers[note.voice] &&
+                trigPasses(note, loopCycle_ * note.passCount + note.pass))
+                chase(note.voice, song, note, note.endBeat());
+        });
+        return;
+    }
+
+    for (int v = 0; v < NUM_VOICES; v++)
+    {
+        const auto &pattern = bank_->playing(v);
+        if (!audible[v] || !midiBuffers[v] || pattern.lengthBeats <= 0.0)
             continue;
 
-        // Wrap the global position to pattern-local position
-        double wrappedStart = std::fmod(startBeat, patternLength);
-        double wrappedEnd = wrappedStart + blockLength;
+        // Patterns loop, so chase at the pattern-local position
+        double localBeat = std::fmod(beat, pattern.lengthBeats);
+        uint32_t pass = slotPass(beat, pattern.lengthBeats);
+        pattern.forEachNoteSoundingAt(localBeat, [&](const CompiledPattern::Note &note) {
+            if (trigPasses(note, pass))
+                chase(v, pattern, note, beat + (note.endBeat() - localBeat));
+        });
+    }
+}
 
-        // Helper to add note-on with sample-accurate timing
-        auto addNoteOn = [&](const MIDINote *note, double noteOffsetBeats) {
-            int samplePos = baseSampleOffset + static_cast<int>(noteOffsetBeats / beatsPerSample_);
-            samplePos = std::clamp(samplePos, 0, numSamples - 1);
-            midiBuffers[v]->addEvent(
-                juce::MidiMessage::noteOn(1, note->pitch, (juce::uint8)note->velocity),
-                samplePos);
-            double noteEndGlobal = startBeat + noteOffsetBeats + note->duration;
-            activeNotes_.push_back({v, note->pitch, noteEndGlobal});
-        };
+void SequencerEngine::applyAutomation(double beat)
+{
+    bool songActive = isSongActive();
 
-        // If this block would cross the pattern boundary, handle in two parts
-        if (wrappedEnd > patternLength)
-        {
-            // Part 1: from wrappedStart to patternLength
-            auto notes1 = voice.pattern.getNotesStartingInRange(wrappedStart, patternLength);
-            for (const auto *note : notes1)
+    for (int v = 0; v < NUM_VOICES; v++)
+    {
+        auto apply = [&](const CompiledPattern::Lane &lane, float value) {
+            if (lane.target == CompiledPattern::TARGET_MIXER_VOLUME)
             {
-                double noteOffsetBeats = note->startBeat - wrappedStart;
-                addNoteOn(note, noteOffsetBeats);
+                automatedVolume_[v] = value;
             }
-
-            // Part 2: from 0 to remainder
-            double remainder = wrappedEnd - patternLength;
-            auto notes2 = voice.pattern.getNotesStartingInRange(0.0, remainder);
-            for (const auto *note : notes2)
+            else if (lane.target == CompiledPattern::TARGET_MIXER_PAN)
+            {
+                automatedPan_[v] = value * 2.0f - 1.0f;
+            }
+            else if (synths_[v] && lane.target < static_cast<int>(parameterIds_.size()) &&
+                     !isLockHeld(v, lane.target))
             {
-                // Note starts at (patternLength - wrappedStart) beats into this block
-                double noteOffsetBeats = (patternLength - wrappedStart) + note->startBeat;
-                addNoteOn(note, noteOffsetBeats);
+                auto &applied = automatedValues_[v][static_cast<size_t>(lane.target)];
+                if (applied.load() != value)
+                {
+                    synths_[v]->setParameter01(parameterIds_[static_cast<size_t>(lane.target)],
+                                               value, false, false);
+                    applied.store(value);
+                    automationApplied_[v].store(true);
+                }
             }
+        };
+
+        if (songActive)
+        {
+            bank_->song().forEachLaneValue(v, beat, apply);
         }
         else
         {
-            // Simple case: block doesn't cross pattern boundary
-            auto notesToTrigger = voice.pattern.getNotesStartingInRange(wrappedStart, wrappedEnd);
-            for (const auto *note : notesToTrigger)
-            {
-                double noteOffsetBeats = note->startBeat - wrappedStart;
-                addNoteOn(note, noteOffsetBeats);
-            }
+            // A voice without lanes costs one empty check
+            const auto &pattern = bank_->playing(v);
+            if (!pattern.laneSpans.empty())
+                pattern.forEachLaneValue(v, std::fmod(beat, pattern.lengthBeats), apply);
+        }
+    }
+}
+
+std::array<bool, NUM_VOICES> SequencerEngine::getAudibleVoices() const
+{
+    // Check for solo
+    bool anySolo = false;
+    for (const auto &v : project_->voices)
+    {
+        if (v.solo)
+        {
+            anySolo = true;
+            break;
+        }
+    }
+
+    std::array<bool, NUM_VOICES> audible{};
+    for (int v = 0; v < NUM_VOICES; v++)
+    {
+        const auto &voice = project_->voices[v];
+        audible[v] = anySolo ? voice.solo : !voice.mute;
+    }
+    return audible;
+}
+
+void SequencerEngine::triggerVoiceNotes(int voice, double fromBeat, double toBeat,
+                                        double originBeat, int numSamples,
+                                        juce::MidiBuffer &midiBuffer, int baseSampleOffset)
+{
+    const auto &pattern = bank_->playing(voice);
+    double patternLength = pattern.lengthBeats;
+    if (patternLength <= 0 || toBeat <= fromBeat)
+        return;
+
+    // Wrap the global position to pattern-local position
+    double wrappedStart = std::fmod(fromBeat, patternLength);
+    double wrappedEnd = wrappedStart + (toBeat - fromBeat);
+
+    // Note-ons for notes starting in [localStart, localEnd) on pass; blockOffset is
+    // the position of localStart relative to originBeat (where sample baseSampleOffset is)
+    auto addNoteOns = [&](double localStart, double localEnd, double blockOffset,
+                          uint32_t pass) {
+        auto [first, last] = pattern.notesStartingIn(localStart, localEnd);
+        for (size_t i = first; i < last; ++i)
+        {
+            const auto &note = pattern.notes[i];
+            if (!trigPasses(note, pass))
+                continue;
+
+            double noteOffsetBeats = blockOffset + (note.startBeat - localStart);
+            int samplePos = baseSampleOffset + static_cast<int>(noteOffsetBeats / beatsPerSample_);
+            samplePos = std::clamp(samplePos, 0, numSamples - 1);
+            double noteEnd = originBeat + noteOffsetBeats + note.duration;
+            if (note.numLocks > 0)
+                lockNote(voice, pattern, i, samplePos, noteEnd);
+            midiBuffer.addEvent(juce::MidiMessage::noteOn(1, note.pitch, note.velocity),
+                                samplePos);
+            activeNotes_.push_back({voice, note.pitch, noteEnd});
         }
+    };
+
+    double fromOffset = fromBeat - originBeat;
+    uint32_t pass = slotPass(fromBeat, patternLength);
+
+    // If this range crosses the pattern boundary, handle it in two parts
+    if (wrappedEnd > patternLength)
+    {
+        addNoteOns(wrappedStart, patternLength, fromOffset, pass);
+        addNoteOns(0.0, wrappedEnd - patternLength, fromOffset + (patternLength - wrappedStart),
+                   pass + 1);
+    }
+    else
+    {
+        addNoteOns(wrappedStart, wrappedEnd, fromOffset, pass);
     }
 }
 
+uint32_t SequencerEngine::slotPass(double beat, double patternLength) const
+{
+    // A slot shorter than the loop plays several passes per loop, the last
+    // possibly cut short by the wrap
+    auto passesPerLoop = static_cast<uint32_t>(std::ceil(blockLoopEnd_ / patternLength));
+    return loopCycle_ * passesPerLoop + static_cast<uint32_t>(beat / patternLength);
+}
+
+bool SequencerEngine::trigPasses(const CompiledPattern::Note &note, uint32_t pass) const
+{
+    // Voices share note IDs - the voice keeps their rolls apart
+    return TrigCondition::passes(note.trig, pass, project_->seed,
+                                 note.id * NUM_VOICES + note.voice, fill_.load());
+}
+
 void SequencerEngine::releaseNotesEndingInRange(double startBeat, double endBeat, int numSamples,
                                                 std::array<juce::MidiBuffer *, NUM_VOICES> midiBuffers,
                                                 int baseSampleOffset)
@@ -261,6 +575,95 @@ void SequencerEngine::releaseNotesEndingInRange(double startBeat, double endBeat
             ++it;
         }
     }
+
+    // Locks are restored at the end of the last note holding them
+    auto held = heldLocks_.begin();
+    while (held != heldLocks_.end())
+    {
+        if (held->endBeat >= startBeat && held->endBeat < endBeat)
+        {
+            double offsetBeats = held->endBeat - startBeat;
+            int samplePos = baseSampleOffset + static_cast<int>(offsetBeats / beatsPerSample_);
+            samplePos = std::clamp(samplePos, 0, numSamples - 1);
+            addParameterEvent({samplePos, held->voiceIndex, held->parameter, held->restoreValue});
+            held = heldLocks_.erase(held);
+        }
+        else
+        {
+            ++held;
+        }
+    }
+}
+
+void SequencerEngine::lockNote(int voice, const CompiledPattern &source, size_t noteIndex,
+                               int samplePos, double endBeat)
+{
+    if (!synths_[voice])
+        return;
+
+    auto [lock, last] = source.locksOf(noteIndex);
+    for (; lock != last; ++lock)
+    {
+        if (lock->parameter >= static_cast<int>(parameterIds_.size()))
+            continue;
+
+        auto held = std::find_if(heldLocks_.begin(), heldLocks_.end(), [&](const HeldLock &h) {
+            return h.voiceIndex == voice && h.parameter == lock->parameter;
+        });
+        if (held != heldLocks_.end())
+        {
+            held->endBeat = std::max(held->endBeat, endBeat);
+        }
+        else if (heldLocks_.size() < MAX_HELD_LOCKS)
+        {
+            heldLocks_.push_back(
+                {voice, lock->parameter, scheduledValue(voice, lock->parameter), endBeat});
+        }
+        else
+        {
+            continue;
+        }
+
+        addParameterEvent({samplePos, voice, lock->parameter, lock->value});
+    }
+}
+
+void SequencerEngine::releaseAllLocks(int samplePos)
+{
+    for (const auto &held : heldLocks_)
+        addParameterEvent({samplePos, held.voiceIndex, held.parameter, held.restoreValue});
+    heldLocks_.clear();
+}
+
+bool SequencerEngine::isLockHeld(int voice, int parameter) const
+{
+    return std::any_of(heldLocks_.begin(), heldLocks_.end(), [&](const HeldLock &h) {
+        return h.voiceIndex == voice && h.parameter == parameter;
+    });
+}
+
+float SequencerEngine::scheduledValue(int voice, int parameter) const
+{
+    // A restore earlier in this block hasn't reached the synth yet - it is the
+    // value the parameter will have by the time a new lock lands
+    for (auto it = parameterEvents_.rbegin(); it != parameterEvents_.rend(); ++it)
+    {
+        if (it->voice == voice && it->parameter == parameter)
+            return it->value;
+    }
+    return synths_[voice]->getParameter01(parameterIds_[static_cast<size_t>(parameter)]);
+}
+
+void SequencerEngine::addParameterEvent(const ParameterEvent &event)
+{
+    if (parameterEvents_.size() >= MAX_PARAMETER_EVENTS)
+        return;
+
+    // Keep sample order; events at the same sample stay in the order they came
+    auto at = std::upper_bound(
+        parameterEvents_.begin(), parameterEvents_.end(), event.sampleOffset,
+        [](int offset, const ParameterEvent &e) { return offset < e.sampleOffset; });
+    parameterEvents_.insert(at, event);
 }
 
 // ============================================================================
@@ -269,28 +672,72 @@ void SequencerEngine::releaseNotesEndingInRange(double startBeat, double endBeat
 
 SurgeBoxEngine::SurgeBoxEngine()
 {
-    // Create pattern models for each voice with auto-sync to project patterns
-    for (int i = 0; i < NUM_VOICES; ++i)
+    // One pattern model per voice and slot, auto-synced to the project patterns.
+    // Every synced change is recompiled for playback off the audio thread.
+    for (int p = 0; p < NUM_PATTERNS; ++p)
     {
-        patternModels_[i] = std::make_unique<PatternModel>(&undoManager_);
-        patternModels_[i]->setAutoSyncPattern(&project_.voices[i].pattern);
+        patternModels_[p] = std::make_unique<PatternModel>(&undoManager_);
+        patternModels_[p]->setAutoSyncPattern(&project_.getPattern(p));
+        patternModels_[p]->onSynced = [this, p]() {
+            patternBank_.submit(p / NUM_PATTERN_SLOTS, p % NUM_PATTERN_SLOTS,
+                                project_.getPattern(p));
+        };
     }
+
+    sequencer_.setPatternBank(&patternBank_);
+
+    for (auto &remote : remoteVoices_)
+        remote = std::make_unique<RemoteVoice>();
 }
 
-SurgeBoxEngine::~SurgeBoxEngine() { shutdown(); }
+SurgeBoxEngine::~SurgeBoxEngine()
+{
+    stopAutosave();
+    shutdown();
+}
 
+#if !defined(SURGEBOX_HEADLESS)
 void SurgeBoxEngine::setProcessors(std::array<SurgeSynthProcessor *, NUM_VOICES> processors)
 {
+    std::array<SurgeSynthesizer *, NUM_VOICES> synthPtrs{};
+    for (int i = 0; i < NUM_VOICES; i++)
+    {
+        if (processors[i] && processors[i]->surge)
+            synthPtrs[i] = processors[i]->surge.get();
+    }
+    setSynths(synthPtrs);
     processors_ = processors;
+}
+#endif
+
+void SurgeBoxEngine::setSynths(std::array<SurgeSynthesizer *, NUM_VOICES> synths)
+{
+#if !defined(SURGEBOX_HEADLESS)
+    processors_ = {};
+#endif
+    synths_ = synths;
+    synthBlockPos_.fill(BLOCK_SIZE);
 
     // Also set up synth pointers for the sequencer
-    std::array<SurgeSynthesizer *, NUM_VOICES> synthPtrs{};
-    for (int i = 0; i < NUM_VOICES; i++)
+    sequencer_.setSynths(synths_);
+
+    // Automation lanes name Surge parameters by storage name; the bank resolves
+    // them to parameter indices as it compiles, so recompile everything
+    auto first = std::find_if(synths_.begin(), synths_.end(), [](auto *s) { return s; });
+    if (first != synths_.end())
     {
-        if (processors_[i] && processors_[i]->surge)
-            synthPtrs[i] = processors_[i]->surge.get();
+        std::vector<std::string> names;
+        for (auto *param : (*first)->storage.getPatch().param_ptr)
+            names.push_back(param->get_storage_name());
+        patternBank_.setParameterNames(names);
+        submitAllPatterns();
     }
-    sequencer_.setSynths(synthPtrs);
+}
+
+void SurgeBoxEngine::submitAllPatterns()
+{
+    for (int p = 0; p < NUM_PATTERNS; ++p)
+        patternBank_.submit(p / NUM_PATTERN_SLOTS, p % NUM_PATTERN_SLOTS, project_.getPattern(p));
 }
 
 bool SurgeBoxEngine::initialize(double sampleRate, int blockSize)
@@ -300,9 +747,20 @@ bool SurgeBoxEngine::initialize(double sampleRate, int blockSize)
 
     sampleRate_ = sampleRate;
     blockSize_ = blockSize;
+    governor_.prepare(sampleRate);
+    quality_.prepare(sampleRate);
+    flightRecorder_.prepare(sampleRate);
 
     // Pre-allocate voice processing buffer (avoid allocations in audio thread)
-    voiceBuffer_ = std::make_unique<juce::AudioBuffer<float>>(2, BLOCK_SIZE);
+    for (auto &buffer : voiceBuffers_)
+        buffer = std::make_unique<juce::AudioBuffer<float>>(2, BLOCK_SIZE);
+    for (auto &buffer : segmentMidiBuffers_)
+        buffer.ensureSize(4096);
+    quantumLiveInput_.ensureSize(4096);
+    for (auto &buffer : voiceInput_)
+        buffer.ensureSize(4096);
+    for (auto &buffer : voiceMidiBuffers_)
+        buffer.ensureSize(4096);
 
     // Set up sequencer with project
     sequencer_.setProject(&project_);
@@ -311,9 +769,9 @@ bool SurgeBoxEngine::initialize(double sampleRate, int blockSize)
     project_.reset();
     for (int i = 0; i < NUM_VOICES; i++)
     {
-        if (processors_[i] && processors_[i]->surge)
+        if (synths_[i])
         {
-            project_.voices[i].name = processors_[i]->surge->storage.getPatch().name;
+            project_.voices[i].name = synths_[i]->storage.getPatch().name;
             if (project_.voices[i].name.empty())
                 project_.voices[i].name = "Init";
         }
@@ -322,6 +780,15 @@ bool SurgeBoxEngine::initialize(double sampleRate, int blockSize)
     // Sync pattern models from project
     syncPatternModelsFromProject();
 
+    // Undo/redo rebuilds patches off the message thread; Surge swaps a queued
+    // patch in at the start of its next block
+    history_.setPatchLoader([this](int voice, const std::string &blob) {
+        if (auto *synth = getSynth(voice))
+            synth->enqueuePatchForLoad(blob.data(), static_cast<int>(blob.size()));
+    });
+
+    observePatches();
+
     initialized_ = true;
     return true;
 }
@@ -333,32 +800,55 @@ void SurgeBoxEngine::shutdown()
 
     // Clear callbacks first to prevent any access during shutdown
     onVoiceChanged = nullptr;
+    onPatternSlotChanged = nullptr;
     onPlayheadMoved = nullptr;
+    onRealtimeApplied = nullptr;
 
     // Clear pattern model callbacks
     for (auto &model : patternModels_)
     {
         if (model)
+        {
             model->onPatternChanged = nullptr;
+            model->onNotesChanged = nullptr;
+        }
     }
 
     sequencer_.stop();
+    setOutOfProcessVoices(false);
+    flightRecorder_.setDirectory({});
+
+    // Workers render through the processors
+    renderScheduler_.setWorkers(0);
+    renderScheduler_.setWorkerStart(nullptr);
+    if (memoryLocked_)
+    {
+        RealtimeMode::unlockMemory();
+        memoryLocked_ = false;
+    }
+
+    // The loader touches processors from the history worker
+    history_.setPatchLoader(nullptr);
 
     // Clear sequencer's synth pointers before we lose access to processors
     sequencer_.setSynths({});
 
-    // Note: We don't own the processors, plugin layer does
-    for (auto &proc : processors_)
+    // Note: We don't own the synths - the plugin layer or the headless host does
+    for (auto &synth : synths_)
     {
-        if (proc && proc->surge)
-            proc->surge->allNotesOff();
-        proc = nullptr;
+        if (synth)
+            synth->allNotesOff();
+        synth = nullptr;
     }
+#if !defined(SURGEBOX_HEADLESS)
+    processors_ = {};
+#endif
 
     initialized_ = false;
 }
 
-void SurgeBoxEngine::process(float *outputL, float *outputR, int numSamples)
+void SurgeBoxEngine::process(float *outputL, float *outputR, int numSamples,
+                             const juce::MidiBuffer &liveInput)
 {
     if (!initialized_)
     {
@@ -367,30 +857,93 @@ void SurgeBoxEngine::process(float *outputL, float *outputR, int numSamples)
         return;
     }
 
-    // Get position BEFORE advancing (this is where audio for this block starts)
-    double blockStartBeat = sequencer_.getPositionBeats();
+    int realtimeRequest = realtimeRequest_.load(std::memory_order_acquire);
+    if (realtimeRequest != realtimeApplied_)
+        applyRealtimeOnAudioThread(realtimeRequest);
 
-    // Store block start for mixVoices to sync Surge
-    blockStartBeat_ = blockStartBeat;
+    auto blockStart = juce::Time::getHighResolutionTicks();
+    flightRecorder_.beginBlock(numSamples, sequencer_.getPositionBeats(), project_.tempo,
+                               sequencer_.isPlaying());
 
-    // Clear MIDI buffers for this block
-    for (auto &buf : voiceMidiBuffers_)
-        buf.clear();
+    // Long host blocks are rendered a quantum at a time. A voice host's shared
+    // block holds at most MAX_BLOCK_SAMPLES, e.g. less than an offline bounce's.
+    int quantum = renderQuantum_.load();
+    if (outOfProcess_.load() && (quantum <= 0 || quantum > VoiceHost::MAX_BLOCK_SAMPLES))
+        quantum = VoiceHost::MAX_BLOCK_SAMPLES;
+    if (quantum <= 0 || quantum >= numSamples)
+    {
+        quantumOffset_ = 0;
+        processQuantum(outputL, outputR, numSamples, liveInput);
+    }
+    else
+    {
+        for (int offset = 0; offset < numSamples; offset += quantum)
+        {
+            int length = std::min(quantum, numSamples - offset);
+            quantumLiveInput_.clear();
+            quantumLiveInput_.addEvents(liveInput, offset, length, -offset);
+            quantumOffset_ = offset;
+            processQuantum(outputL + offset, outputR + offset, length, quantumLiveInput_);
+        }
+    }
 
-    // Build array of pointers for sequencer
-    std::array<juce::MidiBuffer *, NUM_VOICES> midiBufferPtrs;
+    for (auto &input : voiceInput_)
+        input.clear();
+
+    flightRecorder_.endBlock(juce::Time::getHighResolutionTicks() - blockStart,
+                             quality_.getLevel());
+
+    // Notify playhead position (for UI)
+    if (onPlayheadMoved && sequencer_.isPlaying())
+        onPlayheadMoved(sequencer_.getPositionBeats());
+}
+
+void SurgeBoxEngine::processQuantum(float *outputL, float *outputR, int numSamples,
+                                    const juce::MidiBuffer &liveInput)
+{
+    // Get position BEFORE advancing (this is where audio for this block starts)
+    double blockStartBeat = sequencer_.getPositionBeats();
+
+    // Store block start for mixVoices to sync Surge
+    blockStartBeat_ = blockStartBeat;
+
+    // Clear MIDI buffers for this block
+    for (auto &buf : voiceMidiBuffers_)
+        buf.clear();
+
+    // Build array of pointers for sequencer
+    std::array<juce::MidiBuffer *, NUM_VOICES> midiBufferPtrs;
     for (int i = 0; i < NUM_VOICES; ++i)
         midiBufferPtrs[i] = &voiceMidiBuffers_[i];
 
     // Advance sequencer - populates MIDI buffers with sample-accurate events
     sequencer_.process(numSamples, sampleRate_, midiBufferPtrs);
+    captureLiveInput(liveInput);
+
+    // Queued voice input plays alongside the sequencer
+    for (int v = 0; v < NUM_VOICES; ++v)
+    {
+        if (!voiceInput_[v].isEmpty())
+            voiceMidiBuffers_[v].addEvents(voiceInput_[v], quantumOffset_, numSamples,
+                                           -quantumOffset_);
+    }
+
+    if (flightRecorder_.isRecording())
+    {
+        for (int v = 0; v < NUM_VOICES; ++v)
+        {
+            for (const auto metadata : voiceMidiBuffers_[v])
+                flightRecorder_.addMidi(v, quantumOffset_ + metadata.samplePosition,
+                                        metadata.data, metadata.numBytes);
+        }
+    }
 
     // Clear output
     memset(outputL, 0, numSamples * sizeof(float));
     memset(outputR, 0, numSamples * sizeof(float));
 
     // Process each voice and mix
-    mixVoices(outputL, outputR, numSamples);
+    mixVoices(outputL, outputR, numSamples, liveInput);
 
     // Apply master volume
     float mv = project_.masterVolume;
@@ -399,13 +952,41 @@ void SurgeBoxEngine::process(float *outputL, float *outputR, int numSamples)
         outputL[i] *= mv;
         outputR[i] *= mv;
     }
+}
 
-    // Notify playhead position (for UI)
-    if (onPlayheadMoved && sequencer_.isPlaying())
-        onPlayheadMoved(sequencer_.getPositionBeats());
+void SurgeBoxEngine::captureLiveInput(const juce::MidiBuffer &liveInput)
+{
+    bool recording = recorder_.isArmed() && sequencer_.isPlaying();
+    int voice = activeVoice_.load(std::memory_order_relaxed);
+
+    auto capture = [&](int sampleOffset, int pitch, int velocity) {
+        recorder_.push({sequencer_.getBlockBeat(sampleOffset),
+                        sequencer_.getBlockElapsedBeats(sampleOffset), voice,
+                        static_cast<uint8_t>(pitch), static_cast<uint8_t>(velocity)});
+    };
+
+    // Keyboard notes reach Surge in this block - always drain them, so a stale
+    // note isn't recorded when recording starts
+    recorder_.takeKeyboardNotes([&](uint8_t pitch, uint8_t velocity) {
+        if (recording)
+            capture(0, pitch, velocity);
+    });
+
+    if (!recording)
+        return;
+
+    for (const auto metadata : liveInput)
+    {
+        auto msg = metadata.getMessage();
+        if (msg.isNoteOn())
+            capture(metadata.samplePosition, msg.getNoteNumber(), msg.getVelocity());
+        else if (msg.isNoteOff())
+            capture(metadata.samplePosition, msg.getNoteNumber(), 0);
+    }
 }
 
-void SurgeBoxEngine::mixVoices(float *outputL, float *outputR, int numSamples)
+void SurgeBoxEngine::mixVoices(float *outputL, float *outputR, int numSamples,
+                               const juce::MidiBuffer &liveInput)
 {
     // Check for solo
     bool anySolo = false;
@@ -418,41 +999,92 @@ void SurgeBoxEngine::mixVoices(float *outputL, float *outputR, int numSamples)
         }
     }
 
-    // Resize buffer to match incoming size
-    voiceBuffer_->setSize(2, numSamples, false, false, true);
+    // The local instances fall silent while the hosts play - they only get
+    // parameter changes from here on
+    bool remote = outOfProcess_.load();
+    if (remote != renderingRemote_)
+    {
+        renderingRemote_ = remote;
+        if (remote)
+        {
+            for (int v = 0; v < NUM_VOICES; v++)
+            {
+                if (auto *synth = getSynth(v))
+                    synth->allNotesOff();
+            }
+        }
+    }
 
+    // Bring the audible instances inside the voice and CPU budgets before
+    // they render. Hosts keep their own polyphony.
+    std::array<bool, NUM_VOICES> heard{};
+    std::array<SurgeSynthesizer *, NUM_VOICES> audible{};
     for (int v = 0; v < NUM_VOICES; v++)
     {
-        if (!processors_[v] || !processors_[v]->surge)
-            continue;
-
         const auto &voice = project_.voices[v];
+        heard[v] = !(anySolo ? !voice.solo : voice.mute);
+        if (heard[v] && !remote)
+            audible[v] = getSynth(v);
+    }
+    quality_.apply(governor_);
+    governor_.govern(audible, numSamples);
+    auto blockStart = juce::Time::getHighResolutionTicks();
+    renderStartTicks_ = blockStart;
 
-        // Skip muted voices
-        if (anySolo && !voice.solo)
+    // Predicted cost of each audible voice; -1 - not rendered
+    std::array<double, NUM_VOICES> costs;
+    costs.fill(-1.0);
+
+    for (int v = 0; v < NUM_VOICES; v++)
+    {
+        if (!synths_[v])
             continue;
-        if (!anySolo && voice.mute)
+
+        // Skip muted voices - their parameter events (p-lock restores) still apply
+        if (!heard[v])
+        {
+            for (const auto &event : sequencer_.getParameterEvents())
+            {
+                if (event.voice == v)
+                    sequencer_.applyParameterEvent(event);
+            }
             continue;
+        }
 
-        // Sync Surge's internal time with our sequencer ONCE at block start
-        auto *synth = processors_[v]->surge.get();
-        synth->time_data.tempo = project_.tempo;
-        synth->time_data.ppqPos = blockStartBeat_;
-        synth->time_data.timeSigNumerator = 4;
-        synth->time_data.timeSigDenominator = 4;
-        synth->resetStateFromTimeData();
+        // Resize buffer to match incoming size
+        voiceBuffers_[v]->setSize(2, numSamples, false, false, true);
 
-        // Clear and process with MIDI events from sequencer
-        voiceBuffer_->clear();
-        processors_[v]->processBlock(*voiceBuffer_, voiceMidiBuffers_[v]);
+        // A host renders while the local voices do - waiting for it costs
+        // the scheduler nothing
+        if (remote)
+        {
+            postRemoteVoice(v, numSamples, liveInput);
+            costs[v] = 0.0;
+            continue;
+        }
+
+        costs[v] = costModel_.predictTicks(v, governor_.getActiveVoices(v), numSamples);
+    }
+
+    renderNumSamples_ = numSamples;
+    renderScheduler_.render(costs);
+
+    for (int v = 0; v < NUM_VOICES; v++)
+    {
+        if (costs[v] < 0.0)
+            continue;
 
-        // Get output and mix with volume/pan
-        float vol = voice.volume;
-        float panL = std::min(1.0f, 1.0f - voice.pan);
-        float panR = std::min(1.0f, 1.0f + voice.pan);
+        // Get output and mix with volume/pan, automated if a lane drives them
+        const auto &voice = project_.voices[v];
+        float automatedVolume = sequencer_.getAutomatedVolume(v);
+        float automatedPan = sequencer_.getAutomatedPan(v);
+        float vol = std::isnan(automatedVolume) ? voice.volume : automatedVolume;
+        float pan = std::isnan(automatedPan) ? voice.pan : automatedPan;
+        float panL = std::min(1.0f, 1.0f - pan);
+        float panR = std::min(1.0f, 1.0f + pan);
 
-        const float *procL = voiceBuffer_->getReadPointer(0);
-        const float *procR = voiceBuffer_->getReadPointer(1);
+        const float *procL = voiceBuffers_[v]->getReadPointer(0);
+        const float *procR = voiceBuffers_[v]->getReadPointer(1);
 
         for (int i = 0; i < numSamples; i++)
         {
@@ -460,6 +1092,138 @@ void SurgeBoxEngine::mixVoices(float *outputL, float *outputR, int numSamples)
             outputR[i] += procR[i] * vol * panR;
         }
     }
+
+    governor_.endBlock(juce::Time::getHighResolutionTicks() - blockStart);
+    quality_.update(governor_.getBlockLoad(), numSamples);
+}
+
+void SurgeBoxEngine::postRemoteVoice(int voice, int numSamples,
+                                     const juce::MidiBuffer &liveInput)
+{
+    auto &remote = *remoteVoices_[voice];
+    remote.beginBlock(numSamples, project_.tempo, blockStartBeat_);
+
+    // Surge swaps queued patches (undo, the patch browser) in as it
+    // processes, which the local instance no longer does
+    synths_[voice]->processThreadunsafeOperations();
+
+    // The sequencer releases its notes on the local instances when it stops
+    bool playing = sequencer_.isPlaying();
+    if (remoteWasPlaying_[voice] && !playing)
+        remote.addAllNotesOff();
+    remoteWasPlaying_[voice] = playing;
+
+    auto forward = [&](const juce::MidiBuffer &midi) {
+        for (const auto metadata : midi)
+        {
+            auto msg = metadata.getMessage();
+            int offset = metadata.samplePosition;
+            int channel = msg.getChannel() - 1;
+            if (msg.isNoteOn())
+                remote.addNote(offset, channel, msg.getNoteNumber(), msg.getVelocity());
+            else if (msg.isNoteOff())
+                remote.addNote(offset, channel, msg.getNoteNumber(), 0);
+            else if (msg.isAllNotesOff() || msg.isAllSoundOff())
+                remote.addAllNotesOff();
+            else if (msg.isPitchWheel())
+                remote.addPitchBend(offset, channel, (msg.getPitchWheelValue() - 8192) / 8192.0f);
+            else if (msg.isController())
+                remote.addController(offset, channel, msg.getControllerNumber(),
+                                     msg.getControllerValue());
+        }
+    };
+    forward(voiceMidiBuffers_[voice]);
+    if (voice == activeVoice_)
+        forward(liveInput);
+
+    // The local instance follows too, so edits and undo see the played values
+    for (const auto &event : sequencer_.getParameterEvents())
+    {
+        if (event.voice != voice)
+            continue;
+        sequencer_.applyParameterEvent(event);
+        remote.addParameter(event.sampleOffset, event.parameter, event.value);
+    }
+
+    remote.post();
+}
+
+void SurgeBoxEngine::renderScheduledVoice(int voice)
+{
+    if (renderingRemote_)
+    {
+        auto &buffer = *voiceBuffers_[voice];
+        auto blockTicks = static_cast<juce::int64>(
+            REMOTE_DEADLINE_FRACTION * renderNumSamples_ / sampleRate_ *
+            static_cast<double>(juce::Time::getHighResolutionTicksPerSecond()));
+        remoteVoices_[voice]->finish(buffer.getWritePointer(0), buffer.getWritePointer(1),
+                                     renderStartTicks_ + blockTicks);
+        return;
+    }
+
+    // Sync Surge's internal time with our sequencer ONCE at block start
+    auto *synth = synths_[voice];
+    synth->time_data.tempo = project_.tempo;
+    synth->time_data.ppqPos = blockStartBeat_;
+    synth->time_data.timeSigNumerator = 4;
+    synth->time_data.timeSigDenominator = 4;
+    synth->resetStateFromTimeData();
+
+    // Clear and process with MIDI events from sequencer
+    auto renderStart = juce::Time::getHighResolutionTicks();
+    renderVoice(voice, renderNumSamples_);
+    auto ticks = juce::Time::getHighResolutionTicks() - renderStart;
+
+    governor_.recordRender(voice, ticks);
+    costModel_.recordRender(voice, governor_.getActiveVoices(voice), renderNumSamples_, ticks);
+    flightRecorder_.addVoiceRender(voice, ticks, governor_.getActiveVoices(voice));
+}
+
+void SurgeBoxEngine::renderVoice(int voice, int numSamples)
+{
+    auto &buffer = *voiceBuffers_[voice];
+    auto &segmentMidi = segmentMidiBuffers_[voice];
+    buffer.clear();
+
+    const auto &events = sequencer_.getParameterEvents();
+    bool hasEvents = std::any_of(events.begin(), events.end(),
+                                 [voice](const auto &event) { return event.voice == voice; });
+    if (!hasEvents)
+    {
+        renderSegment(voice, buffer, voiceMidiBuffers_[voice]);
+        return;
+    }
+
+    // Render up to each parameter event so it lands ahead of a note-on at the
+    // same sample. Surge still works in BLOCK_SIZE steps internally, so events
+    // are as accurate as its note-ons, no more.
+    int position = 0;
+    auto renderTo = [&](int end) {
+        if (end <= position)
+            return;
+        juce::AudioBuffer<float> segment(buffer.getArrayOfWritePointers(), 2, position,
+                                         end - position);
+        segmentMidi.clear();
+        segmentMidi.addEvents(voiceMidiBuffers_[voice], position, end - position, -position);
+        renderSegment(voice, segment, segmentMidi);
+        position = end;
+    };
+
+    for (const auto &event : events)
+    {
+        if (event.voice != voice)
+            continue;
+        renderTo(event.sampleOffset);
+        sequencer_.applyParameterEvent(event);
+    }
+    renderTo(numSamples);
+}
+
+void SurgeBoxEngine::queueVoiceInput(int voice, const juce::MidiMessage &message,
+                                     int sampleOffset)
+{
+    if (voice >= 0 && voice < NUM_VOICES)
+        voiceInput_[voice].addEvent(message, std::max(0, sampleOffset));
 }
 
 void SurgeBoxEngine::setActiveVoice(int voice)
@@ -473,13 +1237,49 @@ void SurgeBoxEngine::setActiveVoice(int voice)
         onVoiceChanged(voice);
 }
 
+void SurgeBoxEngine::renderSegment(int voice, juce::AudioBuffer<float> &buffer,
+                                   juce::MidiBuffer &midi)
+{
+#if !defined(SURGEBOX_HEADLESS)
+    if (processors_[voice])
+    {
+        processors_[voice]->processBlock(buffer, midi);
+        return;
+    }
+#endif
+
+    // No processor - drive Surge directly, like SurgeSynthProcessor: MIDI
+    // applies at its sample, Surge renders BLOCK_SIZE at a time and the
+    // remainder carries into the next call
+    auto *synth = synths_[voice];
+    auto &blockPos = synthBlockPos_[voice];
+    float *left = buffer.getWritePointer(0);
+    float *right = buffer.getWritePointer(1);
+
+    auto event = midi.cbegin();
+    for (int i = 0; i < buffer.getNumSamples(); ++i)
+    {
+        for (; event != midi.cend() && (*event).samplePosition <= i; ++event)
+            playMidi(*synth, (*event).getMessage());
+
+        if (blockPos >= BLOCK_SIZE)
+        {
+            synth->process();
+            blockPos = 0;
+        }
+        left[i] = synth->output[0][blockPos];
+        right[i] = synth->output[1][blockPos];
+        ++blockPos;
+    }
+    for (; event != midi.cend(); ++event)
+        playMidi(*synth, (*event).getMessage());
+}
+
 SurgeSynthesizer *SurgeBoxEngine::getSynth(int voice)
 {
     if (voice < 0 || voice >= NUM_VOICES)
         return nullptr;
-    if (!processors_[voice])
-        return nullptr;
-    return processors_[voice]->surge.get();
+    return synths_[voice];
 }
 
 void SurgeBoxEngine::captureAllVoices()
@@ -499,31 +1299,1019 @@ void SurgeBoxEngine::restoreAllVoices()
         auto *synth = getSynth(i);
         if (synth)
             project_.voices[i].restoreToSynth(synth);
+
+        // Loaded outside the undo history - don't record it as an edit
+        history_.rebasePatch(i);
+    }
+    observePatches();
+}
+
+void SurgeBoxEngine::setPatchUndo(bool enabled)
+{
+    if (enabled == patchUndo_)
+        return;
+    patchUndo_ = enabled;
+
+    // Whatever changed while nothing polled folds into the next recorded step
+    for (int i = 0; i < NUM_VOICES; i++)
+        history_.followPatch(i);
+}
+
+bool SurgeBoxEngine::undo()
+{
+    pollPatches(true);
+    finishAutomationTake();
+    return undoManager_.undo();
+}
+
+bool SurgeBoxEngine::redo()
+{
+    pollPatches(true);
+    finishAutomationTake();
+    return undoManager_.redo();
+}
+
+// Undo keys: one per global field, one per voice and mixer field
+static uint32_t globalValueKey(EditJournal::GlobalField field)
+{
+    return 0x10000u | static_cast<uint32_t>(field);
+}
+
+static uint32_t mixerValueKey(int voice, EditJournal::MixerField field)
+{
+    return 0x20000u | (static_cast<uint32_t>(voice) << 8) | static_cast<uint32_t>(field);
+}
+
+void SurgeBoxEngine::setGlobalValue(EditJournal::GlobalField field, double value)
+{
+    static const char *names[] = {"Change Tempo", "Change Loop Length", "Change Swing",
+                                  "Change Master Volume", "Change Seed"};
+
+    history_.recordValue(globalValueKey(field), names[static_cast<int>(field)],
+                         getGlobalValue(field), value,
+                         [this, field](double v) { applyGlobalValue(field, v); });
+}
+
+void SurgeBoxEngine::setMixerValue(int voice, EditJournal::MixerField field, float value)
+{
+    if (voice < 0 || voice >= NUM_VOICES)
+        return;
+
+    history_.recordValue(mixerValueKey(voice, field), "Change Mixer", getMixerValue(voice, field),
+                         value, [this, voice, field](double v) {
+                             applyMixerValue(voice, field, static_cast<float>(v));
+                         });
+}
+
+double SurgeBoxEngine::getGlobalValue(EditJournal::GlobalField field) const
+{
+    switch (field)
+    {
+        case EditJournal::GlobalField::Tempo: return project_.tempo;
+        case EditJournal::GlobalField::LoopBars: return project_.loopBars;
+        case EditJournal::GlobalField::Swing: return project_.swing;
+        case EditJournal::GlobalField::MasterVolume: return project_.masterVolume;
+        case EditJournal::GlobalField::Seed: return project_.seed;
+    }
+    return 0.0;
+}
+
+void SurgeBoxEngine::applyGlobalValue(EditJournal::GlobalField field, double value)
+{
+    switch (field)
+    {
+        case EditJournal::GlobalField::Tempo: project_.tempo = value; break;
+        case EditJournal::GlobalField::LoopBars: project_.loopBars = static_cast<int>(value); break;
+        case EditJournal::GlobalField::Swing:
+            project_.swing = value;
+            patternBank_.setGroove(project_.swing, project_.groove);
+            submitAllPatterns();
+            break;
+        case EditJournal::GlobalField::MasterVolume:
+            project_.masterVolume = static_cast<float>(value);
+            break;
+        case EditJournal::GlobalField::Seed: project_.seed = static_cast<uint32_t>(value); break;
+    }
+
+    if (journal_)
+        journal_->recordGlobal(field, value);
+}
+
+float SurgeBoxEngine::getMixerValue(int voice, EditJournal::MixerField field) const
+{
+    const auto &v = project_.voices[voice];
+    switch (field)
+    {
+        case EditJournal::MixerField::Volume: return v.volume;
+        case EditJournal::MixerField::Pan: return v.pan;
+        case EditJournal::MixerField::SendA: return v.sendA;
+        case EditJournal::MixerField::SendB: return v.sendB;
+        case EditJournal::MixerField::Mute: return v.mute ? 1.0f : 0.0f;
+        case EditJournal::MixerField::Solo: return v.solo ? 1.0f : 0.0f;
+    }
+    return 0.0f;
+}
+
+void SurgeBoxEngine::applyMixerValue(int voice, EditJournal::MixerField field, float value)
+{
+    auto &v = project_.voices[voice];
+    switch (field)
+    {
+        case EditJournal::MixerField::Volume: v.volume = value; break;
+        case EditJournal::MixerField::Pan: v.pan = value; break;
+        case EditJournal::MixerField::SendA: v.sendA = value; break;
+        case EditJournal::MixerField::SendB: v.sendB = value; break;
+        case EditJournal::MixerField::Mute: v.mute = value != 0.0f; break;
+        case EditJournal::MixerField::Solo: v.solo = value != 0.0f; break;
+    }
+
+    if (journal_)
+        journal_->recordMixer(voice, field, value);
+}
+
+MemoryReport SurgeBoxEngine::getMemoryReport()
+{
+    MemoryReport report;
+    auto voiceName = [](int v) { return "Voice " + std::to_string(v + 1); };
+    auto midiBytes = [](const juce::MidiBuffer &buffer) {
+        return static_cast<int64_t>(buffer.data.getNumAllocated());
+    };
+
+    // The first instance in the process also loads Surge's shared static tables,
+    // so voice 1's growth is split into a typical instance - the median of the
+    // others - and the shared remainder. All of it is an estimate from resident
+    // memory deltas.
+    std::vector<int64_t> others;
+    for (int v = 1; v < NUM_VOICES; v++)
+    {
+        if (synths_[v] && instanceFootprint_[v] > 0)
+            others.push_back(instanceFootprint_[v]);
+    }
+    int64_t typical = 0;
+    if (!others.empty())
+    {
+        auto middle = others.begin() + static_cast<std::ptrdiff_t>(others.size() / 2);
+        std::nth_element(others.begin(), middle, others.end());
+        typical = *middle;
+    }
+
+    for (int v = 0; v < NUM_VOICES; v++)
+    {
+        if (!synths_[v])
+            continue;
+
+        int64_t bytes = instanceFootprint_[v];
+        if (bytes <= 0)
+        {
+            report.add("Surge", voiceName(v), sizeof(SurgeSynthesizer), true);
+            continue;
+        }
+        if (v == 0 && typical > 0 && bytes > typical)
+        {
+            report.add("Surge", "Shared tables", bytes - typical, true);
+            bytes = typical;
+        }
+        report.add("Surge", voiceName(v), bytes, true);
+    }
+
+    // Steps the models can't claim are the ValueTree's own, mixer and global
+    // changes, and patch deltas
+    int64_t modelUndo = 0;
+    for (int p = 0; p < NUM_PATTERNS; ++p)
+    {
+        if (!patternModels_[p])
+            continue;
+        auto name = voiceName(p / NUM_PATTERN_SLOTS) + " slot " +
+                    std::to_string(p % NUM_PATTERN_SLOTS + 1);
+        report.add("Patterns", name, static_cast<int64_t>(patternModels_[p]->estimateBytes()),
+                   true);
+        auto undo = static_cast<int64_t>(patternModels_[p]->getUndoBytes());
+        if (undo > 0)
+            report.add("Undo", name, undo);
+        modelUndo += undo;
+    }
+    auto allUndo = static_cast<int64_t>(undoManager_.getNumberOfUnitsTakenUpByStoredCommands());
+    report.add("Undo", "Other steps", std::max<int64_t>(0, allUndo - modelUndo));
+    for (int v = 0; v < NUM_VOICES; v++)
+    {
+        report.add("Undo", voiceName(v) + " patch baseline",
+                   static_cast<int64_t>(history_.getPatchBaselineBytes(v)));
+    }
+
+    for (int v = 0; v < NUM_VOICES; v++)
+    {
+        const auto &voice = project_.voices[v];
+        auto bytes = static_cast<int64_t>(voice.patchData.capacity());
+        for (const auto &pattern : voice.patterns)
+            bytes += static_cast<int64_t>(pattern.memoryBytes());
+        report.add("Project", voiceName(v), bytes);
+    }
+
+    int64_t audio = sizeof(mixBufferL_) + sizeof(mixBufferR_);
+    for (const auto &buffer : voiceBuffers_)
+    {
+        if (buffer)
+            audio += static_cast<int64_t>(buffer->getNumChannels()) * buffer->getNumSamples() *
+                     static_cast<int64_t>(sizeof(float));
+    }
+    int64_t midi = midiBytes(quantumLiveInput_);
+    for (int v = 0; v < NUM_VOICES; v++)
+    {
+        midi += midiBytes(voiceMidiBuffers_[v]) + midiBytes(segmentMidiBuffers_[v]) +
+                midiBytes(voiceInput_[v]);
+    }
+    report.add("Engine", "Voice audio buffers", audio);
+    report.add("Engine", "MIDI buffers", midi);
+    report.add("Engine", "Flight recorder", sizeof(FlightRecorder));
+
+    report.residentBytes = MemoryReport::currentResidentBytes();
+    return report;
+}
+
+void SurgeBoxEngine::serviceFlightRecorder()
+{
+    // Only once a capture is written - saving every patch is too much to do
+    // on every edit
+    if (flightRecorder_.wantsProjectImage())
+        flightRecorder_.setProjectImage(captureProjectImage());
+}
+
+std::string SurgeBoxEngine::captureProjectImage()
+{
+    captureAllVoices();
+    syncPatternModelsToProject();
+
+    std::string image;
+    project_.saveToMemory(image);
+    return image;
+}
+
+bool SurgeBoxEngine::startAutosave(const fs::path &directory)
+{
+    if (journal_)
+        return true;
+
+    auto image = captureProjectImage();
+
+    std::array<PatternModel *, NUM_PATTERNS> models{};
+    for (int p = 0; p < NUM_PATTERNS; ++p)
+        models[p] = patternModels_[p].get();
+
+    journal_ = std::make_unique<EditJournal>();
+    if (!journal_->open(directory, std::move(image), models))
+    {
+        journal_.reset();
+        return false;
+    }
+    return true;
+}
+
+void SurgeBoxEngine::stopAutosave(bool cleanShutdown)
+{
+    if (!journal_)
+        return;
+
+    journal_->close(cleanShutdown);
+    journal_.reset();
+}
+
+bool SurgeBoxEngine::recoverAutosave(const fs::path &directory)
+{
+    GrooveboxProject recovered;
+    if (!EditJournal::recover(directory, recovered))
+        return false;
+
+    project_ = recovered;
+    syncPatternModelsFromProject();
+    restoreAllVoices();
+    return true;
+}
+
+void SurgeBoxEngine::tick()
+{
+    if (!initialized_)
+        return;
+
+    if (automationRecording_)
+        recordAutomation();
+    if (recorder_.isArmed())
+        updateLiveRecording();
+
+    if (outOfProcess_.load())
+        updateRemoteVoices();
+
+    if (realtimeReportPending_ && realtimeAudioState_.load() != REALTIME_AUDIO_PENDING)
+    {
+        realtimeReportPending_ = false;
+        if (onRealtimeApplied)
+            onRealtimeApplied(getRealtimeStatus());
+    }
+
+    auto now = juce::Time::getMillisecondCounter();
+    if (now - lastPatchPollMs_ >= PATCH_POLL_INTERVAL_MS)
+    {
+        lastPatchPollMs_ = now;
+
+        // Each poll saves every Surge patch - only worth it while something
+        // uses the result
+        if (patchUndo_ || journal_ || outOfProcess_.load())
+            pollPatches(false);
+        observePatches();
+        flushRecordedLanes();
+    }
+
+    serviceFlightRecorder();
+
+    if (journal_ && journal_->needsCompaction())
+        journal_->compact(captureProjectImage());
+}
+
+void SurgeBoxEngine::pollPatches(bool flush)
+{
+    // The history keeps only deltas; the journal gets a blob whenever the
+    // recorded patch state moves (an edit settles or an undo lands)
+    for (int i = 0; i < NUM_VOICES; i++)
+    {
+        auto *synth = getSynth(i);
+        if (!synth)
+            continue;
+
+        // Automation playback isn't an edit - don't record undo steps for it
+        if (sequencer_.takeAutomationApplied(i))
+            history_.followPatch(i);
+
+        void *data = nullptr;
+        size_t size = synth->saveRaw(&data);
+        bool moved = data && size > 0 && history_.pollPatch(i, data, size, flush);
+        if (moved && journal_)
+            journal_->recordPatch(i, data, size);
+        if (data && size > 0 && outOfProcess_.load())
+            syncRemotePatch(i, synth, data, size);
+        free(data);
+    }
+}
+
+void SurgeBoxEngine::observePatches()
+{
+    // The cost model reseeds a voice when its patch's features change -
+    // loaded, swapped in by undo or the browser, or edited. Checked at the
+    // patch poll rate rather than from the render loop.
+    for (int i = 0; i < NUM_VOICES; i++)
+        costModel_.observePatch(i, getSynth(i));
+}
+
+// ============================================================================
+// Real-time mode
+// ============================================================================
+
+void SurgeBoxEngine::setRealtime(const RealtimeSettings &settings)
+{
+    realtime_ = settings;
+
+    bool lock = settings.enabled && settings.lockMemory;
+    if (lock && !memoryLocked_)
+    {
+        memoryLockReason_.clear();
+        memoryLocked_ = RealtimeMode::lockMemory(memoryLockReason_);
+    }
+    else if (!lock)
+    {
+        if (memoryLocked_)
+            RealtimeMode::unlockMemory();
+        memoryLocked_ = false;
+        memoryLockReason_.clear();
+    }
+
+    {
+        const std::lock_guard<std::mutex> guard(realtimeWorkersMutex_);
+        realtimeWorkerPromoted_ = {};
+        realtimeWorkerReason_.clear();
+    }
+
+    // Workers are started from the message thread, so without the hook the
+    // restarted ones are back to normal scheduling
+    if (settings.enabled)
+    {
+        renderScheduler_.setWorkerStart([this, settings](int worker) {
+            int cpu = settings.firstWorkerCpu >= 0 ? settings.firstWorkerCpu + worker : -1;
+            std::string reason;
+            bool promoted =
+                RealtimeMode::promoteCurrentThread(settings.workerPriority, cpu, reason);
+            RealtimeMode::prefaultStack();
+
+            const std::lock_guard<std::mutex> guard(realtimeWorkersMutex_);
+            realtimeWorkerPromoted_[static_cast<size_t>(worker)] = promoted;
+            if (!promoted && realtimeWorkerReason_.empty())
+                realtimeWorkerReason_ = "Render worker " + std::to_string(worker + 1) + ": " +
+                                        reason;
+        });
+    }
+    else
+    {
+        renderScheduler_.setWorkerStart(nullptr);
+    }
+    renderScheduler_.restartWorkers();
+
+    realtimeAudioPriority_.store(settings.enabled ? settings.audioPriority : 0);
+    realtimeAudioCpu_.store(settings.enabled ? settings.audioCpu : -1);
+    realtimeAudioState_.store(REALTIME_AUDIO_PENDING);
+    realtimeRequest_.fetch_add(1, std::memory_order_release);
+    realtimeReportPending_ = true;
+}
+
+void SurgeBoxEngine::applyRealtimeOnAudioThread(int request)
+{
+    realtimeApplied_ = request;
+
+    int priority = realtimeAudioPriority_.load();
+    if (priority <= 0)
+    {
+        RealtimeMode::demoteCurrentThread();
+        realtimeAudioState_.store(REALTIME_AUDIO_NORMAL, std::memory_order_release);
+        return;
+    }
+
+    // The reason is built here, once, in the block that turns the mode on
+    std::string reason;
+    bool promoted =
+        RealtimeMode::promoteCurrentThread(priority, realtimeAudioCpu_.load(), reason);
+    if (!promoted)
+    {
+        reason = "Audio thread: " + reason;
+        auto length = std::min(reason.size(), realtimeAudioReason_.size() - 1);
+        std::memcpy(realtimeAudioReason_.data(), reason.data(), length);
+        realtimeAudioReason_[length] = '\0';
+    }
+
+    // What the audio thread writes it faults in with writes - no worker renders
+    // until mixVoices(). The voice buffers grow to the host's block now rather
+    // than in a later one.
+    RealtimeMode::prefaultStack();
+    RealtimeMode::prefault(mixBufferL_, sizeof(mixBufferL_));
+    RealtimeMode::prefault(mixBufferR_, sizeof(mixBufferR_));
+    for (auto &buffer : voiceBuffers_)
+    {
+        buffer->setSize(2, std::max(blockSize_, BLOCK_SIZE), false, false, true);
+        for (int channel = 0; channel < buffer->getNumChannels(); ++channel)
+            RealtimeMode::prefault(buffer->getWritePointer(channel),
+                                   static_cast<size_t>(buffer->getNumSamples()) * sizeof(float));
+    }
+    auto prefaultMidi = [](juce::MidiBuffer &buffer) {
+        RealtimeMode::prefault(buffer.data.getRawDataPointer(),
+                               static_cast<size_t>(buffer.data.getNumAllocated()));
+    };
+    for (int v = 0; v < NUM_VOICES; v++)
+    {
+        prefaultMidi(voiceMidiBuffers_[v]);
+        prefaultMidi(segmentMidiBuffers_[v]);
+        prefaultMidi(voiceInput_[v]);
+    }
+    prefaultMidi(quantumLiveInput_);
+
+    // The message thread writes to these too, so they are only read. Surge's
+    // voices live inside its synthesizer object.
+    RealtimeMode::touch(this, sizeof(*this));
+    for (auto *synth : synths_)
+        RealtimeMode::touch(synth, synth ? sizeof(SurgeSynthesizer) : 0);
+
+    realtimeAudioState_.store(promoted ? REALTIME_AUDIO_PROMOTED : REALTIME_AUDIO_FAILED,
+                              std::memory_order_release);
+}
+
+RealtimeStatus SurgeBoxEngine::getRealtimeStatus() const
+{
+    RealtimeStatus status;
+    status.memoryLocked = memoryLocked_;
+
+    std::vector<std::string> reasons;
+    if (!memoryLockReason_.empty())
+        reasons.push_back(memoryLockReason_);
+
+    auto state = realtimeAudioState_.load(std::memory_order_acquire);
+    status.audioPromoted = state == REALTIME_AUDIO_PROMOTED;
+    status.audioPending = state == REALTIME_AUDIO_PENDING;
+    if (state == REALTIME_AUDIO_FAILED)
+        reasons.push_back(realtimeAudioReason_.data());
+
+    {
+        const std::lock_guard<std::mutex> guard(realtimeWorkersMutex_);
+        status.workers = renderScheduler_.getNumWorkers();
+        for (int w = 0; w < status.workers; ++w)
+            status.workersPromoted += realtimeWorkerPromoted_[static_cast<size_t>(w)] ? 1 : 0;
+        if (!realtimeWorkerReason_.empty())
+            reasons.push_back(realtimeWorkerReason_);
+    }
+
+    for (const auto &reason : reasons)
+        status.reason += (status.reason.empty() ? "" : "; ") + reason;
+    return status;
+}
+
+// ============================================================================
+// Out-of-process voices
+// ============================================================================
+
+bool SurgeBoxEngine::setOutOfProcessVoices(bool enabled, const fs::path &hostExecutable,
+                                           int firstCpu)
+{
+    if (!enabled)
+    {
+        // Stopping takes each voice from the audio thread before the host goes
+        outOfProcess_.store(false);
+        for (auto &remote : remoteVoices_)
+            remote->stop();
+        return true;
     }
+
+    if (!initialized_)
+    {
+        outOfProcessError_ = "The engine is not initialized";
+        return false;
+    }
+
+    setOutOfProcessVoices(false);
+    voiceHostExecutable_ = hostExecutable;
+    voiceHostFirstCpu_ = firstCpu;
+    outOfProcessError_.clear();
+
+    for (int v = 0; v < NUM_VOICES; v++)
+    {
+        if (!getSynth(v))
+            continue;
+
+        auto &remote = *remoteVoices_[v];
+        int cpu = firstCpu >= 0 ? firstCpu + v : -1;
+        if (!remote.start(hostExecutable, sampleRate_, cpu) || !sendRemotePatch(v))
+        {
+            outOfProcessError_ = "Voice " + std::to_string(v + 1) + ": " + remote.getError();
+            setOutOfProcessVoices(false);
+            return false;
+        }
+    }
+
+    outOfProcess_.store(true);
+    return true;
+}
+
+void SurgeBoxEngine::updateRemoteVoices()
+{
+    for (int v = 0; v < NUM_VOICES; v++)
+    {
+        auto *synth = getSynth(v);
+        auto &remote = *remoteVoices_[v];
+        if (!synth)
+            continue;
+
+        // Crash containment - only this voice drops out, until its host is back
+        if (remote.checkExited())
+        {
+            int cpu = voiceHostFirstCpu_ >= 0 ? voiceHostFirstCpu_ + v : -1;
+            if (remote.start(voiceHostExecutable_, sampleRate_, cpu))
+            {
+                remote.countRestart();
+                sendRemotePatch(v);
+            }
+            continue;
+        }
+        if (!remote.isRunning())
+            continue;
+
+        // Mirror parameter edits. Values the sequencer set reached the host
+        // with their block.
+        const auto &params = synth->storage.getPatch().param_ptr;
+        auto &snapshot = remoteSnapshots_[v];
+        if (snapshot.size() != params.size())
+            continue;
+
+        for (size_t i = 0; i < params.size(); ++i)
+        {
+            float value = params[i]->get_value_f01();
+            if (value == snapshot[i])
+                continue;
+            if (value != sequencer_.getAutomatedValue(v, static_cast<int>(i)) &&
+                !remote.sendParameter(static_cast<int>(i), value))
+                break; // The ring is full - the rest goes next time
+            snapshot[i] = value;
+            ++remoteParamsMoved_[v];
+        }
+    }
+}
+
+void SurgeBoxEngine::syncRemotePatch(int voice, SurgeSynthesizer *synth, const void *data,
+                                     size_t size)
+{
+    if (!remoteVoices_[voice]->isRunning())
+        return;
+
+    // Parameter edits went out as they happened. Anything else that changes
+    // the blob - modulation routing, wavetables, a new patch - needs the whole
+    // patch, and reloading cuts the host's notes, so it is only sent when no
+    // edit explains the change.
+    size_t hash = std::hash<std::string_view>{}(
+        std::string_view(static_cast<const char *>(data), size));
+    int moved = std::exchange(remoteParamsMoved_[voice], 0);
+    if (hash == remotePatchHashes_[voice])
+        return;
+
+    bool newPatch = synth->storage.getPatch().name != remotePatchNames_[voice] ||
+                    moved > REMOTE_PATCH_LOAD_PARAMS;
+    if (!newPatch && moved > 0)
+    {
+        remotePatchHashes_[voice] = hash;
+        return;
+    }
+    sendRemotePatch(voice);
+}
+
+bool SurgeBoxEngine::sendRemotePatch(int voice)
+{
+    auto *synth = getSynth(voice);
+    if (!synth)
+        return false;
+
+    void *data = nullptr;
+    size_t size = synth->saveRaw(&data);
+    bool sent = data && size > 0 && remoteVoices_[voice]->sendPatch(data, size);
+    if (sent)
+    {
+        remotePatchHashes_[voice] = std::hash<std::string_view>{}(
+            std::string_view(static_cast<const char *>(data), size));
+        remotePatchNames_[voice] = synth->storage.getPatch().name;
+
+        const auto &params = synth->storage.getPatch().param_ptr;
+        auto &snapshot = remoteSnapshots_[voice];
+        snapshot.resize(params.size());
+        for (size_t i = 0; i < params.size(); ++i)
+            snapshot[i] = params[i]->get_value_f01();
+        remoteParamsMoved_[voice] = 0;
+    }
+    free(data);
+    return sent;
+}
+
+void SurgeBoxEngine::recordAutomation()
+{
+    // A take stays on the voice it started on; switching voices finishes it
+    int voice = getActiveVoice();
+    auto *synth = getSynth(voice);
+    if (!synth)
+        return;
+
+    // Stopping finishes the take, so it can be undone at once
+    if (!sequencer_.isPlaying())
+    {
+        finishAutomationTake();
+        return;
+    }
+
+    const auto &params = synth->storage.getPatch().param_ptr;
+
+    // Switching voices starts a new snapshot - nothing is recorded until a
+    // parameter moves after it
+    if (voice != recordVoice_ || recordSnapshot_.size() != params.size())
+    {
+        finishAutomationTake();
+        recordVoice_ = voice;
+        recordTake_.clear();
+        recordSnapshot_.resize(params.size());
+        for (size_t i = 0; i < params.size(); ++i)
+            recordSnapshot_[i] = params[i]->get_value_f01();
+        return;
+    }
+
+    int slot = project_.voices[voice].activeSlot;
+    auto &pattern = project_.voices[voice].patterns[static_cast<size_t>(slot)];
+    double length = pattern.lengthInBeats();
+    if (length <= 0.0)
+        return;
+
+    double beat = std::fmod(sequencer_.getPositionBeats(), length);
+    bool changed = false;
+
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        float value = params[i]->get_value_f01();
+        if (value == recordSnapshot_[i])
+            continue;
+        recordSnapshot_[i] = value;
+
+        // Values the automation itself set aren't edits
+        if (value == sequencer_.getAutomatedValue(voice, static_cast<int>(i)))
+            continue;
+
+        std::string target = params[i]->get_storage_name();
+        auto *lane = pattern.findLane(target);
+
+        // Keep the lane as the take found it, for its undo step
+        auto original = [&](const ProjectHistory::LaneEdit &e) {
+            return e.slot == slot && e.before.target == target;
+        };
+        if (std::none_of(recordLanes_.begin(), recordLanes_.end(), original))
+            recordLanes_.push_back({voice, slot, lane ? *lane : AutomationLane{target, {}}, {}});
+
+        if (!lane)
+        {
+            pattern.automation.push_back({target, {}});
+            lane = &pattern.automation.back();
+        }
+
+        // Overwrite whatever the take has passed over since its last point
+        auto &points = lane->points;
+        auto take = recordTake_.find(static_cast<int>(i));
+        if (take != recordTake_.end())
+        {
+            double from = take->second;
+            auto passed = [&](const AutomationPoint &p) {
+                return from <= beat ? (p.beat > from && p.beat <= beat)
+                                    : (p.beat > from || p.beat <= beat);
+            };
+            points.erase(std::remove_if(points.begin(), points.end(), passed), points.end());
+        }
+        recordTake_[static_cast<int>(i)] = beat;
+
+        auto at = std::upper_bound(points.begin(), points.end(), beat,
+                                   [](double b, const AutomationPoint &p) { return b < p.beat; });
+        points.insert(at, {beat, value});
+
+        // Journaled in batches - a take rewrites its lanes many times a second
+        std::pair<int, std::string> dirty{voice * NUM_PATTERN_SLOTS + slot, target};
+        if (std::find(recordDirty_.begin(), recordDirty_.end(), dirty) == recordDirty_.end())
+            recordDirty_.push_back(std::move(dirty));
+        changed = true;
+    }
+
+    if (changed)
+        patternBank_.submit(voice, slot, pattern);
 }
 
 PatternModel *SurgeBoxEngine::getPatternModel(int voice)
 {
     if (voice < 0 || voice >= NUM_VOICES)
         return nullptr;
-    return patternModels_[voice].get();
+    return getPatternModel(voice, project_.voices[voice].activeSlot);
+}
+
+PatternModel *SurgeBoxEngine::getPatternModel(int voice, int slot)
+{
+    if (voice < 0 || voice >= NUM_VOICES || slot < 0 || slot >= NUM_PATTERN_SLOTS)
+        return nullptr;
+    return patternModels_[voice * NUM_PATTERN_SLOTS + slot].get();
+}
+
+int SurgeBoxEngine::getPatternSlot(int voice) const
+{
+    if (voice < 0 || voice >= NUM_VOICES)
+        return 0;
+    return project_.voices[voice].activeSlot;
+}
+
+void SurgeBoxEngine::selectPatternSlot(int voice, int slot)
+{
+    if (voice < 0 || voice >= NUM_VOICES || slot < 0 || slot >= NUM_PATTERN_SLOTS)
+        return;
+    if (slot == project_.voices[voice].activeSlot)
+        return;
+
+    project_.voices[voice].activeSlot = slot;
+
+    if (sequencer_.isPlaying())
+        patternBank_.queueSlot(voice, slot);
+    else
+        patternBank_.setPlayingSlot(voice, slot);
+
+    if (journal_)
+        journal_->recordActiveSlot(voice, slot);
+
+    if (onPatternSlotChanged)
+        onPatternSlotChanged(voice, slot);
+}
+
+void SurgeBoxEngine::setSong(std::vector<SongSection> song)
+{
+    project_.song = std::move(song);
+    patternBank_.submitSong(project_.song);
+
+    if (journal_)
+        journal_->recordSong(project_.song, project_.songMode);
+}
+
+void SurgeBoxEngine::setGroove(GrooveTemplate groove)
+{
+    groove.sanitise();
+    project_.groove = std::move(groove);
+    patternBank_.setGroove(project_.swing, project_.groove);
+    submitAllPatterns();
+
+    if (journal_)
+        journal_->recordGroove(project_.groove);
+}
+
+void SurgeBoxEngine::setMidiEffects(int voice, const MidiEffectChainSettings &settings)
+{
+    if (voice < 0 || voice >= NUM_VOICES)
+        return;
+
+    project_.voices[voice].midiEffects = settings;
+    sequencer_.setMidiEffects(voice, settings);
+
+    if (journal_)
+        journal_->recordMidiEffects(voice, settings);
+}
+
+void SurgeBoxEngine::setSongMode(bool enabled)
+{
+    if (enabled == project_.songMode)
+        return;
+
+    project_.songMode = enabled;
+
+    // Re-seek in place so the notes of the new source are chased
+    if (sequencer_.isPlaying())
+        sequencer_.setPositionBeats(sequencer_.getPositionBeats());
+
+    if (journal_)
+        journal_->recordSong(project_.song, project_.songMode);
+}
+
+void SurgeBoxEngine::setAutomationLane(int voice, int slot, AutomationLane lane)
+{
+    if (voice < 0 || voice >= NUM_VOICES || slot < 0 || slot >= NUM_PATTERN_SLOTS)
+        return;
+
+    auto &pattern = project_.voices[voice].patterns[static_cast<size_t>(slot)];
+    const auto *current = pattern.findLane(lane.target);
+
+    ProjectHistory::LaneEdit edit{voice, slot, current ? *current : AutomationLane{lane.target, {}},
+                                  std::move(lane)};
+    history_.recordLanes("Edit Automation", {std::move(edit)},
+                         [this](int v, int s, const AutomationLane &l) {
+                             applyAutomationLane(v, s, l);
+                         });
+}
+
+void SurgeBoxEngine::applyAutomationLane(int voice, int slot, const AutomationLane &lane)
+{
+    auto &pattern = project_.voices[voice].patterns[static_cast<size_t>(slot)];
+    auto &lanes = pattern.automation;
+    lanes.erase(std::remove_if(lanes.begin(), lanes.end(),
+                               [&](const AutomationLane &l) { return l.target == lane.target; }),
+                lanes.end());
+
+    if (!lane.points.empty())
+        lanes.push_back(lane);
+
+    patternBank_.submit(voice, slot, pattern);
+    journalAutomationLane(voice, slot, lane.target);
+}
+
+void SurgeBoxEngine::setNoteLock(int voice, int slot, uint32_t noteId, const std::string &target,
+                                 float value)
+{
+    if (voice < 0 || voice >= NUM_VOICES || slot < 0 || slot >= NUM_PATTERN_SLOTS)
+        return;
+
+    const auto &pattern = project_.voices[voice].patterns[static_cast<size_t>(slot)];
+    ProjectHistory::LockEdit edit{voice, slot, noteId, target, pattern.getLock(noteId, target),
+                                  value};
+    history_.recordLock("Change Lock", std::move(edit),
+                        [this](const ProjectHistory::LockEdit &e, float v) {
+                            applyNoteLock(e.voice, e.slot, e.noteId, e.target, v);
+                        });
+}
+
+void SurgeBoxEngine::applyNoteLock(int voice, int slot, uint32_t noteId,
+                                   const std::string &target, float value)
+{
+    auto &pattern = project_.voices[voice].patterns[static_cast<size_t>(slot)];
+    pattern.setLock(noteId, target, value);
+    patternBank_.submit(voice, slot, pattern);
+
+    if (journal_)
+        journal_->recordNoteLock(voice * NUM_PATTERN_SLOTS + slot, noteId, target, value);
+}
+
+void SurgeBoxEngine::setLiveRecording(bool enabled)
+{
+    if (enabled == recorder_.isArmed())
+        return;
+
+    // Commit whatever was finished before disarming, even mid-pass
+    if (!enabled)
+        recorder_.commitAll(getRecordingModels());
+    recorder_.setArmed(enabled);
+}
+
+std::array<PatternModel *, NUM_VOICES> SurgeBoxEngine::getRecordingModels()
+{
+    std::array<PatternModel *, NUM_VOICES> models{};
+    for (int v = 0; v < NUM_VOICES; ++v)
+        models[static_cast<size_t>(v)] = getPatternModel(v);
+    return models;
+}
+
+void SurgeBoxEngine::updateLiveRecording()
+{
+    recorder_.update(getRecordingModels(), sequencer_.getPositionBeats(),
+                     sequencer_.isPlaying());
+}
+
+void SurgeBoxEngine::recordKeyboardNote(int pitch, int velocity)
+{
+    if (pitch < 0 || pitch > 127)
+        return;
+    recorder_.pushKeyboardNote(static_cast<uint8_t>(pitch),
+                               static_cast<uint8_t>(std::clamp(velocity, 0, 127)));
+}
+
+void SurgeBoxEngine::setAutomationRecording(bool enabled)
+{
+    finishAutomationTake();
+    automationRecording_ = enabled;
+
+    // Each take starts from a fresh snapshot
+    recordVoice_ = -1;
+    recordSnapshot_.clear();
+    recordTake_.clear();
+}
+
+void SurgeBoxEngine::flushRecordedLanes()
+{
+    for (const auto &[pattern, target] : recordDirty_)
+        journalAutomationLane(pattern / NUM_PATTERN_SLOTS, pattern % NUM_PATTERN_SLOTS, target);
+    recordDirty_.clear();
+}
+
+void SurgeBoxEngine::finishAutomationTake()
+{
+    if (recordLanes_.empty())
+        return;
+
+    // Every dirty lane is one of the take's - performing the step journals it
+    recordDirty_.clear();
+
+    auto edits = std::move(recordLanes_);
+    recordLanes_.clear();
+    for (auto &edit : edits)
+    {
+        auto &pattern = project_.voices[edit.voice].patterns[static_cast<size_t>(edit.slot)];
+        const auto *lane = pattern.findLane(edit.before.target);
+        edit.after = lane ? *lane : AutomationLane{edit.before.target, {}};
+    }
+
+    history_.recordLanes("Record Automation", std::move(edits),
+                         [this](int v, int s, const AutomationLane &l) {
+                             applyAutomationLane(v, s, l);
+                         });
+}
+
+void SurgeBoxEngine::journalAutomationLane(int voice, int slot, const std::string &target)
+{
+    if (!journal_)
+        return;
+
+    auto &pattern = project_.voices[voice].patterns[static_cast<size_t>(slot)];
+    static const AutomationLane removed;
+    const AutomationLane *lane = pattern.findLane(target);
+    journal_->recordAutomationLane(voice * NUM_PATTERN_SLOTS + slot, target,
+                                   lane ? *lane : removed);
 }
 
 void SurgeBoxEngine::syncPatternModelsFromProject()
 {
-    for (int i = 0; i < NUM_VOICES; ++i)
+    // The project a take was recording into is gone
+    recordLanes_.clear();
+    recordDirty_.clear();
+
+    // Before the models load - each load submits its pattern
+    patternBank_.setGroove(project_.swing, project_.groove);
+
+    for (int v = 0; v < NUM_VOICES; ++v)
+        sequencer_.setMidiEffects(v, project_.voices[v].midiEffects);
+
+    for (int p = 0; p < NUM_PATTERNS; ++p)
     {
-        if (patternModels_[i])
-            patternModels_[i]->loadFromPattern(project_.voices[i].pattern);
+        if (patternModels_[p])
+            patternModels_[p]->loadFromPattern(project_.getPattern(p));
+    }
+
+    patternBank_.submitSong(project_.song);
+
+    // A loaded project starts on its saved slots, without waiting for a boundary
+    for (int v = 0; v < NUM_VOICES; ++v)
+    {
+        int slot = project_.voices[v].activeSlot;
+        patternBank_.setPlayingSlot(v, slot);
+        if (onPatternSlotChanged)
+            onPatternSlotChanged(v, slot);
     }
 }
 
 void SurgeBoxEngine::syncPatternModelsToProject()
 {
-    for (int i = 0; i < NUM_VOICES; ++i)
+    for (int p = 0; p < NUM_PATTERNS; ++p)
     {
-        if (patternModels_[i])
-            patternModels_[i]->saveToPattern(project_.voices[i].pattern);
+        if (patternModels_[p])
+            patternModels_[p]->saveToPattern(project_.getPattern(p));
     }
 }
 
@@ -9,17 +9,37 @@
 #pragma once
 
 #include "GrooveboxProject.h"
+#include "MemoryReport.h"
 #include "PatternModel.h"
+#include "PatternBank.h"
+#include "EditJournal.h"
+#include "FlightRecorder.h"
+#include "MidiEffects.h"
+#include "MidiRecorder.h"
+#include "ProjectHistory.h"
+#include "QualityController.h"
+#include "RealtimeMode.h"
+#include "RemoteVoice.h"
+#include "RenderCalibration.h"
+#include "VoiceCostModel.h"
+#include "VoiceGovernor.h"
+#include "VoiceRenderScheduler.h"
 #include "SurgeSynthesizer.h"
 #include <juce_audio_basics/juce_audio_basics.h>
 #include <juce_data_structures/juce_data_structures.h>
+#include <algorithm>
 #include <array>
 #include <memory>
 #include <atomic>
 #include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 // Forward declarations
+#if !defined(SURGEBOX_HEADLESS)
 class SurgeSynthProcessor;
+#endif
 
 namespace juce
 {
@@ -40,6 +60,7 @@ class SequencerEngine
     SequencerEngine();
 
     void setProject(GrooveboxProject *project);
+    void setPatternBank(PatternBank *bank) { bank_ = bank; }
     void setSynths(std::array<SurgeSynthesizer *, NUM_VOICES> synths);
 
     void play();
@@ -47,35 +68,120 @@ class SequencerEngine
     void setPlaying(bool playing);
     bool isPlaying() const { return playing_.load(); }
 
+    // Jump to beat. At the next block everything sounding is released and the
+    // notes already under the new position are re-triggered for their remaining
+    // length (chased), as if playback had run into it.
     void setPositionBeats(double beat);
     double getPositionBeats() const { return currentBeat_.load(); }
     void rewind() { setPositionBeats(0.0); }
 
-    double getLoopEndBeat() const;
+    // While on, notes with a Fill trig condition play
+    void setFill(bool on) { fill_.store(on); }
+    bool isFill() const { return fill_.load(); }
 
     // Get currently playing notes for a voice (for UI highlighting)
     std::vector<uint8_t> getPlayingNotes(int voiceIndex) const;
 
+    // Where a sample of the current block falls (audio thread, after process):
+    // the loop position, and the beats played so far, which never wrap
+    double getBlockBeat(int sampleOffset) const;
+    double getBlockElapsedBeats(int sampleOffset) const;
+
+    // Mixer values set by automation for the current block, NaN where a field
+    // isn't automated (audio thread)
+    float getAutomatedVolume(int voice) const { return automatedVolume_[voice]; }
+    float getAutomatedPan(int voice) const { return automatedPan_[voice]; }
+
+    // A Surge parameter change at a sample offset in the current block: a p-lock
+    // set just before its note starts, or restored when the note ends
+    struct ParameterEvent
+    {
+        int sampleOffset{0};
+        int voice{0};
+        int parameter{0};
+        float value{0.0f};
+    };
+
+    // This block's parameter events in sample order (audio thread, after process).
+    // The caller renders each voice up to an event, then applies it.
+    const std::vector<ParameterEvent> &getParameterEvents() const { return parameterEvents_; }
+    void applyParameterEvent(const ParameterEvent &event);
+
+    // Whether automation or a p-lock has moved any Surge parameter of voice since
+    // the last call, and the value it last set a parameter to (NaN if never)
+    bool takeAutomationApplied(int voice) { return automationApplied_[voice].exchange(false); }
+    float getAutomatedValue(int voice, int parameter) const;
+
+    // Replace a voice's MIDI effect chain (message thread)
+    void setMidiEffects(int voice, const MidiEffectChainSettings &settings)
+    {
+        midiEffects_[voice].setSettings(settings);
+    }
+
     // Called from audio thread - populates midiBuffers for each voice
     void process(int numSamples, double sampleRate,
                  std::array<juce::MidiBuffer *, NUM_VOICES> midiBuffers);
 
   private:
+    // Audio thread only - reads the compiled patterns
+    bool isSongActive() const;
+    double getLoopEndBeat() const;
+    std::array<bool, NUM_VOICES> getAudibleVoices() const;
+
+    void chaseNotesAt(double beat, std::array<juce::MidiBuffer *, NUM_VOICES> midiBuffers);
+    void applyAutomation(double beat);
+    void triggerSongNotes(double startBeat, double endBeat, int numSamples,
+                          std::array<juce::MidiBuffer *, NUM_VOICES> midiBuffers,
+                          int baseSampleOffset, const std::array<bool, NUM_VOICES> &audible);
+
     void triggerNotesInRange(double startBeat, double endBeat, int numSamples,
                              std::array<juce::MidiBuffer *, NUM_VOICES> midiBuffers,
                              int baseSampleOffset = 0);
+    // Schedule the locks of source.notes[noteIndex], held until endBeat
+    void lockNote(int voice, const CompiledPattern &source, size_t noteIndex, int samplePos,
+                  double endBeat);
+    void releaseAllLocks(int samplePos);
+    bool isLockHeld(int voice, int parameter) const;
+    float scheduledValue(int voice, int parameter) const;
+    void addParameterEvent(const ParameterEvent &event);
+
+    void triggerVoiceNotes(int voice, double fromBeat, double toBeat, double originBeat,
+                           int numSamples, juce::MidiBuffer &midiBuffer, int baseSampleOffset);
+
+    // Trig conditions - the pass a slot is on at a loop position, and whether a
+    // note plays on its pass
+    uint32_t slotPass(double beat, double patternLength) const;
+    bool trigPasses(const CompiledPattern::Note &note, uint32_t pass) const;
     void releaseNotesEndingInRange(double startBeat, double endBeat, int numSamples,
                                    std::array<juce::MidiBuffer *, NUM_VOICES> midiBuffers,
                                    int baseSampleOffset = 0);
 
     GrooveboxProject *project_{nullptr};
+    PatternBank *bank_{nullptr};
     std::array<SurgeSynthesizer *, NUM_VOICES> synths_{};
 
+    // Automation - Surge IDs resolved once per parameter index, and the value
+    // last sent to each, so unchanged values cost no setParameter01 call
+    std::vector<SurgeSynthesizer::ID> parameterIds_;
+    std::array<std::vector<std::atomic<float>>, NUM_VOICES> automatedValues_;
+    std::array<std::atomic<bool>, NUM_VOICES> automationApplied_{};
+    std::array<float, NUM_VOICES> automatedVolume_{};
+    std::array<float, NUM_VOICES> automatedPan_{};
+
     std::atomic<bool> playing_{false};
     std::atomic<double> currentBeat_{0.0};
+    std::atomic<double> seekTarget_{0.0};
+    std::atomic<bool> seekPending_{false};
+    std::atomic<bool> stopPending_{false};
+    std::atomic<bool> fill_{false};
+    std::atomic<bool> restartCycles_{false};
+    uint32_t loopCycle_{0}; // Loop wraps since play started - numbers trig passes
     double sampleRate_{44100.0};
     double beatsPerSample_{0.0};
     double blockStartBeat_{0.0};
+    double blockLoopEnd_{4.0};
+    double blockElapsedBeats_{0.0};
+    double elapsedBeats_{0.0};
     int numSamplesInBlock_{0};
 
     struct ActiveNote
@@ -85,6 +191,25 @@ class SequencerEngine
         double endBeat;
     };
     std::vector<ActiveNote> activeNotes_;
+
+    // P-locks of sounding notes, with the value each parameter goes back to.
+    // Overlapping notes locking the same parameter share one entry.
+    struct HeldLock
+    {
+        int voiceIndex;
+        int parameter;
+        float restoreValue;
+        double endBeat;
+    };
+    std::vector<HeldLock> heldLocks_;
+    std::vector<ParameterEvent> parameterEvents_;
+
+    // Run on each voice's notes once the block's events are generated
+    std::array<MidiEffectChain, NUM_VOICES> midiEffects_;
+
+    // Both are reserved up front; locks past these are dropped rather than allocated
+    static constexpr size_t MAX_HELD_LOCKS = 256;
+    static constexpr size_t MAX_PARAMETER_EVENTS = 512;
 };
 
 // ============================================================================
@@ -98,13 +223,24 @@ class SurgeBoxEngine
     SurgeBoxEngine();
     ~SurgeBoxEngine();
 
-    // Initialization - processors are injected from plugin layer
+    // Initialization - processors are injected from plugin layer. Hosts
+    // without the plugin wrapper (SURGEBOX_HEADLESS) inject bare synths,
+    // which the engine renders itself.
+#if !defined(SURGEBOX_HEADLESS)
     void setProcessors(std::array<SurgeSynthProcessor *, NUM_VOICES> processors);
+#endif
+    void setSynths(std::array<SurgeSynthesizer *, NUM_VOICES> synths);
     bool initialize(double sampleRate, int blockSize);
     void shutdown();
 
-    // Audio processing
-    void process(float *outputL, float *outputR, int numSamples);
+    // Audio processing. liveInput is the host MIDI of this block, captured for
+    // live recording (the plugin plays it on the active voice itself).
+    void process(float *outputL, float *outputR, int numSamples,
+                 const juce::MidiBuffer &liveInput);
+
+    // MIDI for one voice, played at sampleOffset into the next process() call
+    // alongside the sequencer. Same thread as process().
+    void queueVoiceInput(int voice, const juce::MidiMessage &message, int sampleOffset);
 
     // Voice management
     int getActiveVoice() const { return activeVoice_; }
@@ -118,11 +254,146 @@ class SurgeBoxEngine
     GrooveboxProject &getProject() { return project_; }
     const GrooveboxProject &getProject() const { return project_; }
 
-    // Pattern models (with undo support)
+    // Pattern models (with undo support) - one per voice and slot; without a slot,
+    // the voice's selected slot
     PatternModel *getPatternModel(int voice);
+    PatternModel *getPatternModel(int voice, int slot);
     PatternModel *getActivePatternModel() { return getPatternModel(activeVoice_); }
+
+    // Pattern slots. Selecting a slot edits it at once; while playing, playback
+    // follows at the next boundary (see PatternBank::SwitchMode).
+    int getPatternSlot(int voice) const;
+    void selectPatternSlot(int voice, int slot);
+    PatternBank &getPatternBank() { return patternBank_; }
+
+    // Global polyphony and CPU budgets, per-voice priorities and render-time
+    // telemetry
+    VoiceGovernor &getGovernor() { return governor_; }
+
+    // Degrades the governor's limits when blocks near their deadline
+    QualityController &getQualityController() { return quality_; }
+
+    // Message thread - off, render time neither steals voices nor lowers
+    // quality, so a render comes out the same however loaded the machine is
+    void setLoadAdaptive(bool adaptive)
+    {
+        governor_.setCpuBudgetEnabled(adaptive);
+        quality_.setEnabled(adaptive);
+    }
+    bool isLoadAdaptive() const { return quality_.isEnabled(); }
+
+    // Estimated render cost of each voice's instance, for capacity planning
+    const VoiceCostModel &getCostModel() const { return costModel_; }
+
+    // Worker threads rendering voices alongside the audio thread, 0 - render
+    // on the audio thread only
+    void setRenderThreads(int numWorkers) { renderScheduler_.setWorkers(numWorkers); }
+    int getRenderThreads() const { return renderScheduler_.getNumWorkers(); }
+
+    // Linux real-time operation: the audio thread (at its next block) and the
+    // render workers run SCHED_FIFO on the given cores, the process's memory is
+    // locked, and the engine's buffers, the Surge instances and the threads'
+    // stacks are faulted in. Steps the process lacks the privileges for are
+    // skipped - getRealtimeStatus() says which and why.
+    void setRealtime(const RealtimeSettings &settings);
+    const RealtimeSettings &getRealtimeSettings() const { return realtime_; }
+    RealtimeStatus getRealtimeStatus() const;
+
+    // Samples rendered per pass through the sequencer and voices, 0 - the
+    // host's whole block. Finer quanta time modulation more closely.
+    void setRenderQuantum(int samples) { renderQuantum_.store(std::max(0, samples)); }
+    int getRenderQuantum() const { return renderQuantum_.load(); }
+
+    // Out-of-process voices (Linux only): each voice renders in its own
+    // surgebox-voice-host process, pinned to firstCpu + voice when firstCpu >= 0.
+    // The local instances stay the editing model - their patches and parameter
+    // edits are mirrored to the hosts, and a host that dies is restarted.
+    // Returns false, with getOutOfProcessError() saying why, if a host could
+    // not be started; the voices then stay in process.
+    bool setOutOfProcessVoices(bool enabled, const fs::path &hostExecutable = {},
+                               int firstCpu = -1);
+    bool isOutOfProcess() const { return outOfProcess_.load(); }
+    const std::string &getOutOfProcessError() const { return outOfProcessError_; }
+
+    // Xrun flight recorder: the last blocks' MIDI, transport and render times
+    // are written to directory as JSON around each block that misses its
+    // deadline. An empty directory turns it off.
+    void setFlightRecorder(const fs::path &directory) { flightRecorder_.setDirectory(directory); }
+    const FlightRecorder &getFlightRecorder() const { return flightRecorder_; }
+
+    // Where this instance's memory goes: the Surge instances, pattern models
+    // and their undo steps, project data and engine buffers
+    MemoryReport getMemoryReport();
+
+    // The resident memory a voice's Surge instance took as it was created,
+    // measured by whoever created it, voice 1 first. Until then the instance is
+    // reported at sizeof(SurgeSynthesizer). Either way the figure is an estimate,
+    // and a meaningless one if anything else allocated meanwhile - e.g. engines
+    // constructed concurrently, as thread-mode batch renders do.
+    void setInstanceFootprint(int voice, int64_t bytes) { instanceFootprint_[voice] = bytes; }
+
+    // Hands the flight recorder a snapshot of the project when a capture is
+    // waiting for one. Called by tick(); hosts without a message thread call it
+    // between renders, never from inside one.
+    void serviceFlightRecorder();
+
+    // Round-trip overhead, late blocks and restarts of a voice's host
+    const RemoteVoice &getRemoteVoice(int voice) const { return *remoteVoices_[voice]; }
+
+    // Both at once, e.g. from RenderCalibration
+    void applyRenderSettings(const RenderSettings &settings)
+    {
+        setRenderThreads(settings.renderThreads);
+        setRenderQuantum(settings.renderQuantum);
+    }
+
+    // Song arrangement - played instead of the selected slots in song mode
+    void setSong(std::vector<SongSection> song);
+    void setSongMode(bool enabled);
+    bool isSongMode() const { return project_.songMode; }
+
+    // Project groove template, applied with swing as patterns are compiled. An
+    // empty template turns the groove off; a step length that isn't positive
+    // becomes a 16th.
+    void setGroove(GrooveTemplate groove);
+
+    // A voice's MIDI effect chain, between the sequencer and Surge
+    void setMidiEffects(int voice, const MidiEffectChainSettings &settings);
+
+    // Automation lanes of a pattern slot, replacing the lane with the same target.
+    // A lane without points is removed. One undo step.
+    void setAutomationLane(int voice, int slot, AutomationLane lane);
+
+    // P-lock a note of a pattern slot: target (a Surge parameter storage name)
+    // is set to value while the note plays. A NaN value removes the lock.
+    // Undoable - repeated edits of one lock coalesce into one step.
+    void setNoteLock(int voice, int slot, uint32_t noteId, const std::string &target,
+                     float value);
+
+    // While recording and playing, edits to the active voice's Surge parameters
+    // are written into its selected slot's lanes at the playhead. A take - until
+    // recording stops, playback stops or the voice changes - undoes in one step.
+    void setAutomationRecording(bool enabled);
+    bool isAutomationRecording() const { return automationRecording_; }
+
+    // Live recording: while armed and playing, notes played on the active voice
+    // are overdubbed into its selected slot, one undo step per loop pass
+    void setLiveRecording(bool enabled);
+    bool isLiveRecording() const { return recorder_.isArmed(); }
+    void setRecordQuantize(double grid) { recorder_.setQuantize(grid); } // Beats, 0 - off
+
+    // A note from the on-screen keyboard (velocity 0 - released), for recording
+    void recordKeyboardNote(int pitch, int velocity);
     juce::UndoManager &getUndoManager() { return undoManager_; }
 
+    // Project-wide undo - records any settled patch change first so it can be undone
+    bool undo();
+    bool redo();
+
+    // Patches are polled for undo steps only while something can undo them (an
+    // open editor); the journal and out-of-process voices poll regardless
+    void setPatchUndo(bool enabled);
+
     // Sync pattern models to/from project (for save/load)
     void syncPatternModelsFromProject();
     void syncPatternModelsToProject();
@@ -135,6 +406,9 @@ class SurgeBoxEngine
     void stop() { sequencer_.stop(); }
     bool isPlaying() const { return sequencer_.isPlaying(); }
     double getPlayheadBeats() const { return sequencer_.getPositionBeats(); }
+    void seek(double beat) { sequencer_.setPositionBeats(beat); }
+    void setFill(bool on) { sequencer_.setFill(on); }
+    bool isFill() const { return sequencer_.isFill(); }
 
     // Get currently playing notes for UI highlighting
     std::vector<uint8_t> getPlayingNotes(int voice) const { return sequencer_.getPlayingNotes(voice); }
@@ -146,25 +420,98 @@ class SurgeBoxEngine
     // Restore project state to all synths
     void restoreAllVoices();
 
+    // Mixer and global edits (undoable, journaled while autosave is active)
+    void setTempo(double bpm) { setGlobalValue(EditJournal::GlobalField::Tempo, bpm); }
+    void setGlobalValue(EditJournal::GlobalField field, double value);
+    void setMixerValue(int voice, EditJournal::MixerField field, float value);
+
+    // Crash-safe autosave - journal lives in directory until a clean stop
+    bool startAutosave(const fs::path &directory);
+    void stopAutosave(bool cleanShutdown = true);
+    bool isAutosaveActive() const { return journal_ != nullptr; }
+    bool recoverAutosave(const fs::path &directory);
+
+    // Message-thread housekeeping: tracks patch changes for undo and the journal,
+    // compacts the journal. Call it regularly whether or not an editor is open.
+    void tick();
+
     // Sample rate
     double getSampleRate() const { return sampleRate_; }
 
     // Callbacks for UI updates
     std::function<void(int)> onVoiceChanged;
+    std::function<void(int voice, int slot)> onPatternSlotChanged;
     std::function<void(double)> onPlayheadMoved;
 
+    // From tick(), once the audio thread has taken up a setRealtime() request
+    std::function<void(const RealtimeStatus &)> onRealtimeApplied;
+
   private:
-    void mixVoices(float *outputL, float *outputR, int numSamples);
+    void processQuantum(float *outputL, float *outputR, int numSamples,
+                        const juce::MidiBuffer &liveInput);
+    void mixVoices(float *outputL, float *outputR, int numSamples,
+                   const juce::MidiBuffer &liveInput);
+    void renderScheduledVoice(int voice);
+    void postRemoteVoice(int voice, int numSamples, const juce::MidiBuffer &liveInput);
+    void renderVoice(int voice, int numSamples);
+    void renderSegment(int voice, juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midi);
+
+    // Write a value without recording undo (used by the undo actions themselves)
+    void applyGlobalValue(EditJournal::GlobalField field, double value);
+    void applyMixerValue(int voice, EditJournal::MixerField field, float value);
+    double getGlobalValue(EditJournal::GlobalField field) const;
+    float getMixerValue(int voice, EditJournal::MixerField field) const;
+
+    // Recompile every slot in the background, e.g. after the swing or groove changed
+    void submitAllPatterns();
+
+    void pollPatches(bool flush);
+    void observePatches();
+    void updateRemoteVoices();
+    void syncRemotePatch(int voice, SurgeSynthesizer *synth, const void *data, size_t size);
+    bool sendRemotePatch(int voice);
+    void recordAutomation();
+    void flushRecordedLanes();
+    void finishAutomationTake(); // Record the take's lanes as one undo step
+    void captureLiveInput(const juce::MidiBuffer &liveInput);
+    void updateLiveRecording();
+    std::array<PatternModel *, NUM_VOICES> getRecordingModels(); // Pattern recorded into, by voice
+    void journalAutomationLane(int voice, int slot, const std::string &target);
+    void applyAutomationLane(int voice, int slot, const AutomationLane &lane);
+    void applyNoteLock(int voice, int slot, uint32_t noteId, const std::string &target,
+                       float value);
 
     // Processors are owned by plugin, we hold pointers
+#if !defined(SURGEBOX_HEADLESS)
     std::array<SurgeSynthProcessor *, NUM_VOICES> processors_{};
+#endif
+    std::array<SurgeSynthesizer *, NUM_VOICES> synths_{};
+
+    // Where each bare synth is in its current BLOCK_SIZE output
+    std::array<int, NUM_VOICES> synthBlockPos_{};
 
     GrooveboxProject project_;
     SequencerEngine sequencer_;
-    juce::UndoManager undoManager_;
-    std::array<std::unique_ptr<PatternModel>, NUM_VOICES> patternModels_;
 
-    int activeVoice_{0};
+    // Undo history is bounded by memory rather than step count: once stored
+    // transactions exceed the budget (in bytes), the oldest are evicted. Every
+    // action in it is one of ours, sizing itself in bytes - pattern edits never
+    // hand the UndoManager to ValueTree, whose actions count in other units.
+    static constexpr int UNDO_HISTORY_BUDGET_BYTES = 8 * 1024 * 1024;
+    static constexpr int UNDO_MIN_TRANSACTIONS = 1;
+    juce::UndoManager undoManager_{UNDO_HISTORY_BUDGET_BYTES, UNDO_MIN_TRANSACTIONS};
+    ProjectHistory history_{undoManager_};
+
+    // Compiled playback patterns - models submit every change to it
+    PatternBank patternBank_;
+    std::array<std::unique_ptr<PatternModel>, NUM_PATTERNS> patternModels_;
+
+    // Shares polyphony and CPU time between the instances
+    VoiceGovernor governor_;
+    QualityController quality_;
+    VoiceCostModel costModel_;
+
+    std::atomic<int> activeVoice_{0}; // Read by the audio thread's live recording
     double sampleRate_{44100.0};
     int blockSize_{32};
     bool initialized_{false};
@@ -173,14 +520,109 @@ class SurgeBoxEngine
     alignas(16) float mixBufferL_[4096];
     alignas(16) float mixBufferR_[4096];
 
-    // Pre-allocated buffer for voice processing (avoid allocations in audio thread)
-    std::unique_ptr<juce::AudioBuffer<float>> voiceBuffer_;
+    // Pre-allocated buffers for voice processing (avoid allocations in audio
+    // thread) - one per voice, as voices may render in parallel
+    std::array<std::unique_ptr<juce::AudioBuffer<float>>, NUM_VOICES> voiceBuffers_;
 
     // Pre-allocated MIDI buffers for each voice (avoid allocations in audio thread)
     std::array<juce::MidiBuffer, NUM_VOICES> voiceMidiBuffers_;
 
+    // A voice's MIDI for one stretch between parameter events
+    std::array<juce::MidiBuffer, NUM_VOICES> segmentMidiBuffers_;
+
+    // Renders the audible voices, longest first, across the render threads
+    VoiceRenderScheduler renderScheduler_{[this](int voice) { renderScheduledVoice(voice); }};
+    int renderNumSamples_{0};
+    juce::int64 renderStartTicks_{0};
+    std::atomic<int> renderQuantum_{0};
+
+    // Real-time mode. The audio thread applies a request when
+    // realtimeRequest_ moves past the one it last applied, then publishes its
+    // result through realtimeAudioState_.
+    enum RealtimeAudioState
+    {
+        REALTIME_AUDIO_NORMAL,
+        REALTIME_AUDIO_PENDING,
+        REALTIME_AUDIO_PROMOTED,
+        REALTIME_AUDIO_FAILED
+    };
+    void applyRealtimeOnAudioThread(int request);
+    RealtimeSettings realtime_;
+    std::atomic<int> realtimeRequest_{0};
+    int realtimeApplied_{0};
+    std::atomic<int> realtimeAudioPriority_{0}; // 0 - normal scheduling
+    std::atomic<int> realtimeAudioCpu_{-1};
+    std::atomic<int> realtimeAudioState_{REALTIME_AUDIO_NORMAL};
+    std::array<char, 256> realtimeAudioReason_{};
+    bool memoryLocked_{false};
+    std::string memoryLockReason_;
+    bool realtimeReportPending_{false};
+
+    // What each render worker made of it, written as the workers start
+    mutable std::mutex realtimeWorkersMutex_;
+    std::array<bool, VoiceRenderScheduler::MAX_WORKERS> realtimeWorkerPromoted_{};
+    std::string realtimeWorkerReason_;
+
+    // Captures the blocks around a deadline miss
+    FlightRecorder flightRecorder_;
+
+    std::array<int64_t, NUM_VOICES> instanceFootprint_{};
+
+    // Out-of-process voices. The audio thread renders remotely while
+    // outOfProcess_ is set; renderingRemote_ is its own view of it.
+    std::array<std::unique_ptr<RemoteVoice>, NUM_VOICES> remoteVoices_;
+    std::atomic<bool> outOfProcess_{false};
+    bool renderingRemote_{false};
+    std::array<bool, NUM_VOICES> remoteWasPlaying_{};
+    fs::path voiceHostExecutable_;
+    int voiceHostFirstCpu_{-1};
+    std::string outOfProcessError_;
+
+    // What each host was last sent: its parameters, and the patch blob's hash
+    // and name. remoteParamsMoved_ counts parameters sent since the last poll.
+    std::array<std::vector<float>, NUM_VOICES> remoteSnapshots_;
+    std::array<size_t, NUM_VOICES> remotePatchHashes_{};
+    std::array<std::string, NUM_VOICES> remotePatchNames_;
+    std::array<int, NUM_VOICES> remoteParamsMoved_{};
+
+    // Share of the block a host has to answer in before its voice plays silence
+    static constexpr double REMOTE_DEADLINE_FRACTION = 0.8;
+
+    // More parameters than this moving at once looks like a patch load
+    static constexpr int REMOTE_PATCH_LOAD_PARAMS = 16;
+
+    // The live input of one quantum, and where the quantum starts in the block
+    juce::MidiBuffer quantumLiveInput_;
+    int quantumOffset_{0};
+
+    // MIDI queued per voice for the next block
+    std::array<juce::MidiBuffer, NUM_VOICES> voiceInput_;
+
     // Block start position for syncing Surge's internal time
     double blockStartBeat_{0.0};
+
+    // Autosave journal
+    std::unique_ptr<EditJournal> journal_;
+
+    // Surge has no patch-changed notification, so patches are polled
+    juce::uint32 lastPatchPollMs_{0};
+    bool patchUndo_{false};
+    static constexpr juce::uint32 PATCH_POLL_INTERVAL_MS = 500;
+
+    // Live note recording
+    MidiRecorder recorder_;
+
+    // Automation recording - the recorded voice's parameters as last polled, the
+    // beat each parameter's take last wrote at, and each lane the take wrote to as
+    // it was before the take
+    bool automationRecording_{false};
+    int recordVoice_{-1};
+    std::vector<float> recordSnapshot_;
+    std::unordered_map<int, double> recordTake_;
+    std::vector<std::pair<int, std::string>> recordDirty_; // (pattern index, target)
+    std::vector<ProjectHistory::LaneEdit> recordLanes_;
+
+    std::string captureProjectImage();
 };
 
 } // namespace SurgeBox
@@ -0,0 +1,183 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "VoiceCostModel.h"
+#include "SurgeSynthesizer.h"
+
+#include <algorithm>
+
+namespace SurgeBox
+{
+
+namespace
+{
+
+// Relative cost of one unison voice of an oscillator type
+double oscillatorUnits(int type)
+{
+    switch (type)
+    {
+        case ot_audioinput: return 0.2;
+        case ot_wavetable:
+        case ot_window: return 1.5;
+        case ot_string:
+        case ot_twist: return 2.0;
+        default: return 1.0;
+    }
+}
+
+bool hasUnison(int type)
+{
+    switch (type)
+    {
+        case ot_classic:
+        case ot_sine:
+        case ot_wavetable:
+        case ot_shnoise:
+        case ot_window:
+        case ot_modern:
+        case ot_alias: return true;
+        default: return false;
+    }
+}
+
+void mixHash(uint64_t &hash, int value)
+{
+    // FNV-1a over the feature values
+    hash = (hash ^ static_cast<uint64_t>(static_cast<uint32_t>(value))) * 1099511628211ull;
+}
+
+} // namespace
+
+VoiceCostModel::VoiceCostModel()
+{
+    for (int v = 0; v < NUM_VOICES; ++v)
+    {
+        fixedUnits_[v].store(1.0);
+        perVoiceUnits_[v].store(1.0);
+        scale_[v].store(1.0);
+    }
+    ticksPerSecond_ = static_cast<double>(juce::Time::getHighResolutionTicksPerSecond());
+}
+
+VoiceCostModel::Seed VoiceCostModel::seedFromPatch(SurgeSynthesizer *synth)
+{
+    Seed seed;
+    seed.hash = 14695981039346656037ull;
+    auto &patch = synth->storage.getPatch();
+
+    std::array<double, n_scenes> sceneUnits{};
+    for (int sc = 0; sc < n_scenes; ++sc)
+    {
+        const auto &scene = patch.scene[sc];
+
+        // Envelopes, LFOs and the voice's own overhead
+        double units = 1.0;
+        for (int o = 0; o < n_oscs; ++o)
+        {
+            // Unison voices are the last parameter of every type that has them
+            const auto &osc = scene.osc[o];
+            int type = osc.type.val.i;
+            int unison = hasUnison(type) ? std::max(1, osc.p[n_osc_params - 1].val.i) : 1;
+            units += oscillatorUnits(type) * unison;
+            mixHash(seed.hash, type);
+            mixHash(seed.hash, unison);
+        }
+        for (int f = 0; f < n_filterunits_per_scene; ++f)
+        {
+            int type = scene.filterunit[f].type.val.i;
+            if (type != fut_none)
+                units += 0.5;
+            mixHash(seed.hash, type);
+        }
+        if (scene.wsunit.type.val.i != wst_none)
+            units += 0.3;
+        mixHash(seed.hash, scene.wsunit.type.val.i);
+        sceneUnits[static_cast<size_t>(sc)] = units;
+    }
+
+    // Surge voices of the inactive scene never start in single mode
+    int mode = patch.scenemode.val.i;
+    int active = patch.scene_active.val.i;
+    seed.perVoiceUnits = mode == sm_single ? sceneUnits[static_cast<size_t>(active)]
+                                           : (sceneUnits[0] + sceneUnits[1]) * 0.5;
+    mixHash(seed.hash, mode);
+    mixHash(seed.hash, active);
+
+    seed.fixedUnits = 1.0;
+    for (int slot = 0; slot < n_fx_slots; ++slot)
+    {
+        int type = patch.fx[slot].type.val.i;
+        if (type != fxt_off)
+            seed.fixedUnits += 3.0;
+        mixHash(seed.hash, type);
+    }
+    return seed;
+}
+
+void VoiceCostModel::observePatch(int voice, SurgeSynthesizer *synth)
+{
+    if (!synth)
+        return;
+
+    auto seed = seedFromPatch(synth);
+    if (seed.hash == patchHash_[voice])
+        return;
+    patchHash_[voice] = seed.hash;
+
+    fixedUnits_[voice].store(seed.fixedUnits);
+    perVoiceUnits_[voice].store(seed.perVoiceUnits);
+
+    // The machine's speed carries over from the voices already measured
+    double scale = 0.0;
+    int count = 0;
+    for (int v = 0; v < NUM_VOICES; ++v)
+    {
+        if (v != voice && measured_[v].load())
+        {
+            scale += scale_[v].load();
+            ++count;
+        }
+    }
+    scale_[voice].store(count > 0 ? scale / count : 1.0);
+    measured_[voice].store(false);
+}
+
+void VoiceCostModel::recordRender(int voice, int surgeVoices, int numSamples, juce::int64 ticks)
+{
+    if (numSamples <= 0)
+        return;
+
+    double units = fixedUnits_[voice].load() + perVoiceUnits_[voice].load() * surgeVoices;
+    double observed = static_cast<double>(ticks) / ticksPerSecond_ / numSamples;
+    double ratio = observed / (units * UNIT_SECONDS);
+
+    double scale = scale_[voice].load();
+    scale_[voice].store(measured_[voice].load() ? scale + SCALE_SMOOTHING * (ratio - scale)
+                                                : ratio);
+    measured_[voice].store(true);
+}
+
+double VoiceCostModel::predictTicks(int voice, int surgeVoices, int numSamples) const
+{
+    return estimateLoad(voice, surgeVoices, 1.0) * numSamples * ticksPerSecond_;
+}
+
+VoiceCostModel::Estimate VoiceCostModel::getEstimate(int voice) const
+{
+    double unit = scale_[voice].load() * UNIT_SECONDS;
+    return {fixedUnits_[voice].load() * unit, perVoiceUnits_[voice].load() * unit};
+}
+
+double VoiceCostModel::estimateLoad(int voice, int surgeVoices, double sampleRate) const
+{
+    auto estimate = getEstimate(voice);
+    return (estimate.fixedSeconds + estimate.perVoiceSeconds * surgeVoices) * sampleRate;
+}
+
+} // namespace SurgeBox
@@ -0,0 +1,88 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include "GrooveboxProject.h"
+#include <juce_core/juce_core.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+class SurgeSynthesizer;
+
+namespace SurgeBox
+{
+
+/**
+ * Estimates what each voice's Surge instance costs to render.
+ *
+ * An instance's cost per sample is modelled as a fixed part (its FX) plus a
+ * part per sounding Surge voice (oscillators, unison, filters, waveshaper).
+ * Both are seeded from the patch - whenever the patch's features change, so
+ * however the patch was loaded - in units of a plain single-oscillator voice.
+ * Measured render times then fit a per-voice scale to the seeded units, so the
+ * estimate tracks the machine and what the features don't capture.
+ *
+ * observePatch() runs on the message thread whenever the engine looks for
+ * patch changes, not per block. recordRender() runs on the audio thread
+ * (possibly on a render worker, one voice per thread). Estimates are readable
+ * from any thread, e.g. for capacity planning.
+ */
+class VoiceCostModel
+{
+  public:
+    // Seconds of CPU time per sample rendered
+    struct Estimate
+    {
+        double fixedSeconds{0.0};
+        double perVoiceSeconds{0.0};
+    };
+
+    VoiceCostModel();
+
+    // Message thread
+    void observePatch(int voice, SurgeSynthesizer *synth);
+
+    // Audio thread
+    void recordRender(int voice, int surgeVoices, int numSamples, juce::int64 ticks);
+    double predictTicks(int voice, int surgeVoices, int numSamples) const;
+
+    // Any thread
+    Estimate getEstimate(int voice) const;
+
+    // Any thread - CPU seconds per second of audio, e.g. 0.25 for a quarter
+    // of a core, for the voice's instance playing surgeVoices voices
+    double estimateLoad(int voice, int surgeVoices, double sampleRate) const;
+
+  private:
+    // Seconds per sample of the reference voice before any measurement
+    static constexpr double UNIT_SECONDS = 100e-9;
+    static constexpr double SCALE_SMOOTHING = 0.05;
+
+    struct Seed
+    {
+        double fixedUnits{0.0};
+        double perVoiceUnits{0.0};
+        uint64_t hash{0};
+    };
+
+    static Seed seedFromPatch(SurgeSynthesizer *synth);
+
+    std::array<std::atomic<double>, NUM_VOICES> fixedUnits_;
+    std::array<std::atomic<double>, NUM_VOICES> perVoiceUnits_;
+    std::array<std::atomic<double>, NUM_VOICES> scale_; // Measured / seeded
+    std::array<std::atomic<bool>, NUM_VOICES> measured_{};
+    std::array<uint64_t, NUM_VOICES> patchHash_{}; // Message thread
+    double ticksPerSecond_{1.0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VoiceCostModel)
+};
+
+} // namespace SurgeBox
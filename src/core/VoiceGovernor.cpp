@@ -0,0 +1,190 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "VoiceGovernor.h"
+#include "SurgeSynthesizer.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace SurgeBox
+{
+
+VoiceGovernor::VoiceGovernor()
+{
+    static_assert(MAX_CANDIDATES >= NUM_VOICES * n_scenes * MAX_VOICES,
+                  "Every Surge voice must fit in the candidate table");
+
+    for (auto &priority : priority_)
+        priority.store(1);
+    for (auto &load : voiceLoad_)
+        load.store(0.0f);
+    for (auto &active : activeVoices_)
+        active.store(0);
+}
+
+void VoiceGovernor::setCpuBudget(float fraction)
+{
+    cpuBudget_.store(std::clamp(fraction, 0.0f, 1.0f));
+}
+
+void VoiceGovernor::setPriority(int voice, int priority)
+{
+    if (voice >= 0 && voice < NUM_VOICES)
+        priority_[voice].store(std::clamp(priority, MIN_PRIORITY, MAX_PRIORITY));
+}
+
+void VoiceGovernor::prepare(double sampleRate)
+{
+    ticksPerSample_ =
+        static_cast<double>(juce::Time::getHighResolutionTicksPerSecond()) / sampleRate;
+    costPerVoice_.fill(0.0);
+    fixedCost_.fill(0.0);
+}
+
+void VoiceGovernor::setLimits(float voiceBudgetScale, int instanceVoiceCap, float tailFloor)
+{
+    voiceBudgetScale_ = std::clamp(voiceBudgetScale, 0.0f, 1.0f);
+    instanceVoiceCap_ = std::max(0, instanceVoiceCap);
+    tailFloor_ = std::max(0.0f, tailFloor);
+}
+
+int VoiceGovernor::collect(const std::array<SurgeSynthesizer *, NUM_VOICES> &synths)
+{
+    int count = 0;
+    active_.fill(0);
+
+    for (int v = 0; v < NUM_VOICES; ++v)
+    {
+        auto *synth = synths[v];
+        if (!synth)
+            continue;
+
+        int priority = priority_[v].load();
+        for (int scene = 0; scene < n_scenes; ++scene)
+        {
+            for (auto *voice : synth->voices[scene])
+            {
+                // Already on its way out
+                if (voice->state.uberrelease)
+                    continue;
+
+                ++active_[v];
+                candidates_[static_cast<size_t>(count++)] = {
+                    voice, v, priority, !voice->state.gate, voice->ampEGSource.get_output(0),
+                    voice->age};
+            }
+        }
+    }
+    return count;
+}
+
+void VoiceGovernor::govern(const std::array<SurgeSynthesizer *, NUM_VOICES> &synths,
+                           int numSamples)
+{
+    blockTicks_ = ticksPerSample_ * numSamples;
+    int count = collect(synths);
+
+    int total = 0;
+    double fixed = 0.0;
+    double predicted = 0.0;
+    for (int v = 0; v < NUM_VOICES; ++v)
+    {
+        total += active_[v];
+        fixed += fixedCost_[v];
+        predicted += fixedCost_[v] + costPerVoice_[v] * active_[v];
+    }
+
+    int voiceBudget = std::max(1, static_cast<int>(voiceBudget_.load() * voiceBudgetScale_));
+    float cpuBudget = cpuBudgetEnabled_.load() ? cpuBudget_.load() : 0.0f;
+    double cpuTicks = cpuBudget > 0.0f ? cpuBudget * blockTicks_
+                                       : std::numeric_limits<double>::infinity();
+
+    // Out of reach by releasing voices - the effects alone take the budget
+    if (fixed >= cpuTicks)
+        cpuTicks = std::numeric_limits<double>::infinity();
+
+    bool overCap = false;
+    if (instanceVoiceCap_ > 0)
+    {
+        for (int active : active_)
+            overCap = overCap || active > instanceVoiceCap_;
+    }
+
+    if (total > voiceBudget || predicted > cpuTicks || overCap || tailFloor_ > 0.0f)
+    {
+        // Cheapest to lose first - only sorted when something may have to go
+        std::sort(candidates_.begin(), candidates_.begin() + count,
+                  [](const Candidate &a, const Candidate &b) {
+                      if (a.priority != b.priority)
+                          return a.priority < b.priority;
+                      if (a.released != b.released)
+                          return a.released;
+                      if (a.level != b.level)
+                          return a.level < b.level;
+                      return a.age > b.age;
+                  });
+
+        for (int i = 0; i < count; ++i)
+        {
+            const auto &victim = candidates_[static_cast<size_t>(i)];
+            bool overBudget = total > voiceBudget || predicted > cpuTicks;
+            bool overInstanceCap =
+                instanceVoiceCap_ > 0 && active_[victim.instance] > instanceVoiceCap_;
+            bool quietTail = victim.released && victim.level < tailFloor_;
+            if (!overBudget && !overInstanceCap && !quietTail)
+                continue;
+
+            victim.voice->uberrelease();
+            --active_[victim.instance];
+            --total;
+            predicted -= costPerVoice_[victim.instance];
+            stolenVoices_.fetch_add(1);
+        }
+    }
+
+    for (int v = 0; v < NUM_VOICES; ++v)
+        activeVoices_[v].store(active_[v]);
+}
+
+void VoiceGovernor::recordRender(int voice, juce::int64 ticks)
+{
+    if (blockTicks_ <= 0.0)
+        return;
+
+    voiceLoad_[voice].store(static_cast<float>(ticks / blockTicks_));
+
+    // A render with no voices measures the instance's fixed cost, and lets the
+    // per-voice cost decay - otherwise one slow block could price every voice
+    // of the instance out of the budget until the next prepare()
+    double &cost = costPerVoice_[voice];
+    double &fixed = fixedCost_[voice];
+    if (active_[voice] == 0)
+    {
+        fixed += 0.05 * (static_cast<double>(ticks) - fixed);
+        cost -= 0.05 * cost;
+        return;
+    }
+
+    // The rest is the voices'. Rises at once, falls slowly.
+    double perVoice = std::max(0.0, static_cast<double>(ticks) - fixed) / active_[voice];
+    cost = perVoice > cost ? perVoice : cost + 0.05 * (perVoice - cost);
+}
+
+void VoiceGovernor::endBlock(juce::int64 ticks)
+{
+    if (blockTicks_ <= 0.0)
+        return;
+
+    float load = static_cast<float>(ticks / blockTicks_);
+    blockLoad_.store(load);
+    if (load > peakBlockLoad_.load())
+        peakBlockLoad_.store(load);
+}
+
+} // namespace SurgeBox
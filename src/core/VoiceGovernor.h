@@ -0,0 +1,132 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include "GrooveboxProject.h"
+#include <juce_core/juce_core.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+class SurgeSynthesizer;
+class SurgeVoice;
+
+namespace SurgeBox
+{
+
+/**
+ * Keeps the four Surge instances inside one polyphony and CPU budget.
+ *
+ * Each instance runs its own polyphony, so four pads with long releases can
+ * take far more than a buffer's worth of time. Before the voices render, the
+ * governor counts the Surge voices sounding across all instances and predicts
+ * the block's cost from each instance's measured fixed cost (its effects) and
+ * cost per voice. While either budget is exceeded it fast-releases one voice,
+ * taken from the instance of lowest priority: released notes before held ones,
+ * then the quietest, then the oldest. What an instance keeps is, in effect,
+ * its polyphony cap for the block. Releasing voices only saves their part of
+ * the cost, so when the fixed costs alone are over the CPU budget no voice is
+ * released for it - that would silence everything and still miss the budget.
+ *
+ * Notes started inside a block are governed at the next one, so a block can
+ * overshoot by that block's note-ons at most.
+ *
+ * Under CPU pressure the quality controller tightens the limits further
+ * (see setLimits()).
+ *
+ * Budgets and priorities are set from the message thread; everything else runs
+ * on the audio thread. Telemetry is readable from any thread.
+ */
+class VoiceGovernor
+{
+  public:
+    static constexpr int MIN_PRIORITY = 0;
+    static constexpr int MAX_PRIORITY = 3;
+
+    VoiceGovernor();
+
+    // Message thread
+    void setVoiceBudget(int voices) { voiceBudget_.store(std::max(1, voices)); }
+    int getVoiceBudget() const { return voiceBudget_.load(); }
+    void setCpuBudget(float fraction); // Of the block's duration, 0 - no CPU budget
+    float getCpuBudget() const { return cpuBudget_.load(); }
+
+    // Off, only the voice budget applies - no voice is lost to how long the
+    // machine took to render, so output doesn't depend on load (offline renders)
+    void setCpuBudgetEnabled(bool enabled) { cpuBudgetEnabled_.store(enabled); }
+    bool isCpuBudgetEnabled() const { return cpuBudgetEnabled_.load(); }
+    void setPriority(int voice, int priority); // Higher keeps its notes longer
+    int getPriority(int voice) const { return priority_[voice].load(); }
+
+    // Audio thread
+    void prepare(double sampleRate);
+    void govern(const std::array<SurgeSynthesizer *, NUM_VOICES> &synths, int numSamples);
+    void recordRender(int voice, juce::int64 ticks);
+    void endBlock(juce::int64 ticks);
+
+    // Audio thread - tighter limits for degraded quality: a fraction of the
+    // voice budget, a cap on each instance's voices (0 - none) and a level
+    // under which released voices are stopped
+    void setLimits(float voiceBudgetScale, int instanceVoiceCap, float tailFloor);
+
+    // Any thread - the last block's render time of a voice and of the whole
+    // block, as a fraction of the block's duration; Surge voices sounding; and
+    // voices released by the governor since the start
+    float getVoiceLoad(int voice) const { return voiceLoad_[voice].load(); }
+    float getBlockLoad() const { return blockLoad_.load(); }
+    float getPeakBlockLoad() const { return peakBlockLoad_.load(); }
+    int getActiveVoices(int voice) const { return activeVoices_[voice].load(); }
+    uint32_t getStolenVoices() const { return stolenVoices_.load(); }
+    void resetPeak() { peakBlockLoad_.store(0.0f); }
+
+  private:
+    // Room for every voice of every scene of every instance
+    static constexpr int MAX_CANDIDATES = NUM_VOICES * 2 * 64;
+
+    struct Candidate
+    {
+        SurgeVoice *voice{nullptr};
+        int instance{0};
+        int priority{0};
+        bool released{false};
+        float level{0.0f};
+        int age{0};
+    };
+
+    int collect(const std::array<SurgeSynthesizer *, NUM_VOICES> &synths);
+
+    std::atomic<int> voiceBudget_{64};
+    std::atomic<float> cpuBudget_{0.7f};
+    std::atomic<bool> cpuBudgetEnabled_{true};
+    std::array<std::atomic<int>, NUM_VOICES> priority_;
+
+    // Audio thread
+    double ticksPerSample_{0.0};
+    double blockTicks_{0.0};
+    float voiceBudgetScale_{1.0f};
+    int instanceVoiceCap_{0};
+    float tailFloor_{0.0f};
+    std::array<double, NUM_VOICES> costPerVoice_{}; // Smoothed ticks per Surge voice
+    std::array<double, NUM_VOICES> fixedCost_{};    // Smoothed ticks with no voices (FX)
+    std::array<int, NUM_VOICES> active_{};          // Voices sounding this block
+    std::array<Candidate, MAX_CANDIDATES> candidates_{};
+
+    // Telemetry
+    std::array<std::atomic<float>, NUM_VOICES> voiceLoad_;
+    std::array<std::atomic<int>, NUM_VOICES> activeVoices_;
+    std::atomic<float> blockLoad_{0.0f};
+    std::atomic<float> peakBlockLoad_{0.0f};
+    std::atomic<uint32_t> stolenVoices_{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VoiceGovernor)
+};
+
+} // namespace SurgeBox
@@ -0,0 +1,166 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+// Shared-memory layout between the engine and surgebox-voice-host. Included by
+// both, so it depends on nothing but the standard library and Linux.
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace SurgeBox
+{
+namespace VoiceHost
+{
+
+static constexpr uint32_t MAGIC = 0x48564253; // "SBVH"
+static constexpr uint32_t VERSION = 1;
+
+static constexpr int MAX_BLOCK_SAMPLES = 4096;
+static constexpr int MAX_BLOCK_EVENTS = 1024;
+static constexpr uint32_t CONTROL_CAPACITY = 4096; // Power of two
+static constexpr size_t MAX_PATCH_BYTES = 8 * 1024 * 1024;
+
+enum class EventType : uint8_t
+{
+    NoteOn,
+    NoteOff,
+    PitchBend,   // value - -1 to 1
+    Controller,  // pitch - controller number, velocity - value
+    Parameter,   // parameter - Surge parameter index, value - 0 to 1
+    AllNotesOff,
+};
+
+struct Event
+{
+    int32_t sampleOffset{0};
+    EventType type{EventType::NoteOn};
+    uint8_t channel{0};
+    uint8_t pitch{0};
+    uint8_t velocity{0};
+    int32_t parameter{0};
+    float value{0.0f};
+};
+
+// Single producer, single consumer, in shared memory
+template <typename T, uint32_t Capacity> struct Ring
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    std::atomic<uint32_t> head{0}; // Consumer
+    std::atomic<uint32_t> tail{0}; // Producer
+    T items[Capacity];
+
+    bool push(const T &item)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity)
+            return false;
+        items[t & (Capacity - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        item = items[h & (Capacity - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "Futex words must be plain words");
+
+/**
+ * One voice's channel to its host process.
+ *
+ * Blocks run in lockstep: the engine fills the block fields and bumps request;
+ * the host renders, fills the response fields and sets response to the same
+ * value. Both are futex words. The engine only posts a block once the previous
+ * response has arrived, so neither side ever reads fields the other is
+ * writing. The control ring carries parameter changes from the engine's
+ * message thread at any time; a patch is swapped in between blocks when its
+ * serial moves.
+ */
+struct Shared
+{
+    uint32_t magic{MAGIC};
+    uint32_t version{VERSION};
+    double sampleRate{44100.0};
+
+    std::atomic<uint32_t> hostReady{0};
+    std::atomic<uint32_t> shutdown{0};
+    std::atomic<uint32_t> request{0};
+    std::atomic<uint32_t> response{0};
+
+    // Block - written by the engine before request
+    int32_t numSamples{0};
+    double tempo{120.0};
+    double ppqPos{0.0};
+    int32_t numEvents{0};
+    uint64_t postedNanos{0};
+    Event events[MAX_BLOCK_EVENTS];
+
+    // Response - written by the host before response
+    float audio[2][MAX_BLOCK_SAMPLES];
+    uint64_t receivedNanos{0};
+    uint64_t doneNanos{0};
+    int32_t activeVoices{0};
+
+    // Control - parameter changes outside blocks
+    Ring<Event, CONTROL_CAPACITY> control;
+
+    // Patch - the engine writes it while patchSerial == patchLoaded, then bumps
+    // patchSerial
+    std::atomic<uint32_t> patchSerial{0};
+    std::atomic<uint32_t> patchLoaded{0};
+    uint32_t patchSize{0};
+    char patch[MAX_PATCH_BYTES];
+};
+
+#if defined(__linux__)
+
+inline uint64_t monotonicNanos()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Shared between processes, so not FUTEX_PRIVATE
+inline void futexWait(std::atomic<uint32_t> &word, uint32_t expected, int64_t timeoutNanos)
+{
+    timespec timeout{static_cast<time_t>(timeoutNanos / 1000000000),
+                     static_cast<long>(timeoutNanos % 1000000000)};
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, expected, &timeout,
+            nullptr, 0);
+}
+
+inline void futexWake(std::atomic<uint32_t> &word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, INT_MAX, nullptr,
+            nullptr, 0);
+}
+
+#endif
+
+} // namespace VoiceHost
+} // namespace SurgeBox
@@ -0,0 +1,165 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "VoiceRenderScheduler.h"
+
+#include <algorithm>
+
+namespace SurgeBox
+{
+
+VoiceRenderScheduler::VoiceRenderScheduler(RenderFunction render) : render_(std::move(render))
+{
+    for (auto &thread : lastThread_)
+        thread.store(-1);
+}
+
+VoiceRenderScheduler::~VoiceRenderScheduler()
+{
+    const juce::SpinLock::ScopedLockType lock(workersLock_);
+    stopWorkers();
+}
+
+void VoiceRenderScheduler::setWorkers(int numWorkers)
+{
+    numWorkers = std::clamp(numWorkers, 0, MAX_WORKERS);
+
+    const juce::SpinLock::ScopedLockType lock(workersLock_);
+    if (numWorkers == static_cast<int>(workers_.size()))
+        return;
+
+    stopWorkers();
+    stopRequested_.store(false);
+    for (int i = 0; i < numWorkers; ++i)
+        workers_.push_back(std::make_unique<Worker>());
+    for (int i = 0; i < numWorkers; ++i)
+        workers_[static_cast<size_t>(i)]->thread = std::thread([this, i] { workerLoop(i); });
+    numWorkers_.store(numWorkers);
+}
+
+void VoiceRenderScheduler::setWorkerStart(WorkerStartFunction start)
+{
+    const std::lock_guard<std::mutex> lock(workerStartMutex_);
+    workerStart_ = std::move(start);
+}
+
+void VoiceRenderScheduler::restartWorkers()
+{
+    int numWorkers = numWorkers_.load();
+    setWorkers(0);
+    setWorkers(numWorkers);
+}
+
+void VoiceRenderScheduler::stopWorkers()
+{
+    stopRequested_.store(true);
+    for (auto &worker : workers_)
+    {
+        worker->ticket.fetch_add(1);
+        worker->ticket.notify_one();
+    }
+    for (auto &worker : workers_)
+    {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+    workers_.clear();
+    numWorkers_.store(0);
+}
+
+void VoiceRenderScheduler::render(const std::array<double, NUM_VOICES> &costs)
+{
+    const juce::SpinLock::ScopedTryLockType lock(workersLock_);
+    int numBins = lock.isLocked() ? static_cast<int>(workers_.size()) + 1 : 1;
+
+    // Longest first
+    std::array<int, NUM_VOICES> order{};
+    int numVoices = 0;
+    for (int v = 0; v < NUM_VOICES; ++v)
+    {
+        lastThread_[v].store(-1);
+        if (costs[v] >= 0.0)
+            order[static_cast<size_t>(numVoices++)] = v;
+    }
+    std::sort(order.begin(), order.begin() + numVoices,
+              [&costs](int a, int b) { return costs[a] > costs[b]; });
+
+    for (int b = 0; b < numBins; ++b)
+        bins_[static_cast<size_t>(b)] = {};
+
+    // Each to the least loaded thread - ties go to the audio thread, which
+    // needs no wakeup
+    for (int i = 0; i < numVoices; ++i)
+    {
+        int voice = order[static_cast<size_t>(i)];
+        auto lightest =
+            std::min_element(bins_.begin(), bins_.begin() + numBins,
+                             [](const Bin &a, const Bin &b) { return a.cost < b.cost; });
+        lightest->voices[static_cast<size_t>(lightest->count++)] = voice;
+        lightest->cost += costs[voice];
+        lastThread_[voice].store(static_cast<int>(lightest - bins_.begin()));
+    }
+
+    int busy = 0;
+    for (int b = 1; b < numBins; ++b)
+        busy += bins_[static_cast<size_t>(b)].count > 0 ? 1 : 0;
+    remaining_.store(busy);
+
+    for (int b = 1; b < numBins; ++b)
+    {
+        if (bins_[static_cast<size_t>(b)].count == 0)
+            continue;
+        auto &worker = *workers_[static_cast<size_t>(b - 1)];
+        worker.ticket.fetch_add(1);
+        worker.ticket.notify_one();
+    }
+
+    renderBin(0);
+
+    // The workers are normally done or nearly so - spin briefly before sleeping
+    for (int spin = 0; spin < 1000 && remaining_.load() > 0; ++spin)
+        std::this_thread::yield();
+    for (int left = remaining_.load(); left > 0; left = remaining_.load())
+        remaining_.wait(left);
+}
+
+void VoiceRenderScheduler::renderBin(int index)
+{
+    const auto &bin = bins_[static_cast<size_t>(index)];
+    for (int i = 0; i < bin.count; ++i)
+        render_(bin.voices[static_cast<size_t>(i)]);
+}
+
+void VoiceRenderScheduler::workerLoop(int index)
+{
+    // Tickets start at 0 and no block is rendered before every worker exists
+    auto &worker = *workers_[static_cast<size_t>(index)];
+    uint32_t done = 0;
+
+    WorkerStartFunction start;
+    {
+        const std::lock_guard<std::mutex> lock(workerStartMutex_);
+        start = workerStart_;
+    }
+    if (start)
+        start(index);
+
+    while (true)
+    {
+        worker.ticket.wait(done);
+        done = worker.ticket.load();
+        if (stopRequested_.load())
+            return;
+
+        renderBin(index + 1);
+        if (remaining_.fetch_sub(1) == 1)
+            remaining_.notify_one();
+    }
+}
+
+} // namespace SurgeBox
@@ -0,0 +1,110 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include "GrooveboxProject.h"
+#include <juce_core/juce_core.h>
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SurgeBox
+{
+
+/**
+ * Renders the voices of a block on the audio thread plus a few workers.
+ *
+ * The block's voices are packed longest-first: in order of predicted cost,
+ * each goes to the thread with the least work so far. The heaviest voices
+ * start at once and the light ones fill in around them - two light voices
+ * often share a thread. The audio thread takes a share itself and waits for
+ * the workers to finish theirs.
+ *
+ * Workers sleep on a futex-backed atomic between blocks; waking one never
+ * blocks the audio thread. With no workers every voice renders on the audio
+ * thread, in cost order.
+ */
+class VoiceRenderScheduler
+{
+  public:
+    static constexpr int MAX_WORKERS = NUM_VOICES - 1;
+
+    using RenderFunction = std::function<void(int voice)>;
+    using WorkerStartFunction = std::function<void(int worker)>;
+
+    // render is called on the audio thread and the workers, never for the
+    // same voice at once
+    explicit VoiceRenderScheduler(RenderFunction render);
+    ~VoiceRenderScheduler();
+
+    // Message thread - replaces the workers; a block being rendered finishes
+    // first
+    void setWorkers(int numWorkers);
+    int getNumWorkers() const { return numWorkers_.load(); }
+
+    // Message thread - run first on each worker thread, e.g. to set its
+    // scheduling. Takes effect for the workers started next; restartWorkers()
+    // starts them again at once.
+    void setWorkerStart(WorkerStartFunction start);
+    void restartWorkers();
+
+    // Audio thread - render every voice with a cost of 0 or more
+    void render(const std::array<double, NUM_VOICES> &costs);
+
+    // Any thread - the thread each voice rendered on last block, -1 if it did
+    // not render (0 - the audio thread)
+    int getLastThread(int voice) const { return lastThread_[voice].load(); }
+
+  private:
+    struct Bin
+    {
+        std::array<int, NUM_VOICES> voices{};
+        int count{0};
+        double cost{0.0};
+    };
+
+    struct alignas(64) Worker
+    {
+        std::atomic<uint32_t> ticket{0}; // Bumped for each block with work for it
+        std::thread thread;
+    };
+
+    void stopWorkers();
+    void workerLoop(int index);
+    void renderBin(int index);
+
+    RenderFunction render_;
+
+    // Its own lock - workers read it as they start, while setWorkers() may
+    // hold workersLock_ waiting for them
+    std::mutex workerStartMutex_;
+    WorkerStartFunction workerStart_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<int> numWorkers_{0};
+    std::atomic<bool> stopRequested_{false};
+
+    // Audio thread - written before the workers' tickets are bumped
+    std::array<Bin, MAX_WORKERS + 1> bins_{};
+    std::atomic<int> remaining_{0};
+
+    // Held by the audio thread while it renders - it renders alone if the
+    // message thread holds it
+    juce::SpinLock workersLock_;
+
+    std::array<std::atomic<int>, NUM_VOICES> lastThread_{};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VoiceRenderScheduler)
+};
+
+} // namespace SurgeBox
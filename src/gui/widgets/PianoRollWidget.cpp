@@ -25,7 +25,7 @@ PianoRollWidget::PianoRollWidget()
 PianoRollWidget::~PianoRollWidget()
 {
     if (patternModel_)
-        patternModel_->onPatternChanged = nullptr;
+        patternModel_->onNotesChanged = nullptr;
 }
 
 void PianoRollWidget::setEngine(SurgeBoxEngine *engine)
@@ -50,27 +50,101 @@ void PianoRollWidget::setEngine(SurgeBoxEngine *engine)
 
 void PianoRollWidget::setPatternModel(PatternModel *model)
 {
+    // Don't leave a drag half-recorded on the previous voice
+    if (patternModel_ && patternModel_ != model)
+    {
+        patternModel_->endGesture();
+        patternModel_->onNotesChanged = nullptr;
+    }
+
     patternModel_ = model;
 
     if (patternModel_)
     {
-        patternModel_->onPatternChanged = [this]() {
-            std::set<int> validSelection;
-            for (int idx : selectedNotes_)
-            {
-                if (idx < patternModel_->getNumNotes())
-                    validSelection.insert(idx);
-            }
-            selectedNotes_ = validSelection;
-            repaint();
+        patternModel_->onNotesChanged = [this](const PatternModel::NoteChanges &changes) {
+            // IDs survive re-sorting, so only deleted notes leave the selection
+            for (auto id : changes.removed)
+                selectedNotes_.erase(id);
+            repaintNotes(changes);
         };
     }
 
     selectedNotes_.clear();
-    draggingNoteIndex_ = -1;
+    paintedBoundsDirty_ = true;
+    draggingNoteId_ = 0;
     repaint();
 }
 
+void PianoRollWidget::repaintNotes(const PatternModel::NoteChanges &changes)
+{
+    size_t numChanged = changes.added.size() + changes.removed.size() + changes.modified.size();
+    if (changes.patternChanged || numChanged > MAX_INCREMENTAL_REPAINT || paintedBoundsDirty_)
+    {
+        paintedBoundsDirty_ = true;
+        repaint();
+        return;
+    }
+
+    // Where the note was, and where it is now
+    auto repaintNote = [&](uint32_t id) {
+        if (auto it = paintedBounds_.find(id); it != paintedBounds_.end())
+        {
+            repaint(it->second.expanded(1));
+            paintedBounds_.erase(it);
+        }
+
+        int index = patternModel_->indexOfNote(id);
+        if (index < 0)
+            return;
+        auto bounds = noteToScreen(index, paintedArea_);
+        paintedBounds_[id] = bounds;
+        tallestNote_ = std::max(tallestNote_, bounds.getHeight());
+        repaint(bounds.expanded(1));
+    };
+
+    for (auto id : changes.added)
+        repaintNote(id);
+    for (auto id : changes.removed)
+        repaintNote(id);
+    for (auto id : changes.modified)
+        repaintNote(id);
+}
+
+void PianoRollWidget::updatePaintedBounds(const juce::Rectangle<int> &area)
+{
+    if (!paintedBoundsDirty_ && area == paintedArea_ && pixelsPerBeat_ == paintedPixelsPerBeat_)
+        return;
+
+    paintedBoundsDirty_ = false;
+    paintedArea_ = area;
+    paintedPixelsPerBeat_ = pixelsPerBeat_;
+    tallestNote_ = 0;
+    paintedBounds_.clear();
+    for (int i = 0; i < patternModel_->getNumNotes(); ++i)
+    {
+        auto bounds = noteToScreen(i, area);
+        paintedBounds_[patternModel_->getNoteId(i)] = bounds;
+        tallestNote_ = std::max(tallestNote_, bounds.getHeight());
+    }
+}
+
+int PianoRollWidget::firstNoteBelow(int y) const
+{
+    // Notes are sorted by start, so their tops only go down
+    int low = 0;
+    int high = patternModel_->getNumNotes();
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+        auto it = paintedBounds_.find(patternModel_->getNoteId(mid));
+        if (it != paintedBounds_.end() && it->second.getY() < y)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
 void PianoRollWidget::setStepRecordEnabled(bool enabled)
 {
     stepRecordEnabled_ = enabled;
@@ -111,7 +185,14 @@ void PianoRollWidget::selectAll()
 
     selectedNotes_.clear();
     for (int i = 0; i < patternModel_->getNumNotes(); ++i)
-        selectedNotes_.insert(i);
+        selectedNotes_.insert(patternModel_->getNoteId(i));
+    repaint();
+}
+
+void PianoRollWidget::selectNotes(const std::vector<uint32_t> &noteIds)
+{
+    selectedNotes_.clear();
+    selectedNotes_.insert(noteIds.begin(), noteIds.end());
     repaint();
 }
 
@@ -127,18 +208,34 @@ void PianoRollWidget::deleteSelected()
         return;
 
     patternModel_->beginTransaction("Delete Notes");
-
-    std::vector<int> toDelete(selectedNotes_.begin(), selectedNotes_.end());
-    std::sort(toDelete.rbegin(), toDelete.rend());
-
-    for (int idx : toDelete)
-        patternModel_->removeNote(idx);
+    patternModel_->removeNotes({selectedNotes_.begin(), selectedNotes_.end()});
 
     selectedNotes_.clear();
     repaint();
 }
 
-void PianoRollWidget::removeOverlappingNotes(int pitch, double startBeat, double endBeat, int excludeIndex)
+void PianoRollWidget::transformSelected(const std::vector<NoteTransform> &pipeline,
+                                        const juce::String &name)
+{
+    if (!patternModel_ || selectedNotes_.empty())
+        return;
+
+    if (!transformer_.apply(*patternModel_, {selectedNotes_.begin(), selectedNotes_.end()},
+                            pipeline, name))
+        return;
+
+    // Overlap resolution may have dropped selected notes
+    for (auto it = selectedNotes_.begin(); it != selectedNotes_.end();)
+    {
+        if (patternModel_->indexOfNote(*it) < 0)
+            it = selectedNotes_.erase(it);
+        else
+            ++it;
+    }
+}
+
+void PianoRollWidget::removeOverlappingNotes(int pitch, double startBeat, double endBeat,
+                                             uint32_t excludeNoteId)
 {
     if (!patternModel_)
         return;
@@ -146,7 +243,7 @@ void PianoRollWidget::removeOverlappingNotes(int pitch, double startBeat, double
     // Find and remove notes that overlap with the given range
     for (int i = patternModel_->getNumNotes() - 1; i >= 0; --i)
     {
-        if (i == excludeIndex)
+        if (excludeNoteId != 0 && patternModel_->getNoteId(i) == excludeNoteId)
             continue;
 
         double noteStart, noteDuration;
@@ -160,12 +257,7 @@ void PianoRollWidget::removeOverlappingNotes(int pitch, double startBeat, double
 
         // Check for overlap
         if (noteStart < endBeat && noteEnd > startBeat)
-        {
             patternModel_->removeNote(i);
-            // Adjust excludeIndex if we removed a note before it
-            if (excludeIndex > i)
-                excludeIndex--;
-        }
     }
 }
 
@@ -377,10 +469,20 @@ void PianoRollWidget::drawNotes(juce::Graphics &g, const juce::Rectangle<int> &a
     if (!patternModel_)
         return;
 
-    for (int i = 0; i < patternModel_->getNumNotes(); ++i)
+    updatePaintedBounds(area);
+    auto clip = g.getClipBounds();
+
+    // Only the notes that can reach the clip - a note starting above it can
+    // still hang into it by up to the tallest note's height
+    int first = firstNoteBelow(clip.getY() - tallestNote_);
+    int last = firstNoteBelow(clip.getBottom());
+    for (int i = first; i < last; ++i)
     {
-        auto noteRect = noteToScreen(i, area);
-        if (noteRect.isEmpty() || !noteRect.intersects(area))
+        auto it = paintedBounds_.find(patternModel_->getNoteId(i));
+        if (it == paintedBounds_.end())
+            continue;
+        auto noteRect = it->second;
+        if (noteRect.isEmpty() || !noteRect.intersects(area) || !noteRect.intersects(clip))
             continue;
 
         bool selected = isNoteSelected(i);
@@ -402,10 +504,11 @@ void PianoRollWidget::drawNotes(juce::Graphics &g, const juce::Rectangle<int> &a
 
 void PianoRollWidget::drawPlayhead(juce::Graphics &g, const juce::Rectangle<int> &area)
 {
-    if (!engine_ || !engine_->isPlaying())
+    bool enginePlayheadShown = engine_ && engine_->isPlaying();
+    if (!enginePlayheadShown && playheadOverride_ < 0.0)
         return;
 
-    double playhead = engine_->getPlayheadBeats();
+    double playhead = enginePlayheadShown ? engine_->getPlayheadBeats() : playheadOverride_;
     int y = area.getY() + static_cast<int>(playhead * pixelsPerBeat_);
 
     if (y >= area.getY() && y <= area.getBottom())
@@ -488,7 +591,7 @@ void PianoRollWidget::selectNotesInRect(const juce::Rectangle<int> &rect,
     {
         auto noteRect = noteToScreen(i, gridArea);
         if (rect.intersects(noteRect))
-            selectedNotes_.insert(i);
+            selectedNotes_.insert(patternModel_->getNoteId(i));
     }
 }
 
@@ -526,13 +629,10 @@ void PianoRollWidget::mouseDown(const juce::MouseEvent &e)
     // Right-click to delete/erase mode
     if (e.mods.isRightButtonDown())
     {
-        patternModel_->beginTransaction("Erase Notes");
+        patternModel_->beginGesture("Erase Notes");
 
         if (clickedIndex >= 0)
-        {
             patternModel_->removeNote(clickedIndex);
-            selectedNotes_.erase(clickedIndex);
-        }
 
         // Enter erasing mode for drag-to-erase
         dragMode_ = DragMode::Erasing;
@@ -546,14 +646,13 @@ void PianoRollWidget::mouseDown(const juce::MouseEvent &e)
     if (clickedIndex >= 0)
     {
         // Clicked on existing note - can move or resize
+        draggingNoteId_ = patternModel_->getNoteId(clickedIndex);
         if (!isNoteSelected(clickedIndex))
         {
             selectedNotes_.clear();
-            selectedNotes_.insert(clickedIndex);
+            selectedNotes_.insert(draggingNoteId_);
         }
 
-        draggingNoteIndex_ = clickedIndex;
-
         double startBeat, duration;
         int notePitch, velocity;
         patternModel_->getNoteAt(clickedIndex, startBeat, duration, notePitch, velocity);
@@ -566,31 +665,25 @@ void PianoRollWidget::mouseDown(const juce::MouseEvent &e)
 
         // Clicking existing note allows resize by dragging up/down
         dragMode_ = DragMode::ResizeEnd;
-        patternModel_->beginTransaction("Resize Note");
+        patternModel_->beginGesture("Resize Note");
     }
     else
     {
         // Clicked on empty space - add note and enter drawing mode
         selectedNotes_.clear();
 
-        patternModel_->beginTransaction("Draw Notes");
+        patternModel_->beginGesture("Draw Notes");
 
         // Remove any overlapping notes first
         removeOverlappingNotes(pitch, quantizedBeat, quantizedBeat + gridSize_);
 
-        patternModel_->addNote(quantizedBeat, gridSize_, pitch, 100);
-
-        int newIndex = patternModel_->findNoteAt(quantizedBeat, pitch);
-        if (newIndex >= 0)
-        {
-            selectedNotes_.insert(newIndex);
-        }
+        selectedNotes_.insert(patternModel_->addNote(quantizedBeat, gridSize_, pitch, 100));
 
         // Enter drawing mode for drag-to-draw
         dragMode_ = DragMode::Drawing;
         lastDrawnBeat_ = quantizedBeat;
         lastDrawnPitch_ = pitch;
-        draggingNoteIndex_ = -1;
+        draggingNoteId_ = 0;
     }
     repaint();
 }
@@ -645,7 +738,6 @@ void PianoRollWidget::mouseDrag(const juce::MouseEvent &e)
 
                 lastDrawnBeat_ = quantizedBeat;
                 lastDrawnPitch_ = pitch;
-                repaint();
             }
         }
         return;
@@ -659,11 +751,7 @@ void PianoRollWidget::mouseDrag(const juce::MouseEvent &e)
         {
             int noteIndex = patternModel_->findNoteContaining(quantizedBeat, pitch, 0.05);
             if (noteIndex >= 0)
-            {
                 patternModel_->removeNote(noteIndex);
-                selectedNotes_.erase(noteIndex);
-                repaint();
-            }
 
             lastDrawnBeat_ = quantizedBeat;
             lastDrawnPitch_ = pitch;
@@ -671,7 +759,9 @@ void PianoRollWidget::mouseDrag(const juce::MouseEvent &e)
         return;
     }
 
-    if (draggingNoteIndex_ < 0 || dragMode_ == DragMode::None)
+    // Model change notifications repaint just the edited notes from here on
+    int draggingIndex = patternModel_->indexOfNote(draggingNoteId_);
+    if (draggingIndex < 0 || dragMode_ == DragMode::None)
         return;
 
     if (dragMode_ == DragMode::Move)
@@ -685,18 +775,18 @@ void PianoRollWidget::mouseDrag(const juce::MouseEvent &e)
         // Only update if position actually changed
         double currentBeat, currentDuration;
         int currentPitch, currentVel;
-        patternModel_->getNoteAt(draggingNoteIndex_, currentBeat, currentDuration, currentPitch, currentVel);
+        patternModel_->getNoteAt(draggingIndex, currentBeat, currentDuration, currentPitch, currentVel);
 
         if (newBeat != currentBeat || newPitch != currentPitch)
         {
-            patternModel_->moveNote(draggingNoteIndex_, newBeat, newPitch);
+            patternModel_->moveNote(draggingIndex, newBeat, newPitch);
         }
     }
     else if (dragMode_ == DragMode::ResizeEnd)
     {
         double startBeat, duration;
         int notePitch, velocity;
-        patternModel_->getNoteAt(draggingNoteIndex_, startBeat, duration, notePitch, velocity);
+        patternModel_->getNoteAt(draggingIndex, startBeat, duration, notePitch, velocity);
 
         double newEnd = std::max(startBeat + gridSize_, quantizedBeat + gridSize_);
         double newDuration = newEnd - startBeat;
@@ -704,12 +794,10 @@ void PianoRollWidget::mouseDrag(const juce::MouseEvent &e)
         if (newDuration != duration)
         {
             // Remove notes that would be overlapped by the resize
-            removeOverlappingNotes(notePitch, startBeat, newEnd, draggingNoteIndex_);
-            patternModel_->resizeNote(draggingNoteIndex_, newDuration);
+            removeOverlappingNotes(notePitch, startBeat, newEnd, draggingNoteId_);
+            patternModel_->resizeNote(patternModel_->indexOfNote(draggingNoteId_), newDuration);
         }
     }
-
-    repaint();
 }
 
 void PianoRollWidget::mouseUp(const juce::MouseEvent &e)
@@ -729,16 +817,22 @@ void PianoRollWidget::mouseUp(const juce::MouseEvent &e)
 
         selectNotesInRect(selRect, gridArea);
     }
-    else if (dragMode_ == DragMode::Move && draggingNoteIndex_ >= 0)
+    else if (dragMode_ == DragMode::Move && patternModel_ &&
+             patternModel_->indexOfNote(draggingNoteId_) >= 0)
     {
         // After moving, remove any notes that overlap with the moved note
         double startBeat, duration;
         int pitch, velocity;
-        patternModel_->getNoteAt(draggingNoteIndex_, startBeat, duration, pitch, velocity);
-        removeOverlappingNotes(pitch, startBeat, startBeat + duration, draggingNoteIndex_);
+        patternModel_->getNoteAt(patternModel_->indexOfNote(draggingNoteId_), startBeat, duration,
+                                 pitch, velocity);
+        removeOverlappingNotes(pitch, startBeat, startBeat + duration, draggingNoteId_);
     }
 
-    draggingNoteIndex_ = -1;
+    // Commit the whole drag as one undo step
+    if (patternModel_)
+        patternModel_->endGesture();
+
+    draggingNoteId_ = 0;
     dragMode_ = DragMode::None;
     repaint();
 }
@@ -786,20 +880,22 @@ bool PianoRollWidget::keyPressed(const juce::KeyPress &key)
 
         // Find the earliest selected note to use as reference
         double minBeat = std::numeric_limits<double>::max();
-        for (int idx : selectedNotes_)
+        for (auto id : selectedNotes_)
         {
             double startBeat, duration;
             int pitch, velocity;
-            patternModel_->getNoteAt(idx, startBeat, duration, pitch, velocity);
+            patternModel_->getNoteAt(patternModel_->indexOfNote(id), startBeat, duration, pitch,
+                                     velocity);
             minBeat = std::min(minBeat, startBeat);
         }
 
         // Copy notes relative to the earliest note
-        for (int idx : selectedNotes_)
+        for (auto id : selectedNotes_)
         {
             double startBeat, duration;
             int pitch, velocity;
-            patternModel_->getNoteAt(idx, startBeat, duration, pitch, velocity);
+            patternModel_->getNoteAt(patternModel_->indexOfNote(id), startBeat, duration, pitch,
+                                     velocity);
             g_clipboard.emplace_back(startBeat - minBeat, duration, pitch, velocity);
         }
 
@@ -816,19 +912,21 @@ bool PianoRollWidget::keyPressed(const juce::KeyPress &key)
         g_clipboard.clear();
 
         double minBeat = std::numeric_limits<double>::max();
-        for (int idx : selectedNotes_)
+        for (auto id : selectedNotes_)
         {
             double startBeat, duration;
             int pitch, velocity;
-            patternModel_->getNoteAt(idx, startBeat, duration, pitch, velocity);
+            patternModel_->getNoteAt(patternModel_->indexOfNote(id), startBeat, duration, pitch,
+                                     velocity);
             minBeat = std::min(minBeat, startBeat);
         }
 
-        for (int idx : selectedNotes_)
+        for (auto id : selectedNotes_)
         {
             double startBeat, duration;
             int pitch, velocity;
-            patternModel_->getNoteAt(idx, startBeat, duration, pitch, velocity);
+            patternModel_->getNoteAt(patternModel_->indexOfNote(id), startBeat, duration, pitch,
+                                     velocity);
             g_clipboard.emplace_back(startBeat - minBeat, duration, pitch, velocity);
         }
 
@@ -861,11 +959,7 @@ bool PianoRollWidget::keyPressed(const juce::KeyPress &key)
             // Remove overlapping notes
             removeOverlappingNotes(pitch, startBeat, startBeat + duration);
 
-            patternModel_->addNote(startBeat, duration, pitch, velocity);
-
-            int newIndex = patternModel_->findNoteAt(startBeat, pitch);
-            if (newIndex >= 0)
-                selectedNotes_.insert(newIndex);
+            selectedNotes_.insert(patternModel_->addNote(startBeat, duration, pitch, velocity));
         }
 
         repaint();
@@ -887,6 +981,51 @@ bool PianoRollWidget::keyPressed(const juce::KeyPress &key)
         return true;
     }
 
+    // Selection transforms - pitch runs left to right, so Left/Right transpose
+    if (!key.getModifiers().isCommandDown() && hasSelection())
+    {
+        bool shift = key.getModifiers().isShiftDown();
+
+        if (key.isKeyCode(juce::KeyPress::rightKey) || key.isKeyCode(juce::KeyPress::leftKey))
+        {
+            int direction = key.isKeyCode(juce::KeyPress::rightKey) ? 1 : -1;
+            transformSelected({NoteTransform::transpose(direction * (shift ? 12 : 1))},
+                              "Transpose Notes");
+            return true;
+        }
+
+        switch (key.getKeyCode())
+        {
+            case 'Q':
+                transformSelected({NoteTransform::quantize(gridSize_)}, "Quantize Notes");
+                return true;
+            case 'H':
+                transformSelected({NoteTransform::humanize(gridSize_ * 0.25, 10, humanizeSeed_++)},
+                                  "Humanize Notes");
+                return true;
+            case 'R':
+                transformSelected({NoteTransform::reverse()}, "Reverse Notes");
+                return true;
+            case 'L':
+                transformSelected({NoteTransform::legato()}, "Legato");
+                return true;
+            case '[':
+                transformSelected({NoteTransform::stretch(0.5)}, "Stretch Notes");
+                return true;
+            case ']':
+                transformSelected({NoteTransform::stretch(2.0)}, "Stretch Notes");
+                return true;
+            case '-':
+                transformSelected({NoteTransform::scaleVelocity(0.9)}, "Scale Velocity");
+                return true;
+            case '=':
+                transformSelected({NoteTransform::scaleVelocity(1.1, 1)}, "Scale Velocity");
+                return true;
+            default:
+                break;
+        }
+    }
+
     return false;
 }
 
@@ -10,8 +10,10 @@
 
 #include <juce_gui_basics/juce_gui_basics.h>
 #include "core/PatternModel.h"
+#include "core/NoteTransforms.h"
 #include <functional>
-#include <set>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace SurgeBox
 {
@@ -46,10 +48,14 @@ class PianoRollWidget : public juce::Component
 
     // Selection
     void selectAll();
+    void selectNotes(const std::vector<uint32_t> &noteIds);
     void clearSelection();
     void deleteSelected();
     bool hasSelection() const { return !selectedNotes_.empty(); }
 
+    // Run a transform pipeline over the selection as one undo step
+    void transformSelected(const std::vector<NoteTransform> &pipeline, const juce::String &name);
+
     // Step recording
     using StepRecordCallback = std::function<void(int pitch, int velocity)>;
     void setStepRecordCallback(StepRecordCallback callback) { stepRecordCallback_ = callback; }
@@ -58,6 +64,10 @@ class PianoRollWidget : public juce::Component
     void addNoteAtCurrentStep(int pitch, int velocity);
     double getStepPosition() const { return stepPosition_; }
 
+    // Where the playhead is drawn while the engine is stopped or absent
+    // (offscreen rendering); negative - nowhere
+    void setPlayheadOverride(double beats) { playheadOverride_ = beats; repaint(); }
+
     // Callback for playing notes (piano key clicks)
     std::function<void(int pitch, int velocity)> onNoteOn;
     std::function<void(int pitch)> onNoteOff;
@@ -76,11 +86,15 @@ class PianoRollWidget : public juce::Component
     double stepSize_{0.25};
     StepRecordCallback stepRecordCallback_;
 
-    // Multi-selection
-    std::set<int> selectedNotes_;
+    // Multi-selection, by stable note ID
+    std::unordered_set<uint32_t> selectedNotes_;
+
+    // Selection transforms
+    NoteTransformer transformer_;
+    uint32_t humanizeSeed_{1};
 
     // Editing state
-    int draggingNoteIndex_{-1};
+    uint32_t draggingNoteId_{0};
     double dragStartBeat_{0.0};
     int dragStartPitch_{0};
     double dragStartDuration_{0.0};
@@ -127,11 +141,28 @@ class PianoRollWidget : public juce::Component
     juce::Rectangle<int> getPianoArea() const;
 
     // Selection helpers
-    bool isNoteSelected(int index) const { return selectedNotes_.count(index) > 0; }
+    bool isNoteSelected(int index) const
+    {
+        return patternModel_ && selectedNotes_.count(patternModel_->getNoteId(index)) > 0;
+    }
     void selectNotesInRect(const juce::Rectangle<int> &rect, const juce::Rectangle<int> &gridArea);
 
     // Note overlap handling
-    void removeOverlappingNotes(int pitch, double startBeat, double endBeat, int excludeIndex = -1);
+    void removeOverlappingNotes(int pitch, double startBeat, double endBeat,
+                                uint32_t excludeNoteId = 0);
+
+    // Incremental updates - repaint only where changed notes were and now are.
+    // paintedBounds_ follows the changes; it is rebuilt only when the layout
+    // (grid area, zoom) or the whole pattern changed.
+    void repaintNotes(const PatternModel::NoteChanges &changes);
+    void updatePaintedBounds(const juce::Rectangle<int> &area);
+    int firstNoteBelow(int y) const; // Index of the first note whose top is at or below y
+    std::unordered_map<uint32_t, juce::Rectangle<int>> paintedBounds_;
+    bool paintedBoundsDirty_{true};
+    juce::Rectangle<int> paintedArea_;
+    double paintedPixelsPerBeat_{0.0};
+    int tallestNote_{0}; // Pixels; only grows until the next rebuild
+    static constexpr size_t MAX_INCREMENTAL_REPAINT = 64;
 
     // Piano interaction
     int getPitchAtX(int x) const;
@@ -140,6 +171,7 @@ class PianoRollWidget : public juce::Component
 
     // Sequencer playback highlighting
     std::vector<uint8_t> sequencerPlayingNotes_;
+    double playheadOverride_{-1.0};
 
     // Piano key area height (at top)
     static constexpr int PIANO_KEY_HEIGHT = 30;
@@ -0,0 +1,407 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "SurgeBoxHeadless.h"
+#include "SurgeBoxEngine.h"
+#include "SurgeSynthesizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+
+static_assert(SURGEBOX_NUM_VOICES == SurgeBox::NUM_VOICES, "Voice count is part of the ABI");
+
+namespace
+{
+
+// Surge reports parameter changes to its plugin layer - there is no one to tell
+class HeadlessPluginLayer : public SurgeSynthesizer::PluginLayer
+{
+  public:
+    void surgeParameterUpdated(const SurgeSynthesizer::ID &, float) override {}
+    void surgeMacroUpdated(long, float) override {}
+};
+
+} // namespace
+
+struct SurgeBoxHeadless
+{
+    HeadlessPluginLayer layer;
+    std::array<std::unique_ptr<SurgeSynthesizer>, SurgeBox::NUM_VOICES> synths;
+
+    // After the synths, so it shuts down while they still exist
+    SurgeBox::SurgeBoxEngine engine;
+
+    int maxFrames{0};
+    uint64_t framesRendered{0};
+    juce::MidiBuffer noLiveInput;
+    mutable std::string error; // Also set by const entry points that throw
+    std::string realtimeProblems;
+    std::string memoryReport;
+
+    bool fail(std::string reason)
+    {
+        error = std::move(reason);
+        return false;
+    }
+
+    bool queue(int voice, int frameOffset, const juce::MidiMessage &message)
+    {
+        if (voice < 0 || voice >= SurgeBox::NUM_VOICES)
+            return fail("Voice " + std::to_string(voice) + " out of range");
+        if (frameOffset < 0 || frameOffset >= maxFrames)
+            return fail("Frame offset " + std::to_string(frameOffset) + " out of range");
+
+        engine.queueVoiceInput(voice, message, frameOffset);
+        return true;
+    }
+};
+
+namespace
+{
+
+constexpr double BEATS_PER_BAR = 4.0;
+
+int channelOf(int channel) { return std::clamp(channel, 0, 15) + 1; }
+
+void setError(const SurgeBoxHeadless *engine, const char *reason) noexcept
+{
+    if (!engine)
+        return;
+    try
+    {
+        engine->error = reason;
+    }
+    catch (...)
+    {
+    }
+}
+
+// Runs an entry point's body; an exception must not cross the C ABI, so it
+// becomes the last error and the entry point's failure value. Entry points
+// that only read or store plain values can't throw and don't need it.
+template <typename Result, typename Body>
+Result guarded(const SurgeBoxHeadless *engine, Result failed, Body &&body) noexcept
+{
+    try
+    {
+        return body();
+    }
+    catch (const std::exception &e)
+    {
+        setError(engine, e.what());
+    }
+    catch (...)
+    {
+        setError(engine, "Unknown error");
+    }
+    return failed;
+}
+
+template <typename Body>
+void guarded(const SurgeBoxHeadless *engine, Body &&body) noexcept
+{
+    guarded(engine, 0, [&] {
+        body();
+        return 0;
+    });
+}
+
+} // namespace
+
+extern "C"
+{
+
+int surgebox_abi_version(void) { return SURGEBOX_ABI_VERSION; }
+
+SurgeBoxHeadless *surgebox_create(double sample_rate, int max_frames, const char *data_path)
+{
+    if (sample_rate <= 0.0 || max_frames <= 0)
+        return nullptr;
+
+    // Nothing to report an error on yet - a throw is a failed create
+    return guarded<SurgeBoxHeadless *>(nullptr, nullptr, [&]() -> SurgeBoxHeadless * {
+        auto engine = std::make_unique<SurgeBoxHeadless>();
+        engine->maxFrames = max_frames;
+
+        std::array<SurgeSynthesizer *, SurgeBox::NUM_VOICES> synthPtrs{};
+        std::array<int64_t, SurgeBox::NUM_VOICES> footprints{};
+        for (int v = 0; v < SurgeBox::NUM_VOICES; ++v)
+        {
+            auto before = SurgeBox::MemoryReport::currentResidentBytes();
+            auto synth = std::make_unique<SurgeSynthesizer>(&engine->layer,
+                                                            data_path ? data_path : "");
+            synth->setSamplerate(static_cast<float>(sample_rate));
+            synth->audio_processing_active = true;
+            footprints[v] = SurgeBox::MemoryReport::currentResidentBytes() - before;
+            synthPtrs[v] = synth.get();
+            engine->synths[v] = std::move(synth);
+        }
+
+        engine->engine.setSynths(synthPtrs);
+        for (int v = 0; v < SurgeBox::NUM_VOICES; ++v)
+            engine->engine.setInstanceFootprint(v, std::max<int64_t>(0, footprints[v]));
+        if (!engine->engine.initialize(sample_rate, max_frames))
+            return nullptr;
+        return engine.release();
+    });
+}
+
+void surgebox_destroy(SurgeBoxHeadless *engine) { delete engine; }
+
+int surgebox_load_project(SurgeBoxHeadless *engine, const void *data, size_t size)
+{
+    if (!engine)
+        return 0;
+    return guarded(engine, 0, [&]() -> int {
+        if (!data || size == 0)
+            return engine->fail("No project data");
+        if (!engine->engine.getProject().loadFromMemory(data, size))
+            return engine->fail("Not a SurgeBox project");
+
+        // Playback reads patterns compiled from the models, so reload those too.
+        // Compiling is asynchronous - the first render must already hear them.
+        // Restoring the patches also seeds the voice cost model: without tick()
+        // nothing else changes a patch here, so it needs no further polling.
+        engine->engine.syncPatternModelsFromProject();
+        engine->engine.restoreAllVoices();
+        engine->engine.getPatternBank().waitUntilIdle();
+        return 1;
+    });
+}
+
+double surgebox_get_tempo(const SurgeBoxHeadless *engine)
+{
+    return engine ? engine->engine.getProject().tempo : 0.0;
+}
+
+double surgebox_loop_length_beats(const SurgeBoxHeadless *engine)
+{
+    if (!engine)
+        return 0.0;
+
+    const auto &project = engine->engine.getProject();
+    if (project.songMode && !project.song.empty())
+    {
+        double beats = 0.0;
+        for (const auto &section : project.song)
+            beats += section.bars * BEATS_PER_BAR;
+        return beats;
+    }
+
+    // As the sequencer loops: at least a bar
+    double beats = BEATS_PER_BAR;
+    for (const auto &voice : project.voices)
+        beats = std::max(beats, voice.pattern().lengthInBeats());
+    return beats;
+}
+
+void surgebox_play(SurgeBoxHeadless *engine)
+{
+    if (engine)
+        guarded(engine, [&] { engine->engine.play(); });
+}
+
+void surgebox_stop(SurgeBoxHeadless *engine)
+{
+    if (engine)
+        guarded(engine, [&] { engine->engine.stop(); });
+}
+
+void surgebox_seek(SurgeBoxHeadless *engine, double beat)
+{
+    if (engine)
+        guarded(engine, [&] { engine->engine.seek(std::max(0.0, beat)); });
+}
+
+void surgebox_set_tempo(SurgeBoxHeadless *engine, double bpm)
+{
+    // Not an edit - nothing to undo or journal
+    if (engine && bpm > 0.0)
+        engine->engine.getProject().tempo = bpm;
+}
+
+int surgebox_queue_note(SurgeBoxHeadless *engine, int voice, int frame_offset, int channel,
+                        int pitch, int velocity)
+{
+    if (!engine)
+        return 0;
+
+    return guarded(engine, 0, [&]() -> int {
+        int ch = channelOf(channel);
+        int note = std::clamp(pitch, 0, 127);
+        auto level = static_cast<juce::uint8>(std::min(velocity, 127));
+        auto message = velocity > 0 ? juce::MidiMessage::noteOn(ch, note, level)
+                                    : juce::MidiMessage::noteOff(ch, note);
+        return engine->queue(voice, frame_offset, message);
+    });
+}
+
+int surgebox_queue_controller(SurgeBoxHeadless *engine, int voice, int frame_offset, int channel,
+                              int controller, int value)
+{
+    if (!engine)
+        return 0;
+    return guarded(engine, 0, [&]() -> int {
+        auto message = juce::MidiMessage::controllerEvent(
+            channelOf(channel), std::clamp(controller, 0, 127), std::clamp(value, 0, 127));
+        return engine->queue(voice, frame_offset, message);
+    });
+}
+
+int surgebox_queue_pitch_bend(SurgeBoxHeadless *engine, int voice, int frame_offset, int channel,
+                              float bend)
+{
+    if (!engine)
+        return 0;
+    return guarded(engine, 0, [&]() -> int {
+        int value = std::clamp(static_cast<int>(8192.0f + bend * 8192.0f), 0, 16383);
+        auto message = juce::MidiMessage::pitchWheel(channelOf(channel), value);
+        return engine->queue(voice, frame_offset, message);
+    });
+}
+
+int surgebox_queue_all_notes_off(SurgeBoxHeadless *engine, int voice, int frame_offset)
+{
+    if (!engine)
+        return 0;
+    return guarded(engine, 0, [&]() -> int {
+        return engine->queue(voice, frame_offset, juce::MidiMessage::allNotesOff(1));
+    });
+}
+
+int surgebox_render(SurgeBoxHeadless *engine, float *left, float *right, int num_frames)
+{
+    if (!engine)
+        return 0;
+    return guarded(engine, 0, [&]() -> int {
+        if (!left || !right)
+            return engine->fail("No output buffers");
+        if (num_frames <= 0 || num_frames > engine->maxFrames)
+            return engine->fail("Frame count " + std::to_string(num_frames) + " out of range");
+
+        engine->engine.process(left, right, num_frames, engine->noLiveInput);
+        engine->framesRendered += static_cast<uint64_t>(num_frames);
+
+        // There is no message thread - a capture frozen by this render gets its
+        // project image here, after the render rather than inside it
+        engine->engine.serviceFlightRecorder();
+        return 1;
+    });
+}
+
+void surgebox_set_load_adaptive(SurgeBoxHeadless *engine, int adaptive)
+{
+    if (engine)
+        engine->engine.setLoadAdaptive(adaptive != 0);
+}
+
+void surgebox_set_render_threads(SurgeBoxHeadless *engine, int workers)
+{
+    // Starts and stops worker threads
+    if (engine)
+        guarded(engine, [&] { engine->engine.setRenderThreads(workers); });
+}
+
+int surgebox_set_realtime(SurgeBoxHeadless *engine, const SurgeBoxRealtime *settings)
+{
+    if (!engine)
+        return 0;
+    if (!settings || settings->struct_size < sizeof(SurgeBoxRealtime))
+        return engine->fail("Real-time settings missing or too old");
+
+    return guarded(engine, 0, [&]() -> int {
+        SurgeBox::RealtimeSettings realtime;
+        realtime.enabled = settings->enabled != 0;
+        realtime.audioPriority = settings->render_priority;
+        realtime.workerPriority = settings->worker_priority;
+        realtime.audioCpu = settings->render_cpu;
+        realtime.firstWorkerCpu = settings->first_worker_cpu;
+        realtime.lockMemory = settings->lock_memory != 0;
+        engine->engine.setRealtime(realtime);
+
+        auto status = engine->engine.getRealtimeStatus();
+        if (realtime.enabled && realtime.lockMemory && !status.memoryLocked)
+            return engine->fail(status.reason);
+        return 1;
+    });
+}
+
+const char *surgebox_realtime_problems(SurgeBoxHeadless *engine)
+{
+    if (!engine)
+        return "No engine";
+    return guarded(engine, "", [&] {
+        engine->realtimeProblems = engine->engine.getRealtimeStatus().reason;
+        return engine->realtimeProblems.c_str();
+    });
+}
+
+void surgebox_set_flight_recorder(SurgeBoxHeadless *engine, const char *directory)
+{
+    if (engine)
+        guarded(engine, [&] {
+            engine->engine.setFlightRecorder(directory ? fs::path(directory) : fs::path());
+        });
+}
+
+int surgebox_get_telemetry(const SurgeBoxHeadless *engine, SurgeBoxTelemetry *telemetry)
+{
+    if (!engine || !telemetry || telemetry->struct_size < sizeof(uint32_t))
+        return 0;
+    return guarded(engine, 0, [&]() -> int {
+        auto &box = const_cast<SurgeBoxHeadless *>(engine)->engine;
+        auto &governor = box.getGovernor();
+
+        SurgeBoxTelemetry out{};
+        out.struct_size = sizeof(SurgeBoxTelemetry);
+        out.playhead_beats = box.getPlayheadBeats();
+        out.frames_rendered = engine->framesRendered;
+        out.block_load = governor.getBlockLoad();
+        out.peak_block_load = governor.getPeakBlockLoad();
+        out.quality_level = box.getQualityController().getLevel();
+        out.stolen_voices = governor.getStolenVoices();
+        for (int v = 0; v < SurgeBox::NUM_VOICES; ++v)
+        {
+            out.active_voices[v] = governor.getActiveVoices(v);
+            out.voice_load[v] = governor.getVoiceLoad(v);
+        }
+
+        auto realtime = box.getRealtimeStatus();
+        out.realtime_memory_locked = realtime.memoryLocked ? 1 : 0;
+        out.realtime_render_thread = realtime.audioPending ? -1 : (realtime.audioPromoted ? 1 : 0);
+        out.realtime_workers = realtime.workersPromoted;
+        out.xrun_captures = static_cast<uint32_t>(box.getFlightRecorder().getCaptureCount());
+
+        // An older caller gets the fields it knows about
+        size_t size = std::min<size_t>(telemetry->struct_size, sizeof(SurgeBoxTelemetry));
+        std::memcpy(telemetry, &out, size);
+        telemetry->struct_size = static_cast<uint32_t>(size);
+        return 1;
+    });
+}
+
+const char *surgebox_memory_report(SurgeBoxHeadless *engine)
+{
+    if (!engine)
+        return "{}";
+    return guarded(engine, "{}", [&] {
+        engine->memoryReport = engine->engine.getMemoryReport().toJson();
+        return engine->memoryReport.c_str();
+    });
+}
+
+const char *surgebox_last_error(const SurgeBoxHeadless *engine)
+{
+    return engine ? engine->error.c_str() : "No engine";
+}
+
+} // extern "C"
@@ -0,0 +1,169 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+/*
+ * The SurgeBox engine without the plugin wrapper or GUI, behind a C ABI.
+ *
+ * An engine owns its four Surge instances and needs no message thread: create
+ * it, load a project, queue events and render. Calls on one engine must not
+ * overlap; separate engines are independent. Functions returning int return 1
+ * on success and 0 on failure, with surgebox_last_error() saying why. No C++
+ * exception leaves a call: one thrown inside (e.g. out of memory) is reported
+ * as a failure, and surgebox_create() returns NULL.
+ *
+ * The ABI only grows: new functions are added, existing ones keep their
+ * signatures, and structs passed by pointer start with their size.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(SURGEBOX_HEADLESS_BUILD)
+#define SURGEBOX_API __declspec(dllexport)
+#else
+#define SURGEBOX_API __declspec(dllimport)
+#endif
+#else
+#define SURGEBOX_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define SURGEBOX_ABI_VERSION 5
+#define SURGEBOX_NUM_VOICES 4
+
+typedef struct SurgeBoxHeadless SurgeBoxHeadless;
+
+typedef struct SurgeBoxTelemetry
+{
+    uint32_t struct_size; /* Set to sizeof(SurgeBoxTelemetry) before the call */
+
+    double playhead_beats;
+    uint64_t frames_rendered;
+
+    /* Render time of the last block and the worst since creation, as a
+       fraction of the block's duration */
+    float block_load;
+    float peak_block_load;
+
+    int32_t quality_level;  /* 0 - full quality */
+    uint32_t stolen_voices; /* Released by the polyphony governor */
+    int32_t active_voices[SURGEBOX_NUM_VOICES];
+    float voice_load[SURGEBOX_NUM_VOICES];
+
+    /* Real-time mode (ABI 2) - see surgebox_set_realtime() */
+    int32_t realtime_memory_locked;
+    int32_t realtime_render_thread; /* 1 - SCHED_FIFO, 0 - not, -1 - at the next render */
+    int32_t realtime_workers;       /* Render workers running SCHED_FIFO */
+
+    /* Flight recorder captures written (ABI 3) */
+    uint32_t xrun_captures;
+} SurgeBoxTelemetry;
+
+typedef struct SurgeBoxRealtime
+{
+    uint32_t struct_size; /* Set to sizeof(SurgeBoxRealtime) */
+
+    int32_t enabled;
+    int32_t render_priority;  /* SCHED_FIFO 1-99, for the thread calling surgebox_render() */
+    int32_t worker_priority;  /* For the render workers */
+    int32_t render_cpu;       /* Core to pin the render thread to, -1 - any */
+    int32_t first_worker_cpu; /* Worker n runs on first_worker_cpu + n, -1 - any core */
+    int32_t lock_memory;      /* mlockall() the process */
+} SurgeBoxRealtime;
+
+/* The ABI this library implements - SURGEBOX_ABI_VERSION at build time */
+SURGEBOX_API int surgebox_abi_version(void);
+
+/* max_frames bounds a single surgebox_render() call. data_path is Surge's
+   factory data directory, NULL - its default. Returns NULL on failure. */
+SURGEBOX_API SurgeBoxHeadless *surgebox_create(double sample_rate, int max_frames,
+                                               const char *data_path);
+SURGEBOX_API void surgebox_destroy(SurgeBoxHeadless *engine);
+
+/* A .sbox project, as written by SurgeBox. Returns once its patterns are
+   ready to play. */
+SURGEBOX_API int surgebox_load_project(SurgeBoxHeadless *engine, const void *data, size_t size);
+
+/* The loaded project's tempo, and the beats of one pass through it - the song
+   in song mode, otherwise the longest selected pattern */
+SURGEBOX_API double surgebox_get_tempo(const SurgeBoxHeadless *engine);
+SURGEBOX_API double surgebox_loop_length_beats(const SurgeBoxHeadless *engine);
+
+/* Transport */
+SURGEBOX_API void surgebox_play(SurgeBoxHeadless *engine);
+SURGEBOX_API void surgebox_stop(SurgeBoxHeadless *engine);
+SURGEBOX_API void surgebox_seek(SurgeBoxHeadless *engine, double beat);
+SURGEBOX_API void surgebox_set_tempo(SurgeBoxHeadless *engine, double bpm);
+
+/* Events for the next surgebox_render() call, at frame_offset into it.
+   Velocity 0 releases the note; bend runs from -1 to 1. */
+SURGEBOX_API int surgebox_queue_note(SurgeBoxHeadless *engine, int voice, int frame_offset,
+                                     int channel, int pitch, int velocity);
+SURGEBOX_API int surgebox_queue_controller(SurgeBoxHeadless *engine, int voice, int frame_offset,
+                                           int channel, int controller, int value);
+SURGEBOX_API int surgebox_queue_pitch_bend(SurgeBoxHeadless *engine, int voice, int frame_offset,
+                                           int channel, float bend);
+SURGEBOX_API int surgebox_queue_all_notes_off(SurgeBoxHeadless *engine, int voice,
+                                              int frame_offset);
+
+/* Render num_frames (up to max_frames) into the caller's buffers */
+SURGEBOX_API int surgebox_render(SurgeBoxHeadless *engine, float *left, float *right,
+                                 int num_frames);
+
+/* Whether render time may steal voices (the CPU budget) and lower quality
+   (ABI 5). On by default; turn it off for offline renders, which then come
+   out the same however loaded the machine is. The voice budget still
+   applies. */
+SURGEBOX_API void surgebox_set_load_adaptive(SurgeBoxHeadless *engine, int adaptive);
+
+/* Worker threads rendering voices alongside the render thread (ABI 2) */
+SURGEBOX_API void surgebox_set_render_threads(SurgeBoxHeadless *engine, int workers);
+
+/* Linux real-time mode (ABI 2): SCHED_FIFO and core affinity for the render
+   thread (at its next surgebox_render() call) and the workers, mlockall, and
+   the engine's memory and the threads' stacks faulted in up front. A step the
+   process lacks the privileges for is skipped - the telemetry shows what took
+   and surgebox_realtime_problems() why the rest did not. Returns 0 if the
+   settings were invalid or memory could not be locked. */
+SURGEBOX_API int surgebox_set_realtime(SurgeBoxHeadless *engine,
+                                       const SurgeBoxRealtime *settings);
+
+/* Why real-time steps fell back, "" if none did - valid until the next call */
+SURGEBOX_API const char *surgebox_realtime_problems(SurgeBoxHeadless *engine);
+
+/* Flight recorder (ABI 3): the last blocks' MIDI, transport and render times
+   are written to directory as xrun-<time>.json around every surgebox_render()
+   call that takes longer than the audio it renders, at most one every 30
+   seconds, keeping the newest 32. NULL or "" - off. The capture's project
+   hash is of the project as it was when the capture was written. */
+SURGEBOX_API void surgebox_set_flight_recorder(SurgeBoxHeadless *engine, const char *directory);
+
+SURGEBOX_API int surgebox_get_telemetry(const SurgeBoxHeadless *engine,
+                                        SurgeBoxTelemetry *telemetry);
+
+/* Where the engine's memory goes (ABI 4), as JSON: entries of group, name,
+   bytes and whether the bytes are estimated, plus the total and the process's
+   resident memory. Valid until the next call. Surge instances are estimated
+   from resident memory growth while surgebox_create() ran, with Surge's shared
+   tables on their own line; they are meaningless for engines created
+   concurrently from several threads. */
+SURGEBOX_API const char *surgebox_memory_report(SurgeBoxHeadless *engine);
+
+/* The reason for the last failure on this engine - valid until the next call */
+SURGEBOX_API const char *surgebox_last_error(const SurgeBoxHeadless *engine);
+
+#ifdef __cplusplus
+}
+#endif
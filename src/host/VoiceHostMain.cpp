@@ -0,0 +1,239 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+// surgebox-voice-host - renders one SurgeBox voice in its own process.
+//
+//   surgebox-voice-host --shm <name> [--cpu <n>]
+//
+// Started by RemoteVoice, which creates the shared-memory segment <name>. The
+// host dies with its parent.
+
+#include "VoiceHostProtocol.h"
+#include "SurgeSynthesizer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+using namespace SurgeBox;
+using VoiceHost::Event;
+using VoiceHost::EventType;
+
+namespace
+{
+
+// Surge reports parameter changes to its plugin layer - there is no one to tell
+class HostPluginLayer : public SurgeSynthesizer::PluginLayer
+{
+  public:
+    void surgeParameterUpdated(const SurgeSynthesizer::ID &, float) override {}
+    void surgeMacroUpdated(long, float) override {}
+};
+
+constexpr int64_t IDLE_WAIT_NANOS = 100000000;
+
+class VoiceHostLoop
+{
+  public:
+    VoiceHostLoop(VoiceHost::Shared &shared, SurgeSynthesizer &synth)
+        : shared_(shared), synth_(synth)
+    {
+    }
+
+    void run()
+    {
+        uint32_t done = 0;
+        while (!shared_.shutdown.load())
+        {
+            // The parent died - PR_SET_PDEATHSIG normally gets here first
+            if (getppid() == 1)
+                return;
+
+            uint32_t request = shared_.request.load();
+            if (request == done)
+            {
+                VoiceHost::futexWait(shared_.request, done, IDLE_WAIT_NANOS);
+                continue;
+            }
+
+            shared_.receivedNanos = VoiceHost::monotonicNanos();
+            loadPatch();
+            drainControl();
+            render();
+            shared_.doneNanos = VoiceHost::monotonicNanos();
+
+            done = request;
+            shared_.response.store(request);
+            VoiceHost::futexWake(shared_.response);
+        }
+    }
+
+  private:
+    void loadPatch()
+    {
+        uint32_t serial = shared_.patchSerial.load();
+        if (serial == shared_.patchLoaded.load())
+            return;
+
+        synth_.loadRaw(shared_.patch, static_cast<int>(shared_.patchSize), false);
+        shared_.patchLoaded.store(serial);
+    }
+
+    void drainControl()
+    {
+        Event event;
+        while (shared_.control.pop(event))
+            apply(event);
+    }
+
+    void apply(const Event &event)
+    {
+        switch (event.type)
+        {
+            case EventType::NoteOn:
+                synth_.playNote(event.channel, event.pitch, event.velocity, 0, -1);
+                break;
+            case EventType::NoteOff:
+                synth_.releaseNote(event.channel, event.pitch, 0);
+                break;
+            case EventType::PitchBend:
+                synth_.pitchBend(event.channel, static_cast<int>(event.value * 8192.0f));
+                break;
+            case EventType::Controller:
+                synth_.channelController(event.channel, event.pitch, event.velocity);
+                break;
+            case EventType::Parameter:
+            {
+                const auto &params = synth_.storage.getPatch().param_ptr;
+                if (event.parameter >= 0 && event.parameter < static_cast<int>(params.size()))
+                {
+                    auto id = synth_.idForParameter(params[static_cast<size_t>(event.parameter)]);
+                    synth_.setParameter01(id, event.value, false, false);
+                }
+                break;
+            }
+            case EventType::AllNotesOff:
+                synth_.allNotesOff();
+                break;
+        }
+    }
+
+    // Like SurgeSynthProcessor: events apply at their sample, Surge renders
+    // BLOCK_SIZE at a time and the remainder carries into the next block
+    void render()
+    {
+        synth_.time_data.tempo = shared_.tempo;
+        synth_.time_data.ppqPos = shared_.ppqPos;
+        synth_.time_data.timeSigNumerator = 4;
+        synth_.time_data.timeSigDenominator = 4;
+        synth_.resetStateFromTimeData();
+
+        int numSamples = std::min(shared_.numSamples, VoiceHost::MAX_BLOCK_SAMPLES);
+        int numEvents = std::min(shared_.numEvents, VoiceHost::MAX_BLOCK_EVENTS);
+        int next = 0;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            while (next < numEvents && shared_.events[next].sampleOffset <= i)
+                apply(shared_.events[next++]);
+
+            if (blockPos_ >= BLOCK_SIZE)
+            {
+                synth_.process();
+                blockPos_ = 0;
+            }
+            shared_.audio[0][i] = synth_.output[0][blockPos_];
+            shared_.audio[1][i] = synth_.output[1][blockPos_];
+            ++blockPos_;
+        }
+
+        while (next < numEvents)
+            apply(shared_.events[next++]);
+
+        shared_.activeVoices =
+            static_cast<int32_t>(synth_.voices[0].size() + synth_.voices[1].size());
+    }
+
+    VoiceHost::Shared &shared_;
+    SurgeSynthesizer &synth_;
+    int blockPos_{BLOCK_SIZE};
+};
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string shmName;
+    int cpu = -1;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (std::strcmp(argv[i], "--shm") == 0)
+            shmName = argv[i + 1];
+        else if (std::strcmp(argv[i], "--cpu") == 0)
+            cpu = std::atoi(argv[i + 1]);
+    }
+    if (shmName.empty())
+    {
+        std::fprintf(stderr, "usage: surgebox-voice-host --shm <name> [--cpu <n>]\n");
+        return 2;
+    }
+
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() == 1)
+        return 1;
+
+    int fd = shm_open(shmName.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        std::perror("surgebox-voice-host: shm_open");
+        return 1;
+    }
+    void *memory =
+        mmap(nullptr, sizeof(VoiceHost::Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        std::perror("surgebox-voice-host: mmap");
+        return 1;
+    }
+
+    auto &shared = *static_cast<VoiceHost::Shared *>(memory);
+    if (shared.magic != VoiceHost::MAGIC || shared.version != VoiceHost::VERSION)
+    {
+        std::fprintf(stderr, "surgebox-voice-host: protocol mismatch\n");
+        return 1;
+    }
+
+    if (cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+            std::perror("surgebox-voice-host: sched_setaffinity");
+    }
+
+    HostPluginLayer layer;
+    auto synth = std::make_unique<SurgeSynthesizer>(&layer);
+    synth->setSamplerate(static_cast<float>(shared.sampleRate));
+    synth->audio_processing_active = true;
+
+    shared.hostReady.store(1);
+    VoiceHost::futexWake(shared.hostReady);
+
+    VoiceHostLoop(shared, *synth).run();
+    return 0;
+}
@@ -17,6 +17,10 @@ SurgeBoxEditor::SurgeBoxEditor(SurgeBoxProcessor &p)
 
     // Set up callbacks
     engine_.onVoiceChanged = [this](int v) { onVoiceChanged(v); };
+    engine_.onPatternSlotChanged = [this](int voice, int /*slot*/) {
+        if (voice == engine_.getActiveVoice())
+            onPatternSlotChanged();
+    };
 
     // Create command bar components
     voiceSelector_ = std::make_unique<SurgeBox::VoiceSelector>();
@@ -36,6 +40,49 @@ SurgeBoxEditor::SurgeBoxEditor(SurgeBoxProcessor &p)
     stepRecordButton_->setTooltip("Step Record Mode");
     addAndMakeVisible(*stepRecordButton_);
 
+    // Live record button
+    liveRecordButton_ = std::make_unique<juce::TextButton>("REC");
+    liveRecordButton_->addListener(this);
+    liveRecordButton_->setClickingTogglesState(true);
+    liveRecordButton_->setColour(juce::TextButton::buttonColourId, juce::Colour(0xff4a4a6a));
+    liveRecordButton_->setColour(juce::TextButton::buttonOnColourId, juce::Colour(0xffff4444));
+    liveRecordButton_->setTooltip("Record played notes into the pattern while playing");
+    addAndMakeVisible(*liveRecordButton_);
+
+    // Automation record button
+    automationRecordButton_ = std::make_unique<juce::TextButton>("AUTO");
+    automationRecordButton_->addListener(this);
+    automationRecordButton_->setClickingTogglesState(true);
+    automationRecordButton_->setColour(juce::TextButton::buttonColourId,
+                                       juce::Colour(0xff4a4a6a));
+    automationRecordButton_->setColour(juce::TextButton::buttonOnColourId,
+                                       juce::Colour(0xffff4444));
+    automationRecordButton_->setTooltip("Record Surge parameter moves into the pattern");
+    addAndMakeVisible(*automationRecordButton_);
+
+    // Fill - plays the notes with a Fill trig condition
+    fillButton_ = std::make_unique<juce::TextButton>("FILL");
+    fillButton_->addListener(this);
+    fillButton_->setClickingTogglesState(true);
+    fillButton_->setColour(juce::TextButton::buttonColourId, juce::Colour(0xff4a4a6a));
+    fillButton_->setColour(juce::TextButton::buttonOnColourId, juce::Colour(0xffffaa44));
+    fillButton_->setTooltip("Play fill notes");
+    addAndMakeVisible(*fillButton_);
+
+    // Pattern slot selector
+    patternSlotLabel_ = std::make_unique<juce::Label>("", "Pat:");
+    patternSlotLabel_->setColour(juce::Label::textColourId, juce::Colours::white);
+    addAndMakeVisible(*patternSlotLabel_);
+
+    patternSlotCombo_ = std::make_unique<juce::ComboBox>();
+    for (int slot = 0; slot < SurgeBox::NUM_PATTERN_SLOTS; ++slot)
+        patternSlotCombo_->addItem(juce::String(slot + 1), slot + 1);
+    patternSlotCombo_->setSelectedId(engine_.getPatternSlot(engine_.getActiveVoice()) + 1,
+                                     juce::dontSendNotification);
+    patternSlotCombo_->setTooltip("Pattern slot - switches at the end of the playing pattern");
+    patternSlotCombo_->addListener(this);
+    addAndMakeVisible(*patternSlotCombo_);
+
     // Measure control buttons
     measuresLabel_ = std::make_unique<juce::Label>("", "1 bar");
     measuresLabel_->setColour(juce::Label::textColourId, juce::Colours::white);
@@ -82,6 +129,18 @@ SurgeBoxEditor::SurgeBoxEditor(SurgeBoxProcessor &p)
     clearPatternBtn_->setTooltip("Clear pattern");
     addAndMakeVisible(*clearPatternBtn_);
 
+    // Memory report
+    memoryButton_ = std::make_unique<juce::TextButton>("MEM");
+    memoryButton_->addListener(this);
+    memoryButton_->setTooltip("Show where this instance's memory goes");
+    addAndMakeVisible(*memoryButton_);
+
+    // Render calibration
+    calibrateButton_ = std::make_unique<juce::TextButton>("CPU");
+    calibrateButton_->addListener(this);
+    calibrateButton_->setTooltip("Measure render threads and quantum for this machine again");
+    addAndMakeVisible(*calibrateButton_);
+
     // Tempo control
     tempoLabel_ = std::make_unique<juce::Label>("", "BPM:");
     tempoLabel_->setColour(juce::Label::textColourId, juce::Colours::white);
@@ -135,6 +194,9 @@ SurgeBoxEditor::SurgeBoxEditor(SurgeBoxProcessor &p)
     // Start timer for UI updates
     startTimerHz(30);
 
+    // Patch edits can be undone from here
+    engine_.setPatchUndo(true);
+
     // Enable keyboard focus for undo/redo shortcuts
     setWantsKeyboardFocus(true);
 }
@@ -142,7 +204,9 @@ SurgeBoxEditor::SurgeBoxEditor(SurgeBoxProcessor &p)
 SurgeBoxEditor::~SurgeBoxEditor()
 {
     stopTimer();
+    engine_.setPatchUndo(false);
     engine_.onVoiceChanged = nullptr;
+    engine_.onPatternSlotChanged = nullptr;
 
     // Clear look-and-feel before destruction
     setLookAndFeel(nullptr);
@@ -181,6 +245,13 @@ void SurgeBoxEditor::updateKeyboardListener()
 void SurgeBoxEditor::handleNoteOn(juce::MidiKeyboardState *, int /*midiChannel*/,
                                    int midiNoteNumber, float velocity)
 {
+    // Only key presses arrive on the message thread - the keyboard state also
+    // reports the MIDI it passes through on the audio thread
+    if (!juce::MessageManager::existsAndIsCurrentThread())
+        return;
+
+    engine_.recordKeyboardNote(midiNoteNumber, static_cast<int>(velocity * 127.0f));
+
     if (stepRecordEnabled_ && pianoRoll_)
     {
         int vel = static_cast<int>(velocity * 127.0f);
@@ -189,8 +260,10 @@ void SurgeBoxEditor::handleNoteOn(juce::MidiKeyboardState *, int /*midiChannel*/
 }
 
 void SurgeBoxEditor::handleNoteOff(juce::MidiKeyboardState *, int /*midiChannel*/,
-                                    int /*midiNoteNumber*/, float /*velocity*/)
+                                    int midiNoteNumber, float /*velocity*/)
 {
+    if (juce::MessageManager::existsAndIsCurrentThread())
+        engine_.recordKeyboardNote(midiNoteNumber, 0);
 }
 
 void SurgeBoxEditor::paint(juce::Graphics &g)
@@ -253,6 +326,14 @@ void SurgeBoxEditor::resized()
     voiceSelector_->setBounds(commandBar.removeFromLeft(160).reduced(pad, pad));
     transport_->setBounds(commandBar.removeFromLeft(120).reduced(pad, pad));
     stepRecordButton_->setBounds(commandBar.removeFromLeft(60).reduced(pad, pad));
+    liveRecordButton_->setBounds(commandBar.removeFromLeft(60).reduced(pad, pad));
+    automationRecordButton_->setBounds(commandBar.removeFromLeft(60).reduced(pad, pad));
+    fillButton_->setBounds(commandBar.removeFromLeft(60).reduced(pad, pad));
+
+    // Pattern slot
+    commandBar.removeFromLeft(10);
+    patternSlotLabel_->setBounds(commandBar.removeFromLeft(34).reduced(pad, pad));
+    patternSlotCombo_->setBounds(commandBar.removeFromLeft(56).reduced(pad, pad));
 
     // Measure controls
     commandBar.removeFromLeft(10);
@@ -275,6 +356,8 @@ void SurgeBoxEditor::resized()
     // Clear button
     commandBar.removeFromLeft(10);
     clearPatternBtn_->setBounds(commandBar.removeFromLeft(40).reduced(pad, pad));
+    memoryButton_->setBounds(commandBar.removeFromLeft(44).reduced(pad, pad));
+    calibrateButton_->setBounds(commandBar.removeFromLeft(44).reduced(pad, pad));
 
     // 3. Surge viewport fills the rest (top)
     surgeViewport_->setBounds(bounds);
@@ -316,6 +399,18 @@ void SurgeBoxEditor::buttonClicked(juce::Button *button)
         if (stepRecordEnabled_)
             pianoRoll_->resetStepPosition();
     }
+    else if (button == liveRecordButton_.get())
+    {
+        engine_.setLiveRecording(liveRecordButton_->getToggleState());
+    }
+    else if (button == automationRecordButton_.get())
+    {
+        engine_.setAutomationRecording(automationRecordButton_->getToggleState());
+    }
+    else if (button == fillButton_.get())
+    {
+        engine_.setFill(fillButton_->getToggleState());
+    }
     else if (button == measuresDoubleBtn_.get())
     {
         doubleMeasures();
@@ -336,11 +431,23 @@ void SurgeBoxEditor::buttonClicked(juce::Button *button)
     {
         clearPattern();
     }
+    else if (button == memoryButton_.get())
+    {
+        showMemoryReport();
+    }
+    else if (button == calibrateButton_.get())
+    {
+        processor_.recalibrateRendering();
+    }
 }
 
 void SurgeBoxEditor::comboBoxChanged(juce::ComboBox *comboBox)
 {
-    if (comboBox == gridSizeCombo_.get())
+    if (comboBox == patternSlotCombo_.get())
+    {
+        engine_.selectPatternSlot(engine_.getActiveVoice(), patternSlotCombo_->getSelectedId() - 1);
+    }
+    else if (comboBox == gridSizeCombo_.get())
     {
         double gridSize = 0.25;
         switch (gridSizeCombo_->getSelectedId())
@@ -358,7 +465,7 @@ void SurgeBoxEditor::sliderValueChanged(juce::Slider *slider)
 {
     if (slider == tempoSlider_.get())
     {
-        engine_.getProject().tempo = static_cast<float>(tempoSlider_->getValue());
+        engine_.setTempo(tempoSlider_->getValue());
     }
 }
 
@@ -507,35 +614,31 @@ void SurgeBoxEditor::clearPattern()
 
 bool SurgeBoxEditor::keyPressed(const juce::KeyPress &key)
 {
-    auto &undoManager = engine_.getUndoManager();
+    // Undo covers patch, mixer and tempo changes too, so refresh controls after
+    auto afterUndo = [this]() {
+        tempoSlider_->setValue(engine_.getProject().tempo, juce::dontSendNotification);
+        updateMeasuresLabel();
+        return true;
+    };
 
     if (key.isKeyCode('Z') && key.getModifiers().isCommandDown() &&
         !key.getModifiers().isShiftDown())
     {
-        if (undoManager.canUndo())
-        {
-            undoManager.undo();
-            return true;
-        }
+        if (engine_.undo())
+            return afterUndo();
     }
 
     if (key.isKeyCode('Z') && key.getModifiers().isCommandDown() &&
         key.getModifiers().isShiftDown())
     {
-        if (undoManager.canRedo())
-        {
-            undoManager.redo();
-            return true;
-        }
+        if (engine_.redo())
+            return afterUndo();
     }
 
     if (key.isKeyCode('Y') && key.getModifiers().isCommandDown())
     {
-        if (undoManager.canRedo())
-        {
-            undoManager.redo();
-            return true;
-        }
+        if (engine_.redo())
+            return afterUndo();
     }
 
     return false;
@@ -603,7 +706,10 @@ void SurgeBoxEditor::rebuildSurgeEditor()
     auto *surgeProcessor = processor_.getProcessor(newVoice);
     if (surgeProcessor)
     {
+        auto before = SurgeBox::MemoryReport::currentResidentBytes();
         surgeEditor_.reset(surgeProcessor->createEditor());
+        surgeEditorBytes_ =
+            std::max<int64_t>(0, SurgeBox::MemoryReport::currentResidentBytes() - before);
 
         if (surgeEditor_)
         {
@@ -625,6 +731,38 @@ void SurgeBoxEditor::rebuildSurgeEditor()
     }
 }
 
+void SurgeBoxEditor::showMemoryReport()
+{
+    auto report = engine_.getMemoryReport();
+
+    // Only the current voice's Surge editor is kept; the window's backing
+    // image is estimated from its size
+    if (surgeEditor_)
+        report.add("Editor", "Surge editor (voice " + std::to_string(currentSurgeVoice_ + 1) + ")",
+                   surgeEditorBytes_, true);
+    report.add("Editor", "Piano roll", sizeof(SurgeBox::PianoRollWidget), true);
+    auto scale = juce::Desktop::getInstance().getGlobalScaleFactor();
+    report.add("Editor", "Window image",
+               static_cast<int64_t>(getWidth() * getHeight() * 4 * scale * scale), true);
+
+    auto *text = new juce::TextEditor();
+    text->setMultiLine(true);
+    text->setReadOnly(true);
+    text->setFont(juce::Font(juce::Font::getDefaultMonospacedFontName(), 13.0f,
+                             juce::Font::plain));
+    text->setText(report.toText(), false);
+    text->setSize(520, 560);
+
+    juce::DialogWindow::LaunchOptions options;
+    options.content.setOwned(text);
+    options.dialogTitle = "SurgeBox Memory";
+    options.dialogBackgroundColour = juce::Colour(0xff2a2a3a);
+    options.componentToCentreAround = this;
+    options.useNativeTitleBar = true;
+    options.resizable = true;
+    options.launchAsync();
+}
+
 void SurgeBoxEditor::updateSurgeEditorScale()
 {
     if (!surgeEditor_ || !surgeEditorWrapper_)
@@ -652,9 +790,22 @@ void SurgeBoxEditor::onVoiceChanged(int /*voice*/)
     auto *model = engine_.getActivePatternModel();
     pianoRoll_->setPatternModel(model);
 
+    patternSlotCombo_->setSelectedId(engine_.getPatternSlot(engine_.getActiveVoice()) + 1,
+                                     juce::dontSendNotification);
     updateMeasuresLabel();
 
     rebuildSurgeEditor();
     voiceSelector_->repaint();
     resized();
 }
+
+void SurgeBoxEditor::onPatternSlotChanged()
+{
+    pianoRoll_->clearSelection();
+    pianoRoll_->setPatternModel(engine_.getActivePatternModel());
+
+    patternSlotCombo_->setSelectedId(engine_.getPatternSlot(engine_.getActiveVoice()) + 1,
+                                     juce::dontSendNotification);
+    updateMeasuresLabel();
+    resized();
+}
@@ -52,6 +52,15 @@ class SurgeBoxEditor : public juce::AudioProcessorEditor,
     std::unique_ptr<juce::TextButton> stepRecordButton_;
     bool stepRecordEnabled_{false};
 
+    // Automation record button
+    std::unique_ptr<juce::TextButton> automationRecordButton_;
+    std::unique_ptr<juce::TextButton> liveRecordButton_;
+    std::unique_ptr<juce::TextButton> fillButton_;
+
+    // Pattern slot selector
+    std::unique_ptr<juce::ComboBox> patternSlotCombo_;
+    std::unique_ptr<juce::Label> patternSlotLabel_;
+
     // Measure control buttons
     std::unique_ptr<juce::TextButton> measuresDoubleBtn_;
     std::unique_ptr<juce::TextButton> measuresHalfBtn_;
@@ -66,6 +75,13 @@ class SurgeBoxEditor : public juce::AudioProcessorEditor,
     // Clear pattern button
     std::unique_ptr<juce::TextButton> clearPatternBtn_;
 
+    // Shows the engine's memory report, with the editor's own share
+    std::unique_ptr<juce::TextButton> memoryButton_;
+
+    // Runs the render calibration again, e.g. once other heavy software has
+    // come or gone
+    std::unique_ptr<juce::TextButton> calibrateButton_;
+
     // Tempo control
     std::unique_ptr<juce::Slider> tempoSlider_;
     std::unique_ptr<juce::Label> tempoLabel_;
@@ -75,6 +91,7 @@ class SurgeBoxEditor : public juce::AudioProcessorEditor,
     std::unique_ptr<juce::Component> surgeEditorWrapper_;
     std::unique_ptr<juce::AudioProcessorEditor> surgeEditor_;
     int currentSurgeVoice_{-1};
+    int64_t surgeEditorBytes_{0}; // Resident memory taken creating it
 
     // Piano roll in scrollable viewport with resizable divider
     std::unique_ptr<juce::Viewport> pianoRollViewport_;
@@ -90,6 +107,7 @@ class SurgeBoxEditor : public juce::AudioProcessorEditor,
 
     void rebuildSurgeEditor();
     void onVoiceChanged(int voice);
+    void onPatternSlotChanged();
     void updateKeyboardListener();
     void updateSurgeEditorScale();
     void updateMeasuresLabel();
@@ -102,6 +120,7 @@ class SurgeBoxEditor : public juce::AudioProcessorEditor,
     void addMeasure();
     void subtractMeasure();
     void clearPattern();
+    void showMemoryReport();
 
     // Mouse handling for divider
     void mouseDown(const juce::MouseEvent &e) override;
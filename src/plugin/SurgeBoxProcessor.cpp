@@ -10,20 +10,46 @@
 #include "SurgeBoxEditor.h"
 #include "SurgeSynthesizer.h"
 
+#include <algorithm>
+#include <cstdlib>
+
 SurgeBoxProcessor::SurgeBoxProcessor()
     : AudioProcessor(BusesProperties()
                          .withOutput("Output", juce::AudioChannelSet::stereo(), true)
                          .withInput("Input", juce::AudioChannelSet::stereo(), true))
 {
-    // Create the Surge processor instances
+    // Create the Surge processor instances, measuring what each one takes
     for (int i = 0; i < SurgeBox::NUM_VOICES; i++)
     {
+        auto before = SurgeBox::MemoryReport::currentResidentBytes();
         surgeProcessors_[i] = std::make_unique<SurgeSynthProcessor>();
+        auto after = SurgeBox::MemoryReport::currentResidentBytes();
+        engine_.setInstanceFootprint(i, std::max<int64_t>(0, after - before));
     }
+
+    juce::PropertiesFile::Options options;
+    options.applicationName = "SurgeBox";
+    options.folderName = "SurgeBox";
+    options.filenameSuffix = ".settings";
+    options.osxLibrarySubFolder = "Application Support";
+    settings_ = std::make_unique<juce::PropertiesFile>(options);
+
+    // Engine housekeeping runs here rather than in the editor, so the journal and
+    // out-of-process voices keep up while the editor is closed
+    startTimerHz(30);
 }
 
 SurgeBoxProcessor::~SurgeBoxProcessor()
 {
+    stopTimer();
+
+    calibrationCancel_.store(true);
+    if (calibrationThread_.joinable())
+        calibrationThread_.join();
+
+    // Close the autosave journal cleanly - nothing to recover after a normal exit
+    engine_.stopAutosave();
+
     // Shutdown engine first - this clears all callbacks and synth pointers
     engine_.shutdown();
 
@@ -58,6 +84,160 @@ void SurgeBoxProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
     // Pass processor pointers to engine (it will use processBlock to handle GUI keyboard)
     engine_.setProcessors(procPtrs);
     engine_.initialize(sampleRate, samplesPerBlock);
+
+    // Render threads and quantum as calibrated for this machine at this rate
+    // and block size - measured in the background the first time
+    updateRenderSettings(sampleRate, samplesPerBlock, false);
+
+    // Out-of-process voices stay on once chosen; if the hosts can't start, the
+    // voices render in process as usual
+    if (settings_->getBoolValue("outOfProcessVoices", false))
+        setOutOfProcessVoices(true);
+
+    if (settings_->getBoolValue("realtime", false))
+        setRealtime(true);
+
+    // Blocks around each deadline miss go to the user's data directory
+    if (settings_->getBoolValue("flightRecorder", true))
+        engine_.setFlightRecorder(getXrunDirectory());
+
+    // The standalone has no host to persist its state, so keep a crash-safe journal
+    // and pick up where we left off if the last session didn't exit cleanly
+    if (wrapperType == wrapperType_Standalone && !engine_.isAutosaveActive())
+    {
+        auto autosaveDir = getAutosaveDirectory();
+        if (SurgeBox::EditJournal::hasRecoverableSession(autosaveDir))
+            engine_.recoverAutosave(autosaveDir);
+        engine_.startAutosave(autosaveDir);
+    }
+}
+
+void SurgeBoxProcessor::timerCallback()
+{
+    engine_.tick();
+    finishCalibration();
+}
+
+fs::path SurgeBoxProcessor::getAutosaveDirectory()
+{
+    auto dir = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                   .getChildFile("SurgeBox")
+                   .getChildFile("Autosave");
+    return fs::path(dir.getFullPathName().toStdString());
+}
+
+fs::path SurgeBoxProcessor::getXrunDirectory()
+{
+    auto dir = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                   .getChildFile("SurgeBox")
+                   .getChildFile("Xruns");
+    return fs::path(dir.getFullPathName().toStdString());
+}
+
+void SurgeBoxProcessor::recalibrateRendering()
+{
+    double sampleRate = getSampleRate() > 0.0 ? getSampleRate() : 44100.0;
+    int blockSize = getBlockSize() > 0 ? getBlockSize() : 512;
+    updateRenderSettings(sampleRate, blockSize, true);
+}
+
+void SurgeBoxProcessor::updateRenderSettings(double sampleRate, int blockSize, bool recalibrate)
+{
+    const std::lock_guard<std::mutex> lock(calibrationMutex_);
+    calibrationSampleRate_ = sampleRate;
+    calibrationBlockSize_ = blockSize;
+
+    SurgeBox::RenderSettings stored;
+    if (!recalibrate &&
+        SurgeBox::RenderCalibration::load(*settings_, sampleRate, blockSize, stored))
+    {
+        engine_.applyRenderSettings(stored);
+        return;
+    }
+
+    // Everything on the audio thread, whole blocks - safe on any machine
+    if (!recalibrate)
+        engine_.applyRenderSettings({});
+
+    // One already running is checked against the current rate and block size
+    // when it finishes
+    if (!calibrationThread_.joinable())
+        startCalibration(sampleRate, blockSize);
+}
+
+void SurgeBoxProcessor::startCalibration(double sampleRate, int blockSize)
+{
+    calibrationDone_.store(false);
+    calibrationThread_ = std::thread([this, sampleRate, blockSize] {
+        calibrationResult_ =
+            SurgeBox::RenderCalibration::run(sampleRate, blockSize, &calibrationCancel_);
+        calibrationDone_.store(true);
+    });
+}
+
+void SurgeBoxProcessor::finishCalibration()
+{
+    if (!calibrationDone_.load())
+        return;
+
+    const std::lock_guard<std::mutex> lock(calibrationMutex_);
+    calibrationThread_.join();
+    calibrationDone_.store(false);
+
+    const auto &result = calibrationResult_;
+    SurgeBox::RenderCalibration::save(*settings_, result);
+
+    // The host may have changed the rate or block size meanwhile
+    SurgeBox::RenderSettings current;
+    if (SurgeBox::RenderCalibration::load(*settings_, calibrationSampleRate_,
+                                          calibrationBlockSize_, current))
+        engine_.applyRenderSettings(current);
+    else
+        startCalibration(calibrationSampleRate_, calibrationBlockSize_);
+}
+
+fs::path SurgeBoxProcessor::getVoiceHostExecutable()
+{
+    if (auto *overridePath = std::getenv("SURGEBOX_VOICE_HOST"))
+        return fs::path(overridePath);
+
+    auto host = juce::File::getSpecialLocation(juce::File::currentExecutableFile)
+                    .getSiblingFile("surgebox-voice-host");
+    return fs::path(host.getFullPathName().toStdString());
+}
+
+bool SurgeBoxProcessor::setOutOfProcessVoices(bool enabled)
+{
+    settings_->setValue("outOfProcessVoices", enabled);
+    settings_->saveIfNeeded();
+    return engine_.setOutOfProcessVoices(enabled, getVoiceHostExecutable(),
+                                         settings_->getIntValue("voiceHostFirstCpu", -1));
+}
+
+void SurgeBoxProcessor::setRealtime(bool enabled)
+{
+    // A plugin's threads belong to its host
+    if (wrapperType != wrapperType_Standalone)
+        return;
+
+    settings_->setValue("realtime", enabled);
+    settings_->saveIfNeeded();
+
+    SurgeBox::RealtimeSettings realtime;
+    realtime.enabled = enabled;
+    realtime.audioPriority =
+        settings_->getIntValue("realtimeAudioPriority", realtime.audioPriority);
+    realtime.workerPriority =
+        settings_->getIntValue("realtimeWorkerPriority", realtime.workerPriority);
+    realtime.audioCpu = settings_->getIntValue("realtimeAudioCpu", realtime.audioCpu);
+    realtime.firstWorkerCpu =
+        settings_->getIntValue("realtimeWorkerCpu", realtime.firstWorkerCpu);
+
+    engine_.onRealtimeApplied = [](const SurgeBox::RealtimeStatus &status) {
+        if (!status.reason.empty())
+            juce::Logger::writeToLog("SurgeBox real-time mode fell back: " + status.reason);
+    };
+    engine_.setRealtime(realtime);
 }
 
 void SurgeBoxProcessor::releaseResources()
@@ -79,9 +259,12 @@ void SurgeBoxProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::Mid
 
     int numSamples = buffer.getNumSamples();
 
-    // Handle incoming MIDI
+    // Handle incoming MIDI - the engine forwards it to out-of-process voices
     for (const auto metadata : midiMessages)
     {
+        if (engine_.isOutOfProcess())
+            break;
+
         auto msg = metadata.getMessage();
 
         // Route MIDI to active voice
@@ -119,7 +302,7 @@ void SurgeBoxProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::Mid
     float *outputL = buffer.getWritePointer(0);
     float *outputR = buffer.getNumChannels() > 1 ? buffer.getWritePointer(1) : outputL;
 
-    engine_.process(outputL, outputR, numSamples);
+    engine_.process(outputL, outputR, numSamples, midiMessages);
 
     // Copy to mono if needed
     if (buffer.getNumChannels() == 1)
@@ -176,6 +359,8 @@ void SurgeBoxProcessor::setStateInformation(const void *data, int sizeInBytes)
 
         if (engine_.getProject().loadFromFile(tempPath))
         {
+            // Playback reads patterns compiled from the models, so reload those too
+            engine_.syncPatternModelsFromProject();
             engine_.restoreAllVoices();
         }
         fs::remove(tempPath);
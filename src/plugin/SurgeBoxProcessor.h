@@ -12,9 +12,12 @@
 #include "core/SurgeBoxEngine.h"
 #include "SurgeSynthProcessor.h"
 #include <array>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <thread>
 
-class SurgeBoxProcessor : public juce::AudioProcessor
+class SurgeBoxProcessor : public juce::AudioProcessor, private juce::Timer
 {
   public:
     SurgeBoxProcessor();
@@ -51,12 +54,57 @@ class SurgeBoxProcessor : public juce::AudioProcessor
     // Access to individual Surge processors (for GUI)
     SurgeSynthProcessor *getProcessor(int voice);
 
+    // Where the standalone keeps its autosave journal
+    static fs::path getAutosaveDirectory();
+
+    // Where the flight recorder writes the blocks around each deadline miss
+    static fs::path getXrunDirectory();
+
+    // Measure render threads and quantum for this machine again, in the
+    // background; stored and applied when the measurement finishes
+    void recalibrateRendering();
+
+    // Render each voice in its own surgebox-voice-host process (Linux only).
+    // Remembered for the next session; voiceHostFirstCpu in the settings pins
+    // the hosts to consecutive cores. Returns false if the hosts could not be
+    // started - getEngine().getOutOfProcessError() says why.
+    bool setOutOfProcessVoices(bool enabled);
+
+    // Real-time scheduling, memory locking and pre-faulting (Linux standalone
+    // only). Remembered for the next session; the settings realtimeAudioPriority,
+    // realtimeWorkerPriority, realtimeAudioCpu and realtimeWorkerCpu tune it.
+    // Steps without the privileges they need are skipped and logged.
+    void setRealtime(bool enabled);
+
+    // Next to the executable, or $SURGEBOX_VOICE_HOST
+    static fs::path getVoiceHostExecutable();
+
   private:
+    void timerCallback() override;
+
+    // Applies the stored render settings for the rate and block size, or the
+    // plain defaults while a calibration for them runs in the background
+    void updateRenderSettings(double sampleRate, int blockSize, bool recalibrate);
+    void startCalibration(double sampleRate, int blockSize); // Under calibrationMutex_
+    void finishCalibration();
+
     // We own the Surge processors (which each own a SurgeSynthesizer)
     std::array<std::unique_ptr<SurgeSynthProcessor>, SurgeBox::NUM_VOICES> surgeProcessors_;
 
     // Engine orchestrates the voices
     SurgeBox::SurgeBoxEngine engine_;
 
+    // Per-machine settings, such as the render calibration
+    std::unique_ptr<juce::PropertiesFile> settings_;
+
+    // Render calibration - run on its own thread, stored and applied by the timer
+    std::mutex calibrationMutex_;
+    std::thread calibrationThread_;
+    std::atomic<bool> calibrationDone_{false};
+    std::atomic<bool> calibrationCancel_{false};
+    SurgeBox::RenderCalibration::Result calibrationResult_;
+    double calibrationSampleRate_{0.0}; // What the engine runs at now
+    int calibrationBlockSize_{0};
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SurgeBoxProcessor)
 };
@@ -0,0 +1,362 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "BatchRenderer.h"
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+extern char **environ;
+#endif
+
+namespace SurgeBox
+{
+
+namespace
+{
+
+double nowSeconds() { return juce::Time::getMillisecondCounterHiRes() * 0.001; }
+
+#if !defined(_WIN32)
+int64_t maxRssBytes(const struct rusage &usage)
+{
+#if defined(__APPLE__)
+    return static_cast<int64_t>(usage.ru_maxrss);
+#else
+    return static_cast<int64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+#endif
+
+// This process's peak resident memory so far
+int64_t processPeakMemory()
+{
+#if defined(_WIN32)
+    return 0;
+#else
+    struct rusage usage
+    {
+    };
+    getrusage(RUSAGE_SELF, &usage);
+    return maxRssBytes(usage);
+#endif
+}
+
+double wavSeconds(const fs::path &path)
+{
+    juce::WavAudioFormat wav;
+    std::unique_ptr<juce::AudioFormatReader> reader(
+        wav.createReaderFor(new juce::FileInputStream(juce::File(path.string())), true));
+    if (!reader || reader->sampleRate <= 0.0)
+        return 0.0;
+    return static_cast<double>(reader->lengthInSamples) / reader->sampleRate;
+}
+
+std::string trim(const std::string &text)
+{
+    auto begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos)
+        return {};
+    auto end = text.find_last_not_of(" \t\r\n");
+    return text.substr(begin, end - begin + 1);
+}
+
+} // namespace
+
+bool BatchRenderer::collectJobs(const fs::path &source, const fs::path &outputDir,
+                                std::vector<BatchJob> &jobs, std::string &error)
+{
+    jobs.clear();
+    std::error_code ec;
+
+    if (fs::is_directory(source, ec))
+    {
+        for (const auto &entry : fs::recursive_directory_iterator(source, ec))
+        {
+            if (!entry.is_regular_file() || entry.path().extension() != ".sbox")
+                continue;
+            auto output = outputDir / fs::relative(entry.path(), source, ec);
+            output.replace_extension(".wav");
+            jobs.push_back({entry.path(), output});
+        }
+        std::sort(jobs.begin(), jobs.end(),
+                  [](const auto &a, const auto &b) { return a.project < b.project; });
+    }
+    else
+    {
+        std::ifstream manifest(source);
+        if (!manifest)
+        {
+            error = "Could not open " + source.string();
+            return false;
+        }
+
+        // Manifest paths are relative to the manifest; outputs are flat
+        std::set<fs::path> outputs;
+        std::string line;
+        while (std::getline(manifest, line))
+        {
+            line = trim(line);
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            fs::path project(line);
+            if (project.is_relative())
+                project = source.parent_path() / project;
+            auto output = outputDir / project.filename();
+            output.replace_extension(".wav");
+            if (!outputs.insert(output).second)
+            {
+                error = "Two projects render to " + output.string();
+                return false;
+            }
+            jobs.push_back({project, output});
+        }
+    }
+
+    if (jobs.empty())
+    {
+        error = "No projects in " + source.string();
+        return false;
+    }
+    return true;
+}
+
+BatchRenderer::BatchRenderer(BatchOptions options) : options_(std::move(options)) {}
+
+int BatchRenderer::run(const std::vector<BatchJob> &jobs)
+{
+    entries_.clear();
+    for (const auto &job : jobs)
+        entries_.push_back({job, "pending"});
+    next_ = 0;
+    startSeconds_ = nowSeconds();
+
+    if (options_.resume)
+        loadPrevious();
+
+    auto pending = std::count_if(entries_.begin(), entries_.end(),
+                                 [](const Entry &e) { return e.status == "pending"; });
+    int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    numWorkers_ = options_.workers > 0 ? options_.workers : cores;
+    numWorkers_ = std::max(1, std::min(numWorkers_, static_cast<int>(pending)));
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < numWorkers_; ++w)
+        workers.emplace_back([this, w] { work(w); });
+    for (auto &worker : workers)
+        worker.join();
+
+    const std::lock_guard<std::mutex> lock(mutex_);
+    writeSummary();
+    return static_cast<int>(std::count_if(entries_.begin(), entries_.end(),
+                                          [](const Entry &e) { return e.status == "failed"; }));
+}
+
+void BatchRenderer::work(int worker)
+{
+    // Created on first use, so workers that find nothing left load nothing
+    std::unique_ptr<OfflineRenderer> renderer;
+
+    for (;;)
+    {
+        size_t index;
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            while (next_ < entries_.size() && entries_[next_].status != "pending")
+                ++next_;
+            if (next_ >= entries_.size())
+                return;
+            index = next_++;
+        }
+
+        const auto job = entries_[index].job;
+        Entry entry;
+        if (options_.isolate)
+        {
+            entry = renderIsolated(job);
+        }
+        else
+        {
+            if (!renderer)
+                renderer = std::make_unique<OfflineRenderer>(options_.render);
+            auto result = renderer->render(job.project, job.output);
+            entry.status = result.ok ? "rendered" : "failed";
+            entry.error = result.error;
+            entry.renderSeconds = result.renderSeconds;
+            entry.audioSeconds = result.audioSeconds;
+            entry.peakMemoryBytes = processPeakMemory();
+        }
+        entry.job = job;
+        entry.worker = worker;
+
+        const std::lock_guard<std::mutex> lock(mutex_);
+        entries_[index] = std::move(entry);
+        writeSummary();
+    }
+}
+
+BatchRenderer::Entry BatchRenderer::renderIsolated(const BatchJob &job)
+{
+    Entry entry;
+    entry.status = "failed";
+
+#if defined(_WIN32)
+    entry.error = "Isolated renders are not supported on Windows";
+#else
+    const auto &render = options_.render;
+    std::vector<std::string> args{options_.executable.string(),
+                                  job.project.string(),
+                                  "-o",
+                                  job.output.string(),
+                                  "--sample-rate",
+                                  std::to_string(render.sampleRate),
+                                  "--block",
+                                  std::to_string(render.blockSize),
+                                  "--loops",
+                                  std::to_string(render.loops),
+                                  "--tail",
+                                  std::to_string(render.tailSeconds)};
+    if (!render.dataPath.empty())
+    {
+        args.push_back("--data");
+        args.push_back(render.dataPath);
+    }
+
+    std::vector<char *> argv;
+    for (auto &arg : args)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    auto start = nowSeconds();
+    pid_t pid = -1;
+    int spawnError = posix_spawn(&pid, args[0].c_str(), nullptr, nullptr, argv.data(), environ);
+    if (spawnError != 0)
+    {
+        entry.error = "Could not start " + args[0] + ": " + std::strerror(spawnError);
+        return entry;
+    }
+
+    int status = 0;
+    struct rusage usage
+    {
+    };
+    wait4(pid, &status, 0, &usage);
+    entry.renderSeconds = nowSeconds() - start;
+    entry.peakMemoryBytes = maxRssBytes(usage);
+
+    if (WIFSIGNALED(status))
+    {
+        entry.error = "Killed by signal " + std::to_string(WTERMSIG(status));
+    }
+    else if (WEXITSTATUS(status) != 0)
+    {
+        entry.error = "Exited with status " + std::to_string(WEXITSTATUS(status));
+    }
+    else
+    {
+        entry.status = "rendered";
+        entry.audioSeconds = wavSeconds(job.output);
+    }
+#endif
+    return entry;
+}
+
+void BatchRenderer::loadPrevious()
+{
+    juce::File summary(options_.summaryPath.string());
+    if (!summary.existsAsFile())
+        return;
+
+    auto previous = juce::JSON::parse(summary);
+    auto *projects = previous["projects"].getArray();
+    if (!projects)
+        return;
+
+    for (const auto &project : *projects)
+    {
+        if (project["status"].toString() != "rendered")
+            continue;
+
+        fs::path path(project["project"].toString().toStdString());
+        for (auto &entry : entries_)
+        {
+            std::error_code ec;
+            if (entry.job.project != path || !fs::exists(entry.job.output, ec))
+                continue;
+
+            entry.status = "rendered";
+            entry.renderSeconds = project["renderSeconds"];
+            entry.audioSeconds = project["audioSeconds"];
+            entry.peakMemoryBytes = static_cast<juce::int64>(project["peakMemoryBytes"]);
+            entry.resumed = true;
+        }
+    }
+}
+
+void BatchRenderer::writeSummary()
+{
+    double renderSeconds = 0.0;
+    double audioSeconds = 0.0;
+    juce::Array<juce::var> projects;
+
+    for (const auto &entry : entries_)
+    {
+        auto *project = new juce::DynamicObject();
+        project->setProperty("project", juce::String(entry.job.project.string()));
+        project->setProperty("output", juce::String(entry.job.output.string()));
+        project->setProperty("status", juce::String(entry.status));
+        if (!entry.error.empty())
+            project->setProperty("error", juce::String(entry.error));
+        project->setProperty("renderSeconds", entry.renderSeconds);
+        project->setProperty("audioSeconds", entry.audioSeconds);
+        project->setProperty("peakMemoryBytes", static_cast<juce::int64>(entry.peakMemoryBytes));
+        project->setProperty("worker", entry.worker);
+        project->setProperty("resumed", entry.resumed);
+        projects.add(juce::var(project));
+
+        // Throughput counts this run only
+        if (entry.status == "rendered" && !entry.resumed)
+        {
+            renderSeconds += entry.renderSeconds;
+            audioSeconds += entry.audioSeconds;
+        }
+    }
+
+    double elapsed = nowSeconds() - startSeconds_;
+    auto *root = new juce::DynamicObject();
+    root->setProperty("sampleRate", options_.render.sampleRate);
+    root->setProperty("blockSize", options_.render.blockSize);
+    root->setProperty("workers", numWorkers_);
+    root->setProperty("isolated", options_.isolate);
+
+    // In-process workers share one process - its peak is all a project gets
+    root->setProperty("memoryScope", options_.isolate ? "project" : "process");
+    root->setProperty("elapsedSeconds", elapsed);
+    root->setProperty("renderSeconds", renderSeconds);
+    root->setProperty("audioSeconds", audioSeconds);
+    root->setProperty("realtimeFactor", elapsed > 0.0 ? audioSeconds / elapsed : 0.0);
+    root->setProperty("projects", projects);
+
+    // Written beside and renamed over, so an interruption never truncates it
+    juce::File summary(options_.summaryPath.string());
+    auto temporary = summary.getSiblingFile(summary.getFileName() + ".tmp");
+    if (temporary.replaceWithText(juce::JSON::toString(juce::var(root))))
+        temporary.moveFileTo(summary);
+}
+
+} // namespace SurgeBox
@@ -0,0 +1,91 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include "OfflineRenderer.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SurgeBox
+{
+
+struct BatchJob
+{
+    fs::path project;
+    fs::path output;
+};
+
+struct BatchOptions
+{
+    RenderOptions render;
+    int workers{0};        // 0 - one per core
+    bool isolate{false};   // One child process per project
+    bool resume{true};     // Skip projects the summary already has rendered
+    fs::path summaryPath;
+    fs::path executable;   // This renderer, for isolated jobs
+};
+
+/**
+ * Renders many projects in parallel.
+ *
+ * Each worker thread keeps one OfflineRenderer for all its projects, so the
+ * Surge data is loaded once per worker rather than once per project. With
+ * isolate, each project renders in a child process instead: slower to start,
+ * but a crash takes out one project and its peak memory is its own.
+ *
+ * The summary JSON is rewritten as each project finishes. A rerun reads it and
+ * skips every project it records as rendered whose output is still there, so
+ * an interrupted batch picks up where it stopped.
+ */
+class BatchRenderer
+{
+  public:
+    // A manifest lists one project per line (blank lines and # comments are
+    // skipped); a directory is searched for .sbox files. Outputs mirror the
+    // projects' names under outputDir. Returns false with error on failure.
+    static bool collectJobs(const fs::path &source, const fs::path &outputDir,
+                            std::vector<BatchJob> &jobs, std::string &error);
+
+    explicit BatchRenderer(BatchOptions options);
+
+    // Returns the number of projects that failed
+    int run(const std::vector<BatchJob> &jobs);
+
+  private:
+    struct Entry
+    {
+        BatchJob job;
+        std::string status; // "rendered", "failed" or "pending"
+        std::string error;
+        double renderSeconds{0.0};
+        double audioSeconds{0.0};
+        int64_t peakMemoryBytes{0};
+        int worker{-1};
+        bool resumed{false};
+    };
+
+    void work(int worker);
+    Entry renderIsolated(const BatchJob &job);
+    void loadPrevious();
+    void writeSummary();
+
+    BatchOptions options_;
+    int numWorkers_{1};
+
+    std::mutex mutex_;
+    std::vector<Entry> entries_;
+    size_t next_{0};
+    double startSeconds_{0.0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BatchRenderer)
+};
+
+} // namespace SurgeBox
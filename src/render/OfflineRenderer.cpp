@@ -0,0 +1,132 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#include "OfflineRenderer.h"
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+
+namespace SurgeBox
+{
+
+OfflineRenderer::OfflineRenderer(const RenderOptions &options) : options_(options)
+{
+    options_.blockSize = std::max(1, options_.blockSize);
+    engine_ = surgebox_create(options_.sampleRate, options_.blockSize,
+                              options_.dataPath.empty() ? nullptr : options_.dataPath.c_str());
+
+    // Parallel jobs slow each other down; that mustn't change what they render
+    if (engine_)
+        surgebox_set_load_adaptive(engine_, 0);
+    left_.resize(static_cast<size_t>(options_.blockSize));
+    right_.resize(static_cast<size_t>(options_.blockSize));
+}
+
+OfflineRenderer::~OfflineRenderer() { surgebox_destroy(engine_); }
+
+std::string OfflineRenderer::getMemoryReport() const
+{
+    return engine_ ? surgebox_memory_report(engine_) : "{}";
+}
+
+RenderResult OfflineRenderer::render(const fs::path &project, const fs::path &output)
+{
+    RenderResult result;
+    auto start = juce::Time::getHighResolutionTicks();
+    auto fail = [&](std::string error) {
+        result.error = std::move(error);
+        result.renderSeconds = juce::Time::highResolutionTicksToSeconds(
+            juce::Time::getHighResolutionTicks() - start);
+        return result;
+    };
+
+    if (!engine_)
+        return fail("Could not create the engine");
+
+    std::ifstream file(project, std::ios::binary);
+    if (!file)
+        return fail("Could not open " + project.string());
+    std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+
+    // Whatever the last project left sounding stops here
+    surgebox_stop(engine_);
+    surgebox_seek(engine_, 0.0);
+    for (int v = 0; v < SURGEBOX_NUM_VOICES; ++v)
+        surgebox_queue_all_notes_off(engine_, v, 0);
+
+    if (!surgebox_load_project(engine_, data.data(), data.size()))
+        return fail(surgebox_last_error(engine_));
+
+    double beats = surgebox_loop_length_beats(engine_) * std::max(1, options_.loops);
+    double tempo = surgebox_get_tempo(engine_);
+    double playSeconds = tempo > 0.0 ? beats * 60.0 / tempo : 0.0;
+    auto toFrames = [&](double seconds) {
+        return static_cast<juce::int64>(std::ceil(seconds * options_.sampleRate));
+    };
+    auto playFrames = toFrames(playSeconds);
+    auto totalFrames = playFrames + toFrames(options_.tailSeconds);
+
+    auto partial = output;
+    partial += ".partial";
+    std::error_code ec;
+    fs::create_directories(output.parent_path(), ec);
+
+    juce::File partialFile(partial.string());
+    partialFile.deleteFile();
+    std::unique_ptr<juce::OutputStream> stream(partialFile.createOutputStream());
+    if (!stream)
+        return fail("Could not write " + partial.string());
+
+    juce::WavAudioFormat wav;
+    std::unique_ptr<juce::AudioFormatWriter> writer(
+        wav.createWriterFor(stream.get(), options_.sampleRate, 2, 32, {}, 0));
+    if (!writer)
+        return fail("Could not create a WAV writer");
+    stream.release(); // Owned by the writer now
+
+    // The transport stops exactly at the end of the last pass, before the loop
+    // could wrap; the tail rings out after it
+    surgebox_play(engine_);
+    bool playing = true;
+    for (juce::int64 frame = 0; frame < totalFrames;)
+    {
+        if (playing && frame >= playFrames)
+        {
+            surgebox_stop(engine_);
+            playing = false;
+        }
+
+        auto end = playing ? playFrames : totalFrames;
+        int frames = static_cast<int>(std::min<juce::int64>(options_.blockSize, end - frame));
+        frame += frames;
+        if (!surgebox_render(engine_, left_.data(), right_.data(), frames))
+            return fail(surgebox_last_error(engine_));
+
+        const float *channels[] = {left_.data(), right_.data()};
+        if (!writer->writeFromFloatArrays(channels, 2, frames))
+            return fail("Could not write " + partial.string());
+    }
+    surgebox_stop(engine_);
+    writer.reset();
+
+    fs::rename(partial, output, ec);
+    if (ec)
+        return fail("Could not move " + partial.string() + " into place: " + ec.message());
+
+    result.ok = true;
+    result.audioSeconds = static_cast<double>(totalFrames) / options_.sampleRate;
+    result.renderSeconds =
+        juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+    return result;
+}
+
+} // namespace SurgeBox
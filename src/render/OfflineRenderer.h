@@ -0,0 +1,68 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+#pragma once
+
+#include "SurgeBoxHeadless.h"
+#include "filesystem/import.h"
+#include <juce_core/juce_core.h>
+
+#include <string>
+#include <vector>
+
+namespace SurgeBox
+{
+
+struct RenderOptions
+{
+    double sampleRate{48000.0};
+    int blockSize{512};
+    int loops{1};             // Passes through the song or pattern loop
+    double tailSeconds{2.0};  // Rendered after the last pass, for releases and effects
+    std::string dataPath;     // Surge's factory data, empty - its default
+};
+
+struct RenderResult
+{
+    bool ok{false};
+    std::string error;
+    double renderSeconds{0.0}; // Wall time, loading included
+    double audioSeconds{0.0};
+};
+
+/**
+ * Renders .sbox projects to WAV files through the headless engine.
+ *
+ * The engine, and the Surge data it loaded, is created once and reused for
+ * every project - loading a project replaces the patches and patterns. Output
+ * goes to a .partial file that is renamed into place when complete, so an
+ * interrupted render never leaves a truncated WAV behind.
+ */
+class OfflineRenderer
+{
+  public:
+    explicit OfflineRenderer(const RenderOptions &options);
+    ~OfflineRenderer();
+
+    bool isValid() const { return engine_ != nullptr; }
+
+    RenderResult render(const fs::path &project, const fs::path &output);
+
+    // The engine's memory report as JSON - after a render, with its project loaded
+    std::string getMemoryReport() const;
+
+  private:
+    RenderOptions options_;
+    SurgeBoxHeadless *engine_{nullptr};
+    std::vector<float> left_;
+    std::vector<float> right_;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OfflineRenderer)
+};
+
+} // namespace SurgeBox
@@ -0,0 +1,158 @@
+/*
+ * SurgeBox - A groovebox built on Surge XT
+ * Copyright 2024, Various Authors
+ *
+ * Released under the GNU General Public Licence v3 or later (GPL-3.0-or-later).
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ */
+
+// surgebox-render - renders SurgeBox projects to WAV without the plugin.
+//
+//   surgebox-render <project.sbox> -o <out.wav> [options]
+//   surgebox-render --batch <manifest | directory> --out <directory> [options]
+//
+// Options:
+//   --sample-rate <hz>   Default 48000
+//   --block <frames>     Default 512
+//   --loops <n>          Passes through the song or pattern loop, default 1
+//   --tail <seconds>     Rendered after the last pass, default 2
+//   --data <path>        Surge's factory data directory
+//   --memory <file>      Write the engine's memory report as JSON (single project)
+//
+// Batch options:
+//   --jobs <n>           Parallel projects, default one per core
+//   --isolate            One process per project
+//   --summary <file>     Default <out>/summary.json
+//   --no-resume          Render everything again
+
+#include "BatchRenderer.h"
+#include "OfflineRenderer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace SurgeBox;
+
+namespace
+{
+
+int usage()
+{
+    std::fprintf(stderr,
+                 "usage: surgebox-render <project.sbox> -o <out.wav> [options]\n"
+                 "       surgebox-render --batch <manifest | directory> --out <directory> "
+                 "[options]\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    RenderOptions render;
+    BatchOptions batch;
+    fs::path project;
+    fs::path output;
+    fs::path batchSource;
+    fs::path outputDir;
+    fs::path memoryReport;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc)
+            {
+                std::fprintf(stderr, "surgebox-render: %s needs a value\n", arg.c_str());
+                std::exit(usage());
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-o")
+            output = value();
+        else if (arg == "--batch")
+            batchSource = value();
+        else if (arg == "--out")
+            outputDir = value();
+        else if (arg == "--sample-rate")
+            render.sampleRate = std::atof(value().c_str());
+        else if (arg == "--block")
+            render.blockSize = std::atoi(value().c_str());
+        else if (arg == "--loops")
+            render.loops = std::atoi(value().c_str());
+        else if (arg == "--tail")
+            render.tailSeconds = std::atof(value().c_str());
+        else if (arg == "--data")
+            render.dataPath = value();
+        else if (arg == "--memory")
+            memoryReport = value();
+        else if (arg == "--jobs")
+            batch.workers = std::atoi(value().c_str());
+        else if (arg == "--isolate")
+            batch.isolate = true;
+        else if (arg == "--summary")
+            batch.summaryPath = value();
+        else if (arg == "--no-resume")
+            batch.resume = false;
+        else if (!arg.empty() && arg[0] != '-' && project.empty())
+            project = arg;
+        else
+            return usage();
+    }
+
+    if (render.sampleRate <= 0.0 || render.blockSize <= 0)
+        return usage();
+
+    if (batchSource.empty())
+    {
+        if (project.empty() || output.empty())
+            return usage();
+
+        OfflineRenderer renderer(render);
+        auto result = renderer.render(project, output);
+        if (!result.ok)
+        {
+            std::fprintf(stderr, "surgebox-render: %s\n", result.error.c_str());
+            return 1;
+        }
+        std::printf("%s: %.1f s of audio in %.2f s\n", output.string().c_str(),
+                    result.audioSeconds, result.renderSeconds);
+
+        if (!memoryReport.empty() &&
+            !juce::File(memoryReport.string()).replaceWithText(renderer.getMemoryReport()))
+        {
+            std::fprintf(stderr, "surgebox-render: could not write %s\n",
+                         memoryReport.string().c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    if (outputDir.empty())
+        return usage();
+
+    std::vector<BatchJob> jobs;
+    std::string error;
+    if (!BatchRenderer::collectJobs(batchSource, outputDir, jobs, error))
+    {
+        std::fprintf(stderr, "surgebox-render: %s\n", error.c_str());
+        return 1;
+    }
+
+    batch.render = render;
+    if (batch.summaryPath.empty())
+        batch.summaryPath = outputDir / "summary.json";
+    batch.executable = juce::File::getSpecialLocation(juce::File::currentExecutableFile)
+                           .getFullPathName()
+                           .toStdString();
+
+    std::error_code ec;
+    fs::create_directories(outputDir, ec);
+
+    int failed = BatchRenderer(batch).run(jobs);
+    std::printf("%zu projects, %d failed - see %s\n", jobs.size(), failed,
+                batch.summaryPath.string().c_str());
+    return failed > 0 ? 1 : 0;
+}